@@ -0,0 +1,924 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "emc.hh"
+#include "ctfe.hh"
+#include "ast_passes.hh"
+
+namespace {
+
+template<class T>
+void binary_children(ast_node *node, const child_fn &fn)
+{
+    auto t = dynamic_cast<T*>(node);
+    DEBUG_ASSERT_NOTNULL(t);
+    fn(t->first, true);
+    fn(t->sec, true);
+}
+
+template<class T>
+void unary_child(ast_node *node, const child_fn &fn, bool replaceable)
+{
+    auto t = dynamic_cast<T*>(node);
+    DEBUG_ASSERT_NOTNULL(t);
+    if (t->first)
+        fn(t->first, replaceable);
+}
+
+}
+
+/* Calls fn for each child of node. Children that are not replaceable must not
+ * be swapped for another node by fn, e.g. lvalues and the operands of the
+ * chained comparisons which are shared between the links in the chain. */
+void for_each_child(ast_node *node, const child_fn &fn)
+{
+    switch (node->type) {
+    case ast_type::ADD:
+    case ast_type::SUB:
+    case ast_type::MUL:
+    case ast_type::RDIV:
+    case ast_type::INTDIV:
+    case ast_type::REM:
+    case ast_type::POW:
+        binary_children<ast_node_bin_op>(node, fn);
+        break;
+    case ast_type::AND:  binary_children<ast_node_and>(node, fn); break;
+    case ast_type::OR:   binary_children<ast_node_or>(node, fn); break;
+    case ast_type::XOR:  binary_children<ast_node_xor>(node, fn); break;
+    case ast_type::NAND: binary_children<ast_node_nand>(node, fn); break;
+    case ast_type::NOR:  binary_children<ast_node_nor>(node, fn); break;
+    case ast_type::XNOR: binary_children<ast_node_xnor>(node, fn); break;
+    case ast_type::CMP:  binary_children<ast_node_cmp>(node, fn); break;
+    case ast_type::NOT:         unary_child<ast_node_not>(node, fn, true); break;
+    case ast_type::ABS:         unary_child<ast_node_abs>(node, fn, true); break;
+    case ast_type::UMINUS:      unary_child<ast_node_uminus>(node, fn, true); break;
+    case ast_type::DEREF:       unary_child<ast_node_deref>(node, fn, true); break;
+    case ast_type::RETURN:      unary_child<ast_node_return>(node, fn, true); break;
+    case ast_type::DOTOPERATOR: unary_child<ast_node_dotop>(node, fn, false); break;
+    case ast_type::ADDRESS:     unary_child<ast_node_address>(node, fn, false); break;
+    case ast_type::LISTLITERAL: unary_child<ast_node_listlit>(node, fn, false); break;
+    case ast_type::DOBLOCK:     unary_child<ast_node_doblock>(node, fn, false); break;
+    case ast_type::ASSIGN: {
+        auto t = dynamic_cast<ast_node_assign*>(node);
+        fn(t->first, false);
+        fn(t->sec, true);
+        break;
+    }
+    case ast_type::EXPLIST:
+        for (auto &e : dynamic_cast<ast_node_explist*>(node)->v_nodes)
+            fn(e, true);
+        break;
+    case ast_type::ARGUMENT_LIST:
+        for (auto &e : dynamic_cast<ast_node_arglist*>(node)->v_ast_args)
+            fn(e, true);
+        break;
+    case ast_type::FUNCTION_CALL:
+        fn(dynamic_cast<ast_node_funccall*>(node)->arg_list, false);
+        break;
+    case ast_type::FUNCTION_DEF:
+        fn(dynamic_cast<ast_node_funcdef*>(node)->code_block, false);
+        break;
+    case ast_type::DEF: {
+        auto t = dynamic_cast<ast_node_def*>(node);
+        if (t->value_node)
+            fn(t->value_node, true);
+        break;
+    }
+    case ast_type::IF: {
+        auto t = dynamic_cast<ast_node_if*>(node);
+        fn(t->cond_e, true);
+        fn(t->if_el, false);
+        if (auto elseif_t = dynamic_cast<ast_node_elseiflist*>(t->elseif_el)) {
+            for (auto &e : elseif_t->v_cond_e)
+                fn(e, true);
+            for (auto &e : elseif_t->v_elseif)
+                fn(e, false);
+        }
+        if (t->else_el)
+            fn(t->else_el, false);
+        if (t->also_el)
+            fn(t->also_el, false);
+        break;
+    }
+    case ast_type::WHILE: {
+        auto t = dynamic_cast<ast_node_while*>(node);
+        fn(t->cond_e, true);
+        fn(t->if_el, false);
+        if (t->else_el)
+            fn(t->else_el, false);
+        break;
+    }
+    case ast_type::ANDCHAIN: {
+        auto t = dynamic_cast<ast_node_andchain*>(node);
+        for (auto e : t->v_children) {
+            ast_node *first = e->first.get();
+            fn(first, false);
+        }
+        ast_node *last = t->v_children.back()->sec.get();
+        fn(last, false);
+        break;
+    }
+    default: /* Literals, VAR and the type and namespace nodes */
+        break;
+    }
+}
+
+namespace {
+
+bool is_arithmetic_op(ast_type type)
+{
+    switch (type) {
+    case ast_type::ADD:
+    case ast_type::SUB:
+    case ast_type::MUL:
+    case ast_type::RDIV:
+    case ast_type::INTDIV:
+    case ast_type::REM:
+    case ast_type::POW:
+    case ast_type::UMINUS:
+    case ast_type::ABS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_logical_op(ast_type type)
+{
+    switch (type) {
+    case ast_type::AND:
+    case ast_type::OR:
+    case ast_type::XOR:
+    case ast_type::NAND:
+    case ast_type::NOR:
+    case ast_type::XNOR:
+    case ast_type::NOT:
+    case ast_type::CMP:
+    case ast_type::ANDCHAIN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* RETURN and the lists have the type of their expression, so check for a value too */
+bool is_folded(ast_node *node)
+{
+    return node->value_type.is_const_expr && has_value(node->value);
+}
+
+bool is_scalar(const emc_type &type)
+{
+    return type.is_primitive() && !type.is_pointer() && !type.is_bool();
+}
+
+/* True if evaluating node has no side effects. */
+bool is_pure(ast_node *node)
+{
+    if (is_folded(node))
+        return true;
+
+    switch (node->type) {
+    case ast_type::INT_LITERAL:
+    case ast_type::DOUBLE_LITERAL:
+    case ast_type::STRING_LITERAL:
+    case ast_type::VAR:
+        return true;
+    case ast_type::DOTOPERATOR:
+        break;
+    default:
+        if (!is_arithmetic_op(node->type) && !is_logical_op(node->type))
+            return false;
+    }
+
+    bool pure = true;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        pure = pure && is_pure(child);
+    });
+    return pure;
+}
+
+bool contains_assign(ast_node *node)
+{
+    if (node->type == ast_type::ASSIGN)
+        return true;
+    bool found = false;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        found = found || contains_assign(child);
+    });
+    return found;
+}
+
+bool is_const_false(ast_node *cond)
+{
+    return is_folded(cond) && !const_value_to_bool(cond->value);
+}
+
+/* The code a pass is run on: the body of an Engma function, or a DO block
+   on the top level, which is code in main() without parameters. */
+struct pass_body {
+    ast_node *code_block;
+    ast_node *parlist; /* nullptr for a top level DO block */
+};
+
+ast_node_explist* function_body(ast_node *code_block)
+{
+    auto doblock = dynamic_cast<ast_node_doblock*>(code_block);
+    if (!doblock)
+        return nullptr;
+    return dynamic_cast<ast_node_explist*>(doblock->first);
+}
+
+std::vector<std::string> parameter_names(ast_node *parlist)
+{
+    std::vector<std::string> v_names;
+    if (!parlist)
+        return v_names;
+    auto parlist_t = dynamic_cast<ast_node_vardef_list*>(parlist);
+    DEBUG_ASSERT_NOTNULL(parlist_t);
+    for (auto e : parlist_t->v_defs)
+        v_names.push_back(dynamic_cast<ast_node_def*>(e)->var_name);
+    return v_names;
+}
+
+/* What a function does with the names without namespace that are used in it.
+ * Names that are not defined in the function (n_defs == 0) are globals. */
+struct local_info {
+    int n_defs = 0;     /* DEFs of the name, including parameters */
+    int n_assigns = 0;  /* Assignments to the name */
+    int n_reads = 0;    /* VARs of the name that are not folded */
+    bool is_param = false;
+    bool address_taken = false;
+};
+
+typedef std::map<std::string, local_info> local_map;
+
+void collect_locals(ast_node *node, local_map &locals, bool in_address)
+{
+    switch (node->type) {
+    case ast_type::DEF:
+        locals[dynamic_cast<ast_node_def*>(node)->var_name].n_defs++;
+        break;
+    case ast_type::VAR: {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        if (var->nspace.size())
+            return;
+        auto &info = locals[var->name];
+        if (in_address)
+            info.address_taken = true;
+        if (!var->value_type.is_const_expr)
+            info.n_reads++;
+        return;
+    }
+    case ast_type::ASSIGN: {
+        auto assign = dynamic_cast<ast_node_assign*>(node);
+        auto var = dynamic_cast<ast_node_var*>(assign->first);
+        if (var && var->nspace.empty()) {
+            auto &info = locals[var->name];
+            info.n_assigns++;
+            if (in_address)
+                info.address_taken = true;
+            collect_locals(assign->sec, locals, in_address);
+            return;
+        }
+        break;
+    }
+    case ast_type::ADDRESS:
+        in_address = true;
+        break;
+    default:
+        break;
+    }
+
+    for_each_child(node, [&](ast_node *&child, bool) {
+        collect_locals(child, locals, in_address);
+    });
+}
+
+local_map analyze_function(const pass_body &body)
+{
+    local_map locals;
+    for (auto &name : parameter_names(body.parlist)) {
+        auto &info = locals[name];
+        info.n_defs++;
+        info.is_param = true;
+    }
+    collect_locals(body.code_block, locals, false);
+    return locals;
+}
+
+/* fold */
+
+int fold_node(ast_node *node)
+{
+    int n_folded = 0;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        n_folded += fold_node(child);
+    });
+
+    if (node->value_type.is_const_expr)
+        return n_folded;
+
+    bool all_const = true;
+    if (is_arithmetic_op(node->type) || is_logical_op(node->type)) {
+        for_each_child(node, [&](ast_node *&child, bool) {
+            all_const = all_const && is_folded(child);
+        });
+        if (all_const)
+            node->value = ctfe_fold(node);
+    } else if (node->type == ast_type::FUNCTION_CALL) {
+        auto call = dynamic_cast<ast_node_funccall*>(node);
+        for (auto arg : dynamic_cast<ast_node_arglist*>(call->arg_list)->v_ast_args)
+            all_const = all_const && is_folded(arg);
+        if (all_const && call->fdef_node)
+            node->value = ctfe_eval_call(call);
+    } else
+        return n_folded;
+
+    node->value_type.is_const_expr = has_value(node->value);
+    return n_folded + node->value_type.is_const_expr;
+}
+
+int pass_fold(const pass_body &body)
+{
+    return fold_node(body.code_block);
+}
+
+/* constprop */
+
+int mark_const_vars(ast_node *node, const std::string &name, const const_value &value)
+{
+    if (node->type == ast_type::VAR) {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        if (var->nspace.size() || var->name != name || var->value_type.is_const_expr)
+            return 0;
+        var->value = value;
+        var->value_type.is_const_expr = true;
+        return 1;
+    }
+
+    int n_marked = 0;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        n_marked += mark_const_vars(child, name, value);
+    });
+    return n_marked;
+}
+
+/* Locals in the function's outermost block that are initialized with a
+ * constant expression, and are never assigned to or have their address
+ * taken, get their VARs folded to the value. The initializers are folded
+ * as we go so that chains of constants are propagated too. */
+int pass_constprop(const pass_body &body)
+{
+    auto explist = function_body(body.code_block);
+    if (!explist)
+        return 0;
+    auto locals = analyze_function(body);
+
+    int n_marked = 0;
+    auto &v = explist->v_nodes;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i]->type != ast_type::DEF)
+            continue;
+        auto def = dynamic_cast<ast_node_def*>(v[i]);
+        if (!def->value_node || !is_scalar(def->value_type))
+            continue;
+        auto &info = locals[def->var_name];
+        if (info.n_defs != 1 || info.n_assigns || info.address_taken)
+            continue;
+
+        fold_node(def->value_node);
+        if (!is_folded(def->value_node) ||
+            std::holds_alternative<bool>(def->value_node->value))
+            continue;
+
+        /* The value is checked to fit in resolve() */
+        const_value value = cast_value_to_type(def->value_node->value, def->value_type, false);
+        for (size_t j = i + 1; j < v.size(); j++)
+            n_marked += mark_const_vars(v[j], def->var_name, value);
+    }
+    return n_marked;
+}
+
+/* inline */
+
+/* True if node only consists of literals, the parameters and arithmetic. */
+bool is_inlinable_expr(ast_node *node, const std::vector<std::string> &v_params)
+{
+    switch (node->type) {
+    case ast_type::INT_LITERAL:
+    case ast_type::DOUBLE_LITERAL:
+        return true;
+    case ast_type::VAR: {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        return var->nspace.empty() &&
+            std::find(v_params.begin(), v_params.end(), var->name) != v_params.end();
+    }
+    default:
+        if (!is_arithmetic_op(node->type))
+            return false;
+    }
+
+    bool ok = true;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        ok = ok && is_inlinable_expr(child, v_params);
+    });
+    return ok;
+}
+
+/* True if node is a pure expression that can be cloned. */
+bool is_clonable_arg(ast_node *node)
+{
+    switch (node->type) {
+    case ast_type::INT_LITERAL:
+    case ast_type::DOUBLE_LITERAL:
+    case ast_type::VAR:
+        return true;
+    default:
+        if (!is_arithmetic_op(node->type))
+            return false;
+    }
+
+    bool ok = true;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        ok = ok && is_clonable_arg(child);
+    });
+    return ok;
+}
+
+void count_param_uses(ast_node *node, const std::vector<std::string> &v_params, std::vector<int> &v_uses)
+{
+    if (node->type == ast_type::VAR) {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        auto it = std::find(v_params.begin(), v_params.end(), var->name);
+        if (var->nspace.empty() && it != v_params.end())
+            v_uses[it - v_params.begin()]++;
+        return;
+    }
+    for_each_child(node, [&](ast_node *&child, bool) {
+        count_param_uses(child, v_params, v_uses);
+    });
+}
+
+void substitute_params(ast_node *&slot, const std::vector<std::string> &v_params,
+                       const std::vector<ast_node*> &v_args)
+{
+    if (slot->type == ast_type::VAR) {
+        auto var = dynamic_cast<ast_node_var*>(slot);
+        auto it = std::find(v_params.begin(), v_params.end(), var->name);
+        if (var->nspace.size() || it == v_params.end())
+            return;
+        ast_node *arg = v_args[it - v_params.begin()]->clone();
+        delete slot;
+        slot = arg;
+        return;
+    }
+    for_each_child(slot, [&](ast_node *&child, bool) {
+        substitute_params(child, v_params, v_args);
+    });
+}
+
+/* Returns the inlined expression of the call, or nullptr if it can't be
+   inlined. */
+ast_node* inline_call(ast_node_funccall *call)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(call->fdef_node);
+    if (!fdef)
+        return nullptr;
+    auto body = function_body(fdef->code_block);
+    if (!body || body->v_nodes.size() != 1 || body->v_nodes[0]->type != ast_type::RETURN)
+        return nullptr;
+    ast_node *expr = dynamic_cast<ast_node_return*>(body->v_nodes[0])->first;
+    if (!expr || expr->value_type != call->value_type)
+        return nullptr;
+
+    auto v_params = parameter_names(fdef->parlist);
+    if (!is_inlinable_expr(expr, v_params))
+        return nullptr;
+
+    auto &v_args = dynamic_cast<ast_node_arglist*>(call->arg_list)->v_ast_args;
+    auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+    if (v_args.size() != v_params.size())
+        return nullptr;
+
+    /* Arguments used more than once must be cheap to evaluate again */
+    std::vector<int> v_uses(v_params.size(), 0);
+    count_param_uses(expr, v_params, v_uses);
+    for (size_t i = 0; i < v_args.size(); i++) {
+        ast_node *arg = v_args[i];
+        if (arg->value_type != parlist->v_defs[i]->value_type || !is_clonable_arg(arg))
+            return nullptr;
+        if (v_uses[i] > 1 && !is_folded(arg) && arg->type != ast_type::VAR)
+            return nullptr;
+    }
+
+    ast_node *inlined = expr->clone();
+    substitute_params(inlined, v_params, v_args);
+    inlined->loc = call->loc;
+    return inlined;
+}
+
+int inline_calls(ast_node *&slot, bool replaceable)
+{
+    int n_inlined = 0;
+    for_each_child(slot, [&](ast_node *&child, bool child_replaceable) {
+        n_inlined += inline_calls(child, child_replaceable);
+    });
+
+    if (!replaceable || slot->type != ast_type::FUNCTION_CALL || slot->value_type.is_const_expr)
+        return n_inlined;
+
+    ast_node *inlined = inline_call(dynamic_cast<ast_node_funccall*>(slot));
+    if (!inlined)
+        return n_inlined;
+    delete slot;
+    slot = inlined;
+    return n_inlined + 1;
+}
+
+int pass_inline(const pass_body &body)
+{
+    /* The block itself is not replaced */
+    ast_node *code_block = body.code_block;
+    return inline_calls(code_block, false);
+}
+
+/* cse */
+
+std::string const_value_key(const const_value &value)
+{
+    return std::visit([](auto v) -> std::string {
+        using T = decltype(v);
+
+        if constexpr (std::is_same_v<T, std::monostate>)
+            THROW_BUG("");
+        else if constexpr (std::is_floating_point_v<T>) {
+            char buf[64];
+            snprintf(buf, sizeof buf, "%a", (double)v);
+            return buf;
+        } else
+            return std::to_string(v);
+    }, value);
+}
+
+/* Returns a key that is the same for structurally equal expressions, or an
+ * empty string if the expression can't be computed before the statement it
+ * is in, e.g. if it reads globals or locals that might be changed through
+ * pointers. */
+std::string cse_key(ast_node *node, const local_map &locals, const std::string &def_name)
+{
+    if (!is_scalar(node->value_type))
+        return "";
+    std::string type = std::to_string((int)node->value_type.type);
+
+    if (is_folded(node))
+        return "c" + type + ":" + const_value_key(node->value);
+
+    if (node->type == ast_type::VAR) {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        /* The defined name in a DEF statement is pushed before the value is evaluated */
+        if (var->nspace.size() || var->name == def_name)
+            return "";
+        auto it = locals.find(var->name);
+        if (it == locals.end() || it->second.n_defs != 1 || it->second.address_taken)
+            return "";
+        return "v" + type + ":" + var->name;
+    }
+
+    if (!is_arithmetic_op(node->type))
+        return "";
+
+    std::string key = std::to_string((int)node->type) + "." + type + "(";
+    bool ok = true;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        std::string child_key = ok ? cse_key(child, locals, def_name) : "";
+        ok = child_key.size();
+        key += child_key + ",";
+    });
+    return ok ? key + ")" : "";
+}
+
+typedef std::map<std::string, std::vector<ast_node**>> cse_candidates;
+
+void collect_cse_candidates(ast_node *&slot, bool replaceable, const local_map &locals,
+                            const std::string &def_name, cse_candidates &candidates)
+{
+    /* The logical operators might be short circuited, so an expression in
+       them is not always evaluated. */
+    if (is_logical_op(slot->type) || slot->type == ast_type::ADDRESS)
+        return;
+
+    if (replaceable && is_arithmetic_op(slot->type) && !slot->value_type.is_const_expr) {
+        std::string key = cse_key(slot, locals, def_name);
+        if (key.size())
+            candidates[key].push_back(&slot);
+    }
+
+    for_each_child(slot, [&](ast_node *&child, bool child_replaceable) {
+        collect_cse_candidates(child, child_replaceable, locals, def_name, candidates);
+    });
+}
+
+ast_node_var* new_temp_var(const std::string &name, const emc_type &type, YYLTYPE loc)
+{
+    auto var = new ast_node_var{nullptr};
+    var->name = var->full_name = name;
+    var->value_type = type;
+    var->loc = loc;
+    return var;
+}
+
+void cse_walk(ast_node *node, const local_map &locals, int &n_temps);
+
+/* Repeated subexpressions in a statement are moved into a temporary that is
+ * defined just before the statement, the largest expression first. */
+void cse_explist(ast_node_explist *explist, const local_map &locals, int &n_temps)
+{
+    auto &v = explist->v_nodes;
+    for (size_t i = 0; i < v.size(); i++) {
+        ast_node *stmt = v[i];
+        ast_node *stmt_copy = stmt;
+        ast_node **root = &stmt_copy;
+        std::string def_name;
+
+        switch (stmt->type) {
+        case ast_type::IF:
+        case ast_type::WHILE:
+        case ast_type::DOBLOCK:
+        case ast_type::EXPLIST:
+            cse_walk(stmt, locals, n_temps);
+            continue;
+        case ast_type::DEF: {
+            auto def = dynamic_cast<ast_node_def*>(stmt);
+            root = &def->value_node;
+            def_name = def->var_name;
+            break;
+        }
+        case ast_type::RETURN:
+            root = &dynamic_cast<ast_node_return*>(stmt)->first;
+            break;
+        case ast_type::ASSIGN:
+            root = &dynamic_cast<ast_node_assign*>(stmt)->sec;
+            break;
+        default:
+            break;
+        }
+        if (!*root || contains_assign(*root))
+            continue;
+
+        while (true) {
+            cse_candidates candidates;
+            collect_cse_candidates(*root, true, locals, def_name, candidates);
+
+            std::vector<ast_node**> *best = nullptr;
+            size_t best_len = 0;
+            for (auto &e : candidates) {
+                if (e.second.size() > 1 && e.first.size() > best_len) {
+                    best = &e.second;
+                    best_len = e.first.size();
+                }
+            }
+            if (!best)
+                break;
+
+            ast_node *expr = *best->front();
+            std::string name = "__cse" + std::to_string(n_temps++);
+            auto def = new ast_node_def{nullptr, nullptr, expr};
+            def->var_name = def->mangled_name = def->full_name = name;
+            def->value_type = expr->value_type;
+            def->loc = expr->loc;
+
+            for (auto slot : *best) {
+                if (*slot != expr)
+                    delete *slot;
+                *slot = new_temp_var(name, expr->value_type, expr->loc);
+            }
+            v.insert(v.begin() + i, def);
+            i++;
+        }
+    }
+}
+
+void cse_walk(ast_node *node, const local_map &locals, int &n_temps)
+{
+    if (node->type == ast_type::EXPLIST) {
+        cse_explist(dynamic_cast<ast_node_explist*>(node), locals, n_temps);
+        return;
+    }
+    for_each_child(node, [&](ast_node *&child, bool) {
+        cse_walk(child, locals, n_temps);
+    });
+}
+
+int pass_cse(const pass_body &body)
+{
+    int n_temps = 0;
+    cse_walk(body.code_block, analyze_function(body), n_temps);
+    return n_temps;
+}
+
+/* dce */
+
+bool is_dead_statement(ast_node *stmt)
+{
+    if (stmt->type == ast_type::WHILE) {
+        auto while_t = dynamic_cast<ast_node_while*>(stmt);
+        return !while_t->else_el && is_const_false(while_t->cond_e);
+    } else if (stmt->type == ast_type::IF) {
+        auto if_t = dynamic_cast<ast_node_if*>(stmt);
+        if (if_t->else_el || !is_const_false(if_t->cond_e))
+            return false;
+        if (auto elseif_t = dynamic_cast<ast_node_elseiflist*>(if_t->elseif_el))
+            for (auto cond_e : elseif_t->v_cond_e)
+                if (!is_const_false(cond_e))
+                    return false;
+        return true;
+    }
+
+    switch (stmt->type) {
+    case ast_type::INT_LITERAL:
+    case ast_type::DOUBLE_LITERAL:
+    case ast_type::VAR:
+        return true;
+    default:
+        return is_folded(stmt);
+    }
+}
+
+int dce_walk(ast_node *node)
+{
+    int n_removed = 0;
+    for_each_child(node, [&](ast_node *&child, bool) {
+        n_removed += dce_walk(child);
+    });
+
+    if (node->type != ast_type::EXPLIST)
+        return n_removed;
+
+    auto &v = dynamic_cast<ast_node_explist*>(node)->v_nodes;
+    /* Nothing after a RETURN is reached */
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i]->type == ast_type::RETURN) {
+            for (size_t j = i + 1; j < v.size(); j++, n_removed++)
+                delete v[j];
+            v.resize(i + 1);
+            break;
+        }
+    }
+    /* The last node is the value of the list so it is kept */
+    for (size_t i = 0; i + 1 < v.size();) {
+        if (is_dead_statement(v[i])) {
+            delete v[i];
+            v.erase(v.begin() + i);
+            n_removed++;
+        } else
+            i++;
+    }
+    return n_removed;
+}
+
+/* The DEF and the assignments of name, if they all are statements without
+   other side effects. */
+bool collect_stores(ast_node *node, const std::string &name,
+                    std::vector<std::pair<ast_node_explist*, ast_node*>> &v_stores)
+{
+    bool ok = true;
+    if (node->type == ast_type::EXPLIST) {
+        auto explist = dynamic_cast<ast_node_explist*>(node);
+        for (auto stmt : explist->v_nodes) {
+            if (stmt->type == ast_type::DEF) {
+                auto def = dynamic_cast<ast_node_def*>(stmt);
+                if (def->var_name != name)
+                    continue;
+                if (!is_scalar(def->value_type) || (def->value_node && !is_pure(def->value_node)))
+                    return false;
+                v_stores.push_back({explist, stmt});
+            } else if (stmt->type == ast_type::ASSIGN) {
+                auto assign = dynamic_cast<ast_node_assign*>(stmt);
+                auto var = dynamic_cast<ast_node_var*>(assign->first);
+                if (!var || var->nspace.size() || var->name != name)
+                    continue;
+                if (!is_pure(assign->sec))
+                    return false;
+                v_stores.push_back({explist, stmt});
+            }
+        }
+    }
+    for_each_child(node, [&](ast_node *&child, bool) {
+        ok = ok && collect_stores(child, name, v_stores);
+    });
+    return ok;
+}
+
+/* Removes the locals that are never read, until there are no more. */
+int remove_dead_stores(const pass_body &body)
+{
+    int n_removed = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &[name, info] : analyze_function(body)) {
+            if (info.is_param || info.n_defs != 1 || info.n_reads || info.address_taken)
+                continue;
+
+            std::vector<std::pair<ast_node_explist*, ast_node*>> v_stores;
+            if (!collect_stores(body.code_block, name, v_stores) ||
+                v_stores.size() != 1 + info.n_assigns)
+                continue;
+
+            for (auto &[explist, stmt] : v_stores) {
+                auto &v = explist->v_nodes;
+                v.erase(std::find(v.begin(), v.end(), stmt));
+                delete stmt;
+                n_removed++;
+            }
+            changed = true;
+        }
+    }
+    return n_removed;
+}
+
+int pass_dce(const pass_body &body)
+{
+    int n_removed = dce_walk(body.code_block);
+    return n_removed + remove_dead_stores(body);
+}
+
+struct ast_pass {
+    std::string name;
+    int (*run)(const pass_body &body); /* Returns the number of changes */
+};
+
+const std::vector<ast_pass>& ast_passes()
+{
+    static const std::vector<ast_pass> v_passes = {
+        {"inline", pass_inline},
+        {"constprop", pass_constprop},
+        {"fold", pass_fold},
+        {"cse", pass_cse},
+        {"dce", pass_dce},
+    };
+    return v_passes;
+}
+
+/* The function bodies and top level DO blocks of the nodes, and of the
+   compilation units they import. */
+void collect_pass_bodies(const std::vector<ast_node*> &v_nodes, std::vector<pass_body> &v_bodies)
+{
+    for (auto e : v_nodes) {
+        if (e->type == ast_type::FUNCTION_DEF) {
+            auto fdef = dynamic_cast<ast_node_funcdef*>(e);
+            v_bodies.push_back({fdef->code_block, fdef->parlist});
+        } else if (e->type == ast_type::DOBLOCK)
+            v_bodies.push_back({e, nullptr});
+        else if (e->type == ast_type::USING) {
+            auto using_t = dynamic_cast<ast_node_using*>(e);
+            if (using_t->compunit)
+                collect_pass_bodies(using_t->compunit->v_nodes, v_bodies);
+        }
+    }
+}
+
+} /* namespace */
+
+const std::vector<std::string>& ast_pass_names()
+{
+    static const std::vector<std::string> v_names = [] {
+        std::vector<std::string> v;
+        for (auto &pass : ast_passes())
+            v.push_back(pass.name);
+        return v;
+    }();
+    return v_names;
+}
+
+void run_ast_passes(std::vector<ast_node*> &v_nodes)
+{
+    std::vector<pass_body> v_bodies;
+    collect_pass_bodies(v_nodes, v_bodies);
+
+    for (auto &pass : ast_passes()) {
+        auto &disabled = opts().disabled_passes;
+        if (std::find(disabled.begin(), disabled.end(), pass.name) != disabled.end())
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        int n_changes = 0;
+        for (auto &body : v_bodies)
+            n_changes += pass.run(body);
+        auto stop = std::chrono::steady_clock::now();
+
+        if (opts().time_passes)
+            std::cerr << "pass " << pass.name << ": "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()
+                      << " us, " << n_changes << " changes" << std::endl;
+    }
+}
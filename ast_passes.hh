@@ -0,0 +1,42 @@
+#pragma once
+
+/* Optimization passes on the resolved AST.
+ *
+ * The passes are run on each compilation unit after resolve() and before
+ * the nodes are added to the jit, so that GCC gets less and simpler code
+ * also at -O0. They work on the bodies of Engma functions and on the DO
+ * blocks on the top level, also in the imported compilation units. Other
+ * top level statements are left as they are. The passes run in this order:
+ *
+ *   inline    - Calls to functions whose body is a single RETURN of an
+ *               arithmetic expression of the parameters are inlined.
+ *   constprop - Locals that are initialized with a constant expression
+ *               and never assigned are replaced by their value.
+ *   fold      - Operators and calls that got constant operands are folded.
+ *   cse       - Repeated pure subexpressions in a statement are computed
+ *               once into a temporary.
+ *   dce       - Unreachable statements, statements without effect, branches
+ *               that are never taken and stores to locals that are never
+ *               read are removed.
+ *
+ * --disable-pass=NAME turns a pass off and --time-passes prints the time
+ * spent in each pass to stderr.
+ */
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class ast_node;
+
+/* Calls fn for each child of node. fn may replace the child if it is
+   replaceable. */
+typedef std::function<void(ast_node *&child, bool replaceable)> child_fn;
+void for_each_child(ast_node *node, const child_fn &fn);
+
+/* The names of the passes in the order they are run. */
+const std::vector<std::string>& ast_pass_names();
+
+/* Runs the enabled passes on the top level nodes of a compilation unit
+   and the units it imports. */
+void run_ast_passes(std::vector<ast_node*> &v_nodes);
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compares the time to first output of the jit (-X) and the bytecode
+# interpreter (-X --interp). For the jit it is dominated by the compile.
+#
+# Usage: bench/interp-startup.sh [RUNS] [FILES...]
+# Run from the repository root after make. Defaults to 20 runs of the
+# compilation tests that print DONE.
+
+RUNS=${1:-20}
+[ $# -gt 0 ] && shift
+FILES=${*:-$(grep -l 'print("DONE")' testsuite/compilation-general.tests/*.em)}
+ENGMAC=${ENGMAC:-./engmac}
+
+now_us() {
+    echo $(($(date +%s%N) / 1000))
+}
+
+# Prints the mean time in us until the first byte of output
+first_output_us() {
+    tmp=$(mktemp)
+    total=0
+    i=0
+    while [ $i -lt $RUNS ]; do
+        start=$(now_us)
+        stdbuf -o0 $ENGMAC -X $2 -I. "$1" 2>/dev/null |
+            { head -c 1 > /dev/null; now_us > "$tmp"; cat > /dev/null; }
+        end=$(cat "$tmp")
+        total=$((total + end - start))
+        i=$((i + 1))
+    done
+    rm -f "$tmp"
+    echo $((total / RUNS))
+}
+
+printf "%-40s %12s %12s %8s\n" "file" "jit us" "interp us" "speedup"
+for f in $FILES; do
+    jit=$(first_output_us "$f" "")
+    interp=$(first_output_us "$f" "--interp")
+    printf "%-40s %12d %12d %7dx\n" "$(basename $f)" $jit $interp $((jit / (interp > 0 ? interp : 1)))
+done
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Measures the mean latency of a statement in the REPL (-X without files),
+# i.e. the time to compile and run it in its own context. The start up is
+# measured with a single statement and subtracted.
+#
+# Usage: bench/repl-latency.sh [STATEMENTS]
+# Run from the repository root after make.
+
+N=${1:-100}
+ENGMAC=${ENGMAC:-./engmac}
+
+now_us() {
+    echo $(($(date +%s%N) / 1000))
+}
+
+program() {
+    echo "Int x = 0"
+    i=0
+    while [ $i -lt $1 ]; do
+        echo "x = x + 1"
+        i=$((i + 1))
+    done
+}
+
+run_us() {
+    tmp=$(mktemp)
+    program $1 > "$tmp"
+    start=$(now_us)
+    $ENGMAC -X -I. < "$tmp" > /dev/null
+    end=$(now_us)
+    rm -f "$tmp"
+    echo $((end - start))
+}
+
+base=$(run_us 0)
+total=$(run_us $N)
+echo "start up:      $((base / 1000)) ms"
+echo "per statement: $(((total - base) / N / 1000)).$(((total - base) / N % 1000 / 100)) ms ($N statements)"
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <stdexcept>
@@ -5,11 +6,17 @@
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <numeric>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <stdlib.h>
 
 #include "compile.hh"
 #include "common.hh"
+#include "time_report.hh"
+#include "diagnostics.hh"
+#include "profiler.hh"
 
 #define INT_TYPE this->types->int_type
 #define UINT_TYPE this->types->uint_type
@@ -22,51 +29,18 @@
 #define DOUBLE_TYPE this->types->double_type
 #define FLOAT_TYPE this->types->float_type
 #define VOID_TYPE this->types->void_type
+#define VOID_PTR_TYPE this->types->void_ptr_type
 #define BOOL_TYPE this->types->bool_type
 #define CCHARPTR_TYPE this->types->const_char_ptr_type
 
-/* map of gccstructobjects to typename for Engma structs */
-struct struct_wrapper {
-    gcc_jit_struct *gccjit_struct = nullptr;
-    std::string name;
-
-    std::vector<std::string> field_names;
-    std::vector<gcc_jit_field*> gccjit_fields;
-
-    void add_field(std::string name, gcc_jit_field* field) 
-    {
-        field_names.push_back(name);
-        gccjit_fields.push_back(field);
-    }
-
-    gcc_jit_field* get_field(std::string name)
-    {
-        DEBUG_ASSERT_NOTNULL(gccjit_struct);
-        for (int i = 0; i < field_names.size(); i++)
-            if (field_names[i] == name)
-                return gccjit_fields[i];
-        THROW_BUG("Struct " + this->name + " has no field " + name);
-    }
-};
-
-
-
-std::map<std::string, struct_wrapper> map_structtypename_to_gccstructobj;
-
-
-std::string new_unique_name(std::string prefix = "")
+std::string jit::new_unique_name(std::string prefix)
 {
-    static long i;
     std::ostringstream ss;
-    ss << prefix << "_" << std::setw(7) << std::setfill('0') <<  i++;
+    ss << prefix << "_" << std::setw(7) << std::setfill('0') <<  unique_name_counter++;
 
     return ss.str();
 }
 
-std::vector<gcc_jit_type*> v_return_type; /* Stack to keep track of return type of function defs. */
-std::vector<bool> v_block_terminated;     /* To keep track off if the block was terminated depper in the tree. */
-
-
 void jit::push_lval(std::string name, gcc_jit_lvalue* lval)
 {
     auto &scope = get_current_scope();
@@ -84,6 +58,9 @@ gcc_jit_lvalue* jit::find_lval_in_scopes(std::string name)
         if (ans != rit->end())
             return ans->second;
     }
+    /* In the REPL the globals of earlier statements are added when used */
+    if (repl)
+        return repl_global(name);
     return nullptr;
 }
 
@@ -538,68 +515,49 @@ gcc_jit_type* jit::promote_rval(gcc_jit_type *at,
         THROW_BUG("Cast not supported");
 }
 
-gcc_jit_rvalue* jit::obj_to_gcc_literal(obj* obj)
+gcc_jit_rvalue* jit::const_value_to_gcc_literal(const const_value &value)
 {   
-    DEBUG_ASSERT_NOTNULL(obj);
-
     gcc_jit_rvalue* rv = nullptr;
 
-#define MAKE_RV(obj_class, type) do {\
-auto obj_t = dynamic_cast<obj_class*>(obj);\
-DEBUG_ASSERT_NOTNULL(obj_t);\
-rv = gcc_jit_context_new_rvalue_from_long(context,\
-    type, obj_t->val); } while((0));
-
-#define MAKE_RV_FLOATS(obj_class, type) do {\
-auto obj_t = dynamic_cast<obj_class*>(obj);\
-DEBUG_ASSERT_NOTNULL(obj_t);\
-rv = gcc_jit_context_new_rvalue_from_double(context,\
-    type, obj_t->val); } while((0));
-
-    switch (obj->type) {
-    case object_type::LONG:
-        MAKE_RV(object_long, LONG_TYPE)
-        break;
-    case object_type::INT:
-        MAKE_RV(object_int, INT_TYPE)
-        break;
-    case object_type::SHORT:
-        MAKE_RV(object_short, SHORT_TYPE)
-        break;
-    case object_type::SBYTE:
-        MAKE_RV(object_sbyte, SCHAR_TYPE)
-        break;
-    case object_type::ULONG:
-        MAKE_RV(object_ulong, ULONG_TYPE)
-        break;
-    case object_type::UINT:
-        MAKE_RV(object_uint, UINT_TYPE)
-        break;
-    case object_type::USHORT:
-        MAKE_RV(object_ushort, USHORT_TYPE)
-        break;
-    case object_type::BYTE:
-        MAKE_RV(object_byte, UCHAR_TYPE)
-        break;
-    case object_type::DOUBLE:
-        MAKE_RV_FLOATS(object_double, DOUBLE_TYPE);
-        break;
-    case object_type::FLOAT:
-        MAKE_RV_FLOATS(object_float, FLOAT_TYPE);
-        break;
-    default:
+#define MAKE_RV(c_type, type) \
+if (auto v = std::get_if<c_type>(&value)) \
+    rv = gcc_jit_context_new_rvalue_from_long(context, type, *v);
+
+#define MAKE_RV_FLOATS(c_type, type) \
+if (auto v = std::get_if<c_type>(&value)) \
+    rv = gcc_jit_context_new_rvalue_from_double(context, type, *v);
+
+    MAKE_RV(int64_t, LONG_TYPE)
+    else MAKE_RV(int32_t, INT_TYPE)
+    else MAKE_RV(int16_t, SHORT_TYPE)
+    else MAKE_RV(int8_t, SCHAR_TYPE)
+    else MAKE_RV(uint64_t, ULONG_TYPE)
+    else MAKE_RV(uint32_t, UINT_TYPE)
+    else MAKE_RV(uint16_t, USHORT_TYPE)
+    else MAKE_RV(uint8_t, UCHAR_TYPE)
+    else MAKE_RV_FLOATS(double, DOUBLE_TYPE)
+    else MAKE_RV_FLOATS(float, FLOAT_TYPE)
+    else
         THROW_NOT_IMPLEMENTED("");
-    }
 
 #undef MAKE_RV
+#undef MAKE_RV_FLOATS
 
     return rv;
 }
 
-void jit::dump(std::string path)
+void* jit::get_function(std::string name)
 {
-    gcc_jit_context_dump_to_file(context, path.c_str(), 0);
-    gcc_jit_context_dump_reproducer_to_file(context, (path + ".c").c_str());
+    if (!result)
+        THROW_BUG("get_function() before compile()");
+    return gcc_jit_result_get_code(result, name.c_str());
+}
+
+void* jit::get_var(std::string name)
+{
+    if (!result)
+        THROW_BUG("get_var() before compile()");
+    return gcc_jit_result_get_global(result, name.c_str());
 }
 
 gcc_jit_type* jit::emc_type_to_jit_type(emc_type t)
@@ -641,12 +599,80 @@ gcc_jit_type* jit::emc_type_to_jit_type(emc_type t)
     } else
         DEBUG_ASSERT(false, "Not implemented");
 
-    /* Make it a n:th degree pointer if needed. */
-    for (int i = 0; i < t.n_pointer_indirections; i++)
+    /* Make it a n:th degree pointer if needed, with the qualifiers of each
+       indirection. Restrict lets GCC assume that the pointers don't alias. */
+    for (int i = 0; i < t.n_pointer_indirections; i++) {
+        if (t.ptr_const_mask & 1u << i)
+            var_type = gcc_jit_type_get_const(var_type);
         var_type = gcc_jit_type_get_pointer(var_type);
+#ifdef LIBGCCJIT_HAVE_gcc_jit_type_get_restrict
+        if (t.ptr_restrict_mask & 1u << i)
+            var_type = gcc_jit_type_get_restrict(var_type);
+#endif
+    }
     return var_type;
 }
 
+/* DIR/NAME-HASH, without the .gcda, for the profile of the current
+   compilation unit. HASH is of the source, the sources of the USING:ed
+   units, whose functions are compiled into the same code, and the options
+   that change the code, so an unchanged module keeps its profile across
+   rebuilds and a changed one doesn't get a stale profile. */
+static std::string pgo_profile_base(const std::string &dir)
+{
+    const std::string &file_name = compilation_units().get_current_compilation_unit().file_name;
+    std::stringstream ss;
+    for (auto &kv : compilation_units().map_compilation_units_by_paths) {
+        std::ifstream f{kv.second->file_name, std::ios::binary};
+        ss << kv.first << '\0' << f.rdbuf() << '\0';
+    }
+
+    const engma_options &o = opts();
+    ss << o.optimization_level << '\0' << o.debug_flag << '\0' << o.march
+       << '\0' << o.fp_model << '\0' << o.instrument << '\0' << o.coverage
+       << '\0' << o.reorder_fields << '\0' << o.batch_wrappers << '\0' << o.lazy
+       << '\0' << o.tiered << '\0' << o.tier_threshold << '\0' << o.tier_optimization_level
+       << '\0' << o.ctfe_max_steps << '\0' << o.ctfe_max_memory << '\0' << o.ctfe_max_depth;
+    for (auto &pass : o.disabled_passes)
+        ss << '\0' << "no-" << pass;
+    for (auto &target : o.target_clones)
+        ss << '\0' << target;
+    std::string key = ss.str();
+
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::filesystem::path path = std::filesystem::absolute(dir) /
+        std::filesystem::path{file_name}.stem();
+    std::stringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return path.string() + "-" + hex.str();
+}
+
+/* -march and the floating point model, for every context with code */
+void jit::add_target_options(gcc_jit_context *context)
+{
+    if (opts().march.size())
+        gcc_jit_context_add_command_line_option(context, ("-march=" + opts().march).c_str());
+
+    /* libgccjit contracts a * b + c to FMA by default, like GNU C, so
+       contract needs no option */
+    if (opts().fp_model == "strict")
+        gcc_jit_context_add_command_line_option(context, "-ffp-contract=off");
+    else if (opts().fp_model == "fast") {
+        /* Reassociation lets floating point reductions vectorize */
+        gcc_jit_context_add_command_line_option(context, "-ffast-math");
+        gcc_jit_context_add_command_line_option(context, "-ffp-contract=fast");
+    } else if (opts().fp_model != "contract")
+        THROW_BUG("Unknown fp model " + opts().fp_model);
+}
+
 void jit::postprocess()
 {
     /* Close the root_block in root_func */
@@ -655,8 +681,6 @@ void jit::postprocess()
         gcc_jit_block_end_with_return(root_block, 0,
             gcc_jit_context_new_rvalue_from_int(context, INT_TYPE, 0));
 
-    gcc_jit_context_dump_reproducer_to_file(context, "./reprod.c");
-    gcc_jit_context_dump_to_file(context, "./dump.c", 1);
     /* libgccjit default to -fPIC, so lets undo that. */
     gcc_jit_context_add_driver_option(context, "-fno-PIC");
     gcc_jit_context_add_driver_option(context, "-fno-pic");
@@ -668,8 +692,8 @@ void jit::postprocess()
        as long as there is atleast one .em file among the file 
        arguments (in that case we are just linking object files
        or compiling some c or cpp file) */
-    if (opts.run_type == engma_run_type::OUTPUT_TO_EXE && opts.files.size() ||  
-        opts.run_type == engma_run_type::EXECUTE) {
+    if (opts().run_type == engma_run_type::OUTPUT_TO_EXE && opts().files.size() ||  
+        opts().run_type == engma_run_type::EXECUTE) {
 
         /* TODO: Do linking properly... */
         gcc_jit_context_add_driver_option(context, "-ljitruntime");
@@ -697,13 +721,15 @@ void jit::postprocess()
             gcc_jit_param_as_rvalue(argc), 
             gcc_jit_param_as_rvalue(argv)
         };
+        emit_instr_init(main_block);
+        emit_cov_init(main_block);
         /* Call the root_fn function */
         auto root_fn_call = gcc_jit_context_new_call(context, 0, 
             root_func, 2, args);
         gcc_jit_block_add_eval(main_block, 0, root_fn_call);
 
         /* If there is any user specified main() function, call it. */
-        auto main_objects = compilation_units.get_current_objstack().
+        auto main_objects = compilation_units().get_current_objstack().
             find_objects_by_not_mangled_name("main", "");
         if (main_objects.size() > 1)
             THROW_USER_ERROR("Can't have multiple main functions");
@@ -724,54 +750,108 @@ void jit::postprocess()
         }
     }
 
-    if (opts.run_type == engma_run_type::EXECUTE || 
-        opts.run_type == engma_run_type::OUTPUT_TO_SO) {
+    if (opts().run_type == engma_run_type::EXECUTE || 
+        opts().run_type == engma_run_type::OUTPUT_TO_SO) {
         /* If we are going to execute the code by "JIT" or do a shared lib, 
            the Engma code and any c or c++ files need to be compiled with 
            position independent code. */
         gcc_jit_context_add_driver_option(context, "-fPIC");
     }
 
-    if (opts.debug_flag.size())
-        gcc_jit_context_add_command_line_option(context, opts.debug_flag.c_str());
-
-    gcc_jit_context_add_command_line_option(context, opts.optimization_level.c_str());
-
+    if (opts().debug_flag.size())
+        gcc_jit_context_add_command_line_option(context, opts().debug_flag.c_str());
+
+    gcc_jit_context_add_command_line_option(context, opts().optimization_level.c_str());
+    add_target_options(context);
+
+    /* Profile guided optimization. The profile is named by -dumpbase instead
+       of after libgccjit's temporary directory */
+    if (opts().pgo_generate.size()) {
+        std::string pgo_base = pgo_profile_base(opts().pgo_generate);
+        gcc_jit_context_add_command_line_option(context, "-dumpbase");
+        gcc_jit_context_add_command_line_option(context, pgo_base.c_str());
+        gcc_jit_context_add_command_line_option(context, "-fprofile-generate");
+        /* Services are threaded */
+        gcc_jit_context_add_command_line_option(context, "-fprofile-update=prefer-atomic");
+        /* Links libgcov, which writes the profile at exit or when -X unloads the code */
+        gcc_jit_context_add_driver_option(context, "-fprofile-generate");
+    } else if (opts().pgo_use.size()) {
+        std::string pgo_base = pgo_profile_base(opts().pgo_use);
+        if (!std::filesystem::exists(pgo_base + ".gcda"))
+            std::cerr << "Warning: No profile " << pgo_base << ".gcda, the source or"
+                " the options changed since --pgo-generate" << std::endl;
+        gcc_jit_context_add_command_line_option(context, "-dumpbase");
+        gcc_jit_context_add_command_line_option(context, pgo_base.c_str());
+        gcc_jit_context_add_command_line_option(context, "-fprofile-use");
+        /* Code that didn't run in the training isn't an error */
+        gcc_jit_context_add_command_line_option(context, "-Wno-missing-profile");
+    }
 
     
-    for (std::string file : opts.nonengma_files) {
+    for (std::string file : opts().nonengma_files) {
         gcc_jit_context_add_driver_option(context, file.c_str());
     }
     /* Add linker options */
-    for (std::string lib_arg : opts.L_folders)
+    for (std::string lib_arg : opts().L_folders)
         gcc_jit_context_add_driver_option(context, lib_arg.c_str());
-    for (std::string lib_arg : opts.l_folders)
+    for (std::string lib_arg : opts().l_folders)
         gcc_jit_context_add_driver_option(context, lib_arg.c_str());
 }
 
 void jit::compile()
 {
-    if (opts.run_type == engma_run_type::EXECUTE) {
+    /* GCC times its passes for the --time-report too */
+    phase_timer timer{"gcc"};
+    if (current_time_report)
+        gcc_jit_context_set_timer(context, current_time_report->gcc_timer);
+
+    /* --dump, see diagnostics.hh */
+    if (dump_enabled("ir")) {
+        std::string tmp = dump_path("ir") + ".tmp";
+        gcc_jit_context_dump_to_file(context, tmp.c_str(), 1);
+        dump_text("ir", take_dump_file(tmp));
+    }
+    if (dump_enabled("reproducer"))
+        gcc_jit_context_dump_reproducer_to_file(context, dump_path("reproducer").c_str());
+    /* The assembler needs a compile of its own. Do it before the gimple dump
+       is enabled so that only the real compile fills it in. */
+    if (dump_enabled("asm")) {
+        std::string tmp = dump_path("asm") + ".tmp";
+        gcc_jit_context_compile_to_file(context, GCC_JIT_OUTPUT_KIND_ASSEMBLER, tmp.c_str());
+        dump_text("asm", take_dump_file(tmp));
+    }
+    char *gimple = nullptr;
+    if (dump_enabled("gimple"))
+        gcc_jit_context_enable_dump(context, "tree-gimple", &gimple);
+
+    if (opts().run_type == engma_run_type::EXECUTE) {
         DEBUG_ASSERT(gcc_jit_context_get_last_error(context) == 0,"Uncought error");
+        /* The profiler follows the frame pointers and reads the .so's debug info */
+        if (opts().profile_hz) {
+            gcc_jit_context_add_command_line_option(context, "-fno-omit-frame-pointer");
+            gcc_jit_context_set_bool_option(context, GCC_JIT_BOOL_OPTION_KEEP_INTERMEDIATES, 1);
+        }
         result = gcc_jit_context_compile(context);
         if (!result)
         {
             std::cerr <<  "Jit compilation failed" << std::endl;
             std::cerr << gcc_jit_context_get_last_error(context) << std::endl;
-            exit(1);
+            /* Not exit(), libengma has to survive this */
+            throw std::runtime_error("Jit compilation failed");
         }
+        perf_map_add(result, v_perf_fns);
     }
 
-    if (opts.run_type == engma_run_type::OUTPUT_TO_OBJ_FILE &&
-        opts.files.size()) {
+    if (opts().run_type == engma_run_type::OUTPUT_TO_OBJ_FILE &&
+        opts().files.size()) {
         DEBUG_ASSERT(gcc_jit_context_get_last_error(context) == 0,"Uncought error");
         
-        std::string obj_file_name = opts.outputfile_name;
+        std::string obj_file_name = opts().outputfile_name;
         if (obj_file_name.size() == 0) {
-            if (opts.files.size())
-                obj_file_name = strip_last(opts.files[0],".") + ".o";
-            else if (opts.nonengma_files.size())
-                obj_file_name = strip_last(opts.nonengma_files[0],".") + ".o";
+            if (opts().files.size())
+                obj_file_name = strip_last(opts().files[0],".") + ".o";
+            else if (opts().nonengma_files.size())
+                obj_file_name = strip_last(opts().nonengma_files[0],".") + ".o";
             else
                 THROW_BUG("No files seems to be specified");
         }
@@ -787,14 +867,14 @@ void jit::compile()
             std::cerr << c << std::endl;
             exit(1);
         }
-    } else if (opts.run_type == engma_run_type::OUTPUT_TO_OBJ_FILE)
+    } else if (opts().run_type == engma_run_type::OUTPUT_TO_OBJ_FILE)
         THROW_BUG("");
 
 
-    if (opts.run_type == engma_run_type::OUTPUT_TO_SO) {
+    if (opts().run_type == engma_run_type::OUTPUT_TO_SO) {
         DEBUG_ASSERT(gcc_jit_context_get_last_error(context) == 0,"Uncought error");
         
-        std::string obj_file_name = opts.outputfile_name;
+        std::string obj_file_name = opts().outputfile_name;
         if (obj_file_name.size() == 0)
             obj_file_name = "a.out";
 
@@ -810,10 +890,10 @@ void jit::compile()
             exit(1);
         }
     }
-    if (opts.run_type == engma_run_type::OUTPUT_TO_EXE) {
+    if (opts().run_type == engma_run_type::OUTPUT_TO_EXE) {
         DEBUG_ASSERT(gcc_jit_context_get_last_error(context) == 0,"Uncought error");
         
-        std::string obj_file_name = opts.outputfile_name;
+        std::string obj_file_name = opts().outputfile_name;
         if (obj_file_name.size() == 0)
             obj_file_name = "a.out";
 
@@ -829,10 +909,10 @@ void jit::compile()
             exit(1);
         }
     }
-    if (opts.run_type == engma_run_type::OUTPUT_ASSEMBLER) {
+    if (opts().run_type == engma_run_type::OUTPUT_ASSEMBLER) {
         DEBUG_ASSERT(gcc_jit_context_get_last_error(context) == 0,"Uncought error");
         
-        std::string obj_file_name = opts.outputfile_name;
+        std::string obj_file_name = opts().outputfile_name;
         if (obj_file_name.size() == 0)
             obj_file_name = "a.s";
 
@@ -848,6 +928,11 @@ void jit::compile()
             exit(1);
         }
     }  
+
+    if (gimple) {
+        dump_text("gimple", gimple);
+        free(gimple);
+    }
 }
 
 void jit::execute()
@@ -863,8 +948,15 @@ void jit::execute()
        
     if (!root_func)
         THROW_BUG("NULL root function after JIT compilation");
-    else
-        root_func(1, dummy_argv);
+
+    std::unique_ptr<sampling_profiler> profiler;
+    if (opts().profile_hz) {
+        profiler = std::make_unique<sampling_profiler>((void*)root_func, opts().profile_hz);
+        profiler->start();
+    }
+
+    start_tiering();
+    root_func(1, dummy_argv);
 
     for (auto e : v_node_fn_names) {
         root_fn_p root_func = (root_fn_p)gcc_jit_result_get_code(result, e.c_str());
@@ -872,6 +964,12 @@ void jit::execute()
             THROW_BUG("NULL function " + e + " after JIT compilation");
         root_func(1, dummy_argv);
     }
+    stop_tiering();
+
+    if (profiler) {
+        profiler->stop();
+        profiler->print_report(std::cerr);
+    }
 }
 
 void jit::setup_default_root_environment()
@@ -1014,8 +1112,18 @@ void jit::init_as_dummy_context()
 
 void jit::init_as_root_context()
 {
+    lazy = opts().lazy && opts().run_type == engma_run_type::EXECUTE;
+
     /* Init a context */
-    context = gcc_jit_context_acquire ();
+    if (lazy) {
+        /* The functions are compiled later in children of types_context, so
+           the types have to be there to be shared. */
+        types_context = gcc_jit_context_acquire ();
+        if (!types_context)
+            THROW_BUG("Could not acquire jit context");
+        context = gcc_jit_context_new_child_context(types_context);
+    } else
+        context = gcc_jit_context_acquire ();
     if (!context)
         THROW_BUG("Could not acquire jit context");
 
@@ -1024,7 +1132,7 @@ void jit::init_as_root_context()
     gcc_jit_context_set_bool_option(context, GCC_JIT_BOOL_OPTION_DUMP_GENERATED_CODE,
                                             0);
     /* Initialize the default types for this context (e.g. int etc) and put them in this->types */
-    types = new default_types(context);
+    types = new default_types(lazy ? types_context : context);
 
     setup_default_root_environment();
 
@@ -1044,6 +1152,13 @@ void jit::init_as_root_context()
                     2, params, 0);
 
     root_block = gcc_jit_function_new_block(root_func, "root_block");
+
+    if (lazy || opts().tiered && opts().run_type == engma_run_type::EXECUTE)
+        init_tiering();
+    if (opts().instrument.size())
+        init_instrument();
+    if (opts().coverage)
+        init_coverage();
 }
 
 void jit::add_ast_node(ast_node *node)
@@ -1052,11 +1167,20 @@ void jit::add_ast_node(ast_node *node)
      * to wrap them but use the root init function in the case of global vars and just
      * define themself at filescope for functions. 
      */
+    if (tiering)
+        tier_record_node(node);
+
+    /* With --coverage, count the statements run by the root function */
+    if (node->type != ast_type::FUNCTION_DEF && node->type != ast_type::FUNCTION_DECL &&
+        node->type != ast_type::STRUCT && node->type != ast_type::NAMESPACE &&
+        node->type != ast_type::USING)
+        emit_cov_count(root_block, node);
+
     if (node->type == ast_type::DEF || node->type == ast_type::FUNCTION_DEF ||
         node->type == ast_type::FUNCTION_DECL) {
         gcc_jit_rvalue *rval = nullptr;
         walk_tree(node, 0, 0, &rval, 0);
-    } else { /* TODO: Readd support for REPL here somehow */
+    } else { /* In the REPL root_block is the block of the statement, see repl.cc */
         gcc_jit_rvalue *rval = nullptr;
         walk_tree(node, &root_block, &root_func, &rval, 0);
         if (rval) { /* There was only expressions so add it/them to the current block. */
@@ -1728,9 +1852,6 @@ void jit::walk_tree_xnor( ast_node *node,
     *current_rvalue = rv_result;
 }
 
-/* TODO: Make not global */
-std::vector<gcc_jit_lvalue*> andchain_lvals;
-
 void jit::walk_tree_andchain(ast_node *node, 
                         gcc_jit_block **current_block, 
                         gcc_jit_function **current_function, 
@@ -1996,14 +2117,24 @@ void jit::walk_tree_fcall(ast_node *node,
     auto fcall_node = dynamic_cast<ast_node_funccall*>(node);
     DEBUG_ASSERT(fcall_node != nullptr, "FUNCTION_CALL current_rvalue is null");
 
-    auto it = map_fnname_to_gccfnobj.find(fcall_node->mangled_name);
-    if (it == map_fnname_to_gccfnobj.end())
-        THROW_BUG("Function " + fcall_node->mangled_name + " not defined.");
-    gcc_jit_function *func = it->second;
+    /* When tiering, Engma functions are called through the tier table. In
+       the REPL the functions of earlier statements are called by address. */
+    bool via_tier_table = (tiering || tier_parent && !repl) && fcall_node->fdef_node;
+
+    gcc_jit_function *func = nullptr;
+    if (!via_tier_table) {
+        auto it = map_fnname_to_gccfnobj.find(fcall_node->mangled_name);
+        if (it == map_fnname_to_gccfnobj.end() && repl && repl_declare_fn(fcall_node->mangled_name))
+            it = map_fnname_to_gccfnobj.find(fcall_node->mangled_name);
+        if (it != map_fnname_to_gccfnobj.end())
+            func = it->second;
+        else if (!repl || !fcall_node->fdef_node)
+            THROW_BUG("Function " + fcall_node->mangled_name + " not defined.");
+    }
 
     /* Find the ast node of the corrensponding function declaration. */
     
-    obj* fnobj_ = compilation_units.get_current_objstack().find_object(fcall_node->mangled_name);
+    obj* fnobj_ = compilation_units().get_current_objstack().find_object(fcall_node->mangled_name);
     object_func *fnobj = dynamic_cast<object_func*>(fnobj_);
     if (!fnobj)
         THROW_BUG("Function " + fcall_node->mangled_name + " not defined/found.");
@@ -2024,16 +2155,28 @@ void jit::walk_tree_fcall(ast_node *node,
         walk_tree(arg_node, current_block, current_function, &arg_rv);
         DEBUG_ASSERT(arg_node, "Could not produce rval from argument");
         /* The actual type of the parameter in question. */
-        gcc_jit_type *arg_type = gcc_jit_rvalue_get_type(
-                                    gcc_jit_param_as_rvalue(
-                                        gcc_jit_function_get_param(func, i)));
+        gcc_jit_type *arg_type = nullptr;
+        if (!func)
+            arg_type = get_tier_signature(fcall_node->fdef_node).v_param_types[i];
+        else
+            arg_type = gcc_jit_rvalue_get_type(
+                            gcc_jit_param_as_rvalue(
+                                gcc_jit_function_get_param(func, i)));
         gcc_jit_rvalue *casted_rv = cast_to(arg_rv, arg_type);                                  
         DEBUG_ASSERT_NOTNULL(casted_rv);
         v_arg_rv.push_back(casted_rv);
     }
 
-    gcc_jit_rvalue *fncall_rval = gcc_jit_context_new_call(context, 
-        ast_node_to_gccloc(node), func, v_arg_rv.size(), v_arg_rv.data());
+    gcc_jit_rvalue *fncall_rval = nullptr;
+    if (via_tier_table)
+        fncall_rval = tier_call(fcall_node->fdef_node, v_arg_rv, ast_node_to_gccloc(node));
+    else if (!func)
+        fncall_rval = repl_call(fcall_node->fdef_node, v_arg_rv, ast_node_to_gccloc(node));
+    else if (tier_parent)
+        fncall_rval = tier_call_imported(func, fcall_node->mangled_name, v_arg_rv, ast_node_to_gccloc(node));
+    else
+        fncall_rval = gcc_jit_context_new_call(context, 
+            ast_node_to_gccloc(node), func, v_arg_rv.size(), v_arg_rv.data());
 
     *current_rvalue = fncall_rval;
 }
@@ -2047,6 +2190,38 @@ void jit::walk_tree_fdefi(ast_node *node,
     DEBUG_ASSERT(node != nullptr, "node was null");
     auto ast_funcdec = dynamic_cast<ast_node_funcdef*>(node);
     DEBUG_ASSERT(ast_funcdec != nullptr, "ast_funcdec was null");
+
+    /* With --lazy only a stub is put in the root context */
+    if (lazy) {
+        emit_lazy_stub(node);
+        if (opts().batch_wrappers)
+            emit_batch_wrapper(node, map_fnname_to_gccfnobj[ast_funcdec->mangled_name]);
+        return;
+    }
+
+    gcc_jit_function *fn = nullptr;
+    if (opts().target_clones.size() && !tier_parent)
+        fn = emit_target_clones(node);
+    else
+        fn = emit_fn(node, ast_funcdec->mangled_name, GCC_JIT_FUNCTION_EXPORTED);
+
+    map_fnname_to_gccfnobj[ast_funcdec->mangled_name.c_str()] = fn;
+    if (opts().perf_map.size())
+        v_perf_fns.push_back({ast_funcdec->mangled_name,
+                              compilation_units().get_current_compilation_unit().file_name,
+                              node->loc.first_line});
+
+    /* Recompiled functions already have theirs in the root context */
+    if (opts().batch_wrappers && !tier_parent)
+        emit_batch_wrapper(node, fn);
+}
+
+/* The function of a function definition with its body, named name */
+gcc_jit_function* jit::emit_fn(ast_node *node, const std::string &name,
+                               enum gcc_jit_function_kind kind)
+{
+    auto ast_funcdec = dynamic_cast<ast_node_funcdef*>(node);
+    DEBUG_ASSERT_NOTNULL(ast_funcdec);
     auto ast_parlist = dynamic_cast<ast_node_vardef_list*>(ast_funcdec->parlist);
     DEBUG_ASSERT_NOTNULL(ast_parlist);
 
@@ -2069,15 +2244,15 @@ void jit::walk_tree_fdefi(ast_node *node,
     gcc_jit_function *fn = nullptr;
     if (v_params.size())
         fn = gcc_jit_context_new_function(context, ast_node_to_gccloc(node), 
-                                    GCC_JIT_FUNCTION_EXPORTED,
-                                    return_type, ast_funcdec->mangled_name.c_str(),
+                                    kind, return_type, name.c_str(),
                                     v_params.size(), v_params.data(), 0);
     else 
         fn = gcc_jit_context_new_function(context, ast_node_to_gccloc(node), 
-                                    GCC_JIT_FUNCTION_EXPORTED,
-                                    return_type, ast_funcdec->mangled_name.c_str(),
+                                    kind, return_type, name.c_str(),
                                     0, 0, 0);
     DEBUG_ASSERT_NOTNULL(fn);
+    /* Recursive calls in the body call this function */
+    map_fnname_to_gccfnobj[ast_funcdec->mangled_name] = fn;
 
     int block_depth = v_block_terminated.size();
     v_block_terminated.push_back(false);
@@ -2085,7 +2260,7 @@ void jit::walk_tree_fdefi(ast_node *node,
 
     /* Add a new scope and push it with the parameter names. */
      /* TODO: Borde inte behöva detta i compile.cc ... refactor */
-    compilation_units.get_current_objstack().push_new_scope();
+    compilation_units().get_current_objstack().push_new_scope();
 
     for (auto e : ast_parlist->v_defs) {
         auto vardef = dynamic_cast<ast_node_def*>(e);
@@ -2093,26 +2268,256 @@ void jit::walk_tree_fdefi(ast_node *node,
     }
 
     gcc_jit_block *last_block = fn_block;
+
+    int outer_instr_fn_index = instr_fn_index;
+    emit_instr_entry(last_block, node, ast_node_to_gccloc(node));
+
+    /* Count the calls to the function if tiering */
+    int outer_tier_fn_index = tier_fn_index;
+    if (tiering) {
+        tier_fn_index = tier_index(ast_funcdec->mangled_name);
+        emit_tier_counter(&last_block, ast_node_to_gccloc(node));
+    }
+
     gcc_jit_rvalue *rval = nullptr; /* TODO: Inge snyggt skicka denna från en func dec */
     walk_tree(ast_funcdec->code_block, &last_block, &fn, &rval);
     pop_scope();
+    tier_fn_index = outer_tier_fn_index;
 
     /* Pop the function's scope. */
-    compilation_units.get_current_objstack().pop_scope();
-
-    map_fnname_to_gccfnobj[ast_funcdec->mangled_name.c_str()] = fn;
+    compilation_units().get_current_objstack().pop_scope();
 
     v_return_type.pop_back(); /* Pop return type stack */
 
     /* If the return type is void, add a implicit return if there is none */
     if (!v_block_terminated.back() && return_type == VOID_TYPE) {
+        emit_instr_exit(last_block, nullptr, ast_node_to_gccloc(node));
         gcc_jit_block_end_with_void_return(last_block, ast_node_to_gccloc(node));
     }
     v_block_terminated.pop_back();
+    instr_fn_index = outer_instr_fn_index;
 
     /* Check so that we are back to the amount of terminations as when we started. */
     DEBUG_ASSERT(block_depth == v_block_terminated.size(), "Messup in terminations");
+    return fn;
+}
+
+/* With --target-clones each function gets an internal clone per target,
+ * compiled with the target attribute, and a clone for the rest. The
+ * function itself dispatches to them:
+ *
+ *   R name(T1 a1, ...)
+ *   {
+ *       if (!engma_target_clone)
+ *           engma_target_clone = engma_select_target(n, targets) + 1;
+ *       if (engma_target_clone == 1)
+ *           return name_tc_avx2(a1, ...);
+ *       ...
+ *       return name_tc_default(a1, ...);
+ *   }
+ *
+ * libgccjit has no target_clones or ifunc attribute, so the selection is
+ * made on the first call instead, for all functions in the context. */
+gcc_jit_function* jit::emit_target_clones(ast_node *node)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+#ifdef LIBGCCJIT_HAVE_ATTRIBUTES
+    const std::vector<std::string> &targets = opts().target_clones;
+    std::vector<gcc_jit_function*> v_clones;
+    for (const std::string &target : targets) {
+        std::string name = fdef->mangled_name + "_tc_" + target;
+        std::replace(name.begin(), name.end(), '.', '_');
+        std::replace(name.begin(), name.end(), '-', '_');
+        gcc_jit_function *clone = emit_fn(node, name, GCC_JIT_FUNCTION_INTERNAL);
+        std::string attr = target.rfind("x86-64", 0) == 0 ? "arch=" + target : target;
+        gcc_jit_function_add_string_attribute(clone, GCC_JIT_FN_ATTRIBUTE_TARGET, attr.c_str());
+        v_clones.push_back(clone);
+    }
+    gcc_jit_function *default_clone = emit_fn(node, fdef->mangled_name + "_tc_default",
+        GCC_JIT_FUNCTION_INTERNAL);
+
+    gcc_jit_location *loc = ast_node_to_gccloc(node);
+    if (!target_clone_global) {
+        target_clone_global = gcc_jit_context_new_global(context, 0, GCC_JIT_GLOBAL_INTERNAL,
+            types->int_type, "engma_target_clone");
+
+        gcc_jit_type *const_char_ptr_type = gcc_jit_context_get_type(context,
+            GCC_JIT_TYPE_CONST_CHAR_PTR);
+        gcc_jit_param *params[] = {
+            gcc_jit_context_new_param(context, 0, types->int_type, "n"),
+            gcc_jit_context_new_param(context, 0,
+                gcc_jit_type_get_pointer(const_char_ptr_type), "targets")
+        };
+        select_target_fn = gcc_jit_context_new_function(context, 0,
+            GCC_JIT_FUNCTION_IMPORTED, types->int_type, "engma_select_target", 2, params, 0);
+    }
+
+    /* The dispatcher has the clones' parameters */
+    std::vector<gcc_jit_param*> v_params;
+    for (int i = 0; i < gcc_jit_function_get_param_count(default_clone); i++) {
+        gcc_jit_rvalue *param = gcc_jit_param_as_rvalue(gcc_jit_function_get_param(default_clone, i));
+        v_params.push_back(gcc_jit_context_new_param(context, loc,
+            gcc_jit_rvalue_get_type(param), ("a" + std::to_string(i + 1)).c_str()));
+    }
+    gcc_jit_type *return_type = emc_type_to_jit_type(fdef->return_list->value_type);
+    gcc_jit_function *fn = gcc_jit_context_new_function(context, loc,
+        GCC_JIT_FUNCTION_EXPORTED, return_type, fdef->mangled_name.c_str(),
+        v_params.size(), v_params.size() ? v_params.data() : 0, 0);
+    std::vector<gcc_jit_rvalue*> v_args;
+    for (auto param : v_params)
+        v_args.push_back(gcc_jit_param_as_rvalue(param));
+
+    gcc_jit_block *start_block = gcc_jit_function_new_block(fn, new_unique_name("tc_start").c_str());
+    gcc_jit_block *select_block = gcc_jit_function_new_block(fn, new_unique_name("tc_select").c_str());
+    gcc_jit_block *dispatch_block = gcc_jit_function_new_block(fn, new_unique_name("tc_dispatch").c_str());
+
+    gcc_jit_rvalue *selected = gcc_jit_lvalue_as_rvalue(target_clone_global);
+    gcc_jit_block_end_with_conditional(start_block, loc,
+        gcc_jit_context_new_comparison(context, loc, GCC_JIT_COMPARISON_EQ,
+            selected, gcc_jit_context_zero(context, types->int_type)),
+        select_block, dispatch_block);
+
+    /* The target names for engma_select_target() */
+    gcc_jit_type *const_char_ptr_type = gcc_jit_context_get_type(context,
+        GCC_JIT_TYPE_CONST_CHAR_PTR);
+    gcc_jit_lvalue *names = gcc_jit_function_new_local(fn, loc,
+        gcc_jit_context_new_array_type(context, loc, const_char_ptr_type, targets.size()),
+        "targets");
+    for (int i = 0; i < targets.size(); i++)
+        gcc_jit_block_add_assignment(select_block, loc,
+            gcc_jit_context_new_array_access(context, loc, gcc_jit_lvalue_as_rvalue(names),
+                gcc_jit_context_new_rvalue_from_int(context, types->int_type, i)),
+            gcc_jit_context_new_string_literal(context, targets[i].c_str()));
+    gcc_jit_rvalue *select_args[] = {
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, targets.size()),
+        gcc_jit_lvalue_get_address(gcc_jit_context_new_array_access(context, loc,
+            gcc_jit_lvalue_as_rvalue(names), gcc_jit_context_zero(context, types->int_type)), loc)
+    };
+    gcc_jit_block_add_assignment(select_block, loc, target_clone_global,
+        gcc_jit_context_new_binary_op(context, loc, GCC_JIT_BINARY_OP_PLUS, types->int_type,
+            gcc_jit_context_new_call(context, loc, select_target_fn, 2, select_args),
+            gcc_jit_context_one(context, types->int_type)));
+    gcc_jit_block_end_with_jump(select_block, loc, dispatch_block);
+
+    auto end_with_call = [&](gcc_jit_block *block, gcc_jit_function *clone) {
+        gcc_jit_rvalue *call = gcc_jit_context_new_call(context, loc, clone,
+            v_args.size(), v_args.size() ? v_args.data() : 0);
+        if (return_type == VOID_TYPE) {
+            gcc_jit_block_add_eval(block, loc, call);
+            gcc_jit_block_end_with_void_return(block, loc);
+        } else
+            gcc_jit_block_end_with_return(block, loc, call);
+    };
+
+    gcc_jit_block *block = dispatch_block;
+    for (int i = 0; i < v_clones.size(); i++) {
+        gcc_jit_block *call_block = gcc_jit_function_new_block(fn, new_unique_name("tc_call").c_str());
+        gcc_jit_block *next_block = gcc_jit_function_new_block(fn, new_unique_name("tc_next").c_str());
+        gcc_jit_block_end_with_conditional(block, loc,
+            gcc_jit_context_new_comparison(context, loc, GCC_JIT_COMPARISON_EQ, selected,
+                gcc_jit_context_new_rvalue_from_int(context, types->int_type, i + 1)),
+            call_block, next_block);
+        end_with_call(call_block, v_clones[i]);
+        block = next_block;
+    }
+    end_with_call(block, default_clone);
+    return fn;
+#else
+    THROW_USER_ERROR("--target-clones needs libgccjit with function attributes, from GCC 14");
+#endif
+}
+
+/* void name_batch(const T1 *a1, ..., R *out, size_t n)
+ * {
+ *     for (size_t i = 0; i < n; i++)
+ *         out[i] = name(a1[i], ...);
+ * }
+ *
+ * The call is in the same context as the function so GCC can inline it and
+ * vectorize the loop. Functions with non primitive or pointer types or no
+ * return value get none. */
+void jit::emit_batch_wrapper(ast_node *fdef_node, gcc_jit_function *fn)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+    DEBUG_ASSERT_NOTNULL(fn);
+    auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+    DEBUG_ASSERT_NOTNULL(parlist);
+
+    auto is_scalar = [](const emc_type &t) { return t.is_primitive() && !t.n_pointer_indirections; };
+    emc_type return_type = fdef->return_list->value_type;
+    if (!is_scalar(return_type))
+        return;
+    std::vector<emc_type> v_param_types;
+    for (auto e : parlist->v_defs) {
+        if (!is_scalar(e->value_type))
+            return;
+        v_param_types.push_back(e->value_type);
+    }
 
+    /* The parameters are the arrays, then out and n */
+    std::vector<emc_type> v_batch_types;
+    for (auto t : v_param_types) {
+        t.n_pointer_indirections = 1;
+        t.ptr_const_mask = 1;
+        v_batch_types.push_back(t);
+    }
+    emc_type out_type = return_type;
+    out_type.n_pointer_indirections = 1;
+    v_batch_types.push_back(out_type);
+    v_batch_types.push_back(emc_type{emc_types::ULONG});
+
+    std::string batch_name = fdef->c_linkage ? fdef->name + "_batch" :
+        mangle_emc_fn_name(emc_type{emc_types::NONE}, fdef->nspace, fdef->name + "_batch", v_batch_types);
+
+    gcc_jit_location *loc = ast_node_to_gccloc(fdef_node);
+    std::vector<gcc_jit_param*> v_params;
+    for (int i = 0; i < v_param_types.size(); i++) {
+        gcc_jit_type *elem_type = gcc_jit_type_get_const(emc_type_to_jit_type(v_param_types[i]));
+        v_params.push_back(gcc_jit_context_new_param(context, loc,
+            gcc_jit_type_get_pointer(elem_type), ("a" + std::to_string(i + 1)).c_str()));
+    }
+    gcc_jit_param *out = gcc_jit_context_new_param(context, loc,
+        gcc_jit_type_get_pointer(emc_type_to_jit_type(return_type)), "out");
+    gcc_jit_param *n = gcc_jit_context_new_param(context, loc, types->ulong_type, "n");
+    v_params.push_back(out);
+    v_params.push_back(n);
+
+    gcc_jit_function *batch_fn = gcc_jit_context_new_function(context, loc,
+        GCC_JIT_FUNCTION_EXPORTED, types->void_type, batch_name.c_str(),
+        v_params.size(), v_params.data(), 0);
+
+    gcc_jit_block *start_block = gcc_jit_function_new_block(batch_fn, new_unique_name("batch_start").c_str());
+    gcc_jit_block *cond_block = gcc_jit_function_new_block(batch_fn, new_unique_name("batch_cond").c_str());
+    gcc_jit_block *body_block = gcc_jit_function_new_block(batch_fn, new_unique_name("batch_body").c_str());
+    gcc_jit_block *end_block = gcc_jit_function_new_block(batch_fn, new_unique_name("batch_end").c_str());
+
+    gcc_jit_lvalue *i = gcc_jit_function_new_local(batch_fn, loc, types->ulong_type, "i");
+    gcc_jit_block_add_assignment(start_block, loc, i,
+        gcc_jit_context_zero(context, types->ulong_type));
+    gcc_jit_block_end_with_jump(start_block, loc, cond_block);
+
+    gcc_jit_rvalue *i_rval = gcc_jit_lvalue_as_rvalue(i);
+    gcc_jit_block_end_with_conditional(cond_block, loc,
+        gcc_jit_context_new_comparison(context, loc, GCC_JIT_COMPARISON_LT,
+            i_rval, gcc_jit_param_as_rvalue(n)),
+        body_block, end_block);
+
+    std::vector<gcc_jit_rvalue*> v_args;
+    for (int j = 0; j < v_param_types.size(); j++)
+        v_args.push_back(gcc_jit_lvalue_as_rvalue(gcc_jit_context_new_array_access(context, loc,
+            gcc_jit_param_as_rvalue(v_params[j]), i_rval)));
+    gcc_jit_rvalue *call = gcc_jit_context_new_call(context, loc, fn,
+        v_args.size(), v_args.size() ? v_args.data() : 0);
+    gcc_jit_block_add_assignment(body_block, loc,
+        gcc_jit_context_new_array_access(context, loc, gcc_jit_param_as_rvalue(out), i_rval),
+        call);
+    gcc_jit_block_add_assignment_op(body_block, loc, i, GCC_JIT_BINARY_OP_PLUS,
+        gcc_jit_context_one(context, types->ulong_type));
+    gcc_jit_block_end_with_jump(body_block, loc, cond_block);
+
+    gcc_jit_block_end_with_void_return(end_block, loc);
 }
 
 void jit::walk_tree_fdecl(ast_node *node, 
@@ -2186,10 +2591,12 @@ void jit::walk_tree_ret(ast_node *node,
             casted_rval = gcc_jit_context_new_cast(
                 context, ast_node_to_gccloc(node), rval, return_type);
         }
-        
+
+        casted_rval = emit_instr_exit(*current_block, casted_rval, ast_node_to_gccloc(node));
         gcc_jit_block_end_with_return(*current_block, ast_node_to_gccloc(node), casted_rval);
         /* TODO: Ensure there are no more returns in the block ... */
     } else { /* void return */
+        emit_instr_exit(*current_block, nullptr, ast_node_to_gccloc(node));
         gcc_jit_block_end_with_void_return(*current_block, ast_node_to_gccloc(node));
     }
 
@@ -2249,7 +2656,8 @@ void jit::walk_tree_assign(ast_node *node,
     gcc_jit_type *rv_t = gcc_jit_rvalue_get_type(rval);
 
     gcc_jit_rvalue *casted_rval = nullptr;
-    if (lv_as_rv_t == rv_t)
+    /* Structs can't be cast, but one of them might be an aligned field */
+    if (lv_as_rv_t == rv_t || ass_node->first->value_type.is_struct() && !ass_node->first->value_type.is_pointer())
         casted_rval = rval;
     else {
         casted_rval = gcc_jit_context_new_cast(context, ast_node_to_gccloc(node), rval, lv_as_rv_t);
@@ -2297,6 +2705,10 @@ void jit::walk_tree_dotop(  ast_node *node,
 
         if (current_lvalue) /* Caller wants a lvalue */
             *current_lvalue = gcc_jit_lvalue_access_field(left_lv, ast_node_to_gccloc(node), field);
+        else if (!var_dotop->value_type.is_struct() || var_dotop->value_type.is_pointer())
+            /* Cast away an alignment of the field, so the value has the same type as other values */
+            *current_rvalue = cast_to(gcc_jit_rvalue_access_field(left_rv, ast_node_to_gccloc(node), field),
+                                      emc_type_to_jit_type(var_dotop->value_type));
         else /* Caller wants a rvalue */
             *current_rvalue = gcc_jit_rvalue_access_field(left_rv, ast_node_to_gccloc(node), field); 
     } else
@@ -2313,10 +2725,20 @@ void jit::walk_tree_using(  ast_node *node,
 
     DEBUG_ASSERT_NOTNULL(node_t->compunit);
 
+    /* With --coverage, count the unit's statements against its own file */
+    int prev_cov_file = cov_file;
+    if (cov_counts_global) {
+        auto it = std::find(v_cov_files.begin(), v_cov_files.end(), node_t->compunit->file_name);
+        cov_file = it - v_cov_files.begin();
+        if (it == v_cov_files.end())
+            v_cov_files.push_back(node_t->compunit->file_name);
+    }
+
     /* Walk all the ast_node:s in the compilation unit */
     for (ast_node * cu_node : node_t->compunit->v_nodes) {
         walk_tree(cu_node, current_block, current_function, current_rvalue);
     }
+    cov_file = prev_cov_file;
 
 }
 
@@ -2342,6 +2764,12 @@ void jit::walk_tree_deref(  ast_node *node,
     DEBUG_ASSERT_NOTNULL(deref_lv);
     if (current_lvalue) /* Caller wants a lvalue */
         *current_lvalue = deref_lv;
+    else if (var_deref->first->value_type.is_ptr_to_const() &&
+             (!var_deref->value_type.is_struct() || var_deref->value_type.is_pointer()))
+        /* Drop the const of the target, so the value has the same type as other values.
+           Structs can't be cast. */
+        *current_rvalue = gcc_jit_context_new_cast(context, ast_node_to_gccloc(node),
+            gcc_jit_lvalue_as_rvalue(deref_lv), emc_type_to_jit_type(var_deref->value_type));
     else /* Caller wants a rvalue */
         *current_rvalue = gcc_jit_lvalue_as_rvalue(deref_lv);
 }
@@ -2393,18 +2821,42 @@ void jit::walk_tree_type(   ast_node *node,
         auto var_struct = dynamic_cast<ast_node_struct_def*>(var_type->first);
         DEBUG_ASSERT(var_struct != nullptr, "var_struct was null");
 
+        /* With --lazy the struct has to be visible to the contexts of the functions */
+        gcc_jit_context *struct_context = types_context ? types_context : context;
         /* A container to store the gcc_jit struct with its fields and names. */
         struct_wrapper sw;
-        /* Create a c-struct corrensponding to the struct */
-        for (auto e : var_struct->v_fields) {
+
+        /* The order of the fields in memory. With --reorder-fields the most
+           aligned fields come first, so there is no padding between them */
+        auto &v_fields = var_struct->v_fields;
+        std::vector<int> v_order(v_fields.size());
+        std::iota(v_order.begin(), v_order.end(), 0);
+        if (opts().reorder_fields && !var_struct->clinkage)
+            std::stable_sort(v_order.begin(), v_order.end(), [&](int a, int b) {
+                return type_alignment(v_fields[a]->value_type) > type_alignment(v_fields[b]->value_type);
+            });
+
+        /* Create a c-struct corrensponding to the struct. The struct_wrapper has the
+           fields in the declaration order, which e.g. list literals are in. */
+        for (auto e : v_fields) {
             const char *field_name = e->var_name.c_str();
             gcc_jit_type *field_type = emc_type_to_jit_type(e->value_type);
-            gcc_jit_field *field = gcc_jit_context_new_field(context, ast_node_to_gccloc(e), field_type, field_name);
+            /* ALIGN(n) on the struct aligns its first field in memory, which also pads
+               the size to a multiple of n */
+            int alignment = e->alignment;
+            if (e == v_fields[v_order.front()])
+                alignment = std::max(alignment, var_struct->alignment);
+            if (alignment)
+                field_type = gcc_jit_type_get_aligned(field_type, alignment);
+            gcc_jit_field *field = gcc_jit_context_new_field(struct_context, ast_node_to_gccloc(e), field_type, field_name);
             sw.add_field(field_name, field);
         }
-        gcc_jit_struct *str = gcc_jit_context_new_struct_type(context, ast_node_to_gccloc(node), 
+        std::vector<gcc_jit_field*> v_layout;
+        for (int i : v_order)
+            v_layout.push_back(sw.gccjit_fields[i]);
+        gcc_jit_struct *str = gcc_jit_context_new_struct_type(struct_context, ast_node_to_gccloc(node), 
                             walk_tree_type_typename.c_str(), 
-                            sw.gccjit_fields.size(), sw.gccjit_fields.data());
+                            v_layout.size(), v_layout.data());
         sw.gccjit_struct = str;
         sw.name = walk_tree_type_typename;
         /* Add the struct to the structmap */
@@ -2496,6 +2948,10 @@ void jit::walk_tree_def(ast_node *node,
             context, ast_node_to_gccloc(node), GCC_JIT_GLOBAL_EXPORTED,
             var_type,
             ast_def->mangled_name.c_str());
+    /* ALIGN(n) on the variable. Not with gcc_jit_type_get_aligned(), since a
+       variable of its own type would need casts everywhere it is used */
+    if (ast_def->alignment)
+        gcc_jit_lvalue_set_alignment(lval, ast_def->alignment);
 
     push_lval(ast_def->var_name, lval);
 
@@ -2507,19 +2963,22 @@ void jit::walk_tree_def(ast_node *node,
             /* If the rh side is a const expr, e.g. Int a = 2+3 we don't walk the 
                tree but use the compiled value from the ast tree. */
             if (ast_def->value_node->value_type.is_const_expr) {
-                auto rh_obj = ast_def->value_node->value_obj;
-                rv_assignment = obj_to_gcc_literal(rh_obj);
+                auto &rh_value = ast_def->value_node->value;
+                rv_assignment = const_value_to_gcc_literal(rh_value);
                 /* Verify that the const expression fits in the target type (throws).
                    Should be cought in the ast tree but check here anyways */
-                verify_obj_fits_in_type(rh_obj, ast_def->value_type);
+                verify_value_fits_in_type(rh_value, ast_def->value_type);
                 /* Do a forcing cast (since it fits) */
                 cast_rv = gcc_jit_context_new_cast(context, 
                     ast_node_to_gccloc(ast_def->value_node), 
                     rv_assignment, var_type); 
             } else {
                 walk_tree(ast_def->value_node, current_block, current_function, &rv_assignment);
-                /* Cast to the local's type */
-                promote_rval(var_type, rv_assignment, &cast_rv);
+                /* Cast to the local's type. Pointers can only differ in their qualifiers */
+                if (is_pointer)
+                    cast_rv = cast_to(rv_assignment, var_type);
+                else
+                    promote_rval(var_type, rv_assignment, &cast_rv);
             }
             /* Assign the value */
             if (is_file_scope)
@@ -2549,8 +3008,9 @@ void jit::walk_tree_def(ast_node *node,
 
                     gcc_jit_lvalue *field_lv = gcc_jit_lvalue_access_field(lval, 
                         ast_node_to_gccloc(node), field);
-                    gcc_jit_type *field_type = gcc_jit_rvalue_get_type(
-                        gcc_jit_lvalue_as_rvalue(field_lv));
+                    /* Without the field's alignment, that promote_rval() doesn't know */
+                    gcc_jit_type *field_type = emc_type_to_jit_type(
+                        ast_def->value_type.children_types[i]);
 
                     gcc_jit_rvalue *rv_arg = nullptr;
                     gcc_jit_rvalue *rv_arg_casted = nullptr;
@@ -2558,11 +3018,11 @@ void jit::walk_tree_def(ast_node *node,
                     /* If the rh side is a const expr, e.g. Int a = 2+3 we don't walk the 
                        tree but use the compiled value from the ast tree. */
                     if (arglist->v_ast_args[i]->value_type.is_const_expr) {
-                        auto rh_obj = arglist->v_ast_args[i]->value_obj;
-                        rv_arg = obj_to_gcc_literal(rh_obj);
+                        auto &rh_value = arglist->v_ast_args[i]->value;
+                        rv_arg = const_value_to_gcc_literal(rh_value);
                         /* Verify that the const expression fits in the target type (throws).
                            Should be cought in the ast tree but check here anyways */
-                        verify_obj_fits_in_type(rh_obj, ast_def->value_type.children_types[i]);
+                        verify_value_fits_in_type(rh_value, ast_def->value_type.children_types[i]);
                         /* Do a forcing cast (since it fits) */
                         rv_arg_casted = gcc_jit_context_new_cast(context, ast_node_to_gccloc(node), rv_arg, field_type); 
                     } else {
@@ -2646,10 +3106,23 @@ void jit::walk_tree_def(ast_node *node,
 
 gcc_jit_location *jit::ast_node_to_gccloc(const ast_node *node)
 {
-    return gcc_jit_context_new_location (context,
-				  compilation_units.get_current_compilation_unit().file_name.c_str(),
+    /* The locations are only used for debug info */
+    const std::string &debug_flag = opts().debug_flag;
+    if (debug_flag.empty() || debug_flag == "-g0")
+        return nullptr;
+
+    const std::string &file_name = compilation_units().get_current_compilation_unit().file_name;
+    auto it = map_file_to_gcclocs.find(file_name);
+    if (it == map_file_to_gcclocs.end())
+        it = map_file_to_gcclocs.emplace(file_name, decltype(it->second){}).first;
+
+    auto &loc = it->second[{node->loc.first_line, node->loc.first_column}];
+    if (!loc)
+        loc = gcc_jit_context_new_location (context,
+				  file_name.c_str(),
 				  node->loc.first_line,
 				  node->loc.first_column);
+    return loc;
 }
 
 void jit::walk_tree_explist( ast_node *node, 
@@ -2660,7 +3133,13 @@ void jit::walk_tree_explist( ast_node *node,
     auto expl_ast = dynamic_cast<ast_node_explist*>(node);
 
     gcc_jit_rvalue *rval = nullptr;
+    int prev_line = -1;
     for (auto e : expl_ast->v_nodes) {
+        /* With --coverage, count the statement unless it shares a line with the last one */
+        if (e->loc.first_line != prev_line)
+            emit_cov_count(*current_block, e);
+        prev_line = e->loc.first_line;
+
         rval = nullptr;
         gcc_jit_block *last_block = *current_block;
         walk_tree(e, &last_block, current_function, &rval);
@@ -2699,6 +3178,50 @@ void jit::walk_tree_if(ast_node *node,
     auto if_ast = dynamic_cast<ast_node_if*>(node);
     auto elseif_t = dynamic_cast<ast_node_elseiflist*>(if_ast->elseif_el);
 
+    /* Collect the IF and ELSE IF conditions and their blocks. Branches with a
+       constant false condition are dropped. A constant true condition makes its
+       branch the last one, taken like an ELSE but followed by the ALSO. */
+    std::vector<ast_node*> v_cond;
+    std::vector<ast_node*> v_body;
+    ast_node *else_el = if_ast->else_el;
+    bool else_is_if = false;
+    {
+        std::vector<std::pair<ast_node*, ast_node*>> v_branches{{if_ast->cond_e, if_ast->if_el}};
+        if (elseif_t)
+            for (int i = 0; i < elseif_t->v_cond_e.size(); i++)
+                v_branches.push_back({elseif_t->v_cond_e[i], elseif_t->v_elseif[i]});
+
+        for (auto [cond_e, body] : v_branches) {
+            if (cond_e->value_type.is_const_expr && has_value(cond_e->value)) {
+                if (!const_value_to_bool(cond_e->value))
+                    continue;
+                else_el = body;
+                else_is_if = true;
+                break;
+            }
+            v_cond.push_back(cond_e);
+            v_body.push_back(body);
+        }
+    }
+
+    /* If all the conditions are constant, only the taken block is emitted,
+       straight into the current block. */
+    if (v_cond.empty()) {
+        gcc_jit_rvalue *rv = nullptr; /* Discards any rval */
+        if (else_el) {
+            push_scope();
+            walk_tree(else_el, current_block, current_function, &rv);
+            pop_scope();
+        }
+        if (else_is_if && if_ast->also_el && !v_block_terminated.back()) {
+            push_scope();
+            walk_tree(if_ast->also_el, current_block, current_function, &rv);
+            pop_scope();
+        }
+        return;
+    }
+    int n_elseif = v_cond.size() - 1;
+
     bool are_all_ifs_terminated = true; /* Keeps track of if all paths RETURN */
 
     /* Create the if-block */
@@ -2709,16 +3232,14 @@ void jit::walk_tree_if(ast_node *node,
        Both for the else if's condition, and code. */
     std::vector<gcc_jit_block*> v_elseif_block;
     std::vector<gcc_jit_block*> v_elseif_cond_block;
-    if (elseif_t) {
-        for (int i = 0; i < elseif_t->v_elseif.size(); i++)   
-            v_elseif_cond_block.push_back(gcc_jit_function_new_block(*current_function, new_unique_name("elseif_block_cond").c_str()));
-        for (int i = 0; i < elseif_t->v_elseif.size(); i++)   
-            v_elseif_block.push_back(gcc_jit_function_new_block(*current_function, new_unique_name("elseif_block").c_str()));
-    }
+    for (int i = 0; i < n_elseif; i++)   
+        v_elseif_cond_block.push_back(gcc_jit_function_new_block(*current_function, new_unique_name("elseif_block_cond").c_str()));
+    for (int i = 0; i < n_elseif; i++)   
+        v_elseif_block.push_back(gcc_jit_function_new_block(*current_function, new_unique_name("elseif_block").c_str()));
 
     /* If there is a else, create the else block */
     gcc_jit_block *else_block = nullptr;
-    if (if_ast->else_el) 
+    if (else_el) 
         else_block = gcc_jit_function_new_block(*current_function, new_unique_name("else_block").c_str());
 
     /* If there is an also, create the also block */
@@ -2741,7 +3262,7 @@ void jit::walk_tree_if(ast_node *node,
     {
         /* Begin with making the (first) if's conditation rval */
         gcc_jit_rvalue *cond_rv = nullptr;
-        walk_tree(if_ast->cond_e, current_block, current_function, &cond_rv);
+        walk_tree(v_cond[0], current_block, current_function, &cond_rv);
         DEBUG_ASSERT(cond_rv != nullptr, "If condition rvalue is null");
         gcc_jit_rvalue *bool_cond_rv = gcc_jit_context_new_cast(
             context, ast_node_to_gccloc(node),
@@ -2757,23 +3278,22 @@ void jit::walk_tree_if(ast_node *node,
 
         if (v_elseif_block.size())
             if_false_block = v_elseif_cond_block.front();
-        else if (if_ast->else_el)
+        else if (else_el)
             if_false_block = else_block;
         else
             if_false_block = create_after_block_if_needed();
 
         /* Now make a jump from current block to where ever the if condition wanna go */
         gcc_jit_block_end_with_conditional(*current_block, 
-            ast_node_to_gccloc(if_ast->cond_e), 
+            ast_node_to_gccloc(v_cond[0]), 
             bool_cond_rv, if_true_block, if_false_block);
     }
     
     /* Now do the same for each else if-condition, if any */
-    if (elseif_t)
-    for (int i = 0; i < elseif_t->v_cond_e.size(); i++) {
+    for (int i = 0; i < n_elseif; i++) {
         /* Begin with making the if else's conditation rval */
         gcc_jit_rvalue *cond_rv = nullptr;
-        walk_tree(elseif_t->v_cond_e[i], current_block, current_function, &cond_rv);
+        walk_tree(v_cond[i + 1], current_block, current_function, &cond_rv);
         DEBUG_ASSERT(cond_rv != nullptr, "If else condition rvalue is null");
 
         gcc_jit_rvalue *bool_cond_rv = gcc_jit_context_new_cast(
@@ -2789,7 +3309,7 @@ void jit::walk_tree_if(ast_node *node,
         if (i + 1 < v_elseif_block.size())
             if_false_block = v_elseif_cond_block[i + 1];
         /* Otherwise go to the else block, if any */
-        else if (if_ast->else_el)
+        else if (else_el)
             if_false_block = else_block;
         /* Otherwise go to the after block */
         else
@@ -2797,7 +3317,7 @@ void jit::walk_tree_if(ast_node *node,
 
         /* Now make a jump from conditional block to where ever the if else condition wanna go */
         gcc_jit_block_end_with_conditional(v_elseif_cond_block[i], 
-            ast_node_to_gccloc(elseif_t->v_cond_e[i]), 
+            ast_node_to_gccloc(v_cond[i + 1]), 
             bool_cond_rv, if_true_block, if_false_block);
     }
 
@@ -2812,7 +3332,7 @@ void jit::walk_tree_if(ast_node *node,
         gcc_jit_block *last_block = if_block;
         gcc_jit_rvalue *rv = nullptr; /* TODO: Remove */
         push_scope();
-        walk_tree(if_ast->if_el, &last_block, current_function, &rv);
+        walk_tree(v_body[0], &last_block, current_function, &rv);
         pop_scope();
         bool was_terminated = v_block_terminated.back();
         are_all_ifs_terminated = are_all_ifs_terminated && was_terminated;
@@ -2823,20 +3343,19 @@ void jit::walk_tree_if(ast_node *node,
         if (!was_terminated)
             if (if_ast->also_el)
                 gcc_jit_block_end_with_jump(last_block, 
-                    ast_node_to_gccloc(if_ast->if_el), also_block);
+                    ast_node_to_gccloc(v_body[0]), also_block);
             else
                 gcc_jit_block_end_with_jump(last_block, 
-                    ast_node_to_gccloc(if_ast->if_el), create_after_block_if_needed());
+                    ast_node_to_gccloc(v_body[0]), create_after_block_if_needed());
     }
 
     /* Now do the same for all the else if blocks, if any. */
-    if (elseif_t)
-    for (int i = 0; i < elseif_t->v_cond_e.size(); i++) {
+    for (int i = 0; i < n_elseif; i++) {
         v_block_terminated.push_back(false); /* Keeps track of if block is terminated */
         gcc_jit_block *last_block = v_elseif_block[i];
         gcc_jit_rvalue *rv = nullptr; /* TODO: Remove */
         push_scope();
-        walk_tree(elseif_t->v_elseif[i], &last_block, current_function, &rv);
+        walk_tree(v_body[i + 1], &last_block, current_function, &rv);
         pop_scope();
         bool was_terminated = v_block_terminated.back();
         are_all_ifs_terminated = are_all_ifs_terminated && was_terminated;
@@ -2847,29 +3366,38 @@ void jit::walk_tree_if(ast_node *node,
         if (!was_terminated)
             if (if_ast->also_el)
                 gcc_jit_block_end_with_jump(last_block, 
-                    ast_node_to_gccloc(elseif_t), also_block);
+                    ast_node_to_gccloc(v_body[i + 1]), also_block);
             else
                 gcc_jit_block_end_with_jump(last_block, 
-                    ast_node_to_gccloc(elseif_t), create_after_block_if_needed());
+                    ast_node_to_gccloc(v_body[i + 1]), create_after_block_if_needed());
     }
 
     /* Now do the same for the else block, if any */
     bool else_was_terminated = false;
-    if (if_ast->else_el) {
+    if (else_el) {
         v_block_terminated.push_back(false); /* Keeps track of if block is terminated */
         gcc_jit_block *last_block = else_block;
         gcc_jit_rvalue *rv = nullptr; /* TODO: Remove */
         push_scope();
-        walk_tree(if_ast->else_el, &last_block, current_function, &rv);
+        walk_tree(else_el, &last_block, current_function, &rv);
         pop_scope();
         else_was_terminated = v_block_terminated.back();
         v_block_terminated.pop_back();
 
-        /* If the if-block was not terminated, it needs to end with a jump
-       to the also block, if that exists, otherwise to the after block. */
-        if (!else_was_terminated)
+        /* If the else-block was not terminated, it needs to end with a jump
+       to the after block, or to the also block if it is a taken IF. */
+        if (else_is_if) {
+            are_all_ifs_terminated = are_all_ifs_terminated && else_was_terminated;
+            if (!else_was_terminated)
+                if (if_ast->also_el)
+                    gcc_jit_block_end_with_jump(last_block, 
+                        ast_node_to_gccloc(else_el), also_block);
+                else
+                    gcc_jit_block_end_with_jump(last_block, 
+                        ast_node_to_gccloc(else_el), create_after_block_if_needed());
+        } else if (!else_was_terminated)
                 gcc_jit_block_end_with_jump(last_block, 
-                    ast_node_to_gccloc(if_ast->else_el), create_after_block_if_needed());
+                    ast_node_to_gccloc(else_el), create_after_block_if_needed());
     }
 
     /* Now do the same for the also block, if any */
@@ -2896,11 +3424,14 @@ void jit::walk_tree_if(ast_node *node,
     }
     
     bool all_paths_terminated = false;
+    /* If the ELSE is a taken IF all paths go through the IFs and then the ALSO. */
+    if (else_is_if)
+        all_paths_terminated = are_all_ifs_terminated || (if_ast->also_el && also_was_terminated);
     /* If the ALSO and the ELSE are terminated, all paths are no matter the IFs. */
-    if ((if_ast->else_el && else_was_terminated) && (if_ast->also_el && also_was_terminated))
+    else if ((else_el && else_was_terminated) && (if_ast->also_el && also_was_terminated))
         all_paths_terminated = true;
     /* If the ifs and the else are terminated, all paths are terminated. */
-    else if ((if_ast->else_el && else_was_terminated) && are_all_ifs_terminated)
+    else if ((else_el && else_was_terminated) && are_all_ifs_terminated)
         all_paths_terminated = true;
     v_block_terminated.back() = all_paths_terminated;
     /* Set current_block to the after block (which might be null if all paths terminate) */
@@ -2945,13 +3476,30 @@ void jit::walk_tree_while(ast_node *node,
 
     auto while_ast = dynamic_cast<ast_node_while*>(node);
     DEBUG_ASSERT_NOTNULL(while_ast);
+
+    /* With a constant false condition the loop never runs, so only the ELSE
+       is emitted. With a constant true condition the ELSE is never run. */
+    ast_node *else_el = while_ast->else_el;
+    if (while_ast->cond_e->value_type.is_const_expr && has_value(while_ast->cond_e->value)) {
+        if (!const_value_to_bool(while_ast->cond_e->value)) {
+            if (else_el) {
+                gcc_jit_rvalue *rv = nullptr; /* Discards any rval */
+                push_scope();
+                walk_tree(else_el, current_block, current_function, &rv);
+                pop_scope();
+            }
+            return;
+        }
+        else_el = nullptr;
+    }
+
     /* Create the while-block */
     gcc_jit_block_add_comment(*current_block, ast_node_to_gccloc(node), "WHILE");
     
     /* If there is and else block, we need an first cond block that either goes
        to the while block, or goes to the else block. */
     gcc_jit_block *first_cond_block = nullptr;
-    if (while_ast->else_el) /* If there is an else we need a first condition block tested only once */
+    if (else_el) /* If there is an else we need a first condition block tested only once */
         first_cond_block = gcc_jit_function_new_block(*current_function, new_unique_name("first_while_cond_block").c_str());
     
     
@@ -2965,7 +3513,7 @@ void jit::walk_tree_while(ast_node *node,
         return cond_block;
     };
 
-    if (while_ast->else_el) {
+    if (else_el) {
         gcc_jit_block_end_with_jump(*current_block, ast_node_to_gccloc(node), first_cond_block);
     } else 
         gcc_jit_block_end_with_jump(*current_block, ast_node_to_gccloc(node), create_cond_block_if_needed());
@@ -2985,8 +3533,8 @@ void jit::walk_tree_while(ast_node *node,
     gcc_jit_block *last_else_block = else_block;
 
     v_block_terminated.push_back(false);
-    if (while_ast->else_el) {
-        walk_tree(while_ast->else_el, &last_else_block, current_function, &else_rv);
+    if (else_el) {
+        walk_tree(else_el, &last_else_block, current_function, &else_rv);
     }
     bool else_was_terminated = v_block_terminated.back();
     v_block_terminated.pop_back();
@@ -3001,7 +3549,7 @@ void jit::walk_tree_while(ast_node *node,
             gcc_jit_context_new_cast(context, ast_node_to_gccloc(while_ast->cond_e), cond_rv, INT_TYPE),
             BOOL_TYPE);
 
-    if (while_ast->else_el) {
+    if (else_el) {
         gcc_jit_block *after_block = nullptr;
         if (!(while_was_terminated && else_was_terminated)) /* Unless the quite silly while block where all paths return */
             after_block = gcc_jit_function_new_block(*current_function, 
@@ -3016,7 +3564,7 @@ void jit::walk_tree_while(ast_node *node,
             gcc_jit_block_end_with_jump(create_cond_block_if_needed(), ast_node_to_gccloc(while_ast->cond_e), while_block); /* All paths in the while block return. */ 
 
         if (!else_was_terminated)
-            gcc_jit_block_end_with_jump(else_block, ast_node_to_gccloc(while_ast->else_el), after_block);
+            gcc_jit_block_end_with_jump(else_block, ast_node_to_gccloc(else_el), after_block);
         
         if (after_block)            
             *current_block = after_block;
@@ -3027,9 +3575,12 @@ void jit::walk_tree_while(ast_node *node,
         *current_block = else_block;
     }
 
-    /* Unless all paths in the while block are terminted it need to end in an jump back to the cond block. */
-    if (!while_was_terminated)
-        gcc_jit_block_end_with_jump(while_block, ast_node_to_gccloc(while_ast), cond_block);    
+    /* Unless all paths in the while block are terminted it need to end in an jump back to the cond block. 
+       The back edge counts as a call to the function when tiering. */
+    if (!while_was_terminated) {
+        emit_tier_counter(&last_while_block, ast_node_to_gccloc(while_ast));
+        gcc_jit_block_end_with_jump(last_while_block, ast_node_to_gccloc(while_ast), cond_block);
+    }
 }
 
 void jit::walk_tree(ast_node *node, 
@@ -3038,6 +3589,13 @@ void jit::walk_tree(ast_node *node,
         gcc_jit_rvalue **current_rvalue, 
         gcc_jit_lvalue **current_lvalue)
 {
+    /* Folded constant expressions are just literals */
+    if (node->value_type.is_const_expr && has_value(node->value)) {
+        DEBUG_ASSERT_NOTNULL(current_rvalue);
+        *current_rvalue = const_value_to_gcc_literal(node->value);
+        return;
+    }
+
     ast_type type = node->type;
     switch(type) {
     case ast_type::ADD:
@@ -3179,24 +3737,24 @@ void jit::walk_tree(ast_node *node,
 
 void compile_c_obj_files() {
     std::string args = "gcc -c ";
-    for (auto file : opts.nonengma_files)
+    for (auto file : opts().nonengma_files)
         args += file + " ";
 
-    if (opts.outputfile_name.size()) {
-        if (opts.nonengma_files.size() > 1) {
+    if (opts().outputfile_name.size()) {
+        if (opts().nonengma_files.size() > 1) {
             std::cerr << "Multiple files specified together with -o option" <<
             std::endl;
             exit(1);
         }
             
-        args += " -o " + opts.outputfile_name;
+        args += " -o " + opts().outputfile_name;
     }
-    for (std::string lib_arg : opts.L_folders)
+    for (std::string lib_arg : opts().L_folders)
         args += lib_arg + " ";
-    for (std::string lib_arg : opts.l_folders)
+    for (std::string lib_arg : opts().l_folders)
         args += lib_arg + " ";
-    if (opts.debug_flag.size())
-        args += " " + opts.debug_flag + " ";
+    if (opts().debug_flag.size())
+        args += " " + opts().debug_flag + " ";
 
     int status = system(args.c_str());
     if (status) {
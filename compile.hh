@@ -4,8 +4,36 @@
 #include <libgccjit.h>
 #include <vector>
 #include <map>
+#include <set>
 
 #include "emc.hh"
+#include "perf_map.hh"
+
+struct tier_state;
+
+/* map of gccstructobjects to typename for Engma structs */
+struct struct_wrapper {
+    gcc_jit_struct *gccjit_struct = nullptr;
+    std::string name;
+
+    std::vector<std::string> field_names;
+    std::vector<gcc_jit_field*> gccjit_fields; /* In the declaration order */
+
+    void add_field(std::string name, gcc_jit_field* field) 
+    {
+        field_names.push_back(name);
+        gccjit_fields.push_back(field);
+    }
+
+    gcc_jit_field* get_field(std::string name)
+    {
+        DEBUG_ASSERT_NOTNULL(gccjit_struct);
+        for (int i = 0; i < field_names.size(); i++)
+            if (field_names[i] == name)
+                return gccjit_fields[i];
+        THROW_BUG("Struct " + this->name + " has no field " + name);
+    }
+};
 
 
 struct default_types {
@@ -37,6 +65,7 @@ struct default_types {
         ulong_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_UNSIGNED_LONG);
         double_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_DOUBLE);
         void_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_VOID);
+        void_ptr_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_VOID_PTR);
         bool_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_BOOL);
         uchar_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_UNSIGNED_CHAR);
         schar_type = gcc_jit_context_get_type (context, GCC_JIT_TYPE_SIGNED_CHAR);
@@ -76,11 +105,16 @@ class jit {
 public:
     ~jit()
     {
+        end_tiering();
         if (result)
             gcc_jit_result_release(result);
         if (context)
             gcc_jit_context_release(context);
-        delete types;
+        /* The parent context has to outlive its children */
+        if (types_context && !shared_types)
+            gcc_jit_context_release(types_context);
+        if (!shared_types)
+            delete types;
     }
 
     jit()
@@ -89,6 +123,7 @@ public:
         push_scope();
     }
 
+    /* Code and globals of the compiled result by their mangled names */
     void* get_function(std::string name);
     void* get_var(std::string name);
     /* Add a ast node to the root block */
@@ -98,8 +133,18 @@ public:
     void postprocess();
     void compile();
     void execute();
-    void dump(std::string path);
     gcc_jit_type *emc_type_to_jit_type(emc_type t);
+    static void add_target_options(gcc_jit_context *context);
+
+    /* Tiered compilation with -X --tiered and lazy compilation with --lazy,
+       see tiered.cc. execute() starts and stops it. */
+    void start_tiering();
+    void stop_tiering();
+
+    /* The REPL, see repl.cc. Each statement is compiled in its own context
+       and run before the next one is added. */
+    void init_as_repl_root();
+    void run_repl_statement(ast_node *node);
 private:
     gcc_jit_result *result = nullptr;
     gcc_jit_context *context = nullptr;
@@ -111,13 +156,22 @@ private:
     void setup_default_root_environment();
 
     default_types *types = nullptr;
+    bool shared_types = false; /* types and types_context belong to another jit object */
+    /* With --lazy and in the REPL the types and structs are put in this
+       context, which the contexts with code are children of. */
+    gcc_jit_context *types_context = nullptr;
     std::map<std::string, gcc_jit_type*> map_typename_to_gcctypeobj;
 
     std::map<std::string, gcc_jit_function*> map_fnname_to_gccfnobj;
     int call_depth = 0;
 
     
+    /* Null unless compiling with debug info. The locations are interned per
+       file, line and column since libgccjit records each one it is given. */
     gcc_jit_location *ast_node_to_gccloc(const ast_node *node);
+    /* The Engma functions defined in the context, for --perf-map */
+    std::vector<perf_map_fn> v_perf_fns;
+    std::map<std::string, std::map<std::pair<int, int>, gcc_jit_location*>> map_file_to_gcclocs;
 
     /* Cast a and b according to promotion rules. The casted values can be
      * pointing to the original rvalues if no cast was done. 
@@ -157,14 +211,14 @@ private:
 
     void push_scope()
     {
-        compilation_units.get_current_objstack().push_new_scope();
+        compilation_units().get_current_objstack().push_new_scope();
         v_of_map_of_varname_to_lval.push_back(
                 (std::map<std::string, gcc_jit_lvalue*>){});
     }
 
     void pop_scope()
     {
-        compilation_units.get_current_objstack().pop_scope();
+        compilation_units().get_current_objstack().pop_scope();
         v_of_map_of_varname_to_lval.pop_back();
     }
 
@@ -181,8 +235,95 @@ private:
 
     std::vector<std::string> v_node_fn_names;
 
-    gcc_jit_rvalue* obj_to_gcc_literal(obj* obj);
+    std::map<std::string, struct_wrapper> map_structtypename_to_gccstructobj;
+    std::vector<gcc_jit_type*> v_return_type; /* Stack to keep track of return type of function defs. */
+    std::vector<bool> v_block_terminated;     /* To keep track off if the block was terminated depper in the tree. */
+    std::vector<gcc_jit_lvalue*> andchain_lvals;
+
+    long unique_name_counter = 0;
+    std::string new_unique_name(std::string prefix = "");
+
+    gcc_jit_rvalue* const_value_to_gcc_literal(const const_value &value);
+
+    /* Tiered compilation. tiering is set in the tier 0 context, which calls
+     * Engma functions through a table and counts calls and loop iterations.
+     * tier_parent is set in the contexts that recompile hot functions. */
+    tier_state *tiering = nullptr;
+    tier_state *tier_parent = nullptr;
+    int tier_fn_index = -1; /* Table index of the function being walked */
+    gcc_jit_lvalue *tier_table_global = nullptr;
+    gcc_jit_lvalue *tier_counters_global = nullptr;
+    gcc_jit_lvalue *tier_hook_global = nullptr;
+    /* Lazy compilation with --lazy. The root context has a stub for each
+     * Engma function that compiles the function on the first call. */
+    bool lazy = false;
+    gcc_jit_lvalue *lazy_hook_global = nullptr;
+    /* Set in the context of a REPL statement */
+    bool repl = false;
+
+    struct tier_signature {
+        gcc_jit_type *fn_ptr_type = nullptr;
+        std::vector<gcc_jit_type*> v_param_types;
+    };
+    std::map<std::string, tier_signature> map_fnname_to_tier_signature;
+
+    void init_tiering();
+    void end_tiering();
+    void init_as_tier_context(tier_state *parent);
+    void tier_record_node(ast_node *node);
+    void add_tier_node(ast_node *node, const std::set<std::string> &hot_fns);
+    static void tier_worker(tier_state *state);
+    static int compile_tier_fns(tier_state *state, const std::set<std::string> &fns,
+                                const std::string &optimization_level);
+    static void* lazy_compile(tier_state *state, int index);
+    void emit_lazy_stub(ast_node *fdef_node);
+    int tier_index(const std::string &mangled_name);
+    const tier_signature& get_tier_signature(ast_node *fdef_node);
+    void emit_tier_counter(gcc_jit_block **current_block, gcc_jit_location *loc);
+    gcc_jit_rvalue* tier_call(ast_node *fdef_node, std::vector<gcc_jit_rvalue*> &v_args, gcc_jit_location *loc);
+    gcc_jit_lvalue* tier_global(gcc_jit_type *type, const std::string &mangled_name, gcc_jit_location *loc);
+    static void* tier_lookup(tier_state *state, const std::string &name, bool global);
+    gcc_jit_rvalue* repl_call(ast_node *fdef_node, std::vector<gcc_jit_rvalue*> &v_args, gcc_jit_location *loc);
+    gcc_jit_lvalue* repl_global(const std::string &name);
+    bool repl_declare_fn(const std::string &mangled_name);
+    gcc_jit_rvalue* tier_call_imported(gcc_jit_function *func, const std::string &mangled_name, std::vector<gcc_jit_rvalue*> &v_args, gcc_jit_location *loc);
     
+    /* Function level instrumentation with --instrument, see instrument.cc */
+    int instr_mode = -1;            /* engma_instr_mode, -1 when not instrumenting */
+    int instr_fn_index = -1;        /* Index of the function being walked */
+    std::vector<std::string> v_instr_fn_names;
+    gcc_jit_lvalue *instr_counts_global = nullptr;
+    gcc_jit_function *instr_enter_fn = nullptr;
+    gcc_jit_function *instr_exit_fn = nullptr;
+
+    void init_instrument();
+    void emit_instr_entry(gcc_jit_block *block, ast_node *fdef_node, gcc_jit_location *loc);
+    gcc_jit_rvalue* emit_instr_exit(gcc_jit_block *block, gcc_jit_rvalue *ret, gcc_jit_location *loc);
+    void emit_instr_init(gcc_jit_block *block);
+
+    /* Line counts with --coverage, also in instrument.cc */
+    gcc_jit_lvalue *cov_counts_global = nullptr;
+    std::vector<std::string> v_cov_files;   /* The main file and the USING:ed ones */
+    int cov_file = 0;                       /* Index of the file being walked */
+    std::map<std::pair<int, int>, int> map_cov_slots; /* (file, line) to index in counts */
+
+    void init_coverage();
+    void emit_cov_count(gcc_jit_block *block, ast_node *node);
+    void emit_cov_init(gcc_jit_block *block);
+
+    /* The function of a function definition, also used for each clone */
+    gcc_jit_function* emit_fn(ast_node *fdef_node, const std::string &name,
+                              enum gcc_jit_function_kind kind);
+
+    /* Function multiversioning with --target-clones */
+    gcc_jit_lvalue *target_clone_global = nullptr; /* Selected clone + 1, 0 until the first call */
+    gcc_jit_function *select_target_fn = nullptr;
+    gcc_jit_function* emit_target_clones(ast_node *fdef_node);
+
+    /* With --batch-wrappers, name_batch(const T1 *a1, ..., R *out, size_t n)
+       for functions of primitives */
+    void emit_batch_wrapper(ast_node *fdef_node, gcc_jit_function *fn);
+
     /* walk_tree(node, current_block, current_function, current_rvalue); */
     void walk_tree(ast_node *node, 
         gcc_jit_block **current_block,
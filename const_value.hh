@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <variant>
+
+/* The value of a constant expression, stored inline in the ast nodes.
+ *
+ * The alternative held has the C type of the node's value type, e.g.
+ * int32_t for an Int. std::monostate means that there is no value.
+ */
+typedef std::variant<
+    std::monostate,
+    int64_t,
+    int32_t,
+    int16_t,
+    int8_t,
+    uint64_t,
+    uint32_t,
+    uint16_t,
+    uint8_t,
+    double,
+    float,
+    bool> const_value;
+
+inline bool has_value(const const_value &value)
+{
+    return !std::holds_alternative<std::monostate>(value);
+}
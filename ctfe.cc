@@ -0,0 +1,789 @@
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "emc.hh"
+#include "ctfe.hh"
+
+/* The interpreter mirrors the semantics of the code jit::walk_tree_*() emits,
+ * i.e. C semantics for the operators with the casts done the same way.
+ * Anything the interpreter does not know how to do, or that would be
+ * undefined behaviour in C, like signed overflow, aborts the evaluation
+ * and the call is done at runtime instead. */
+
+namespace {
+
+/* Thrown to abort an evaluation. Never escapes ctfe_eval_call(). */
+struct ctfe_abort {};
+
+struct ctfe_value {
+    emc_types type = emc_types::INVALID;
+    union {
+        int64_t i;  /* LONG, INT, SHORT, SBYTE */
+        uint64_t u; /* ULONG, UINT, USHORT, BYTE */
+        double d;
+        float f;
+    };
+    ctfe_value() : i(0) {}
+};
+
+struct ctfe_var {
+    std::string name;
+    ctfe_value val;
+    bool is_initialized;
+};
+
+/* One frame per Engma function call. */
+struct ctfe_frame {
+    std::vector<ctfe_var> vars;
+    std::vector<size_t> scope_marks;
+    ctfe_value ret;
+};
+
+bool is_signed_int(emc_types t)
+{
+    return t == emc_types::LONG || t == emc_types::INT ||
+           t == emc_types::SHORT || t == emc_types::SBYTE;
+}
+
+bool is_unsigned_int(emc_types t)
+{
+    return t == emc_types::ULONG || t == emc_types::UINT ||
+           t == emc_types::USHORT || t == emc_types::BYTE;
+}
+
+bool is_floating(emc_types t)
+{
+    return t == emc_types::DOUBLE || t == emc_types::FLOAT;
+}
+
+bool is_arithmetic(const emc_type &t)
+{
+    return !t.is_pointer() &&
+        (is_signed_int(t.type) || is_unsigned_int(t.type) || is_floating(t.type));
+}
+
+/* Wraps the value to the width of the type, as a C cast does. */
+ctfe_value make_signed(emc_types t, int64_t v)
+{
+    ctfe_value ans;
+    ans.type = t;
+    switch (t) {
+    case emc_types::LONG:  ans.i = v; break;
+    case emc_types::INT:   ans.i = (int32_t)v; break;
+    case emc_types::SHORT: ans.i = (int16_t)v; break;
+    case emc_types::SBYTE: ans.i = (int8_t)v; break;
+    default: THROW_BUG("");
+    }
+    return ans;
+}
+
+ctfe_value make_unsigned(emc_types t, uint64_t v)
+{
+    ctfe_value ans;
+    ans.type = t;
+    switch (t) {
+    case emc_types::ULONG:  ans.u = v; break;
+    case emc_types::UINT:   ans.u = (uint32_t)v; break;
+    case emc_types::USHORT: ans.u = (uint16_t)v; break;
+    case emc_types::BYTE:   ans.u = (uint8_t)v; break;
+    default: THROW_BUG("");
+    }
+    return ans;
+}
+
+ctfe_value make_double(double d)
+{
+    ctfe_value ans;
+    ans.type = emc_types::DOUBLE;
+    ans.d = d;
+    return ans;
+}
+
+ctfe_value make_float(float f)
+{
+    ctfe_value ans;
+    ans.type = emc_types::FLOAT;
+    ans.f = f;
+    return ans;
+}
+
+ctfe_value make_int(int32_t i)
+{
+    return make_signed(emc_types::INT, i);
+}
+
+int64_t signed_lowest(emc_types t)
+{
+    switch (t) {
+    case emc_types::LONG:  return std::numeric_limits<int64_t>::lowest();
+    case emc_types::INT:   return std::numeric_limits<int32_t>::lowest();
+    case emc_types::SHORT: return std::numeric_limits<int16_t>::lowest();
+    case emc_types::SBYTE: return std::numeric_limits<int8_t>::lowest();
+    default: THROW_BUG("");
+    }
+}
+
+int64_t signed_max(emc_types t)
+{
+    switch (t) {
+    case emc_types::LONG:  return std::numeric_limits<int64_t>::max();
+    case emc_types::INT:   return std::numeric_limits<int32_t>::max();
+    case emc_types::SHORT: return std::numeric_limits<int16_t>::max();
+    case emc_types::SBYTE: return std::numeric_limits<int8_t>::max();
+    default: THROW_BUG("");
+    }
+}
+
+uint64_t unsigned_max(emc_types t)
+{
+    switch (t) {
+    case emc_types::ULONG:  return std::numeric_limits<uint64_t>::max();
+    case emc_types::UINT:   return std::numeric_limits<uint32_t>::max();
+    case emc_types::USHORT: return std::numeric_limits<uint16_t>::max();
+    case emc_types::BYTE:   return std::numeric_limits<uint8_t>::max();
+    default: THROW_BUG("");
+    }
+}
+
+/* Signed overflow is UB in the emitted code so it aborts */
+ctfe_value make_signed_checked(emc_types t, ast_type op, int64_t a, int64_t b)
+{
+    int64_t v;
+    bool overflow;
+    switch (op) {
+    case ast_type::ADD: overflow = __builtin_add_overflow(a, b, &v); break;
+    case ast_type::SUB: overflow = __builtin_sub_overflow(a, b, &v); break;
+    case ast_type::MUL: overflow = __builtin_mul_overflow(a, b, &v); break;
+    default: THROW_BUG("");
+    }
+    if (overflow || v < signed_lowest(t) || v > signed_max(t))
+        throw ctfe_abort{};
+    return make_signed(t, v);
+}
+
+double to_double(const ctfe_value &v)
+{
+    if (is_signed_int(v.type))
+        return (double)v.i;
+    else if (is_unsigned_int(v.type))
+        return (double)v.u;
+    else if (v.type == emc_types::DOUBLE)
+        return v.d;
+    else if (v.type == emc_types::FLOAT)
+        return v.f;
+    throw ctfe_abort{};
+}
+
+/* Convert like a C cast. Floating point values out of range for an integer
+   type is undefined behaviour in C, so those abort. */
+ctfe_value convert(const ctfe_value &v, emc_types t)
+{
+    if (v.type == t)
+        return v;
+
+    if (t == emc_types::DOUBLE)
+        return make_double(to_double(v));
+    if (t == emc_types::FLOAT) {
+        if (is_signed_int(v.type))
+            return make_float((float)v.i);
+        else if (is_unsigned_int(v.type))
+            return make_float((float)v.u);
+        return make_float((float)to_double(v));
+    }
+    if (is_signed_int(t)) {
+        if (is_signed_int(v.type))
+            return make_signed(t, v.i);
+        else if (is_unsigned_int(v.type))
+            return make_signed(t, (int64_t)v.u);
+        double d = to_double(v);
+        if (!(d > (double)signed_lowest(t) - 1. && d < (double)signed_max(t) + 1.))
+            throw ctfe_abort{};
+        return make_signed(t, (int64_t)d);
+    }
+    if (is_unsigned_int(t)) {
+        if (is_signed_int(v.type))
+            return make_unsigned(t, (uint64_t)v.i);
+        else if (is_unsigned_int(v.type))
+            return make_unsigned(t, v.u);
+        double d = to_double(v);
+        if (!(d > -1. && d < (double)unsigned_max(t) + 1.))
+            throw ctfe_abort{};
+        return make_unsigned(t, (uint64_t)d);
+    }
+    throw ctfe_abort{};
+}
+
+/* Conditions are cast to Int and then Bool, as in walk_tree_if() */
+bool to_bool(const ctfe_value &v)
+{
+    return convert(v, emc_types::INT).i != 0;
+}
+
+ctfe_value from_const_value(const const_value &value)
+{
+    return std::visit([](auto v) -> ctfe_value {
+        using V = decltype(v);
+
+        if constexpr (std::is_same_v<V, int64_t>)
+            return make_signed(emc_types::LONG, v);
+        else if constexpr (std::is_same_v<V, int32_t>)
+            return make_signed(emc_types::INT, v);
+        else if constexpr (std::is_same_v<V, int16_t>)
+            return make_signed(emc_types::SHORT, v);
+        else if constexpr (std::is_same_v<V, int8_t>)
+            return make_signed(emc_types::SBYTE, v);
+        else if constexpr (std::is_same_v<V, uint64_t>)
+            return make_unsigned(emc_types::ULONG, v);
+        else if constexpr (std::is_same_v<V, uint32_t>)
+            return make_unsigned(emc_types::UINT, v);
+        else if constexpr (std::is_same_v<V, uint16_t>)
+            return make_unsigned(emc_types::USHORT, v);
+        else if constexpr (std::is_same_v<V, uint8_t>)
+            return make_unsigned(emc_types::BYTE, v);
+        else if constexpr (std::is_same_v<V, double>)
+            return make_double(v);
+        else if constexpr (std::is_same_v<V, float>)
+            return make_float(v);
+        else
+            throw ctfe_abort{};
+    }, value);
+}
+
+const_value to_const_value(const ctfe_value &v)
+{
+    switch (v.type) {
+    case emc_types::LONG:   return (int64_t)v.i;
+    case emc_types::INT:    return (int32_t)v.i;
+    case emc_types::SHORT:  return (int16_t)v.i;
+    case emc_types::SBYTE:  return (int8_t)v.i;
+    case emc_types::ULONG:  return (uint64_t)v.u;
+    case emc_types::UINT:   return (uint32_t)v.u;
+    case emc_types::USHORT: return (uint16_t)v.u;
+    case emc_types::BYTE:   return (uint8_t)v.u;
+    case emc_types::DOUBLE: return v.d;
+    case emc_types::FLOAT:  return v.f;
+    default: THROW_BUG("");
+    }
+}
+
+/* The integer POW is folded the same way as in ast_node_bin_op::make_value() */
+template<class T>
+T checked_pow(T a, T b)
+{
+    double p = pow((double)a, (double)b);
+    if (!(p >= (double)std::numeric_limits<T>::lowest() &&
+          p <= (double)std::numeric_limits<T>::max()) ||
+        p < -9007199254740992. || p > 9007199254740992.)
+        throw ctfe_abort{};
+    return (T)p;
+}
+
+ctfe_value binary_op(ast_type op, ctfe_value a, ctfe_value b, emc_types t)
+{
+    a = convert(a, t);
+    b = convert(b, t);
+
+    if (is_signed_int(t)) {
+        switch (op) {
+        case ast_type::ADD:
+        case ast_type::SUB:
+        case ast_type::MUL:
+            return make_signed_checked(t, op, a.i, b.i);
+        case ast_type::INTDIV:
+        case ast_type::REM:
+            /* Would trap at runtime */
+            if (b.i == 0)
+                throw ctfe_abort{};
+            if (a.i == signed_lowest(t) && b.i == -1)
+                throw ctfe_abort{};
+            if (op == ast_type::INTDIV)
+                return make_signed(t, a.i / b.i);
+            return make_signed(t, a.i % b.i);
+        case ast_type::POW:
+            return make_signed(t, checked_pow<int64_t>(a.i, b.i));
+        default:
+            throw ctfe_abort{};
+        }
+    } else if (is_unsigned_int(t)) {
+        switch (op) {
+        case ast_type::ADD: return make_unsigned(t, a.u + b.u);
+        case ast_type::SUB: return make_unsigned(t, a.u - b.u);
+        case ast_type::MUL: return make_unsigned(t, a.u * b.u);
+        case ast_type::INTDIV:
+            if (b.u == 0)
+                throw ctfe_abort{};
+            return make_unsigned(t, a.u / b.u);
+        case ast_type::REM:
+            if (b.u == 0)
+                throw ctfe_abort{};
+            return make_unsigned(t, a.u % b.u);
+        case ast_type::POW:
+            return make_unsigned(t, checked_pow<uint64_t>(a.u, b.u));
+        default:
+            throw ctfe_abort{};
+        }
+    } else if (t == emc_types::DOUBLE) {
+        switch (op) {
+        case ast_type::ADD: return make_double(a.d + b.d);
+        case ast_type::SUB: return make_double(a.d - b.d);
+        case ast_type::MUL: return make_double(a.d * b.d);
+        case ast_type::RDIV: return make_double(a.d / b.d);
+        case ast_type::INTDIV: return make_double(floor(a.d / b.d));
+        case ast_type::REM: return make_double(fmod(a.d, b.d));
+        case ast_type::POW: return make_double(pow(a.d, b.d));
+        default:
+            throw ctfe_abort{};
+        }
+    } else if (t == emc_types::FLOAT) {
+        switch (op) {
+        case ast_type::ADD: return make_float(a.f + b.f);
+        case ast_type::SUB: return make_float(a.f - b.f);
+        case ast_type::MUL: return make_float(a.f * b.f);
+        case ast_type::RDIV: return make_float(a.f / b.f);
+        case ast_type::INTDIV: return make_float(floorf(a.f / b.f));
+        case ast_type::REM: return make_float(fmodf(a.f, b.f));
+        case ast_type::POW: return make_float(powf(a.f, b.f));
+        default:
+            throw ctfe_abort{};
+        }
+    }
+    throw ctfe_abort{};
+}
+
+/* Same promotions as jit::promote_rvals_for_compare() */
+emc_types compare_type(emc_types at, emc_types bt)
+{
+    using T = emc_types;
+
+    if (at == bt)
+        return at;
+    else if (at == T::ULONG && is_signed_int(bt) || bt == T::ULONG && is_signed_int(at))
+        throw ctfe_abort{};
+    else if (at == T::DOUBLE || bt == T::DOUBLE)
+        return T::DOUBLE;
+    else if (at == T::FLOAT || bt == T::FLOAT)
+        return T::FLOAT;
+    else if (at == T::LONG || bt == T::LONG ||
+             at == T::INT && bt == T::UINT || bt == T::INT && at == T::UINT)
+        return T::LONG;
+    else if (at == T::INT || bt == T::INT ||
+             at == T::SHORT && bt == T::USHORT || bt == T::SHORT && at == T::USHORT)
+        return T::INT;
+    else if (at == T::SHORT || bt == T::SHORT ||
+             at == T::SBYTE && bt == T::BYTE || bt == T::SBYTE && at == T::BYTE)
+        return T::SHORT;
+    else if (at == T::SBYTE || bt == T::SBYTE)
+        return T::SBYTE;
+    else if (at == T::ULONG || bt == T::ULONG)
+        return T::ULONG;
+    else if (at == T::UINT || bt == T::UINT)
+        return T::UINT;
+    else if (at == T::USHORT || bt == T::USHORT)
+        return T::USHORT;
+    else if (at == T::BYTE || bt == T::BYTE)
+        return T::BYTE;
+    throw ctfe_abort{};
+}
+
+bool compare(ast_type op, ctfe_value a, ctfe_value b)
+{
+    emc_types t = compare_type(a.type, b.type);
+    a = convert(a, t);
+    b = convert(b, t);
+
+    /* -1, 0 or 1. Unordered (NaN) compares are handled separately. */
+    int c;
+    if (is_signed_int(t))
+        c = a.i < b.i ? -1 : a.i > b.i;
+    else if (is_unsigned_int(t))
+        c = a.u < b.u ? -1 : a.u > b.u;
+    else {
+        double da = to_double(a), db = to_double(b);
+        if (std::isnan(da) || std::isnan(db))
+            return op == ast_type::NEQ;
+        c = da < db ? -1 : da > db;
+    }
+
+    switch (op) {
+    case ast_type::LES: return c < 0;
+    case ast_type::GRE: return c > 0;
+    case ast_type::LEQ: return c <= 0;
+    case ast_type::GEQ: return c >= 0;
+    case ast_type::EQU: return c == 0;
+    case ast_type::NEQ: return c != 0;
+    default: throw ctfe_abort{};
+    }
+}
+
+class ctfe_interpreter {
+public:
+    long n_steps = 0;
+    long max_steps = opts().ctfe_max_steps;
+    long n_vars = 0;
+    std::vector<ctfe_frame> frames;
+
+    ctfe_value call(ast_node_funcdef *fdef, const std::vector<ctfe_value> &args)
+    {
+        /* The first frame is the one the arguments of the outermost call
+           are evaluated in, so it does not count. The return type is not
+           resolved while the body is, e.g. for a recursive call with
+           constant arguments. */
+        if (!fdef || fdef->value_type.type != emc_types::FUNCTION ||
+            frames.size() > opts().ctfe_max_depth)
+            throw ctfe_abort{};
+        auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+        DEBUG_ASSERT_NOTNULL(parlist);
+        if (parlist->v_defs.size() != args.size())
+            throw ctfe_abort{};
+        emc_type ret_type = fdef->return_list->value_type;
+        if (!is_arithmetic(ret_type))
+            throw ctfe_abort{};
+
+        frames.push_back({});
+        for (int i = 0; i < args.size(); i++) {
+            auto par = dynamic_cast<ast_node_def*>(parlist->v_defs[i]);
+            DEBUG_ASSERT_NOTNULL(par);
+            if (!is_arithmetic(par->value_type))
+                throw ctfe_abort{};
+            push_var(par->var_name, convert(args[i], par->value_type.type), true);
+        }
+
+        /* A function with a return type that does not RETURN is UB */
+        if (!exec(fdef->code_block))
+            throw ctfe_abort{};
+
+        ctfe_value ret = convert(frames.back().ret, ret_type.type);
+        n_vars -= frames.back().vars.size();
+        frames.pop_back();
+        return ret;
+    }
+
+    ctfe_value eval_call(ast_node_funccall *call_node)
+    {
+        auto arg_list = dynamic_cast<ast_node_arglist*>(call_node->arg_list);
+        DEBUG_ASSERT_NOTNULL(arg_list);
+
+        std::vector<ctfe_value> args;
+        for (auto arg : arg_list->v_ast_args)
+            args.push_back(eval(arg));
+
+        return call(dynamic_cast<ast_node_funcdef*>(call_node->fdef_node), args);
+    }
+
+private:
+    void step()
+    {
+        if (++n_steps > max_steps)
+            throw ctfe_abort{};
+    }
+
+    void push_scope()
+    {
+        frames.back().scope_marks.push_back(frames.back().vars.size());
+    }
+
+    void pop_scope()
+    {
+        auto &frame = frames.back();
+        size_t mark = frame.scope_marks.back();
+        frame.scope_marks.pop_back();
+        n_vars -= frame.vars.size() - mark;
+        frame.vars.resize(mark);
+    }
+
+    void push_var(std::string name, ctfe_value val, bool is_initialized)
+    {
+        if (++n_vars > opts().ctfe_max_memory)
+            throw ctfe_abort{};
+        frames.back().vars.push_back({name, val, is_initialized});
+    }
+
+    /* Only the current frame is searched. A miss means a global. */
+    ctfe_var& find_var(ast_node *node)
+    {
+        auto var = dynamic_cast<ast_node_var*>(node);
+        if (!var || var->nspace.size() || frames.empty())
+            throw ctfe_abort{};
+        auto &vars = frames.back().vars;
+        for (auto it = vars.rbegin(); it != vars.rend(); it++)
+            if (it->name == var->name)
+                return *it;
+        throw ctfe_abort{};
+    }
+
+    /* Executes the node in a new scope. */
+    bool exec_scoped(ast_node *node)
+    {
+        push_scope();
+        bool returned = exec(node);
+        pop_scope();
+        return returned;
+    }
+
+    /* Executes a statement. Returns true if a RETURN was executed. */
+    bool exec(ast_node *node)
+    {
+        step();
+
+        switch (node->type) {
+        case ast_type::EXPLIST: {
+            auto t_node = dynamic_cast<ast_node_explist*>(node);
+            for (auto e : t_node->v_nodes)
+                if (exec(e))
+                    return true;
+            return false;
+        }
+        case ast_type::DOBLOCK:
+            return exec_scoped(dynamic_cast<ast_node_doblock*>(node)->first);
+        case ast_type::IF: {
+            auto t_node = dynamic_cast<ast_node_if*>(node);
+            auto elseif_t = dynamic_cast<ast_node_elseiflist*>(t_node->elseif_el);
+            bool taken = false;
+
+            if (to_bool(eval(t_node->cond_e))) {
+                taken = true;
+                if (exec_scoped(t_node->if_el))
+                    return true;
+            } else if (elseif_t) {
+                for (int i = 0; i < elseif_t->v_cond_e.size(); i++) {
+                    if (to_bool(eval(elseif_t->v_cond_e[i]))) {
+                        taken = true;
+                        if (exec_scoped(elseif_t->v_elseif[i]))
+                            return true;
+                        break;
+                    }
+                }
+            }
+            if (!taken && t_node->else_el)
+                if (exec_scoped(t_node->else_el))
+                    return true;
+            /* ALSO is done if any of the IFs was */
+            if (taken && t_node->also_el)
+                if (exec_scoped(t_node->also_el))
+                    return true;
+            return false;
+        }
+        case ast_type::WHILE: {
+            auto t_node = dynamic_cast<ast_node_while*>(node);
+            bool has_looped = false;
+            while (to_bool(eval(t_node->cond_e))) {
+                has_looped = true;
+                if (exec_scoped(t_node->if_el))
+                    return true;
+            }
+            /* The ELSE is done if the loop never was */
+            if (!has_looped && t_node->else_el)
+                return exec_scoped(t_node->else_el);
+            return false;
+        }
+        case ast_type::RETURN: {
+            auto t_node = dynamic_cast<ast_node_return*>(node);
+            if (!t_node->first)
+                throw ctfe_abort{};
+            frames.back().ret = eval(t_node->first);
+            return true;
+        }
+        case ast_type::DEF: {
+            auto t_node = dynamic_cast<ast_node_def*>(node);
+            if (!is_arithmetic(t_node->value_type))
+                throw ctfe_abort{};
+            ctfe_value val;
+            val.type = t_node->value_type.type;
+            if (t_node->value_node)
+                val = convert(eval(t_node->value_node), t_node->value_type.type);
+            push_var(t_node->var_name, val, t_node->value_node != nullptr);
+            return false;
+        }
+        default:
+            eval(node);
+            return false;
+        }
+    }
+
+public:
+    ctfe_value eval(ast_node *node)
+    {
+        step();
+
+        switch (node->type) {
+        case ast_type::INT_LITERAL:
+            return make_int(dynamic_cast<ast_node_int_literal*>(node)->i);
+        case ast_type::DOUBLE_LITERAL:
+            return make_double(dynamic_cast<ast_node_double_literal*>(node)->d);
+        default:
+            break;
+        }
+
+        /* Use the value of already folded nodes */
+        if (node->value_type.is_const_expr && has_value(node->value))
+            return convert(from_const_value(node->value), node->value_type.type);
+
+        switch (node->type) {
+        case ast_type::VAR: {
+            auto &var = find_var(node);
+            if (!var.is_initialized)
+                throw ctfe_abort{};
+            return var.val;
+        }
+        case ast_type::ASSIGN: {
+            auto t_node = dynamic_cast<ast_node_assign*>(node);
+            ctfe_value val = eval(t_node->sec);
+            auto &var = find_var(t_node->first);
+            var.val = convert(val, var.val.type);
+            var.is_initialized = true;
+            return var.val;
+        }
+        case ast_type::ADD:
+        case ast_type::SUB:
+        case ast_type::MUL:
+        case ast_type::RDIV:
+        case ast_type::INTDIV:
+        case ast_type::REM:
+        case ast_type::POW: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            ctfe_value a = eval(t_node->first);
+            ctfe_value b = eval(t_node->sec);
+            return binary_op(node->type, a, b, node->value_type.type);
+        }
+        case ast_type::UMINUS: {
+            auto t_node = dynamic_cast<ast_node_uminus*>(node);
+            emc_types t = node->value_type.type;
+            ctfe_value a = convert(eval(t_node->first), t);
+            if (is_signed_int(t))
+                return make_signed_checked(t, ast_type::SUB, 0, a.i);
+            else if (is_unsigned_int(t))
+                return make_unsigned(t, 0 - a.u);
+            else if (t == emc_types::DOUBLE)
+                return make_double(-a.d);
+            else if (t == emc_types::FLOAT)
+                return make_float(-a.f);
+            throw ctfe_abort{};
+        }
+        case ast_type::ABS: {
+            auto t_node = dynamic_cast<ast_node_abs*>(node);
+            emc_types t = node->value_type.type;
+            ctfe_value a = convert(eval(t_node->first), t);
+            if (is_signed_int(t))
+                return a.i < 0 ? make_signed_checked(t, ast_type::SUB, 0, a.i) : a;
+            else if (is_unsigned_int(t))
+                return a;
+            else if (t == emc_types::DOUBLE)
+                return make_double(fabs(a.d));
+            else if (t == emc_types::FLOAT)
+                return make_float(fabsf(a.f));
+            throw ctfe_abort{};
+        }
+        case ast_type::ANDCHAIN: {
+            auto t_node = dynamic_cast<ast_node_andchain*>(node);
+            DEBUG_ASSERT(t_node->v_children.size(), "No children in andchain");
+            /* All operands are evaluated, like in walk_tree_andchain() */
+            std::vector<ctfe_value> vals;
+            vals.push_back(eval(t_node->v_children.front()->first.get()));
+            for (auto e : t_node->v_children)
+                vals.push_back(eval(e->sec.get()));
+            bool ans = true;
+            for (int i = 0; i < t_node->v_children.size(); i++)
+                ans = compare(t_node->v_children[i]->type, vals[i], vals[i + 1]) && ans;
+            return make_int(ans);
+        }
+        case ast_type::LES:
+        case ast_type::GRE:
+        case ast_type::LEQ:
+        case ast_type::GEQ:
+        case ast_type::EQU:
+        case ast_type::NEQ: {
+            auto t_node = dynamic_cast<ast_node_chainable*>(node);
+            ctfe_value a = eval(t_node->first.get());
+            ctfe_value b = eval(t_node->sec.get());
+            return make_int(compare(node->type, a, b));
+        }
+        case ast_type::CMP: {
+            auto t_node = dynamic_cast<ast_node_cmp*>(node);
+            ctfe_value a = eval(t_node->first);
+            ctfe_value b = eval(t_node->sec);
+            if (compare(ast_type::LES, a, b))
+                return make_int(-1);
+            else if (compare(ast_type::GRE, a, b))
+                return make_int(1);
+            else if (compare(ast_type::EQU, a, b))
+                return make_int(0);
+            throw ctfe_abort{}; /* Unordered */
+        }
+        case ast_type::AND:
+        case ast_type::OR:
+        case ast_type::XOR:
+        case ast_type::NAND:
+        case ast_type::NOR:
+        case ast_type::XNOR: {
+            ast_node *first = nullptr, *sec = nullptr;
+            if (auto t = dynamic_cast<ast_node_and*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_or*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_xor*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_nand*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_nor*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_xnor*>(node)) first = t->first, sec = t->sec;
+            DEBUG_ASSERT_NOTNULL(first);
+            /* Both operands are always evaluated */
+            bool a = to_bool(eval(first));
+            bool b = to_bool(eval(sec));
+            switch (node->type) {
+            case ast_type::AND:  return make_int(a && b);
+            case ast_type::OR:   return make_int(a || b);
+            case ast_type::XOR:  return make_int(a != b);
+            case ast_type::NAND: return make_int(!(a && b));
+            case ast_type::NOR:  return make_int(!(a || b));
+            default:             return make_int(a == b);
+            }
+        }
+        case ast_type::NOT: {
+            auto t_node = dynamic_cast<ast_node_not*>(node);
+            return make_int(!to_bool(eval(t_node->first)));
+        }
+        case ast_type::FUNCTION_CALL:
+            return eval_call(dynamic_cast<ast_node_funccall*>(node));
+        default:
+            /* Strings, pointers, structs etc. */
+            throw ctfe_abort{};
+        }
+    }
+};
+
+} /* namespace */
+
+const_value ctfe_eval_call(ast_node_funccall *call)
+{
+    DEBUG_ASSERT_NOTNULL(call);
+    if (opts().ctfe_max_steps <= 0 || !call->fdef_node)
+        return std::monostate{};
+
+    ctfe_interpreter interp;
+    /* Dummy frame for evaluating the arguments */
+    interp.frames.push_back({});
+    try {
+        ctfe_value ans = interp.eval_call(call);
+        return to_const_value(ans);
+    } catch (ctfe_abort&) {
+        return std::monostate{};
+    }
+}
+
+const_value ctfe_fold(ast_node *node)
+{
+    DEBUG_ASSERT_NOTNULL(node);
+
+    /* The operands are already folded so this is only a few steps,
+       and it is not subject to the CTFE step limit. No frame is pushed
+       since there can't be any variables. */
+    ctfe_interpreter interp;
+    interp.max_steps = std::numeric_limits<long>::max();
+    try {
+        return to_const_value(interp.eval(node));
+    } catch (ctfe_abort&) {
+        return std::monostate{};
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/* Compile time function evaluation (CTFE).
+ *
+ * Calls to Engma functions where all arguments are constant expressions
+ * are evaluated during resolve by interpreting the resolved AST of the
+ * function. If the function turns out not to be side effect free (reads
+ * or writes a global, calls a C function, uses pointers etc.), or runs
+ * into the step or memory limits in opts, the call is left to be done
+ * at runtime.
+ */
+
+#include "const_value.hh"
+
+class ast_node;
+class ast_node_funccall;
+
+/* Returns the value of the call, or no value (std::monostate) if the call
+   can't be evaluated at compile time. */
+const_value ctfe_eval_call(ast_node_funccall *call);
+
+/* Folds an operator node whose operands all are folded constant
+   expressions. Returns no value if the node can't be folded. */
+const_value ctfe_fold(ast_node *node);
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "emc.hh"
+#include "ast_passes.hh"
+#include "diagnostics.hh"
+#include "util_string.hh"
+
+const std::vector<std::string>& dump_kinds()
+{
+    static const std::vector<std::string> v_kinds = {
+        "ast-parse", "ast-resolve", "ast-passes", "ir", "reproducer", "gimple", "asm"
+    };
+    return v_kinds;
+}
+
+bool dump_enabled(const std::string &kind)
+{
+    auto &dumps = opts().dumps;
+    return std::find(dumps.begin(), dumps.end(), kind) != dumps.end() ||
+        std::find(dumps.begin(), dumps.end(), "all") != dumps.end();
+}
+
+std::string dump_path(const std::string &kind)
+{
+    std::string stem = "engma";
+    if (opts().files.size())
+        stem = std::filesystem::path{opts().files[0]}.stem().string();
+
+    std::string file_name;
+    if (kind == "ir" || kind == "reproducer")
+        file_name = stem + "." + kind + ".c";
+    else if (kind == "gimple")
+        file_name = stem + ".gimple";
+    else if (kind == "asm")
+        file_name = stem + ".s";
+    else
+        file_name = stem + "." + kind + ".txt";
+
+    std::filesystem::create_directories(opts().dump_dir);
+    return opts().dump_dir + "/" + file_name;
+}
+
+/* The first write in a session truncates the file, later ones append */
+static std::ofstream open_dump(const std::string &kind)
+{
+    std::string path = dump_path(kind);
+    bool first = current_session->dump_paths.insert(path).second;
+    std::ofstream f{path, first ? std::ios::trunc : std::ios::app};
+    if (!f)
+        THROW_USER_ERROR("Could not write dump file: " + path);
+    return f;
+}
+
+/* GCC's dumps only have the mangled names, where '_' is "__" */
+static bool matches_filter(const std::string &name)
+{
+    auto &filter = opts().dump_filter;
+    return filter.empty() || name.find(filter) != std::string::npos ||
+        name.find(copy_and_replace_all_substrs(filter, "_", "__")) != std::string::npos;
+}
+
+static const char* ast_type_name(ast_type type)
+{
+    static const char *names[] = {
+        "INVALID", "DOUBLE_LITERAL", "INT_LITERAL", "STRING_LITERAL", "ADD", "SUB",
+        "MUL", "RDIV", "UMINUS", "VAR", "ASSIGN", "GEQ", "GRE", "LEQ", "LES", "CMP",
+        "EQU", "NEQ", "ABS", "TEMP", "POW", "EXPLIST", "DOBLOCK", "IF",
+        "PARAMETER_LIST", "ARGUMENT_LIST", "FUNCTION_DEF", "FUNCTION_DECL",
+        "FUNCTION_CALL", "ANDCHAIN", "WHILE", "DEF", "RETURN", "VARDEF_LIST", "AND",
+        "OR", "XOR", "NAND", "NOR", "XNOR", "NOT", "TYPE", "STRUCT", "DOTOPERATOR",
+        "LISTLITERAL", "DEREF", "ADDRESS", "PTRDEF_LIST", "TYPEDOTCHAIN",
+        "TYPEDOTNAMECHAIN", "NAMESPACE", "USINGCHAIN", "USING", "REM", "INTDIV"
+    };
+    static_assert(sizeof names / sizeof *names == (int)ast_type::INTDIV + 1);
+    return names[(int)type];
+}
+
+static std::string type_string(const emc_type &t)
+{
+    static const std::map<emc_types, std::string> map_names = {
+        {emc_types::NONE, "void"}, {emc_types::INT, "Int"}, {emc_types::UINT, "Uint"},
+        {emc_types::SHORT, "Short"}, {emc_types::USHORT, "Ushort"},
+        {emc_types::BYTE, "Byte"}, {emc_types::SBYTE, "Sbyte"},
+        {emc_types::LONG, "Long"}, {emc_types::ULONG, "Ulong"},
+        {emc_types::FLOAT, "Float"}, {emc_types::DOUBLE, "Double"},
+        {emc_types::BOOL, "Bool"}, {emc_types::STRING, "String"},
+        {emc_types::FUNCTION, "function"}, {emc_types::LISTLIT, "list"}
+    };
+    std::string name;
+    if (t.is_struct())
+        name = t.mangled_name;
+    else if (map_names.count(t.type))
+        name = map_names.at(t.type);
+    else
+        name = "type" + std::to_string((int)t.type);
+    return t.ptr_prefix() + name +
+        (t.is_const_expr ? " const" : "");
+}
+
+static void print_ast(std::ostream &os, ast_node *node, int depth)
+{
+    os << std::string(depth * 2, ' ') << ast_type_name(node->type);
+
+    switch (node->type) {
+    case ast_type::INT_LITERAL:
+        os << " " << dynamic_cast<ast_node_int_literal*>(node)->i;
+        break;
+    case ast_type::DOUBLE_LITERAL:
+        os << " " << dynamic_cast<ast_node_double_literal*>(node)->d;
+        break;
+    case ast_type::STRING_LITERAL:
+        os << " \"" << dynamic_cast<ast_node_string_literal*>(node)->s << "\"";
+        break;
+    case ast_type::VAR:
+        os << " " << dynamic_cast<ast_node_var*>(node)->full_name;
+        break;
+    case ast_type::DEF:
+        os << " " << dynamic_cast<ast_node_def*>(node)->var_name;
+        break;
+    case ast_type::FUNCTION_CALL:
+        os << " " << dynamic_cast<ast_node_funccall*>(node)->name;
+        break;
+    case ast_type::FUNCTION_DEF: {
+        auto fdef = dynamic_cast<ast_node_funcdef*>(node);
+        os << " " << fdef->name;
+        if (fdef->mangled_name.size())
+            os << " (" << fdef->mangled_name << ")";
+        break;
+    }
+    case ast_type::FUNCTION_DECL:
+        os << " " << dynamic_cast<ast_node_funcdec*>(node)->name;
+        break;
+    case ast_type::DOTOPERATOR:
+        os << " ." << dynamic_cast<ast_node_dotop*>(node)->field_name;
+        break;
+    case ast_type::TYPE:
+        os << " " << dynamic_cast<ast_node_type*>(node)->type_name;
+        break;
+    default:
+        break;
+    }
+    if (node->value_type.is_valid())
+        os << " : " << type_string(node->value_type);
+    os << "\n";
+
+    for_each_child(node, [&](ast_node *&child, bool) {
+        if (child)
+            print_ast(os, child, depth + 1);
+    });
+}
+
+void dump_ast(const std::string &kind, ast_node *node)
+{
+    if (!node || !dump_enabled(kind))
+        return;
+    /* With a filter only the matching functions */
+    if (opts().dump_filter.size()) {
+        auto fdef = dynamic_cast<ast_node_funcdef*>(node);
+        if (!fdef || !(matches_filter(fdef->name) || matches_filter(fdef->mangled_name)))
+            return;
+    }
+
+    auto f = open_dump(kind);
+    print_ast(f, node, 0);
+}
+
+void dump_ast(const std::string &kind, const std::vector<ast_node*> &v_nodes)
+{
+    for (auto e : v_nodes)
+        dump_ast(kind, e);
+}
+
+/* C-like code and gimple: a function ends with a "}" line and its name is
+   on the line before its "{" line */
+static std::string filter_c_functions(const std::string &text)
+{
+    std::istringstream ss{text};
+    std::string ans, line, prev_line;
+    std::vector<std::string> v_chunk;
+    bool in_function = false, keep = false;
+
+    while (std::getline(ss, line)) {
+        if (!in_function && line.empty())
+            v_chunk.clear();
+        v_chunk.push_back(line);
+        if (!in_function && line == "{") {
+            in_function = true;
+            keep = matches_filter(prev_line);
+        } else if (in_function && line == "}") {
+            if (keep)
+                for (auto &e : v_chunk)
+                    ans += e + "\n";
+            ans += keep ? "\n" : "";
+            v_chunk.clear();
+            in_function = false;
+        }
+        prev_line = line;
+    }
+    return ans;
+}
+
+/* Assembler: from ".type NAME, @function" to ".size NAME, .-NAME" */
+static std::string filter_asm_functions(const std::string &text)
+{
+    std::istringstream ss{text};
+    std::string ans, line;
+    bool keep = false;
+
+    while (std::getline(ss, line)) {
+        auto type_pos = line.find(".type");
+        if (type_pos != std::string::npos && line.find("@function") != std::string::npos)
+            keep = matches_filter(line.substr(type_pos));
+        if (keep)
+            ans += line + "\n";
+        if (line.find(".size") != std::string::npos)
+            keep = false;
+    }
+    return ans;
+}
+
+void dump_text(const std::string &kind, const std::string &text)
+{
+    if (!dump_enabled(kind))
+        return;
+
+    auto f = open_dump(kind);
+    if (opts().dump_filter.empty())
+        f << text;
+    else if (kind == "asm")
+        f << filter_asm_functions(text);
+    else
+        f << filter_c_functions(text);
+}
+
+std::string take_dump_file(const std::string &path)
+{
+    std::ifstream f{path};
+    std::stringstream ss;
+    ss << f.rdbuf();
+    f.close();
+    std::remove(path.c_str());
+    return ss.str();
+}
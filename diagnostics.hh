@@ -0,0 +1,42 @@
+#pragma once
+
+/* Debug dumps. Nothing is written unless asked for with --dump=KIND,...
+ *
+ *   ast-parse    FILE.ast-parse.txt  Each top level statement as parsed
+ *   ast-resolve  FILE.ast-resolve.txt  ... after resolve()
+ *   ast-passes   FILE.ast-passes.txt  ... after the AST passes
+ *   ir           FILE.ir.c           The gccjit IR, gcc_jit_context_dump_to_file()
+ *   reproducer   FILE.reproducer.c   A C program that rebuilds the last compiled
+ *                                    context
+ *   gimple       FILE.gimple         GCC's gimple
+ *   asm          FILE.s              The generated assembler
+ *   all          All of them
+ *
+ * FILE is the name of the first .em file without .em, or "engma". The files
+ * are written to --dump-dir, default ".", and are appended to by later
+ * compiles in the same run, e.g. of the REPL statements. --dump-filter=NAME
+ * keeps only the functions whose name contains NAME, in all dumps
+ * but the reproducer.
+ */
+
+#include <string>
+#include <vector>
+
+class ast_node;
+
+const std::vector<std::string>& dump_kinds();
+
+bool dump_enabled(const std::string &kind);
+/* Creates --dump-dir if needed */
+std::string dump_path(const std::string &kind);
+
+/* Appends the top level nodes to the dump of an ast-* kind */
+void dump_ast(const std::string &kind, ast_node *node);
+void dump_ast(const std::string &kind, const std::vector<ast_node*> &v_nodes);
+
+/* Appends GCC output, i.e. C-like code, gimple or assembler, keeping only the
+   functions that match the filter */
+void dump_text(const std::string &kind, const std::string &text);
+
+/* Reads and removes a file that GCC dumped to */
+std::string take_dump_file(const std::string &path);
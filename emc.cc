@@ -12,12 +12,40 @@ typedef void *yyscan_t;
 #include "lexer.h"
 /* End of stupid include order. */
 #include "util_string.hh"
+#include "time_report.hh"
+#include "diagnostics.hh"
 
 #ifndef NDEBUG
-int ast_node_count;
-int value_expr_count;
+thread_local int ast_node_count;
+thread_local int value_expr_count;
 #endif
 
+thread_local engma_session *current_session = nullptr;
+
+engma_options& opts()
+{
+    DEBUG_ASSERT_NOTNULL(current_session);
+    return current_session->opts;
+}
+
+ast_compilation_units& compilation_units()
+{
+    DEBUG_ASSERT_NOTNULL(current_session);
+    return current_session->compilation_units;
+}
+
+typescope_stack& builtin_typestack()
+{
+    DEBUG_ASSERT_NOTNULL(current_session);
+    return current_session->builtin_typestack;
+}
+
+objscope_stack& builtin_objstack()
+{
+    DEBUG_ASSERT_NOTNULL(current_session);
+    return current_session->builtin_objstack;
+}
+
 emc_type string_to_type(std::string type_name) {
     if (type_name == "Int")
         return emc_type{emc_types::INT};
@@ -47,372 +75,123 @@ emc_type string_to_type(std::string type_name) {
     /* See if it is a user defined type */
     
 
-    return compilation_units.get_current_typestack().find_type(type_name); /* Throws if not found */
+    return compilation_units().get_current_typestack().find_type(type_name); /* Throws if not found */
 }
 
-/* Allocate a new obj by casting from object to type. 
-   Throws if the source object value wont fit in the target
-   object.
-   
-   Caller deletes pointer. */
-obj* cast_obj_to_type_return_new_obj(obj* obj, emc_type type)
+/* The alignment in bytes of an object of the type, on the targets Engma runs on */
+int type_alignment(const emc_type &t)
 {
-/* Macro that checks range and returns a new object with the specified type */
-#define MAKE_OBJ_RETURN(obj_class, obj_val_type)\
-do {\
-    auto obj_t = dynamic_cast<obj_class*>(obj);\
-    DEBUG_ASSERT_NOTNULL(obj_t);\
-    if (type.is_long()) {\
-        check_in_range<obj_val_type, int64_t>(obj_t->val);\
-        return new object_long{(int64_t)obj_t->val};\
-    } else if (type.is_int()) {\
-        check_in_range<obj_val_type, int32_t>(obj_t->val);\
-        return new object_int{(int32_t)obj_t->val};\
-    } else if (type.is_short()) {\
-        check_in_range<obj_val_type, int16_t>(obj_t->val);\
-        return new object_short{(int16_t)obj_t->val};\
-    } else if (type.is_sbyte()) {\
-        check_in_range<obj_val_type, int8_t>(obj_t->val);\
-        return new object_sbyte{(int8_t)obj_t->val};\
-    } else if (type.is_ulong()) {\
-        check_in_range<obj_val_type, uint64_t>(obj_t->val);\
-        return new object_ulong{(uint64_t)obj_t->val};\
-    } else if (type.is_uint()) {\
-        check_in_range<obj_val_type, uint32_t>(obj_t->val);\
-        return new object_uint{(uint32_t)obj_t->val};\
-    } else if (type.is_ushort()) {\
-        check_in_range<obj_val_type, uint16_t>(obj_t->val);\
-        return new object_ushort{(uint16_t)obj_t->val};\
-    } else if (type.is_byte()) {\
-        check_in_range<obj_val_type, uint8_t>(obj_t->val);\
-        return new object_byte{(uint8_t)obj_t->val};\
-    } else if (type.is_double()) {\
-        check_exact_as_double<obj_val_type>(obj_t->val);\
-        return new object_double{(double)obj_t->val};\
-    } else if (type.is_float()) {\
-        check_exact_as_float<obj_val_type>(obj_t->val);\
-        return new object_float{(float)obj_t->val};\
-    }\
-    THROW_BUG("");\
-} while((0))
-
-    switch (obj->type) {
-    case object_type::LONG:
-        MAKE_OBJ_RETURN(object_long, int64_t);
-    case object_type::INT:
-        MAKE_OBJ_RETURN(object_int, int32_t);
-    case object_type::SHORT:
-        MAKE_OBJ_RETURN(object_short, int16_t);
-    case object_type::SBYTE:
-        MAKE_OBJ_RETURN(object_sbyte, int8_t);
-    case object_type::ULONG:
-        MAKE_OBJ_RETURN(object_ulong, uint64_t);
-    case object_type::UINT:
-        MAKE_OBJ_RETURN(object_uint, uint32_t);
-    case object_type::USHORT:
-        MAKE_OBJ_RETURN(object_ushort, uint16_t);
-    case object_type::BYTE:
-        MAKE_OBJ_RETURN(object_byte, uint8_t);
-    case object_type::DOUBLE:
-        MAKE_OBJ_RETURN(object_double, double);
-    case object_type::FLOAT:
-        MAKE_OBJ_RETURN(object_double, float);
-    default:
-        THROW_BUG("");
-    }
+    int a = 1;
+    if (t.n_pointer_indirections)
+        a = sizeof(void*);
+    else if (t.is_double() || t.is_long() || t.is_ulong())
+        a = 8;
+    else if (t.is_float() || t.is_int() || t.is_uint())
+        a = 4;
+    else if (t.is_short() || t.is_ushort())
+        a = 2;
+    else if (t.is_struct())
+        for (const emc_type &child : t.children_types)
+            a = std::max(a, type_alignment(child));
+    return std::max(a, t.alignment);
+}
 
-#undef MAKE_OBJ_RETURN
+/* Cast a constant value to the C type of type.
+   Throws if the source value wont fit in the target type, unless
+   check is false in which case it is a plain C cast. */
+const_value cast_value_to_type(const const_value &value, emc_type type, bool check)
+{
+    return std::visit([&](auto v) -> const_value {
+        using V = decltype(v);
+
+        if constexpr (std::is_same_v<V, std::monostate> || std::is_same_v<V, bool>)
+            THROW_BUG("");
+        else {
+            if (type.is_long()) {
+                if (check) check_in_range<V, int64_t>(v);
+                return (int64_t)v;
+            } else if (type.is_int()) {
+                if (check) check_in_range<V, int32_t>(v);
+                return (int32_t)v;
+            } else if (type.is_short()) {
+                if (check) check_in_range<V, int16_t>(v);
+                return (int16_t)v;
+            } else if (type.is_sbyte()) {
+                if (check) check_in_range<V, int8_t>(v);
+                return (int8_t)v;
+            } else if (type.is_ulong()) {
+                if (check) check_in_range<V, uint64_t>(v);
+                return (uint64_t)v;
+            } else if (type.is_uint()) {
+                if (check) check_in_range<V, uint32_t>(v);
+                return (uint32_t)v;
+            } else if (type.is_ushort()) {
+                if (check) check_in_range<V, uint16_t>(v);
+                return (uint16_t)v;
+            } else if (type.is_byte()) {
+                if (check) check_in_range<V, uint8_t>(v);
+                return (uint8_t)v;
+            } else if (type.is_double()) {
+                if (check) check_exact_as_double<V>(v);
+                return (double)v;
+            } else if (type.is_float()) {
+                if (check) check_exact_as_float<V>(v);
+                return (float)v;
+            }
+            THROW_BUG("");
+        }
+    }, value);
+}
+
+/* Truth value of a constant condition. Conditions are cast to Int and then
+   to Bool, see jit::walk_tree_if(). */
+bool const_value_to_bool(const const_value &value)
+{
+    return std::visit([](auto v) -> bool {
+        using V = decltype(v);
+
+        if constexpr (std::is_same_v<V, std::monostate>)
+            THROW_BUG("");
+        else if constexpr (std::is_floating_point_v<V>)
+            return std::trunc(v) != 0;
+        else
+            return (int32_t)v != 0;
+    }, value);
 }
 
 /* TODO: Should have LOC parameter to do nicer errors */
-void verify_obj_fits_in_type(obj* obj, emc_type type)
+void verify_value_fits_in_type(const const_value &value, emc_type type)
 {
-    DEBUG_ASSERT_NOTNULL(obj);
-    /* TODO: Verify that ulong and long can be compared like this .. */
-    /* TODO: Refactor to a long max and long min, this is stupid. */
-    /* TODO: Use range check in emc_assert.h? */
-    /* TODO: Does this work for float and double and int and long? */
-
-#define DO_CHECK(obj_class, ctype) do {\
-auto obj_t = dynamic_cast<obj_class*>(obj);\
-DEBUG_ASSERT_NOTNULL(obj_t);\
-\
-check_in_range<decltype(obj_t->val),ctype>(obj_t->val); } while((0))
-
-    /* TODO: Floats, only if exact conversion maybe? */
-    if (type.is_double()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-        case object_type::FLOAT:
-        case object_type::ULONG:
-        case object_type::LONG:
-        case object_type::INT:
-        case object_type::SHORT:
-        case object_type::SBYTE:
-        case object_type::UINT:
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_float()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, float);
-            break;
-        case object_type::FLOAT:
-        case object_type::ULONG:
-        case object_type::LONG:
-        case object_type::INT:
-        case object_type::SHORT:
-        case object_type::SBYTE:
-        case object_type::UINT:
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_long()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, int64_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, int64_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, int64_t);
-            break;
-        case object_type::LONG:
-        case object_type::INT:
-        case object_type::SHORT:
-        case object_type::SBYTE:
-        case object_type::UINT:
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_int()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, int32_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, int32_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, int32_t);
-            break;
-        case object_type::UINT:
-            DO_CHECK(object_uint, int32_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, int32_t);
-            break;
-        case object_type::INT:
-        case object_type::SHORT:
-        case object_type::SBYTE:
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_short()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, int16_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, int16_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, int16_t);
-            break;
-        case object_type::UINT:
-            DO_CHECK(object_uint, int16_t);
-            break;
-        case object_type::USHORT:
-            DO_CHECK(object_ushort, int16_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, int16_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, int16_t);
-            break;
-        case object_type::SHORT:
-        case object_type::SBYTE:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_sbyte()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, int8_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, int8_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, int8_t);
-            break;
-        case object_type::UINT:
-            DO_CHECK(object_uint, int8_t);
-            break;
-        case object_type::USHORT:
-            DO_CHECK(object_ushort, int8_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, int8_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, int8_t);
-            break;
-        case object_type::SHORT:
-            DO_CHECK(object_short, int8_t);
-            break;
-        case object_type::BYTE:
-            DO_CHECK(object_byte, int8_t);
-            break;
-        case object_type::SBYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_ulong())  {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, uint64_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, uint64_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, uint64_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, uint64_t);
-            break;
-        case object_type::SHORT:
-            DO_CHECK(object_short, uint64_t);
-            break;
-        case object_type::SBYTE:
-            DO_CHECK(object_sbyte, uint64_t);
-            break;
-        case object_type::BYTE:
-        case object_type::ULONG:
-        case object_type::UINT:
-        case object_type::USHORT:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_uint()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, uint32_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, uint32_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, uint32_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, uint32_t);
-            break;
-        case object_type::SHORT:
-            DO_CHECK(object_short, uint32_t);
-            break;
-        case object_type::SBYTE:
-            DO_CHECK(object_sbyte, uint32_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, uint32_t);
-            break;
-        case object_type::UINT:
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_ushort()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, uint16_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, uint16_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, uint16_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, uint16_t);
-            break;
-        case object_type::SHORT:
-            DO_CHECK(object_short, uint16_t);
-            break;
-        case object_type::SBYTE:
-            DO_CHECK(object_sbyte, uint16_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, uint16_t);
-            break;
-        case object_type::UINT:
-            DO_CHECK(object_uint, uint16_t);
-            break;
-        case object_type::USHORT:
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
-            THROW_NOT_IMPLEMENTED("");
-        }
-    } else if (type.is_byte()) {
-        switch (obj->type) {
-        case object_type::DOUBLE:
-            DO_CHECK(object_double, uint8_t);
-            break;
-        case object_type::FLOAT:
-            DO_CHECK(object_float, uint8_t);
-            break;
-        case object_type::LONG:
-            DO_CHECK(object_long, uint8_t);
-            break;
-        case object_type::INT:
-            DO_CHECK(object_int, uint8_t);
-            break;
-        case object_type::SHORT:
-            DO_CHECK(object_short, uint8_t);
-            break;
-        case object_type::SBYTE:
-            DO_CHECK(object_sbyte, uint8_t);
-            break;
-        case object_type::ULONG:
-            DO_CHECK(object_ulong, uint8_t);
-            break;
-        case object_type::UINT:
-            DO_CHECK(object_uint, uint8_t);
-            break;
-        case object_type::USHORT:
-            DO_CHECK(object_ushort, uint8_t);
-            break;
-        case object_type::BYTE:
-            break; /* These all fits */
-        default:
+    std::visit([&](auto v) {
+        using V = decltype(v);
+
+        if constexpr (std::is_same_v<V, std::monostate> || std::is_same_v<V, bool>)
             THROW_NOT_IMPLEMENTED("");
+        else {
+            /* TODO: Floats, only if exact conversion maybe? */
+            if (type.is_double())
+                ; /* All fits */
+            else if (type.is_float()) {
+                if constexpr (std::is_same_v<V, double>)
+                    check_in_range<double, float>(v);
+            } else if (type.is_long())
+                check_in_range<V, int64_t>(v);
+            else if (type.is_int())
+                check_in_range<V, int32_t>(v);
+            else if (type.is_short())
+                check_in_range<V, int16_t>(v);
+            else if (type.is_sbyte())
+                check_in_range<V, int8_t>(v);
+            else if (type.is_ulong())
+                check_in_range<V, uint64_t>(v);
+            else if (type.is_uint())
+                check_in_range<V, uint32_t>(v);
+            else if (type.is_ushort())
+                check_in_range<V, uint16_t>(v);
+            else if (type.is_byte())
+                check_in_range<V, uint8_t>(v);
         }
-    } 
-
-#undef DO_CHECK
+    }, value);
 }
 
 void push_dummyobject_to_resolve_scope(std::string var_name, emc_type type)
@@ -445,7 +224,9 @@ void push_dummyobject_to_resolve_scope(std::string var_name, emc_type type)
         od = new object_struct{var_name, "", type, type.n_pointer_indirections};
     else
         THROW_NOT_IMPLEMENTED("Type not implemented: " + var_name);
-    compilation_units.get_current_objstack().get_top_scope().push_object(od);
+    od->ptr_const_mask = type.ptr_const_mask;
+    od->ptr_restrict_mask = type.ptr_restrict_mask;
+    compilation_units().get_current_objstack().get_top_scope().push_object(od);
 }
 
 emc_type ast_node_funcdef::resolve()
@@ -456,39 +237,25 @@ emc_type ast_node_funcdef::resolve()
 
     name = typedotnamenode->name;
     /* Append current namespace to relative namespace if any */
-    if (compilation_units.get_current_typestack().current_scope.size())
+    if (compilation_units().get_current_typestack().current_scope.size())
         if (typedotnamenode->nspace.size())
-            nspace = compilation_units.get_current_typestack().current_scope + "." + typedotnamenode->nspace;
+            nspace = compilation_units().get_current_typestack().current_scope + "." + typedotnamenode->nspace;
         else
-            nspace = compilation_units.get_current_typestack().current_scope; 
+            nspace = compilation_units().get_current_typestack().current_scope; 
     else
         nspace = typedotnamenode->nspace;
 
     parlist->resolve(); /* TODO: Reduntant to parlist_t->resolve()? */
-    
-    compilation_units.get_current_objstack().push_new_scope();
-    auto parlist_t = dynamic_cast<ast_node_vardef_list*>(parlist);
-    DEBUG_ASSERT_NOTNULL(parlist_t);
-    //parlist_t->resolve();
-
-    /* Create variables with the arguments' names in the function scope. */
-    for (int i = 0; i < parlist_t->v_defs.size(); i++) {
-        auto par = dynamic_cast<ast_node_def*>(parlist_t->v_defs[i]);
-        std::string var_name = par->var_name;
-
-        push_dummyobject_to_resolve_scope(var_name, par->value_type);
-    }
-    code_block->resolve();
-    compilation_units.get_current_objstack().pop_scope();
 
     /* Hack to allow for return names with same names as other things ... */
-    compilation_units.get_current_objstack().push_new_scope();
+    compilation_units().get_current_objstack().push_new_scope();
     return_list->resolve();
-    compilation_units.get_current_objstack().pop_scope();
+    compilation_units().get_current_objstack().pop_scope();
 
     /* TODO: code_block is probably uneccesary. */
     auto fobj = new object_func { 0, name, nspace,
             parlist->clone() , return_list->clone()};
+    fobj->fdef_node = this;
     /* Resolve the mangled name and write it to this and the function object. */
     /* If c linkage is specified there is no name mangleing. */
     if (c_linkage) { 
@@ -500,8 +267,24 @@ emc_type ast_node_funcdef::resolve()
         mangled_name = mangle_emc_fn_name(*fobj);
         fobj->mangled_name = mangled_name;
     }
-    /* Push the function object to top scope */
-    compilation_units.get_current_objstack().get_top_scope().push_object(fobj);
+    /* Push the function object to top scope before the body is resolved,
+       so that recursive calls find it. */
+    compilation_units().get_current_objstack().get_top_scope().push_object(fobj);
+
+    compilation_units().get_current_objstack().push_new_scope();
+    auto parlist_t = dynamic_cast<ast_node_vardef_list*>(parlist);
+    DEBUG_ASSERT_NOTNULL(parlist_t);
+    //parlist_t->resolve();
+
+    /* Create variables with the arguments' names in the function scope. */
+    for (int i = 0; i < parlist_t->v_defs.size(); i++) {
+        auto par = dynamic_cast<ast_node_def*>(parlist_t->v_defs[i]);
+        std::string var_name = par->var_name;
+
+        push_dummyobject_to_resolve_scope(var_name, par->value_type);
+    }
+    code_block->resolve();
+    compilation_units().get_current_objstack().pop_scope();
 
     return value_type = emc_type{emc_types::FUNCTION}; /* TODO: Add types too */
 }
@@ -514,8 +297,8 @@ emc_type ast_node_funcdec::resolve()
 
     name = typedotnamenode->name;
     /* Append current namespace to relative namespace if any */
-    if (compilation_units.get_current_typestack().current_scope.size()) {
-        nspace = compilation_units.get_current_typestack().current_scope;
+    if (compilation_units().get_current_typestack().current_scope.size()) {
+        nspace = compilation_units().get_current_typestack().current_scope;
         if (typedotnamenode->nspace.size())
             nspace += "." + typedotnamenode->nspace;
     } else
@@ -523,17 +306,17 @@ emc_type ast_node_funcdec::resolve()
     
     parlist->resolve();
     
-    compilation_units.get_current_objstack().push_new_scope();
+    compilation_units().get_current_objstack().push_new_scope();
     auto parlist_t = dynamic_cast<ast_node_vardef_list*>(parlist);
     DEBUG_ASSERT_NOTNULL(parlist_t);
     parlist_t->resolve();
 
-    compilation_units.get_current_objstack().pop_scope();
+    compilation_units().get_current_objstack().pop_scope();
 
     /* Hack to allow for return names with same names as other things ... */
-    compilation_units.get_current_objstack().push_new_scope();
+    compilation_units().get_current_objstack().push_new_scope();
     return_list->resolve();
-    compilation_units.get_current_objstack().pop_scope();
+    compilation_units().get_current_objstack().pop_scope();
 
     auto fobj = new object_func { 0, name, nspace,
             parlist->clone() , return_list->clone()};
@@ -554,7 +337,7 @@ emc_type ast_node_funcdec::resolve()
     }
     /* Push the function object to top scope */
     /* TODO: Declarations collide with definitions. Should be some flag. */
-    compilation_units.get_current_objstack().get_top_scope().push_object(fobj);
+    compilation_units().get_current_objstack().get_top_scope().push_object(fobj);
 
     return value_type = emc_type{emc_types::FUNCTION}; /* TODO: Add types too */
 }
@@ -573,19 +356,19 @@ emc_type ast_node_using::resolve()
     
     /* Push the namespace to the stack of "usings" if it was a USING IMPORT */
     if (using_ns) {
-        auto &ts = compilation_units.get_current_typestack();
+        auto &ts = compilation_units().get_current_typestack();
         ts.push_using(path);
     }
 
 
     /* See if we already are using the file */
-    auto *cup = compilation_units.find_compilation_unit(path);
+    auto *cup = compilation_units().find_compilation_unit(path);
     std::string dir_path = copy_and_replace_all_substrs(path, ".", "/");
     
     if (cup) {
         THROW_NOT_IMPLEMENTED("");
     } else {
-        
+        phase_timer timer{"import"};
         namespace fs = std::filesystem;
         /* TODO: add support for looking for "system headers" in some folders */
         /* TODO: add support for Foo.emh (headers) for refering to some object file */
@@ -593,7 +376,7 @@ emc_type ast_node_using::resolve()
         /* Relative to current dir has first priority */
         bool dir_exists = fs::is_directory(dir_path);
         if (!dir_exists) {
-            for (std::string dir : opts.include_dirs) {
+            for (std::string dir : opts().include_dirs) {
                 dir_exists = fs::is_directory(dir + "/" + dir_path);
                 if (dir_exists) {
                     dir_path = dir + "/" + dir_path;
@@ -612,18 +395,18 @@ emc_type ast_node_using::resolve()
             THROW_BUG("Using do not resolve to a file: " + file_path);
 
         /* Push the scope and type stacks. */
-        extern int curr_line; /* In the lexer TODO: Not globals */
-        extern int curr_col;
+        extern thread_local int curr_line; /* In the lexer */
+        extern thread_local int curr_col;
 
         int curr_line_poped = curr_line;
         curr_line = 1;
         int curr_col_poped = curr_col;
         curr_col = 1;
 
-        compilation_units.push_compilation_unit(path);
+        compilation_units().push_compilation_unit(path);
         /* Scan the file and parse it */
         {
-            auto &cu = compilation_units.get_current_compilation_unit();
+            auto &cu = compilation_units().get_current_compilation_unit();
 
             yyscan_t scanner;
             yylex_init(&scanner);
@@ -634,9 +417,16 @@ emc_type ast_node_using::resolve()
             cu.file_name = file_path;
             
             do {
-                int err = yyparse(scanner);
+                int err;
+                {
+                    phase_timer timer{"parse"};
+                    err = yyparse(scanner);
+                }
                 if (cu.ast_root) {
+                    phase_timer timer{"resolve"};
+                    dump_ast("ast-parse", cu.ast_root);
                     cu.ast_root->resolve();
+                    dump_ast("ast-resolve", cu.ast_root);
                     cu.v_nodes.push_back(cu.ast_root);
                     cu.ast_root = nullptr;
                 }
@@ -650,9 +440,9 @@ emc_type ast_node_using::resolve()
             yylex_destroy(scanner);
         }
         /* Pop the scope and type stacks */
-        auto &new_cu = compilation_units.get_current_compilation_unit();
-        compilation_units.pop_compilation_unit();
-        auto &cu = compilation_units.get_current_compilation_unit();
+        auto &new_cu = compilation_units().get_current_compilation_unit();
+        compilation_units().pop_compilation_unit();
+        auto &cu = compilation_units().get_current_compilation_unit();
 
         /* Link in the type and object stacks from new to current.
            So the linked scopes can be searched by current's type and object
@@ -684,6 +474,8 @@ emc_type ast_node_vardef_list::resolve()
 {
     for (auto e : v_defs) {
         auto ee = dynamic_cast<ast_node_def*>(e);
+        if (ee->alignment)
+            THROW_USER_ERROR_WITH_LOC("ALIGN() on a parameter or return value", ee->loc);
         emc_type value = ee->resolve_no_push();
     }
 
@@ -693,6 +485,15 @@ emc_type ast_node_vardef_list::resolve()
         return value_type = v_defs.front()->value_type;
 }
 
+bool ast_node_assign::writes_through_const(ast_node *lvalue)
+{
+    if (lvalue->type == ast_type::DEREF)
+        return dynamic_cast<ast_node_deref*>(lvalue)->first->value_type.is_ptr_to_const();
+    if (lvalue->type == ast_type::DOTOPERATOR)
+        return writes_through_const(dynamic_cast<ast_node_dotop*>(lvalue)->first);
+    return false;
+}
+
 object_func::~object_func()
 {
     delete root;
@@ -837,8 +638,8 @@ obj* objscope_stack::find_object(std::string name)
     }
 
     /* Search built-in obj scope */
-    if (this != &builtin_objstack) {
-        obj *p = builtin_objstack.find_object(name);
+    if (this != &builtin_objstack()) {
+        obj *p = builtin_objstack().find_object(name);
         if (p)
             return p;
     }
@@ -872,8 +673,8 @@ std::vector<obj*> objscope_stack::find_objects_by_not_mangled_name_helper(std::s
     }
     /* Also search the top scope with current namespace prepended to access eg.
      * Foo.Bar.b as b if we are in Foo.Bar */
-    if (compilation_units.get_current_typestack().current_scope.size()) {
-        std::string current_scope = compilation_units.get_current_typestack().current_scope;
+    if (compilation_units().get_current_typestack().current_scope.size()) {
+        std::string current_scope = compilation_units().get_current_typestack().current_scope;
         std::string full_nspace;
         if (nspace.size() && current_scope.size())
             full_nspace = current_scope + "." + nspace;
@@ -889,8 +690,8 @@ std::vector<obj*> objscope_stack::find_objects_by_not_mangled_name_helper(std::s
     }
 
     /* Search built-in obj scope */
-    if (this != &builtin_objstack) {
-        auto tmp_v = builtin_objstack.find_objects_by_not_mangled_name(name, nspace);
+    if (this != &builtin_objstack()) {
+        auto tmp_v = builtin_objstack().find_objects_by_not_mangled_name(name, nspace);
         for (auto e : tmp_v)
             ans.push_back(e);
     }
@@ -915,7 +716,7 @@ emc_type typescope_stack::find_type(std::string name)
         return ans;
 
     /* Now relook but with the namespace specified by USING directives. */
-    auto &ts = compilation_units.get_current_typestack();
+    auto &ts = compilation_units().get_current_typestack();
     for (auto scopes : ts.using_scopes) {
         for (std::string ns : scopes) {
             if (ns.size()) {
@@ -937,7 +738,7 @@ std::vector<obj*> objscope_stack::find_objects_by_not_mangled_name(std::string n
         ans.push_back(e);
 
     /* Now relook but with the namespace specified by USING directives. */
-    auto &ts = compilation_units.get_current_typestack();
+    auto &ts = compilation_units().get_current_typestack();
     for (auto scopes : ts.using_scopes) {
         for (std::string ns : scopes) {
             if (ns.size()) {
@@ -956,22 +757,22 @@ void register_double_var(std::string name, double d)
 {
     
     auto obj = new object_double {name, "", d, 0};
-    compilation_units.get_current_objstack().get_top_scope().push_object(obj);
+    compilation_units().get_current_objstack().get_top_scope().push_object(obj);
 }
 
 
 void init_builtin_types()
 {
-    builtin_typestack.push_type("Byte", {emc_types::BYTE});
-    builtin_typestack.push_type("Sbyte", {emc_types::SBYTE});
-    builtin_typestack.push_type("Short", {emc_types::SHORT});
-    builtin_typestack.push_type("Ushort", {emc_types::USHORT});
-    builtin_typestack.push_type("Int", {emc_types::INT});
-    builtin_typestack.push_type("Uint", {emc_types::UINT});
-    builtin_typestack.push_type("Long", {emc_types::LONG});
-    builtin_typestack.push_type("Ulong", {emc_types::ULONG});
-    builtin_typestack.push_type("Double", {emc_types::DOUBLE});
-    builtin_typestack.push_type("Float", {emc_types::FLOAT});
+    builtin_typestack().push_type("Byte", {emc_types::BYTE});
+    builtin_typestack().push_type("Sbyte", {emc_types::SBYTE});
+    builtin_typestack().push_type("Short", {emc_types::SHORT});
+    builtin_typestack().push_type("Ushort", {emc_types::USHORT});
+    builtin_typestack().push_type("Int", {emc_types::INT});
+    builtin_typestack().push_type("Uint", {emc_types::UINT});
+    builtin_typestack().push_type("Long", {emc_types::LONG});
+    builtin_typestack().push_type("Ulong", {emc_types::ULONG});
+    builtin_typestack().push_type("Double", {emc_types::DOUBLE});
+    builtin_typestack().push_type("Float", {emc_types::FLOAT});
 
 }
 
@@ -1007,6 +808,20 @@ std::string mangle_emc_var_name(std::string name, std::string nspace)
     return mangled_name + nspace + copy_and_replace_all_substrs(name, "_", "__");
 }
 
+/* A 'P' per pointer indirection, the outermost first, each after a 'K' if
+   its target is const. E.g. "PKP" for "&RESTRICT &CONST". Like in C,
+   RESTRICT is not part of the function's type and is not mangled. */
+static std::string mangle_pointers(const emc_type &t)
+{
+    std::string s;
+    for (int i = t.n_pointer_indirections - 1; i >= 0; i--) {
+        if (t.ptr_const_mask & 1u << i)
+            s += "K";
+        s += "P";
+    }
+    return s;
+}
+
 /* Mangles a Engma function name to its symbol name that will be used for linking.
  *  Note That underscores in name and types are replaces with two underscores.
  *  Namespaces are eg. NamespaceType
@@ -1014,30 +829,39 @@ std::string mangle_emc_var_name(std::string name, std::string nspace)
         TODO: Need to prevent Engma names from ending with _ to not collide whit Foo_._foo 
  */
 std::string mangle_emc_fn_name(const object_func &fn_obj)
+{
+    ast_node_vardef_list *parlist_node = dynamic_cast<ast_node_vardef_list*>(fn_obj.para_list);
+    DEBUG_ASSERT_NOTNULL(parlist_node);
+    std::vector<emc_type> v_param_types;
+    for (ast_node *para : parlist_node->v_defs)
+        v_param_types.push_back(para->value_type);
+
+    return mangle_emc_fn_name(fn_obj.var_list->value_type, fn_obj.nspace, fn_obj.name, v_param_types);
+}
+
+/* Same as above but from the signature, e.g. to look up a function in
+   compiled code without its object. */
+std::string mangle_emc_fn_name(const emc_type &return_type, std::string nspace,
+                               const std::string &name, const std::vector<emc_type> &v_param_types)
 {
     std::ostringstream ss;
     ss << "engma_c58b_fn";
 
     /* Begin with the return type. */
-    if (fn_obj.var_list->value_type.is_primitive()) {
+    if (return_type.is_primitive()) {
         ss << "_";
-        auto iter = map_emc_types_to_mangled_shortversion.find(fn_obj.var_list->value_type.type);
+        auto iter = map_emc_types_to_mangled_shortversion.find(return_type.type);
         if (iter == map_emc_types_to_mangled_shortversion.end())
-            THROW_BUG("Could not find mangled short version of type: " + std::to_string((int)fn_obj.var_list->value_type.type));
-        /* Add a 'P' per pointer indirection. */
-        if (fn_obj.var_list->value_type.n_pointer_indirections)
-            for (int i = 0; i < fn_obj.var_list->value_type.n_pointer_indirections; i++)
-                ss << "P";
-        ss << iter->second;
-    } else if (fn_obj.var_list->value_type.is_void()) {
+            THROW_BUG("Could not find mangled short version of type: " + std::to_string((int)return_type.type));
+        ss << mangle_pointers(return_type) << iter->second;
+    } else if (return_type.is_void()) {
         
     } else
-        THROW_NOT_IMPLEMENTED("Mangle of type not impelmented: " + std::to_string((int)fn_obj.var_list->value_type.type));
+        THROW_NOT_IMPLEMENTED("Mangle of type not impelmented: " + std::to_string((int)return_type.type));
     
     
     /* Mangle the functions namespace, if any. */
-    if (fn_obj.nspace.size()) {
-        std::string nspace = fn_obj.nspace;
+    if (nspace.size()) {
         /* '_' is used as a delimiter so we need to double them if some is in a string */
         nspace = copy_and_replace_all_substrs(nspace, "_", "__");
         /* Namespaces' '.' can be replaced with just the capital letter as delimiter. */
@@ -1047,61 +871,130 @@ std::string mangle_emc_fn_name(const object_func &fn_obj)
     }
 
     /* Function name */
-    ss << "_" << copy_and_replace_all_substrs(fn_obj.name, "_", "__");
+    ss << "_" << copy_and_replace_all_substrs(name, "_", "__");
     /* Parameters */
-    ast_node_vardef_list *parlist_node = dynamic_cast<ast_node_vardef_list*>(fn_obj.para_list);
-    DEBUG_ASSERT_NOTNULL(parlist_node);
-    for (ast_node *para : parlist_node->v_defs) {
-        if (para->value_type.is_primitive()) {
+    for (const emc_type &para_type : v_param_types) {
+        if (para_type.is_primitive()) {
             ss << "_";
-            /* Add a 'P' per pointer indirection. */
-            if (para->value_type.n_pointer_indirections)
-                for (int i = 0; i < para->value_type.n_pointer_indirections; i++)
-                    ss << "P";
-            auto iter = map_emc_types_to_mangled_shortversion.find(para->value_type.type);
+            ss << mangle_pointers(para_type);
+            auto iter = map_emc_types_to_mangled_shortversion.find(para_type.type);
             if (iter == map_emc_types_to_mangled_shortversion.end())
-                THROW_BUG("Could not find mangled short version of type: " + std::to_string((int)para->value_type.type));
+                THROW_BUG("Could not find mangled short version of type: " + std::to_string((int)para_type.type));
             ss << iter->second;
-        } else if (para->value_type.is_struct()) {
-            DEBUG_ASSERT(para->value_type.mangled_name.size(),"");
-            std::string s = copy_and_replace_all_substrs(para->value_type.mangled_name,"engma_c58b_type_","");
+        } else if (para_type.is_struct()) {
+            DEBUG_ASSERT(para_type.mangled_name.size(),"");
+            std::string s = copy_and_replace_all_substrs(para_type.mangled_name,"engma_c58b_type_","");
             ss << "_S" << s << "S";
         } else
-            THROW_NOT_IMPLEMENTED("Mangle of type not impelmented: " + std::to_string((int)para->value_type.type));
+            THROW_NOT_IMPLEMENTED("Mangle of type not impelmented: " + std::to_string((int)para_type.type));
     }
 
     return ss.str();
 }
 
-std::string demangle_emc_fn_name(std::string c_fn_name)
+/* Splits the mangled name on the '_' delimiters, where "__" is an escaped '_' */
+static std::vector<std::string> split_mangled_tokens(const std::string &s)
 {
-/* TODO: Do if needed. */
-#if 0
-    std::ostringstream ss;
+    std::vector<std::string> v_tokens{""};
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] != '_')
+            v_tokens.back() += s[i];
+        else if (i + 1 < s.size() && s[i + 1] == '_')
+            v_tokens.back() += s[i++];
+        else
+            v_tokens.push_back("");
+    }
+    return v_tokens;
+}
+
+/* "NFooBarN" to "Foo.Bar" */
+static std::string demangle_nspace(const std::string &s)
+{
+    std::string ans;
+    for (size_t i = 1; i + 1 < s.size(); i++) {
+        if (i > 1 && isupper(s[i]))
+            ans += '.';
+        ans += s[i];
+    }
+    return ans;
+}
 
-    /* Magic sequence */
-    size_t pos = c_fn_name.find("engma_c58b_fn_");
+/* A primitive like "PPL" or "KPL", or "" */
+static std::string demangle_primitive(const std::string &token)
+{
+    static const std::map<std::string, std::string> map_short_to_typename = {
+        {"L", "Long"}, {"UL", "Ulong"}, {"I", "Int"}, {"UI", "Uint"},
+        {"H", "Short"}, {"UH", "Ushort"}, {"SB", "Sbyte"}, {"UB", "Byte"},
+        {"B", "Bool"}, {"F", "Float"}, {"D", "Double"}
+    };
+    std::string pointers;
+    size_t i = 0;
+    while (i < token.size()) {
+        bool is_const = token[i] == 'K';
+        size_t j = i + is_const;
+        if (j == token.size() || token[j] != 'P') {
+            if (is_const)
+                return "";
+            break;
+        }
+        pointers += is_const ? "&CONST " : "&";
+        i = j + 1;
+    }
+    auto iter = map_short_to_typename.find(token.substr(i));
+    if (iter == map_short_to_typename.end())
+        return "";
+    return pointers + iter->second;
+}
 
-    if (pos != 0)
+/* Turns a name from mangle_emc_fn_name() back into something readable, e.g.
+ * engma_c58b_fn_L_NFooN_add__one_PL_SPointS becomes Foo.add_one(&Long, Point).
+ * The return type is left out. Throws if the name is not a mangled Engma name.
+ */
+std::string demangle_emc_fn_name(std::string c_fn_name)
+{
+    const std::string prefix = "engma_c58b_fn_";
+    if (c_fn_name.rfind(prefix, 0) != 0 || c_fn_name.size() == prefix.size())
         throw std::runtime_error("Function name '" + c_fn_name + "' is not a mangled Engma name");
 
-    pos += std::string{"engma_c58b_fn_"}.size();
-    if (pos == c_fn_name.size())
-        throw std::runtime_error("Function name '" + c_fn_name + "' is not a mangled Engma name");
-    /* Search for name, which will be starting with lowercase. */
-    bool in_token = false;
-    for (; pos < c_fn_name.size(); pos++) {
-        char c = c_fn_name[pos];
-        if (in_token) {
-            if (c == '_'
-        } else {
-            
-        }
+    std::vector<std::string> v_tokens = split_mangled_tokens(c_fn_name.substr(prefix.size()));
+    size_t i = 0;
+
+    /* Return type, none if void */
+    if (demangle_primitive(v_tokens[i]).size() && v_tokens.size() > 1)
+        i++;
+
+    std::string nspace;
+    if (v_tokens[i].size() > 2 && v_tokens[i].front() == 'N' && v_tokens[i].back() == 'N' &&
+        i + 1 < v_tokens.size()) {
+        nspace = demangle_nspace(v_tokens[i]);
+        i++;
     }
 
-    return ss.str();  
-#endif
-    THROW_NOT_IMPLEMENTED("");  
+    std::ostringstream ss;
+    if (nspace.size())
+        ss << nspace << ".";
+    ss << v_tokens[i++] << "(";
+
+    for (bool first = true; i < v_tokens.size(); i++, first = false) {
+        std::string token = v_tokens[i];
+        std::string type_name = demangle_primitive(token);
+        if (type_name.empty() && token.size() > 2 && token.front() == 'S') {
+            /* A struct, whose mangled name might have a namespace "NFooN_Bar" */
+            if (token[1] == 'N' && token.back() == 'N' && i + 1 < v_tokens.size()) {
+                type_name = demangle_nspace(token.substr(1)) + ".";
+                token = v_tokens[++i];
+            } else
+                token = token.substr(1);
+            if (token.size() < 2 || token.back() != 'S')
+                throw std::runtime_error("Function name '" + c_fn_name + "' is not a mangled Engma name");
+            type_name += token.substr(0, token.size() - 1);
+        } else if (type_name.empty())
+            throw std::runtime_error("Function name '" + c_fn_name + "' is not a mangled Engma name");
+
+        ss << (first ? "" : ", ") << type_name;
+    }
+    ss << ")";
+    return ss.str();
 }
 
 std::string mangle_emc_type_name(std::string full_path)
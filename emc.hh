@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -10,13 +11,18 @@
 #include <cerrno>
 #include <limits>
 #include <map>
+#include <set>
 #include <cinttypes>
 #include <sstream>
 #include <filesystem>
 #include <functional>
+#include <variant>
+#include <type_traits>
 
 #include "emc_assert.hh"
 #include "util_string.hh"
+#include "const_value.hh"
+#include "ctfe.hh"
 
 # define YYLTYPE_IS_DECLARED 1
 # define YYLTYPE_IS_TRIVIAL 1
@@ -30,8 +36,8 @@ struct YYLTYPE
 };
 
 #ifndef NDEBUG
-extern int ast_node_count;
-extern int value_expr_count;
+extern thread_local int ast_node_count;
+extern thread_local int value_expr_count;
 #endif
 
 enum class engma_run_type {
@@ -60,18 +66,81 @@ struct engma_options {
     std::string optimization_level = "-O0";
 
     std::string debug_flag;
-};
 
-/* CLI options parsed into this struct in main() */
-extern struct engma_options opts;
+    /* Debug dumps, see diagnostics.hh */
+    std::vector<std::string> dumps;
+    std::string dump_dir = ".";
+    std::string dump_filter;
+
+    /* Limits for compile time evaluation of function calls. A step is
+       one evaluated AST node, the memory is counted in live local
+       variables and the depth in nested calls. ctfe_max_steps = 0 turns
+       it off. */
+    long ctfe_max_steps = 1000000;
+    long ctfe_max_memory = 100000;
+    int ctfe_max_depth = 64;
+
+    /* Names of the AST passes turned off with --disable-pass */
+    std::vector<std::string> disabled_passes;
+    bool time_passes = false;
+
+    /* Tiered compilation with -X. Functions whose call and loop count
+       reaches tier_threshold are recompiled at tier_optimization_level. */
+    bool tiered = false;
+    long tier_threshold = 10000;
+    std::string tier_optimization_level = "-O2";
+    bool tier_stats = false;    /* Print the number of recompiled functions */
+
+    /* Run with the bytecode interpreter instead of the jit, see interp.hh */
+    bool interp = false;
+
+    /* Compile each Engma function the first time it is called, with -X */
+    bool lazy = false;
+
+    /* Emit an array-mapping companion for each function of primitives */
+    bool batch_wrappers = false;
+
+    /* "table" or "json" to print the time spent in each phase, see time_report.hh */
+    std::string time_report;
+
+    /* "map" or "jitdump" to write symbols for perf with -X, see perf_map.hh */
+    std::string perf_map;
+
+    /* "counts", "report" or "trace" to instrument the functions, see instrument.hh */
+    std::string instrument;
+
+    /* Count the executions of each line, see instrument.hh */
+    bool coverage = false;
+
+    /* Samples per second with --profile, 0 when not profiling, see profiler.hh */
+    int profile_hz = 0;
+
+    /* -march, native by default with -X since the code runs where it is compiled */
+    std::string march;
+    /* --fp-model: "strict" IEEE, "contract" to FMA or "fast" math, for the
+       whole module. contract is libgccjit's default. */
+    std::string fp_model = "contract";
+    /* Lay out the fields of structs without c:: by alignment, to minimize the padding */
+    bool reorder_fields = false;
+    /* The targets of --target-clones without default, see target_clones.hh */
+    std::vector<std::string> target_clones;
+
+    /* Profile directories for --pgo-generate and --pgo-use, see pgo_profile_base() in compile.cc */
+    std::string pgo_generate;
+    std::string pgo_use;
+};
 
 /* compilation_units keeps track of type and objects in scopes for each compilation unit. */
 class ast_compilation_units;
 class typescope_stack;
 class objscope_stack;
-extern ast_compilation_units compilation_units;
-extern typescope_stack builtin_typestack;
-extern objscope_stack builtin_objstack;
+
+/* The options and the scopes are in the session that is current for the
+   thread, see engma_session at the end of this file. */
+engma_options& opts();
+ast_compilation_units& compilation_units();
+typescope_stack& builtin_typestack();
+objscope_stack& builtin_objstack();
 
 enum class ast_type {
     INVALID = 0,
@@ -281,10 +350,60 @@ struct emc_type {
     /* TODO: Should be flags for const etc instead? Do a "root type" and then have
              vector only for structs etc. */
     int n_pointer_indirections = 0;
+    /* Bit i is for the pointer of indirection i, where 0 is the innermost
+       pointer, i.e. the last '&' in "&RESTRICT &CONST Long". A const bit
+       means the pointer's target can't be written through it, a restrict bit
+       that the pointer is restrict qualified. Not part of operator==. */
+    unsigned ptr_const_mask = 0;
+    unsigned ptr_restrict_mask = 0;
+    /* The alignment from ALIGN(n) on the struct, field or variable, 0 if none.
+       Not part of operator==. */
+    int alignment = 0;
     bool is_const = false;
     bool is_const_expr = false;
     emc_types type;
 
+    /* If the target of the pointer can't be written through it */
+    bool is_ptr_to_const() const
+    {
+        return n_pointer_indirections && ptr_const_mask & 1u << (n_pointer_indirections - 1);
+    }
+
+    /* If a pointer of type from converts to this type without dropping a
+     * const. Like in C++, adding a const below the outermost indirection
+     * needs const on all the indirections above it, or "&&Long" could be
+     * made into a "&&CONST Long" and used to write to a const Long.
+     * Restrict is not checked, like in C.
+     */
+    bool accepts_ptr_quals_of(const emc_type &from) const
+    {
+        int n = std::min(n_pointer_indirections, from.n_pointer_indirections);
+        for (int i = 0; i < n; i++) {
+            unsigned bit = 1u << i;
+            if ((from.ptr_const_mask & bit) && !(ptr_const_mask & bit))
+                return false;
+            if ((ptr_const_mask & bit) && !(from.ptr_const_mask & bit))
+                for (int j = i + 1; j < n; j++)
+                    if (!(ptr_const_mask & 1u << j))
+                        return false;
+        }
+        return true;
+    }
+
+    /* The pointer part of the type in the source syntax, e.g. "&RESTRICT &CONST " */
+    std::string ptr_prefix() const
+    {
+        std::string s;
+        for (int i = n_pointer_indirections - 1; i >= 0; i--) {
+            s += "&";
+            if (ptr_const_mask & 1u << i)
+                s += "CONST ";
+            if (ptr_restrict_mask & 1u << i)
+                s += "RESTRICT ";
+        }
+        return s;
+    }
+
     bool operator==(const emc_type &r) const
     {
         DEBUG_ASSERT(is_struct() || is_primitive() || is_string(), ""); //Other not implemented
@@ -331,6 +450,7 @@ emc_type cast_to(const emc_type &a, const emc_types &target);
 emc_type standard_type_promotion(const emc_type &a, const emc_type &b);
 emc_type standard_type_promotion_or_invalid(const emc_type &a, const emc_type &b);
 emc_type string_to_type(std::string);
+int type_alignment(const emc_type &t);
 std::string mangle_emc_var_name(std::string name, std::string nspace);
 /* Forward declarations. */
 class objscope;
@@ -342,10 +462,13 @@ class object_func;
 /* Functions */
 void init_builtin_types();
 std::string mangle_emc_fn_name(const object_func &fn_obj);
+std::string mangle_emc_fn_name(const emc_type &return_type, std::string nspace,
+                               const std::string &name, const std::vector<emc_type> &v_param_types);
 std::string demangle_emc_fn_name(std::string c_fn_name);
 std::string mangle_emc_type_name(std::string full_path);
-void verify_obj_fits_in_type(obj* obj, emc_type type);
-obj* cast_obj_to_type_return_new_obj(obj* obj, emc_type type);
+void verify_value_fits_in_type(const const_value &value, emc_type type);
+const_value cast_value_to_type(const const_value &value, emc_type type, bool check = true);
+bool const_value_to_bool(const const_value &value);
 
 class obj {
 public:
@@ -375,6 +498,8 @@ public:
     std::string nspace; /* The namespace of the object */
     object_type type;
     int n_pointer_indirection = 0;
+    unsigned ptr_const_mask = 0;    /* See emc_type */
+    unsigned ptr_restrict_mask = 0;
 };
 
 class objscope;
@@ -547,9 +672,9 @@ public:
         std::string full_type_name = prefix + name;
 
         /* Search built-in types first */
-        if (this != &builtin_typestack)
-            if (builtin_typestack.has_type(name)) { /* TODO: Wastefull check */
-                ans = builtin_typestack.find_type(name);
+        if (this != &builtin_typestack())
+            if (builtin_typestack().has_type(name)) { /* TODO: Wastefull check */
+                ans = builtin_typestack().find_type(name);
                 return true;
             }
 
@@ -810,6 +935,8 @@ public:\
     {\
         emc_type t = emc_ret_type;\
         t.n_pointer_indirections = n_pointer_indirection;\
+        t.ptr_const_mask = ptr_const_mask;\
+        t.ptr_restrict_mask = ptr_restrict_mask;\
         return t;\
     }\
 };\
@@ -853,7 +980,10 @@ public:
 
     emc_type resolve()
     {
-        return struct_type;
+        emc_type t = struct_type;
+        t.ptr_const_mask = ptr_const_mask;
+        t.ptr_restrict_mask = ptr_restrict_mask;
+        return t;
     }
 };
 
@@ -878,6 +1008,9 @@ public:
     ast_node *root; /* TODO: remove */
     ast_node *para_list;
     ast_node *var_list;
+    /* The definition of the function, if it is an Engma function defined in
+       Engma code. Not owned. */
+    ast_node *fdef_node = nullptr;
     bool c_linkage = false;
 
     emc_type resolve();
@@ -890,15 +1023,14 @@ public:
     ast_node()
     {
 #ifndef NDEBUG
-        extern int ast_node_count; ast_node_count++;
+        extern thread_local int ast_node_count; ast_node_count++;
 #endif
     }
     virtual ~ast_node()
     {
 #ifndef NDEBUG
-        extern int ast_node_count; ast_node_count--;
+        extern thread_local int ast_node_count; ast_node_count--;
 #endif
-        delete value_obj;
     }
     
     YYLTYPE loc = {-1, -1, -1, -1};
@@ -908,11 +1040,24 @@ public:
 
     virtual ast_node* clone() {THROW_BUG("");};
     virtual emc_type resolve() = 0;
-    virtual obj* resolve_value() {THROW_BUG("");}
+
+    /* Folds the node if all the operands are constant expressions.
+       Sets value and value_type.is_const_expr. */
+    void fold_if_const(std::initializer_list<ast_node*> operands)
+    {
+        value = std::monostate{};
+        value_type.is_const_expr = false;
+        for (auto e : operands)
+            if (!e->value_type.is_const_expr)
+                return;
+        value = ctfe_fold(this);
+        value_type.is_const_expr = has_value(value);
+    }
 
     ast_type type = ast_type::INVALID;
     emc_type value_type = emc_type{emc_types::INVALID};
-    obj *value_obj = nullptr;
+    /* The folded value if value_type.is_const_expr */
+    const_value value;
 };
 
 enum class emc_operators {
@@ -939,225 +1084,92 @@ public:
     ast_node *first;
     ast_node *sec;
 
+    /* Folds the values of first and sec. Signed integer overflow is
+       undefined behaviour in the generated code, so like the compile time
+       evaluation of calls in ctfe.cc it is not folded. The node is left
+       non-const and the operation is done at runtime. */
     template <emc_operators op_type>
-    void make_value_obj()
-    {
-        obj* obj_1 = first->resolve_value();
-        obj* obj_2 = sec->resolve_value();
+    void make_value()
+    {
+        const_value casted_1 = cast_value_to_type(first->value, value_type);
+        const_value casted_2 = cast_value_to_type(sec->value, value_type);
+        bool overflow = false;
+
+        /* Both operands have the C type of value_type after the cast. */
+        value = std::visit([&](auto f) -> const_value {
+            using T = decltype(f);
+
+            if constexpr (std::is_same_v<T, std::monostate> || std::is_same_v<T, bool>)
+                THROW_NOT_IMPLEMENTED("");
+            else {
+                T s = std::get<T>(casted_2);
+
+                if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                    T r;
+                    if constexpr (op_type == emc_operators::PLUS)
+                        overflow = __builtin_add_overflow(f, s, &r);
+                    else if constexpr (op_type == emc_operators::MINUS)
+                        overflow = __builtin_sub_overflow(f, s, &r);
+                    else if constexpr (op_type == emc_operators::MULT)
+                        overflow = __builtin_mul_overflow(f, s, &r);
+                    else if constexpr (op_type == emc_operators::INTDIV ||
+                                       op_type == emc_operators::REM)
+                        /* Traps at runtime */
+                        overflow = f == std::numeric_limits<T>::lowest() && s == -1;
+                    if (overflow)
+                        return std::monostate{};
+                }
 
-        obj* casted_1 = cast_obj_to_type_return_new_obj(obj_1, value_type);
-        obj* casted_2 = cast_obj_to_type_return_new_obj(obj_2, value_type);
-        
-        if (value_type.is_long()) {
-            auto *f = dynamic_cast<object_long*>(casted_1);
-            auto *s = dynamic_cast<object_long*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_long{(int64_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_long{(int64_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_long{(int64_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_long{(int64_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_long{(int64_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                if (p < -9007199254740992 || p > 9007199254740992)
-                    THROW_NOT_IMPLEMENTED("To big answer from Long power operator");
-                value_obj = new object_long{(int64_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_int()) {
-            auto *f = dynamic_cast<object_int*>(casted_1);
-            auto *s = dynamic_cast<object_int*>(casted_2);
-            
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_int{(int32_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_int{(int32_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_int{(int32_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_int{(int32_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_int{(int32_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, int32_t>(p);
-                value_obj = new object_int{(int32_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_short()) {
-            auto *f = dynamic_cast<object_short*>(casted_1);
-            auto *s = dynamic_cast<object_short*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_short{(int16_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_short{(int16_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_short{(int16_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_short{(int16_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_short{(int16_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, int16_t>(p);                
-                value_obj = new object_short{(int16_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_sbyte()) {
-            auto *f = dynamic_cast<object_sbyte*>(casted_1);
-            auto *s = dynamic_cast<object_sbyte*>(casted_2);
-            
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_sbyte{(int8_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_sbyte{(int8_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_sbyte{(int8_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_sbyte{(int8_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_sbyte{(int8_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, int8_t>(p);
-                value_obj = new object_sbyte{(int8_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_ulong()) {
-            auto *f = dynamic_cast<object_ulong*>(casted_1);
-            auto *s = dynamic_cast<object_ulong*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_ulong{(uint64_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_ulong{(uint64_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_ulong{(uint64_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_ulong{(uint64_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_ulong{(uint64_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                if (p < -9007199254740992 || p > 9007199254740992)
-                    THROW_NOT_IMPLEMENTED("To big answer from Long power operator");
-                value_obj = new object_ulong{(uint64_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_uint()) {
-            auto *f = dynamic_cast<object_uint*>(casted_1);
-            auto *s = dynamic_cast<object_uint*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_uint{(uint32_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_uint{(uint32_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_uint{(uint32_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_uint{(uint32_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_uint{(uint32_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, uint32_t>(p);
-                value_obj = new object_uint{(uint32_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_ushort()) {
-            auto *f = dynamic_cast<object_ushort*>(casted_1);
-            auto *s = dynamic_cast<object_ushort*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_ushort{(uint16_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_ushort{(uint16_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_ushort{(uint16_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_ushort{(uint16_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_ushort{(uint16_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, uint16_t>(p);
-                value_obj = new object_ushort{(uint16_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_byte()) {
-            auto *f = dynamic_cast<object_byte*>(casted_1);
-            auto *s = dynamic_cast<object_byte*>(casted_2);
-            
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_byte{(uint8_t)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_byte{(uint8_t)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_byte{(uint8_t)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::INTDIV)
-                value_obj = new object_byte{(uint8_t)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_byte{(uint8_t)(f->val % s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, uint8_t>(p);
-                value_obj = new object_byte{(uint8_t)p};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_double()) {
-            auto *f = dynamic_cast<object_double*>(casted_1);
-            auto *s = dynamic_cast<object_double*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_double{(double)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_double{(double)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_double{(double)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::RDIV)
-                value_obj = new object_double{(double)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_double{(double)fmod(f->val, s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                value_obj = new object_double{p};
-            } else if constexpr (op_type == emc_operators::INTDIV) {
-                double p = f->val / s->val;
-                value_obj = new object_double{floor(p)};
-            } else
-                THROW_BUG("");
-        } else if (value_type.is_float()) {
-            auto *f = dynamic_cast<object_float*>(casted_1);
-            auto *s = dynamic_cast<object_float*>(casted_2);
-
-            if constexpr (op_type == emc_operators::PLUS)
-                value_obj = new object_float{(float)(f->val + s->val)};
-            else if constexpr (op_type == emc_operators::MINUS)
-                value_obj = new object_float{(float)(f->val - s->val)};
-            else if constexpr (op_type == emc_operators::MULT)
-                value_obj = new object_float{(float)(f->val * s->val)};
-            else if constexpr (op_type == emc_operators::RDIV)
-                value_obj = new object_float{(float)(f->val / s->val)};
-            else if constexpr (op_type == emc_operators::REM)
-                value_obj = new object_float{(float)fmodf(f->val, s->val)};
-            else if constexpr (op_type == emc_operators::POW) {
-                double p = pow(f->val, s->val);
-                check_in_range<double, float>(p);
-                value_obj = new object_float{(float)p};
-            } else if constexpr (op_type == emc_operators::INTDIV) {
-                float p = f->val / s->val;
-                value_obj = new object_float{floorf(p)};
-            } else
-                THROW_BUG("");
-        } else
-            THROW_NOT_IMPLEMENTED("");
-        delete casted_1; delete casted_2;
+                if constexpr (op_type == emc_operators::PLUS)
+                    return (T)(f + s);
+                else if constexpr (op_type == emc_operators::MINUS)
+                    return (T)(f - s);
+                else if constexpr (op_type == emc_operators::MULT)
+                    return (T)(f * s);
+                else if constexpr (op_type == emc_operators::RDIV) {
+                    if constexpr (!std::is_floating_point_v<T>)
+                        THROW_BUG("");
+                    else
+                        return (T)(f / s);
+                } else if constexpr (op_type == emc_operators::INTDIV) {
+                    if constexpr (std::is_same_v<T, double>)
+                        return floor(f / s);
+                    else if constexpr (std::is_same_v<T, float>)
+                        return floorf(f / s);
+                    else {
+                        if (s == 0)
+                            THROW_USER_ERROR_LOC("Integer division by zero in constant expression");
+                        return (T)(f / s);
+                    }
+                } else if constexpr (op_type == emc_operators::REM) {
+                    if constexpr (std::is_same_v<T, double>)
+                        return fmod(f, s);
+                    else if constexpr (std::is_same_v<T, float>)
+                        return fmodf(f, s);
+                    else {
+                        if (s == 0)
+                            THROW_USER_ERROR_LOC("Integer division by zero in constant expression");
+                        return (T)(f % s);
+                    }
+                } else if constexpr (op_type == emc_operators::POW) {
+                    double p = pow(f, s);
+                    if constexpr (std::is_same_v<T, double>)
+                        return p;
+                    else if constexpr (sizeof(T) == 8) {
+                        if (p < -9007199254740992 || p > 9007199254740992)
+                            THROW_NOT_IMPLEMENTED("To big answer from Long power operator");
+                        return (T)p;
+                    } else {
+                        check_in_range<double, T>(p);
+                        return (T)p;
+                    }
+                } else
+                    THROW_BUG("");
+            }
+        }, casted_1);
+
+        if (overflow)
+            value_type.is_const_expr = false;
     }
 };
 
@@ -1182,7 +1194,7 @@ public:
     {
         std::string full_type_name = resolve_full_type_name();
 
-        value_type = compilation_units.get_current_typestack().find_type(full_type_name);
+        value_type = compilation_units().get_current_typestack().find_type(full_type_name);
 
         return value_type;
     }
@@ -1382,12 +1394,16 @@ public:
     {
         value_type = emc_type{emc_types::DOUBLE};
         value_type.is_const_expr = true;
+        value = d;
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj = new object_double{d};
+        auto c = new ast_node_double_literal{d};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1428,12 +1444,16 @@ public:
     {
         value_type = emc_type{emc_types::INT};
         value_type.is_const_expr = true;
+        value = (int32_t)i;
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj = new object_long{i};
+        auto c = new ast_node_int_literal{i};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1483,7 +1503,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1512,7 +1534,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1541,7 +1565,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1570,7 +1596,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1586,18 +1614,35 @@ public:
         
     }
     
+    /* Per '&', the last one first */
     std::vector<bool> v_const;
+    std::vector<bool> v_restrict;
 
     ast_node* clone()
     {
         auto argl = new ast_node_ptrdef_list { };
         argl->v_const = v_const;
+        argl->v_restrict = v_restrict;
         return argl;
     }
 
-    void append_const(bool is_const)
+    void append_const(bool is_const, bool is_restrict = false)
     {
         v_const.push_back(is_const);
+        v_restrict.push_back(is_restrict);
+    }
+
+    /* Sets the pointer part of t */
+    void apply_to_type(emc_type &t) const
+    {
+        t.n_pointer_indirections = (int)v_const.size();
+        t.ptr_const_mask = t.ptr_restrict_mask = 0;
+        for (size_t i = 0; i < v_const.size(); i++) {
+            if (v_const[i])
+                t.ptr_const_mask |= 1u << i;
+            if (v_restrict[i])
+                t.ptr_restrict_mask |= 1u << i;
+        }
     }
 
     emc_type resolve()
@@ -1631,7 +1676,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1660,7 +1707,9 @@ public:
     {
     	first->resolve();
     	sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -1686,7 +1735,9 @@ public:
     emc_type resolve()
     {
     	first->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first});
+        return value_type;
     }
 };
 
@@ -1706,16 +1757,19 @@ public:
     {
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::PLUS>();
+            make_value<emc_operators::PLUS>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_add{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1735,16 +1789,19 @@ public:
     {
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::MINUS>();
+            make_value<emc_operators::MINUS>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_sub{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1764,16 +1821,19 @@ public:
     {
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::MULT>();
+            make_value<emc_operators::MULT>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_mul{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1793,16 +1853,19 @@ public:
     {
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::REM>();
+            make_value<emc_operators::REM>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_rem{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1822,16 +1885,19 @@ public:
     {
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::INTDIV>();
+            make_value<emc_operators::INTDIV>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_intdiv{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1856,16 +1922,19 @@ public:
         else
             value_type = value_type_tmp;
 
-        /* Create an object from the value of first and sec's objects */
+        /* Fold the values of first and sec */
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::RDIV>();
+            make_value<emc_operators::RDIV>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_rdiv{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1894,6 +1963,9 @@ public:
         if(!value_type.n_pointer_indirections)
             THROW_USER_ERROR_LOC("Dereferencing non-pointer");
         value_type.n_pointer_indirections--;
+        unsigned mask = (1u << value_type.n_pointer_indirections) - 1;
+        value_type.ptr_const_mask &= mask;
+        value_type.ptr_restrict_mask &= mask;
         return value_type;
     }
 };
@@ -1949,14 +2021,17 @@ public:
         value_type = standard_type_promotion(first->resolve(), sec->resolve());
 
         if (value_type.is_const_expr)
-            make_value_obj<emc_operators::POW>();
+            make_value<emc_operators::POW>();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_pow{first->clone(), sec->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1976,7 +2051,17 @@ public:
 
     emc_type resolve()
     {
-        return value_type = first->resolve();
+        value_type = first->resolve();
+        fold_if_const({first});
+        return value_type;
+    }
+
+    ast_node* clone()
+    {
+        auto c = new ast_node_abs{first->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -1999,63 +2084,41 @@ public:
     
     ast_node *first;
 
-    template<class Obj_class, class C_type>
-    void make_value_obj(obj* child_obj)
+    void make_value()
     {
-        auto child_obj_t = dynamic_cast<Obj_class*>(child_obj);
-        DEBUG_ASSERT_NOTNULL(child_obj_t);
-        auto obj_t = new Obj_class{};
-        if (std::is_integral<C_type>() && child_obj_t->val == std::numeric_limits<C_type>::lowest()) {
-            THROW_USER_ERROR_LOC("Negating int will be out of range: " + std::to_string(child_obj_t->val));
-        }
-        obj_t->val = -child_obj_t->val;
-        value_obj = obj_t;
+        value = std::visit([&](auto v) -> const_value {
+            using T = decltype(v);
+
+            if constexpr (std::is_same_v<T, std::monostate>)
+                THROW_BUG("");
+            else if constexpr (std::is_same_v<T, bool>)
+                THROW_USER_ERROR_LOC("Can't negate bool type with unary minus");
+            else if constexpr (std::is_unsigned_v<T>)
+                THROW_USER_ERROR_LOC("Can't negate unsigned integer type with unary minus");
+            else {
+                if (std::is_integral_v<T> && v == std::numeric_limits<T>::lowest())
+                    THROW_USER_ERROR_LOC("Negating int will be out of range: " + std::to_string(v));
+                return (T)-v;
+            }
+        }, first->value);
     }
 
     emc_type resolve()
     {
         value_type = first->resolve();
 
-        if (value_type.is_const_expr) {
-            auto child_obj = first->resolve_value();
-             
-            switch (child_obj->type) {
-            case object_type::DOUBLE:
-                make_value_obj<object_double, double>(child_obj);
-                break;
-            case object_type::FLOAT:
-                make_value_obj<object_float, float>(child_obj);
-                break;
-            case object_type::LONG:
-                make_value_obj<object_long, int64_t>(child_obj);
-                break;
-            case object_type::INT:
-                make_value_obj<object_int, int32_t>(child_obj);
-                break;
-            case object_type::SHORT:
-                make_value_obj<object_short, int16_t>(child_obj);
-                break;
-            case object_type::SBYTE:
-                make_value_obj<object_short, int8_t>(child_obj);
-                break;
-            case object_type::ULONG:
-            case object_type::UINT:
-            case object_type::USHORT:
-            case object_type::BYTE:
-                THROW_USER_ERROR_LOC("Can't negate unsigned integer type with unary minus");
-                break;
-            case object_type::BOOL:
-                THROW_USER_ERROR_LOC("Can't negate bool type with unary minus");
-                break;
-            }
-        }
+        if (value_type.is_const_expr)
+            make_value();
 
         return value_type;
     }
 
-    obj* resolve_value()
+    ast_node* clone()
     {
-        return value_obj;
+        auto c = new ast_node_uminus{first->clone()};
+        c->value_type = value_type;
+        c->value = value;
+        return c;
     }
 };
 
@@ -2088,7 +2151,7 @@ public:
         nspace = node->nspace;
         full_name = node->full_name;
         
-        auto v = compilation_units.get_current_objstack().find_objects_by_not_mangled_name(name, nspace);
+        auto v = compilation_units().get_current_objstack().find_objects_by_not_mangled_name(name, nspace);
         if (v.size() == 0) /* TODO: Kanske borde throwa "inte hittat än" för att kunna fortsätta? */
             THROW_USER_ERROR_LOC("Object does not exist: " + full_name);
         /* Pick the object in top scope (which is in the front of the vector from find...() */
@@ -2099,8 +2162,12 @@ public:
 
     ast_node* clone()
     {
-        auto c = new ast_node_var { typedotnamechain->clone() };
+        auto c = new ast_node_var { typedotnamechain ? typedotnamechain->clone() : nullptr };
         c->value_type = value_type;
+        c->value = value;
+        c->name = name;
+        c->nspace = nspace;
+        c->full_name = full_name;
         return c;
     }
 };
@@ -2125,8 +2192,16 @@ public:
     emc_type resolve()
     {
         sec->resolve();
-        return value_type = first->resolve();
+        value_type = first->resolve();
+        if (writes_through_const(first))
+            THROW_USER_ERROR_LOC("Assignment through a pointer to const");
+        if (!value_type.accepts_ptr_quals_of(sec->value_type))
+            THROW_USER_ERROR_LOC("Assignment with incompatible const qualifiers");
+        return value_type;
     }
+
+    /* If the lvalue is, or is a field of, the target of a pointer to const */
+    static bool writes_through_const(ast_node *lvalue);
 };
 
 class ast_node_cmp: public ast_node {
@@ -2153,7 +2228,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first, sec});
+        return value_type;
     }
 };
 
@@ -2213,9 +2290,9 @@ public:
     emc_type resolve()
     {
         
-        compilation_units.get_current_objstack().push_new_scope();
+        compilation_units().get_current_objstack().push_new_scope();
         value_type = first->resolve();
-        compilation_units.get_current_objstack().pop_scope();
+        compilation_units().get_current_objstack().pop_scope();
         return value_type;
     }
 };
@@ -2297,9 +2374,9 @@ public:
     emc_type resolve()
     {
         cond_e->resolve();
-        compilation_units.get_current_objstack().push_new_scope();
+        compilation_units().get_current_objstack().push_new_scope();
         if_el->resolve();
-        compilation_units.get_current_objstack().pop_scope();
+        compilation_units().get_current_objstack().pop_scope();
 
         if (elseif_el) {
             auto *elseif_el_t = dynamic_cast<ast_node_elseiflist*>(elseif_el);
@@ -2309,20 +2386,20 @@ public:
                 cond_e->resolve();
 
             for (auto elseif : elseif_el_t->v_elseif) {
-                compilation_units.get_current_objstack().push_new_scope();
+                compilation_units().get_current_objstack().push_new_scope();
                 elseif->resolve();
-                compilation_units.get_current_objstack().pop_scope();
+                compilation_units().get_current_objstack().pop_scope();
             }
         }
         if (else_el) {
-            compilation_units.get_current_objstack().push_new_scope();
+            compilation_units().get_current_objstack().push_new_scope();
             else_el->resolve();
-            compilation_units.get_current_objstack().pop_scope();
+            compilation_units().get_current_objstack().pop_scope();
         }
         if (also_el) {
-            compilation_units.get_current_objstack().push_new_scope();
+            compilation_units().get_current_objstack().push_new_scope();
             also_el->resolve();
-            compilation_units.get_current_objstack().pop_scope();
+            compilation_units().get_current_objstack().pop_scope();
         }
 
         return value_type = emc_type{emc_types::NONE};
@@ -2356,18 +2433,18 @@ public:
         cond_e->resolve();
         if (!else_el) {
             
-            compilation_units.get_current_objstack().push_new_scope();
+            compilation_units().get_current_objstack().push_new_scope();
             value_type = if_el->resolve();
-            compilation_units.get_current_objstack().pop_scope();
+            compilation_units().get_current_objstack().pop_scope();
             return value_type;
         } else {
             
-            compilation_units.get_current_objstack().push_new_scope();
+            compilation_units().get_current_objstack().push_new_scope();
             auto value_type_if = if_el->resolve();
-            compilation_units.get_current_objstack().pop_scope();
-            compilation_units.get_current_objstack().push_new_scope();
+            compilation_units().get_current_objstack().pop_scope();
+            compilation_units().get_current_objstack().push_new_scope();
             auto value_type_else = else_el->resolve();
-            compilation_units.get_current_objstack().pop_scope();
+            compilation_units().get_current_objstack().pop_scope();
 
             auto t = standard_type_promotion_or_invalid(value_type_if, value_type_else);
             if (t.is_valid())
@@ -2555,6 +2632,7 @@ public:
     std::string name;
     std::string nspace;
     ast_node *arg_list;
+    ast_node *fdef_node = nullptr; /* Definition of the called function, if any. Not owned. */
 
     emc_type resolve()
     {
@@ -2569,7 +2647,7 @@ public:
         if (name == "one_ptrto_long")
             int b = 0;
         
-        std::vector<obj*> v_objs = compilation_units.get_current_objstack().find_objects_by_not_mangled_name(name, nspace);
+        std::vector<obj*> v_objs = compilation_units().get_current_objstack().find_objects_by_not_mangled_name(name, nspace);
         if (!v_objs.size()) /* TODO: Kolla så fn */
             THROW_USER_ERROR_LOC("Could not find any function " + nspace + " " + name);
 
@@ -2592,7 +2670,9 @@ public:
                 /* Check if the parameters in the function object and the arguments of the call
                  * all have the same type. */
                 for (int i = 0; i < parameter_list->v_defs.size(); i++) {
-                    if (parameter_list->v_defs[i]->value_type != argument_list->v_ast_args[i]->value_type) {
+                    const emc_type &para_type = parameter_list->v_defs[i]->value_type;
+                    const emc_type &arg_type = argument_list->v_ast_args[i]->value_type;
+                    if (para_type != arg_type || !para_type.accepts_ptr_quals_of(arg_type)) {
                         hit = false;
                         break;
                     }
@@ -2608,9 +2688,23 @@ public:
             THROW_USER_ERROR_LOC("There are no objects of '" + name + "' that match the call signature");
         /* This function call will call this mangled name */
         mangled_name = choosen_obj->mangled_name;
+        fdef_node = dynamic_cast<object_func*>(choosen_obj)->fdef_node;
 
-        return value_type = choosen_obj->resolve();
+        value_type = choosen_obj->resolve();
+
+        /* If all the arguments are constant expressions, try to evaluate the call
+         * at compile time. */
+        value = std::monostate{};
+        bool all_args_const = true;
+        for (auto arg : dynamic_cast<ast_node_arglist*>(arg_list)->v_ast_args)
+            all_args_const = all_args_const && arg->value_type.is_const_expr;
+        if (fdef_node && all_args_const)
+            value = ctfe_eval_call(this);
+        value_type.is_const_expr = has_value(value);
+
+        return value_type;
     }
+
 };
 
 class ast_node_funcdec: public ast_node {
@@ -2685,7 +2779,17 @@ public:
             e->first->resolve();
         }
         (*v_children.rbegin())->sec->resolve(); /* Dont forget this one */
-        return value_type = emc_type{emc_types::INT}; /* Always an int */
+        value_type = emc_type{emc_types::INT}; /* Always an int */
+
+        /* Folded if all the operands are constant */
+        bool all_const = v_children.back()->sec->value_type.is_const_expr;
+        for (auto e : v_children)
+            all_const = all_const && e->first->value_type.is_const_expr;
+        value = std::monostate{};
+        if (all_const)
+            value = ctfe_fold(this);
+        value_type.is_const_expr = has_value(value);
+        return value_type;
     }
 
     void append_next(ast_node_chainable *node)
@@ -2723,7 +2827,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 
 };
@@ -2747,7 +2853,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 };
 
@@ -2769,19 +2877,10 @@ public:
     }
     emc_type resolve()
     {
-        emc_type type1 = first->resolve(); 
-        emc_type type2 = sec->resolve();
-
-        /* TODO: This node could be const_expr too if
-           both these are that. */
-        if (type1.is_const_expr) {
-            first->resolve_value();
-        }
-        if (type2.is_const_expr) {
-            sec->resolve_value();
-        }
-
-        return value_type = emc_type{emc_types::INT};
+        first->resolve(); sec->resolve();
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 };
 
@@ -2804,7 +2903,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 };
 
@@ -2827,7 +2928,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 };
 
@@ -2852,7 +2955,9 @@ public:
     emc_type resolve()
     {
         first->resolve(); sec->resolve();
-        return value_type = emc_type{emc_types::INT};
+        value_type = emc_type{emc_types::INT};
+        fold_if_const({first.get(), sec.get()});
+        return value_type;
     }
 };
 
@@ -2888,6 +2993,7 @@ public:
     ast_node *typedotchain = nullptr; /* The type: *Foo* Bar.name */
     ast_node *typedotnamechain = nullptr; /* The name with ns: Foo *Bar.name* */
     int n_pointer_indirections = 0;
+    int alignment = 0;          /* From ALIGN(n), 0 if none */
     bool clinkage = false;
 
     ast_node* clone()
@@ -2902,9 +3008,26 @@ public:
         c->mangled_name = mangled_name;
         c->full_name = full_name;
         c->n_pointer_indirections = n_pointer_indirections;
+        c->alignment = alignment;
         return c;        
     }
 
+    /* Sets the alignment of the type, which ALIGN(n) can only raise */
+    void resolve_alignment(emc_type &type)
+    {
+        /* A pointer doesn't have the alignment of the struct it points to */
+        if (type.n_pointer_indirections)
+            type.alignment = 0;
+        if (!alignment)
+            return;
+        if (alignment < 0 || alignment & (alignment - 1))
+            THROW_USER_ERROR_LOC("ALIGN(" + std::to_string(alignment) + ") is not a power of two");
+        if (alignment < type_alignment(type))
+            THROW_USER_ERROR_LOC("ALIGN(" + std::to_string(alignment) + ") is less than the alignment " +
+                                 std::to_string(type_alignment(type)) + " of the type");
+        type.alignment = alignment;
+    }
+
     emc_type resolve()
     {
         /* Resolve the type node */
@@ -2918,7 +3041,7 @@ public:
         var_name = typedotnamechain_T->name;
         nspace = typedotnamechain_T->nspace;
 
-        if (compilation_units.get_current_objstack().is_in_global_scope() && nspace.size())
+        if (compilation_units().get_current_objstack().is_in_global_scope() && nspace.size())
             THROW_USER_ERROR_LOC("Can't specify a namespace in variable declarations in a scope: " + nspace + "." + var_name);
 
         /* Set how many pointer indirections this var def has */
@@ -2927,9 +3050,12 @@ public:
             auto ptrdef_node_t = dynamic_cast<ast_node_ptrdef_list*>(ptrdef_node);
             DEBUG_ASSERT_NOTNULL(ptrdef_node_t);
             n_pointer_indirections = (int)ptrdef_node_t->v_const.size();
-            type.n_pointer_indirections = n_pointer_indirections;
+            if (n_pointer_indirections > 32)
+                THROW_USER_ERROR_LOC("More than 32 pointer indirections");
+            ptrdef_node_t->apply_to_type(type);
         }
-        /* TODO: Bitfield for const ptr? volatile? */
+        resolve_alignment(type);
+        /* TODO: volatile? */
 
         obj *od = nullptr;
         if (type.is_double())
@@ -2958,24 +3084,26 @@ public:
             od = new object_struct{var_name, "", type, n_pointer_indirections};
         else
             THROW_NOT_IMPLEMENTED("Type not implemented ast_node_def");
+        od->ptr_const_mask = type.ptr_const_mask;
+        od->ptr_restrict_mask = type.ptr_restrict_mask;
 
         /* Flytta in i ctor för objektet? */
         
         /* If we are in filescope (global scope) any declaration might be in a
          * namespace, so we add it to the specified namespace. */
-        if (compilation_units.get_current_objstack().is_in_global_scope())
-            if (compilation_units.get_current_typestack().current_scope.size()) {
+        if (compilation_units().get_current_objstack().is_in_global_scope())
+            if (compilation_units().get_current_typestack().current_scope.size()) {
                 if (nspace.size())
-                    nspace = compilation_units.get_current_typestack().current_scope + "." + nspace;
+                    nspace = compilation_units().get_current_typestack().current_scope + "." + nspace;
                 else
-                    nspace = compilation_units.get_current_typestack().current_scope;
+                    nspace = compilation_units().get_current_typestack().current_scope;
             }
 
         od->nspace = nspace;
         full_name = (nspace.size() ? nspace + ".": "") + var_name;
         
         /* Only filescope variables need mangling. TODO: Static variables */
-        if (!clinkage && compilation_units.get_current_objstack().is_in_global_scope()) {
+        if (!clinkage && compilation_units().get_current_objstack().is_in_global_scope()) {
             mangled_name = mangle_emc_var_name( var_name, 
                                                 nspace);
             od->mangled_name = mangled_name;
@@ -2984,17 +3112,18 @@ public:
             od->mangled_name = mangled_name = var_name;
         }
 
-        compilation_units.get_current_objstack().get_top_scope().push_object(od);
+        compilation_units().get_current_objstack().get_top_scope().push_object(od);
 
-        if (value_node)
+        if (value_node) {
             value_node->resolve();
+            if (!type.accepts_ptr_quals_of(value_node->value_type))
+                THROW_USER_ERROR_LOC("Initializing '" + var_name + "' with incompatible const qualifiers");
+        }
 
         value_type = type;
-        /* If the rh node is a constant expression, resolve its value */
-        if (value_node && value_node->value_type.is_const_expr) {
-            auto child_obj = value_node->resolve_value();
-            verify_obj_fits_in_type(child_obj, value_type);
-        }
+        /* If the rh node is a constant expression, check that its value fits */
+        if (value_node && value_node->value_type.is_const_expr)
+            verify_value_fits_in_type(value_node->value, value_type);
         return value_type;
     }
 
@@ -3017,8 +3146,11 @@ public:
             auto ptrdef_node_t = dynamic_cast<ast_node_ptrdef_list*>(ptrdef_node);
             DEBUG_ASSERT_NOTNULL(ptrdef_node_t);
             n_pointer_indirections = (int)ptrdef_node_t->v_const.size();
-            type.n_pointer_indirections = n_pointer_indirections;
+            if (n_pointer_indirections > 32)
+                THROW_USER_ERROR_LOC("More than 32 pointer indirections");
+            ptrdef_node_t->apply_to_type(type);
         }
+        resolve_alignment(type);
 
         if (value_node)
             value_node->resolve();
@@ -3072,6 +3204,8 @@ public:
     }
 
     std::vector<ast_node_def*> v_fields;
+    int alignment = 0;          /* From "STRUCT ALIGN(n)", 0 if none */
+    bool clinkage = false;      /* "STRUCT c::" keeps the declaration order with --reorder-fields */
 
     void append_field(ast_node *node)
     {
@@ -3093,6 +3227,12 @@ public:
             t.children_types.push_back(e->value_type);
             t.children_types.back().name = e->var_name; /* def nodes does not store var name in type usually*/
         }
+        if (alignment < 0 || alignment & (alignment - 1))
+            THROW_USER_ERROR_LOC("ALIGN(" + std::to_string(alignment) + ") is not a power of two");
+        if (alignment && alignment < type_alignment(t))
+            THROW_USER_ERROR_LOC("ALIGN(" + std::to_string(alignment) + ") is less than the alignment " +
+                                 std::to_string(type_alignment(t)) + " of the fields");
+        t.alignment = alignment;
 
         //resolve_scope.push_type(t); //TODO: Need to be in TYPE's ast_node
 
@@ -3124,7 +3264,7 @@ public:
         DEBUG_ASSERT_NOTNULL(type_node);
         /* We prepend the current namespace scope to the type (it is stored
            with absolute namespace). */
-        nspace = compilation_units.get_current_typestack().current_scope;
+        nspace = compilation_units().get_current_typestack().current_scope;
         
         type_node->resolve_name_and_namespace(&type_name, &nspace);
         if (nspace.size())
@@ -3141,7 +3281,7 @@ public:
          * is called from here. */
         struct_node->value_type.name = type_name;
         struct_node->value_type.mangled_name = mangled_name;
-        compilation_units.get_current_typestack().push_type(full_relative_name, struct_node->value_type);
+        compilation_units().get_current_typestack().push_type(full_relative_name, struct_node->value_type);
 
         return value_type = emc_type{emc_types::NONE};
     }
@@ -3182,11 +3322,8 @@ public:
         if (first->type == ast_type::ARGUMENT_LIST) {
             auto arg_list = dynamic_cast<ast_node_arglist*>(first);
             DEBUG_ASSERT_NOTNULL(arg_list);
-            for (ast_node* node : arg_list->v_ast_args) {
+            for (ast_node* node : arg_list->v_ast_args)
                 value_type.children_types.push_back(node->value_type);
-                if (node->value_type.is_const_expr)
-                    node->resolve_value();
-            }
         } else
             THROW_BUG("Child first is not an arglist");
 
@@ -3223,7 +3360,7 @@ public:
 
         std::string full_nspace = typedotchain_T->resolve_full_type_name();
         
-        compilation_units.get_current_typestack().set_scopes(full_nspace);
+        compilation_units().get_current_typestack().set_scopes(full_nspace);
 
         return value_type = emc_type{emc_types::NONE};
     }
@@ -3231,3 +3368,34 @@ public:
 
 void push_dummyobject_to_resolve_scope(std::string var_name, emc_type type);
 
+/* The state of one compilation. The compiler works on the session that is
+ * current for the thread, so independent sessions can compile on different
+ * threads at the same time. The state of the code generation is in the jit
+ * objects. */
+struct engma_session {
+    engma_options opts; /* E.g. the CLI options parsed in main() */
+    ast_compilation_units compilation_units;
+    typescope_stack builtin_typestack;
+    objscope_stack builtin_objstack;
+    std::set<std::string> dump_paths; /* Dumps written to, see diagnostics.hh */
+};
+
+extern thread_local engma_session *current_session;
+
+/* Makes session the current one of the thread while in scope */
+class engma_session_scope {
+public:
+    engma_session_scope(engma_session *session)
+        : prev(current_session)
+    {
+        current_session = session;
+    }
+
+    ~engma_session_scope()
+    {
+        current_session = prev;
+    }
+
+private:
+    engma_session *prev;
+};
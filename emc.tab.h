@@ -75,20 +75,23 @@ extern int yydebug;
     NAMESPACE = 276,               /* NAMESPACE  */
     USING = 277,                   /* USING  */
     IMPORT = 278,                  /* IMPORT  */
-    OR = 279,                      /* OR  */
-    NOR = 280,                     /* NOR  */
-    XOR = 281,                     /* XOR  */
-    XNOR = 282,                    /* XNOR  */
-    AND = 283,                     /* AND  */
-    NAND = 284,                    /* NAND  */
-    NOT = 285,                     /* NOT  */
-    CMP = 286,                     /* CMP  */
-    LEQ = 287,                     /* LEQ  */
-    GEQ = 288,                     /* GEQ  */
-    EQU = 289,                     /* EQU  */
-    NEQ = 290,                     /* NEQ  */
-    INTDIV = 291,                  /* INTDIV  */
-    UMINUS = 292                   /* UMINUS  */
+    CONST = 279,                   /* CONST  */
+    RESTRICT = 280,                /* RESTRICT  */
+    ALIGN = 281,                   /* ALIGN  */
+    OR = 282,                      /* OR  */
+    NOR = 283,                     /* NOR  */
+    XOR = 284,                     /* XOR  */
+    XNOR = 285,                    /* XNOR  */
+    AND = 286,                     /* AND  */
+    NAND = 287,                    /* NAND  */
+    NOT = 288,                     /* NOT  */
+    CMP = 289,                     /* CMP  */
+    LEQ = 290,                     /* LEQ  */
+    GEQ = 291,                     /* GEQ  */
+    EQU = 292,                     /* EQU  */
+    NEQ = 293,                     /* NEQ  */
+    INTDIV = 294,                  /* INTDIV  */
+    UMINUS = 295                   /* UMINUS  */
   };
   typedef enum yytokentype yytoken_kind_t;
 #endif
@@ -102,7 +105,7 @@ union YYSTYPE
     ast_node *node;
     std::string *s;
 
-#line 106 "emc.tab.h"
+#line 109 "emc.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -5,9 +5,7 @@
 #include <iostream>
 
 #include "emc.hh"
-
-ast_node *ast_root; /* Bison parser writes answer to this. */
-bool parsed_eol = false;
+#include "time_report.hh"
 
 typedef void* yyscan_t;
 }
@@ -27,7 +25,7 @@ typedef void* yyscan_t;
 %token <s> TYPENAME 
 %token <s> ESC_STRING
 
-%token EOL IF DO END ELSE WHILE ENDOFFILE FUNC ELSEIF ALSO RETURN STRUCT TYPE CLINKAGE NAMESPACE USING IMPORT
+%token EOL IF DO END ELSE WHILE ENDOFFILE FUNC ELSEIF ALSO RETURN STRUCT TYPE CLINKAGE NAMESPACE USING IMPORT CONST RESTRICT ALIGN
 
 %right '='
 %left OR NOR XOR XNOR
@@ -35,7 +33,8 @@ typedef void* yyscan_t;
 %right NOT
 %left CMP LEQ GEQ EQU NEQ '>' '<'
 %left '+' '-' 
-%left '*' '/' '%' '.' INTDIV
+%left '*' '/' '%' INTDIV
+%left '.'
 %right '^' '@' '&' 
 
 %nonassoc DO
@@ -46,7 +45,7 @@ typedef void* yyscan_t;
 
 %type <node> exp cmp_exp e se cse exp_list code_block arg_list
 %type <node> vardef elseif_list sl_elseif_list vardef_list field_list struct_def
-%type <node> ptrdef_list typedotchain typedotnamechain using usingchain
+%type <node> ptrdef_list ptr_quals typedotchain typedotnamechain using usingchain
 
 %define parse.trace
     
@@ -54,6 +53,25 @@ typedef void* yyscan_t;
 %code {
 int yylex (YYSTYPE * yylval_param, YYLTYPE * yylloc_param , void * yyscanner);
 int yyerror(struct YYLTYPE * yylloc_param, void *scanner, const char *s);
+
+/* The lexer is timed apart from the parser with --time-report */
+static int timed_yylex(YYSTYPE * yylval_param, YYLTYPE * yylloc_param , void * yyscanner)
+{
+    phase_timer timer{"lex", false};
+    return yylex(yylval_param, yylloc_param, yyscanner);
+}
+#define yylex timed_yylex
+
+/* The n in "ALIGN(n)" */
+static int align_value(ast_node *number)
+{
+    auto lit = dynamic_cast<ast_node_int_literal*>(number);
+    int n = lit ? lit->i : 0;
+    delete number;
+    if (!lit)
+        throw std::runtime_error("ALIGN() takes an integer");
+    return n;
+}
 }    
     
     
@@ -63,12 +81,12 @@ program:
 		/*| program*/ 
      	 cse
                         { 	
-                            auto &cu = compilation_units.get_current_compilation_unit();
+                            auto &cu = compilation_units().get_current_compilation_unit();
                         	cu.ast_root = $1;
                         	YYACCEPT;
                         }
         | ENDOFFILE     { 
-                            auto &cu = compilation_units.get_current_compilation_unit();
+                            auto &cu = compilation_units().get_current_compilation_unit();
                             cu.ast_root = nullptr;
                             cu.parsed_eol = true; 
                             YYACCEPT;
@@ -293,11 +311,40 @@ ptrdef_list: '&'                            {
                                                 auto p = new ast_node_ptrdef_list;
                                                 p->append_const(false); $$ = p; $$->loc = @$;
                                             }
+            | '&' ptr_quals                 {
+                                                auto p = dynamic_cast<ast_node_ptrdef_list*>($2);
+                                                $$ = p; $$->loc = @$;
+                                            }
             | '&' ptrdef_list               {
                                                 auto p = dynamic_cast<ast_node_ptrdef_list*>($2);
                                                 p->append_const(false);
                                                 $$ = p; $$->loc = @$;
                                             }
+            | '&' ptr_quals ptrdef_list     {
+                                                auto q = dynamic_cast<ast_node_ptrdef_list*>($2);
+                                                auto p = dynamic_cast<ast_node_ptrdef_list*>($3);
+                                                p->append_const(q->v_const[0], q->v_restrict[0]);
+                                                delete q;
+                                                $$ = p; $$->loc = @$;
+                                            }
+
+ /* The qualifiers of one '&', as a ptrdef_list with one indirection */
+ptr_quals: CONST                            {
+                                                auto p = new ast_node_ptrdef_list;
+                                                p->append_const(true); $$ = p;
+                                            }
+            | RESTRICT                      {
+                                                auto p = new ast_node_ptrdef_list;
+                                                p->append_const(false, true); $$ = p;
+                                            }
+            | CONST RESTRICT                {
+                                                auto p = new ast_node_ptrdef_list;
+                                                p->append_const(true, true); $$ = p;
+                                            }
+            | RESTRICT CONST                {
+                                                auto p = new ast_node_ptrdef_list;
+                                                p->append_const(true, true); $$ = p;
+                                            }
 
 vardef: typedotchain typedotnamechain       {
                                                 $$ = new ast_node_def{$1, $2, nullptr}; $$->loc = @$;
@@ -322,6 +369,11 @@ vardef: typedotchain typedotnamechain       {
                                                 node->ptrdef_node = node_pdl;
                                                 $$ = node; $$->loc = @$;
                                             }
+        | ALIGN '(' NUMBER ')' vardef       {
+                                                auto node = dynamic_cast<ast_node_def*>($5);
+                                                node->alignment = align_value($3);
+                                                $$ = node; $$->loc = @$;
+                                            }
 
 typedotchain: TYPENAME                      {
                                                 auto p = new ast_node_typedotchain{};
@@ -395,6 +447,8 @@ exp: exp '+' exp            {$$ = new ast_node_add{$1, $3}; $$->loc = @$;}
                                 auto p = dynamic_cast<ast_node_ptrdef_list*>($1);
                                 if (p->v_const.size() != 1)
                                     throw std::runtime_error("To many '&'s for an expression");
+                                if (p->v_const[0] || p->v_restrict[0])
+                                    throw std::runtime_error("Qualifiers on '&' in an expression");
                                 delete p;
                                 $$ = new ast_node_address{$2}; $$->loc = @$;
                             }
@@ -425,6 +479,26 @@ exp: exp '+' exp            {$$ = new ast_node_add{$1, $3}; $$->loc = @$;}
     ;
 
 struct_def : STRUCT EOL field_list EOL END { $$ = $3; $$->loc = @$; }
+            | STRUCT ALIGN '(' NUMBER ')' EOL field_list EOL END
+                                            {
+                                                auto p = dynamic_cast<ast_node_struct_def*>($7);
+                                                p->alignment = align_value($4);
+                                                $$ = p; $$->loc = @$;
+                                            }
+            /* c:: keeps the fields in the declaration order, like in C */
+            | STRUCT CLINKAGE EOL field_list EOL END
+                                            {
+                                                auto p = dynamic_cast<ast_node_struct_def*>($4);
+                                                p->clinkage = true;
+                                                $$ = p; $$->loc = @$;
+                                            }
+            | STRUCT CLINKAGE ALIGN '(' NUMBER ')' EOL field_list EOL END
+                                            {
+                                                auto p = dynamic_cast<ast_node_struct_def*>($8);
+                                                p->clinkage = true;
+                                                p->alignment = align_value($5);
+                                                $$ = p; $$->loc = @$;
+                                            }
 
     /* TODO: Make a ast_node_list to accumulate ast_nodes to a generic list and 
     * then constreuct stuff from it etc. */
@@ -1,7 +1,13 @@
 #include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <argp.h>
+#include <algorithm>
 
 /* Bison and flex requires this include order. */
 #include "emc.hh"
@@ -11,20 +17,62 @@ typedef void *yyscan_t;
 /* End of stupid include order. */
 
 #include "compile.hh"
+#include "ast_passes.hh"
+#include "interp.hh"
+#include "repl.hh"
+#include "time_report.hh"
+#include "diagnostics.hh"
+#include "target_clones.hh"
 
 /* external objects */
 extern int yydebug;
-extern ast_node *ast_root; /* Bison writes to this after each parse(). */
-extern bool parsed_eol;
 
-/* Scope during resolving of the ast node tree. */
-ast_compilation_units compilation_units;
-typescope_stack builtin_typestack;
-objscope_stack builtin_objstack;
+/* Counts the allocations for --time-report */
+void* operator new(std::size_t size)
+{
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
 
-struct engma_options opts;
+void operator delete(void *p, std::size_t) noexcept
+{
+    free(p);
+}
 
 #define ARG_SHARED 1000
+#define ARG_CTFE_MAX_STEPS 1001
+#define ARG_CTFE_MAX_MEMORY 1002
+#define ARG_DISABLE_PASS 1003
+#define ARG_TIME_PASSES 1004
+#define ARG_TIERED 1005
+#define ARG_TIER_THRESHOLD 1006
+#define ARG_TIER_LEVEL 1007
+#define ARG_INTERP 1008
+#define ARG_LAZY 1009
+#define ARG_BATCH_WRAPPERS 1010
+#define ARG_TIME_REPORT 1011
+#define ARG_DUMP 1012
+#define ARG_DUMP_DIR 1013
+#define ARG_DUMP_FILTER 1014
+#define ARG_PERF_MAP 1015
+#define ARG_INSTRUMENT 1016
+#define ARG_PROFILE 1017
+#define ARG_COVERAGE 1018
+#define ARG_PGO_GENERATE 1019
+#define ARG_PGO_USE 1020
+#define ARG_MARCH 1021
+#define ARG_TARGET_CLONES 1022
+#define ARG_FP_MODEL 1023
+#define ARG_REORDER_FIELDS 1024
+#define ARG_CTFE_MAX_DEPTH 1025
+#define ARG_TIER_STATS 1026
 struct argp_option options[] = 
 {
     {"exe",     'X', 0, 0, "Execute as a JIT compilation."},
@@ -37,47 +85,217 @@ struct argp_option options[] =
     {0,         'g',"LEVEL", OPTION_ARG_OPTIONAL, "Debugging flag"},
     {0,         'L', "FOLDER", 0, "Specifies a folder to look for shared objects"},
     {0,         's', 0, 0, "Just output assembler"},
+    {"ctfe-max-steps", ARG_CTFE_MAX_STEPS, "N", 0, "Max steps for compile time evaluation of a function call. 0 turns it off"},
+    {"ctfe-max-memory", ARG_CTFE_MAX_MEMORY, "N", 0, "Max live variables for compile time evaluation of a function call"},
+    {"ctfe-max-depth", ARG_CTFE_MAX_DEPTH, "N", 0, "Max call depth for compile time evaluation of a function call"},
+    {"disable-pass", ARG_DISABLE_PASS, "NAME", 0, "Turn off an AST optimization pass: inline, constprop, fold, cse or dce"},
+    {"time-passes", ARG_TIME_PASSES, 0, 0, "Print the time spent in each AST optimization pass"},
+    {"tiered", ARG_TIERED, 0, 0, "Recompile hot functions at a higher optimization level when executing with -X"},
+    {"tier-threshold", ARG_TIER_THRESHOLD, "N", 0, "Calls and loop iterations before a function is recompiled with --tiered"},
+    {"tier-level", ARG_TIER_LEVEL, "LEVEL", 0, "Optimization level for recompiled functions with --tiered: 0, 1, 2, 3, s or fast. Default 2"},
+    {"tier-stats", ARG_TIER_STATS, 0, 0, "Print the number of functions recompiled by --tiered at exit"},
+    {"interp", ARG_INTERP, 0, 0, "Run with the bytecode interpreter when executing with -X"},
+    {"lazy", ARG_LAZY, 0, 0, "Compile each function the first time it is called when executing with -X"},
+    {"time-report", ARG_TIME_REPORT, "FORMAT", OPTION_ARG_OPTIONAL, "Print the time and memory spent in each compiler phase, as a table or json"},
+    {"dump", ARG_DUMP, "KINDS", 0, "Write debug dumps, comma separated: ast-parse, ast-resolve, ast-passes, ir, reproducer, gimple, asm or all"},
+    {"dump-dir", ARG_DUMP_DIR, "DIR", 0, "Directory for the --dump files. Default ."},
+    {"dump-filter", ARG_DUMP_FILTER, "NAME", 0, "Only dump the functions whose name contains NAME"},
+    {"perf-map", ARG_PERF_MAP, "FORMAT", OPTION_ARG_OPTIONAL, "Write /tmp/perf-PID.map for perf with -X, or also /tmp/jit-PID.dump with FORMAT jitdump"},
+    {"instrument", ARG_INSTRUMENT, "MODE", OPTION_ARG_OPTIONAL, "Count and time the calls of each function and print a report at exit. MODE is counts, report (default) or trace for Chrome trace JSON"},
+    {"profile", ARG_PROFILE, "HZ", OPTION_ARG_OPTIONAL, "Sample the program run with -X and print where it spends its time. Default 1000 samples per second"},
+    {"coverage", ARG_COVERAGE, 0, 0, "Count the executions of each line and write FILE.em.gcov at exit"},
+    {"pgo-generate", ARG_PGO_GENERATE, "DIR", OPTION_ARG_OPTIONAL, "Instrument for profile guided optimization. The program writes its profile to DIR, default engma-pgo, at exit"},
+    {"pgo-use", ARG_PGO_USE, "DIR", OPTION_ARG_OPTIONAL, "Optimize with the profiles in DIR, default engma-pgo, from a run with --pgo-generate"},
+    {"march", ARG_MARCH, "ARCH", 0, "Generate code for ARCH, as gcc -march. Default native with -X"},
+    {"fp-model", ARG_FP_MODEL, "MODEL", 0, "Floating point semantics of the whole module: contract to allow FMA (default), strict IEEE or fast for -ffast-math, which lets reductions vectorize"},
+    {"target-clones", ARG_TARGET_CLONES, "TARGETS", 0, "Clone each function for the comma separated TARGETS, e.g. avx2,avx512f,default, and run the clone for the best one the CPU supports"},
+    {"reorder-fields", ARG_REORDER_FIELDS, 0, 0, "Lay out the fields of each struct by alignment to minimize the padding. Structs declared STRUCT c:: keep the declaration order"},
+    {"batch-wrappers", ARG_BATCH_WRAPPERS, 0, 0, "Emit name_batch(const T1*, ..., R *out, size_t n) for each function of primitives"},
     {0}
 };
 
+/* Parses all of arg as a number in [min, max] */
+static bool parse_long(const char *arg, long min, long max, long &out)
+{
+    char *end;
+    errno = 0;
+    long l = strtol(arg, &end, 10);
+    if (end == arg || *end || errno == ERANGE || l < min || l > max)
+        return false;
+    out = l;
+    return true;
+}
+
 static int parse_opt (int key, char *arg, struct argp_state *state)
 {
     switch (key) {
     case 's':
-        opts.run_type = engma_run_type::OUTPUT_ASSEMBLER;
+        opts().run_type = engma_run_type::OUTPUT_ASSEMBLER;
         break;
     case 'g':
-        opts.debug_flag = "-g" + (arg ? std::string{arg} : "");
+        opts().debug_flag = "-g" + (arg ? std::string{arg} : "");
         break;
     case 'L':
-        opts.l_folders.push_back("-L" + std::string{arg});
+        opts().l_folders.push_back("-L" + std::string{arg});
         break;
     case 'l':
-        opts.l_folders.push_back("-l" + std::string{arg});
+        opts().l_folders.push_back("-l" + std::string{arg});
         break;
     case 'O':
-        opts.optimization_level = "-O" + (arg ? std::string{arg} : "");
+        opts().optimization_level = "-O" + (arg ? std::string{arg} : "");
         break;
     case 'X':
-        opts.run_type = engma_run_type::EXECUTE;
+        opts().run_type = engma_run_type::EXECUTE;
         break;
     case 'I':
-        opts.include_dirs.push_back(arg);
+        opts().include_dirs.push_back(arg);
         break;
     case 'c':
-        opts.run_type = engma_run_type::OUTPUT_TO_OBJ_FILE;
+        opts().run_type = engma_run_type::OUTPUT_TO_OBJ_FILE;
         break;
     case ARG_SHARED:
-        opts.run_type = engma_run_type::OUTPUT_TO_SO;
+        opts().run_type = engma_run_type::OUTPUT_TO_SO;
         break;
     case 'o':
-        opts.outputfile_name = std::string{arg};
+        opts().outputfile_name = std::string{arg};
+        break;
+    case ARG_CTFE_MAX_STEPS:
+        if (!parse_long(arg, 0, LONG_MAX, opts().ctfe_max_steps))
+            argp_error(state, "--ctfe-max-steps must be a number >= 0: %s", arg);
+        break;
+    case ARG_CTFE_MAX_MEMORY:
+        if (!parse_long(arg, 0, LONG_MAX, opts().ctfe_max_memory))
+            argp_error(state, "--ctfe-max-memory must be a number >= 0: %s", arg);
+        break;
+    case ARG_CTFE_MAX_DEPTH: {
+        long depth;
+        if (!parse_long(arg, 0, INT_MAX, depth))
+            argp_error(state, "--ctfe-max-depth must be a number >= 0: %s", arg);
+        else
+            opts().ctfe_max_depth = depth;
+        break;
+    }
+    case ARG_DISABLE_PASS: {
+        auto &names = ast_pass_names();
+        if (std::find(names.begin(), names.end(), arg) == names.end())
+            argp_error(state, "Unknown pass: %s", arg);
+        opts().disabled_passes.push_back(arg);
+        break;
+    }
+    case ARG_TIME_PASSES:
+        opts().time_passes = true;
+        break;
+    case ARG_TIERED:
+        opts().tiered = true;
+        break;
+    case ARG_TIER_THRESHOLD:
+        if (!parse_long(arg, 1, LONG_MAX, opts().tier_threshold))
+            argp_error(state, "--tier-threshold must be a positive number: %s", arg);
+        break;
+    case ARG_TIER_STATS:
+        opts().tier_stats = true;
+        break;
+    case ARG_TIER_LEVEL: {
+        std::string level = arg;
+        if (level != "0" && level != "1" && level != "2" && level != "3" &&
+            level != "s" && level != "fast")
+            argp_error(state, "Unknown --tier-level: %s", arg);
+        opts().tier_optimization_level = "-O" + level;
+        break;
+    }
+    case ARG_INTERP:
+        opts().interp = true;
+        break;
+    case ARG_LAZY:
+        opts().lazy = true;
+        break;
+    case ARG_BATCH_WRAPPERS:
+        opts().batch_wrappers = true;
+        break;
+    case ARG_TIME_REPORT:
+        opts().time_report = arg ? arg : "table";
+        if (opts().time_report != "table" && opts().time_report != "json")
+            argp_error(state, "Unknown --time-report format: %s", arg);
+        break;
+    case ARG_DUMP: {
+        std::stringstream ss{arg};
+        std::string kind;
+        while (std::getline(ss, kind, ',')) {
+            auto &kinds = dump_kinds();
+            if (kind != "all" && std::find(kinds.begin(), kinds.end(), kind) == kinds.end())
+                argp_error(state, "Unknown --dump kind: %s", kind.c_str());
+            opts().dumps.push_back(kind);
+        }
+        break;
+    }
+    case ARG_DUMP_DIR:
+        opts().dump_dir = arg;
+        break;
+    case ARG_DUMP_FILTER:
+        opts().dump_filter = arg;
+        break;
+    case ARG_PERF_MAP:
+        opts().perf_map = arg ? arg : "map";
+        if (opts().perf_map != "map" && opts().perf_map != "jitdump")
+            argp_error(state, "Unknown --perf-map format: %s", arg);
+        break;
+    case ARG_INSTRUMENT:
+        opts().instrument = arg ? arg : "report";
+        if (opts().instrument != "counts" && opts().instrument != "report" &&
+            opts().instrument != "trace")
+            argp_error(state, "Unknown --instrument mode: %s", arg);
+        break;
+    case ARG_COVERAGE:
+        opts().coverage = true;
+        break;
+    case ARG_PROFILE: {
+        long hz = 1000;
+        if (arg && !parse_long(arg, 1, 1000000, hz))
+            argp_error(state, "--profile must be between 1 and 1000000 Hz: %s", arg);
+        else
+            opts().profile_hz = hz;
+        break;
+    }
+    case ARG_PGO_GENERATE:
+        opts().pgo_generate = arg ? arg : "engma-pgo";
+        break;
+    case ARG_PGO_USE:
+        opts().pgo_use = arg ? arg : "engma-pgo";
+        break;
+    case ARG_FP_MODEL:
+        opts().fp_model = arg;
+        if (opts().fp_model != "strict" && opts().fp_model != "contract" &&
+            opts().fp_model != "fast")
+            argp_error(state, "Unknown --fp-model: %s", arg);
+        break;
+    case ARG_MARCH:
+        opts().march = arg;
+        break;
+    case ARG_REORDER_FIELDS:
+        opts().reorder_fields = true;
+        break;
+    case ARG_TARGET_CLONES: {
+        std::stringstream ss{arg};
+        std::string target;
+        while (std::getline(ss, target, ',')) {
+            /* There is always a default clone */
+            if (target == "default")
+                continue;
+            bool known = false;
+#define X(name) known |= target == name;
+            ENGMA_FOR_EACH_CLONE_TARGET(X)
+#undef X
+            if (!known)
+                argp_error(state, "Unknown --target-clones target: %s", target.c_str());
+            opts().target_clones.push_back(target);
+        }
         break;
+    }
     case ARGP_KEY_ARG:
         if (ends_with(arg, ".em"))
-            opts.files.push_back(arg);
+            opts().files.push_back(arg);
         else
-            opts.nonengma_files.push_back(arg);
+            opts().nonengma_files.push_back(arg);
         break;
     }
 
@@ -86,27 +304,126 @@ static int parse_opt (int key, char *arg, struct argp_state *state)
 
 void verify_opts()
 {
-
+    if (opts().tiered && opts().run_type != engma_run_type::EXECUTE) {
+        std::cerr << "--tiered requires -X" << std::endl;
+        exit(1);
+    }
+    if (opts().interp && opts().run_type != engma_run_type::EXECUTE) {
+        std::cerr << "--interp requires -X" << std::endl;
+        exit(1);
+    }
+    if (opts().lazy && opts().run_type != engma_run_type::EXECUTE) {
+        std::cerr << "--lazy requires -X" << std::endl;
+        exit(1);
+    }
+    if (opts().lazy && opts().tiered) {
+        std::cerr << "--lazy can't be combined with --tiered" << std::endl;
+        exit(1);
+    }
+    /* The functions and lines are registered in main() */
+    if (opts().instrument.size() && opts().run_type != engma_run_type::EXECUTE &&
+        opts().run_type != engma_run_type::OUTPUT_TO_EXE) {
+        std::cerr << "--instrument requires -X or an executable" << std::endl;
+        exit(1);
+    }
+    if (opts().instrument.size() && (opts().lazy || opts().tiered || opts().interp)) {
+        std::cerr << "--instrument can't be combined with --lazy, --tiered or --interp" << std::endl;
+        exit(1);
+    }
+    if (opts().coverage && opts().run_type != engma_run_type::EXECUTE &&
+        opts().run_type != engma_run_type::OUTPUT_TO_EXE) {
+        std::cerr << "--coverage requires -X or an executable" << std::endl;
+        exit(1);
+    }
+    if (opts().coverage && (opts().lazy || opts().tiered || opts().interp)) {
+        std::cerr << "--coverage can't be combined with --lazy, --tiered or --interp" << std::endl;
+        exit(1);
+    }
+    if (opts().profile_hz && opts().run_type != engma_run_type::EXECUTE) {
+        std::cerr << "--profile requires -X" << std::endl;
+        exit(1);
+    }
+    if (opts().profile_hz && (opts().lazy || opts().tiered || opts().interp)) {
+        std::cerr << "--profile can't be combined with --lazy, --tiered or --interp" << std::endl;
+        exit(1);
+    }
+    if (opts().pgo_generate.size() && opts().pgo_use.size()) {
+        std::cerr << "--pgo-generate can't be combined with --pgo-use" << std::endl;
+        exit(1);
+    }
+    /* The profile is written by the running program */
+    if (opts().pgo_generate.size() && opts().run_type != engma_run_type::EXECUTE &&
+        opts().run_type != engma_run_type::OUTPUT_TO_EXE) {
+        std::cerr << "--pgo-generate requires -X or an executable" << std::endl;
+        exit(1);
+    }
+    /* The profile is for one context with all the code */
+    if ((opts().pgo_generate.size() || opts().pgo_use.size()) &&
+        (opts().lazy || opts().tiered || opts().interp)) {
+        std::cerr << "--pgo-generate and --pgo-use can't be combined with --lazy, --tiered or --interp" << std::endl;
+        exit(1);
+    }
+    /* The clones are selected by libjitruntime */
+    if (opts().target_clones.size() && opts().run_type != engma_run_type::EXECUTE &&
+        opts().run_type != engma_run_type::OUTPUT_TO_EXE) {
+        std::cerr << "--target-clones requires -X or an executable" << std::endl;
+        exit(1);
+    }
+    if (opts().target_clones.size() && (opts().lazy || opts().tiered || opts().interp ||
+                                         opts().instrument.size())) {
+        std::cerr << "--target-clones can't be combined with --lazy, --tiered, --interp or --instrument" << std::endl;
+        exit(1);
+    }
+    /* -X runs the code on the machine that compiles it */
+    if (opts().run_type == engma_run_type::EXECUTE && opts().march.empty())
+        opts().march = "native";
+    /* The profiler maps the samples to lines with the debug info */
+    if (opts().profile_hz && opts().debug_flag.empty())
+        opts().debug_flag = "-g";
 }
 
+/* Prints the --time-report when main() returns, from any of its returns */
+struct time_report_printer {
+    std::unique_ptr<time_report> report;
+
+    ~time_report_printer()
+    {
+        if (!report)
+            return;
+        current_time_report = nullptr;
+        if (opts().time_report == "json")
+            report->print_json(std::cerr);
+        else
+            report->print_table(std::cerr);
+    }
+};
+
 /* TODO: Refactor this messy main function */
 int main(int argc, char **argv)
 {
-    
+    engma_session session;
+    engma_session_scope session_scope{&session};
+
     argp argp = {options, parse_opt, "FILES...", 0};
     argp_parse(&argp, argc, argv, 0, 0, 0);
     verify_opts();
     yydebug = 0;
 
+    time_report_printer report_printer;
+    if (opts().time_report.size()) {
+        report_printer.report = std::make_unique<time_report>();
+        current_time_report = report_printer.report.get();
+    }
+
     init_builtin_types();
 
-    if (opts.run_type == engma_run_type::OUTPUT_TO_OBJ_FILE ||
-        opts.run_type == engma_run_type::OUTPUT_ASSEMBLER ) {
-        if (opts.nonengma_files.size()) {
+    if (opts().run_type == engma_run_type::OUTPUT_TO_OBJ_FILE ||
+        opts().run_type == engma_run_type::OUTPUT_ASSEMBLER ) {
+        if (opts().nonengma_files.size()) {
             compile_c_obj_files();
         }
-        if (opts.files.size()) {
-            for (std::string file : opts.files) {
+        if (opts().files.size()) {
+            for (std::string file : opts().files) {
                 yyscan_t scanner;
                 yylex_init(&scanner);
 
@@ -115,13 +432,17 @@ int main(int argc, char **argv)
                 if(!f) {
                     throw std::runtime_error("Could not open file: " + std::string{argv[1]});
                 }
-                compilation_units.get_current_compilation_unit().file_name = file;
+                compilation_units().get_current_compilation_unit().file_name = file;
                 yyset_in(f, scanner);
 
                 bool parsed_eol;
 
                 do {
-                    int err = yyparse(scanner);
+                    int err;
+                    {
+                        phase_timer timer{"parse"};
+                        err = yyparse(scanner);
+                    }
 
                     if (err) {
                         std::cerr << "error" << std::endl;
@@ -129,10 +450,13 @@ int main(int argc, char **argv)
                             return 1;
                     }
 
-                    auto &cu = compilation_units.get_current_compilation_unit();
+                    auto &cu = compilation_units().get_current_compilation_unit();
 
                     if (cu.ast_root) {
-                        cu.ast_root->resolve(), 
+                        phase_timer timer{"resolve"};
+                        dump_ast("ast-parse", cu.ast_root);
+                        cu.ast_root->resolve();
+                        dump_ast("ast-resolve", cu.ast_root);
                         cu.v_nodes.push_back(cu.ast_root);
                         cu.ast_root = nullptr;
                     }
@@ -141,39 +465,46 @@ int main(int argc, char **argv)
 
                 } while (!parsed_eol);
 
+                auto &cu = compilation_units().get_current_compilation_unit();
+                {
+                    phase_timer timer{"passes"};
+                    run_ast_passes(cu.v_nodes);
+                }
+                dump_ast("ast-passes", cu.v_nodes);
+
                 jit jit;
-                jit.init_as_root_context();
-
-                auto &cu = compilation_units.get_current_compilation_unit();
-                for (auto e : cu.v_nodes)
-                    jit.add_ast_node(e);
-                
-                jit.postprocess();
-                jit.dump("./dump.txt");
+                {
+                    phase_timer timer{"codegen"};
+                    jit.init_as_root_context();
+                    for (auto e : cu.v_nodes)
+                        jit.add_ast_node(e);
+                    
+                    jit.postprocess();
+                }
                 jit.compile();
-                if (opts.run_type == engma_run_type::EXECUTE)
+                if (opts().run_type == engma_run_type::EXECUTE)
                     jit.execute();
 
                 yylex_destroy(scanner);
 
                 /* Clear some globals so we can see that all nodes are freed for
                 * debugging purposes. */
-                compilation_units.clear();
-                builtin_typestack.clear();
-                builtin_objstack.clear();
+                compilation_units().clear();
+                builtin_typestack().clear();
+                builtin_objstack().clear();
 
                 DEBUG_ASSERT(ast_node_count == 0, "ast nodes seems to be leaking: " << ast_node_count);
                 DEBUG_ASSERT(value_expr_count == 0, "value_expr seems to be leaking: " << value_expr_count);
             }
         }
-    } else if (opts.run_type == engma_run_type::OUTPUT_TO_SO || 
-                opts.run_type == engma_run_type::OUTPUT_TO_EXE) 
+    } else if (opts().run_type == engma_run_type::OUTPUT_TO_SO || 
+                opts().run_type == engma_run_type::OUTPUT_TO_EXE) 
     {
-        if (opts.files.size()) {
-            if (opts.files.size() != 1)
+        if (opts().files.size()) {
+            if (opts().files.size() != 1)
                 THROW_NOT_IMPLEMENTED("");
 
-            for (std::string file : opts.files) {
+            for (std::string file : opts().files) {
                 yyscan_t scanner;
                 yylex_init(&scanner);
 
@@ -182,13 +513,17 @@ int main(int argc, char **argv)
                 if(!f) {
                     throw std::runtime_error("Could not open file: " + std::string{argv[1]});
                 }
-                compilation_units.get_current_compilation_unit().file_name = file;
+                compilation_units().get_current_compilation_unit().file_name = file;
                 yyset_in(f, scanner);
 
                     bool parsed_eol;
 
                 do {
-                    int err = yyparse(scanner);
+                    int err;
+                    {
+                        phase_timer timer{"parse"};
+                        err = yyparse(scanner);
+                    }
 
                     if (err) {
                         std::cerr << "error" << std::endl;
@@ -196,10 +531,13 @@ int main(int argc, char **argv)
                             return 1;
                     }
 
-                    auto &cu = compilation_units.get_current_compilation_unit();
+                    auto &cu = compilation_units().get_current_compilation_unit();
 
                     if (cu.ast_root) {
-                        cu.ast_root->resolve(), 
+                        phase_timer timer{"resolve"};
+                        dump_ast("ast-parse", cu.ast_root);
+                        cu.ast_root->resolve();
+                        dump_ast("ast-resolve", cu.ast_root);
                         cu.v_nodes.push_back(cu.ast_root);
                         cu.ast_root = nullptr;
                     }
@@ -208,38 +546,45 @@ int main(int argc, char **argv)
 
                 } while (!parsed_eol);
 
+                auto &cu = compilation_units().get_current_compilation_unit();
+                {
+                    phase_timer timer{"passes"};
+                    run_ast_passes(cu.v_nodes);
+                }
+                dump_ast("ast-passes", cu.v_nodes);
+
                 jit jit;
-                jit.init_as_root_context();
-
-                auto &cu = compilation_units.get_current_compilation_unit();
-                for (auto e : cu.v_nodes)
-                    jit.add_ast_node(e);
-                
-                jit.postprocess();
-                jit.dump("./dump.txt");
+                {
+                    phase_timer timer{"codegen"};
+                    jit.init_as_root_context();
+                    for (auto e : cu.v_nodes)
+                        jit.add_ast_node(e);
+                    
+                    jit.postprocess();
+                }
                 jit.compile();
-                if (opts.run_type == engma_run_type::EXECUTE)
+                if (opts().run_type == engma_run_type::EXECUTE)
                     jit.execute();
 
                 yylex_destroy(scanner);
 
                 /* Clear some globals so we can see that all nodes are freed for
                 * debugging purposes. */
-                compilation_units.clear();
-                builtin_typestack.clear();
-                builtin_objstack.clear();
+                compilation_units().clear();
+                builtin_typestack().clear();
+                builtin_objstack().clear();
 
                 DEBUG_ASSERT(ast_node_count == 0, "ast nodes seems to be leaking: " << ast_node_count);
                 DEBUG_ASSERT(value_expr_count == 0, "value_expr seems to be leaking: " << value_expr_count);
             }
         }
-    } else if (opts.run_type == engma_run_type::EXECUTE) {
-        if (opts.files.size()) {
+    } else if (opts().run_type == engma_run_type::EXECUTE) {
+        if (opts().files.size()) {
 
-            if (opts.files.size() != 1)
+            if (opts().files.size() != 1)
                 THROW_NOT_IMPLEMENTED("");
 
-            for (std::string file : opts.files) {
+            for (std::string file : opts().files) {
                 yyscan_t scanner;
                 yylex_init(&scanner);
 
@@ -248,13 +593,17 @@ int main(int argc, char **argv)
                 if(!f) {
                     throw std::runtime_error("Could not open file: " + std::string{argv[1]});
                 }
-                compilation_units.get_current_compilation_unit().file_name = file;
+                compilation_units().get_current_compilation_unit().file_name = file;
                 yyset_in(f, scanner);
 
                     bool parsed_eol;
 
                 do {
-                    int err = yyparse(scanner);
+                    int err;
+                    {
+                        phase_timer timer{"parse"};
+                        err = yyparse(scanner);
+                    }
 
                     if (err) {
                         std::cerr << "error" << std::endl;
@@ -262,10 +611,13 @@ int main(int argc, char **argv)
                             return 1;
                     }
 
-                    auto &cu = compilation_units.get_current_compilation_unit();
+                    auto &cu = compilation_units().get_current_compilation_unit();
 
                     if (cu.ast_root) {
-                        cu.ast_root->resolve(), 
+                        phase_timer timer{"resolve"};
+                        dump_ast("ast-parse", cu.ast_root);
+                        cu.ast_root->resolve();
+                        dump_ast("ast-resolve", cu.ast_root);
                         cu.v_nodes.push_back(cu.ast_root);
                         cu.ast_root = nullptr;
                     }
@@ -274,30 +626,58 @@ int main(int argc, char **argv)
 
                 } while (!parsed_eol);
 
-                jit jit;
-                jit.init_as_root_context();
-
-                auto &cu = compilation_units.get_current_compilation_unit();
-                for (auto e : cu.v_nodes)
-                    jit.add_ast_node(e);
-                
-                jit.postprocess();
-                jit.dump("./dump.txt");
-                jit.compile();
-                if (opts.run_type == engma_run_type::EXECUTE)
+                auto &cu = compilation_units().get_current_compilation_unit();
+                {
+                    phase_timer timer{"passes"};
+                    run_ast_passes(cu.v_nodes);
+                }
+                dump_ast("ast-passes", cu.v_nodes);
+
+                /* The interpreter falls back to the jit if it can't run the program */
+                bool interpreted = false;
+                if (opts().interp) {
+                    phase_timer timer{"execute"};
+                    interpreted = interp_run(cu.v_nodes);
+                }
+                if (!interpreted) {
+                    jit jit;
+                    {
+                        phase_timer timer{"codegen"};
+                        jit.init_as_root_context();
+
+                        for (auto e : cu.v_nodes)
+                            jit.add_ast_node(e);
+                        
+                        jit.postprocess();
+                    }
+                    jit.compile();
+                    phase_timer timer{"execute"};
                     jit.execute();
+                }
 
                 yylex_destroy(scanner);
 
                 /* Clear some globals so we can see that all nodes are freed for
                 * debugging purposes. */
-                compilation_units.clear();
-                builtin_typestack.clear();
-                builtin_objstack.clear();
+                compilation_units().clear();
+                builtin_typestack().clear();
+                builtin_objstack().clear();
 
                 DEBUG_ASSERT(ast_node_count == 0, "ast nodes seems to be leaking: " << ast_node_count);
                 DEBUG_ASSERT(value_expr_count == 0, "value_expr seems to be leaking: " << value_expr_count);
             }
+        } else {
+            /* No files, read statements from stdin */
+            if (opts().nonengma_files.size())
+                THROW_NOT_IMPLEMENTED("C files in the REPL");
+
+            int status = repl_run(stdin);
+
+            compilation_units().clear();
+            builtin_typestack().clear();
+            builtin_objstack().clear();
+
+            return status;
         }
     }
 
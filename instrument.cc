@@ -0,0 +1,217 @@
+/* Code generation for --instrument and --coverage, see instrument.hh for the
+   runtime side */
+
+#include <stdexcept>
+
+#include "compile.hh"
+#include "instrument.hh"
+
+void jit::init_instrument()
+{
+    if (opts().instrument == "counts")
+        instr_mode = ENGMA_INSTR_COUNTS;
+    else if (opts().instrument == "report")
+        instr_mode = ENGMA_INSTR_REPORT;
+    else if (opts().instrument == "trace")
+        instr_mode = ENGMA_INSTR_TRACE;
+    else
+        THROW_BUG("Unknown instrument mode " + opts().instrument);
+
+    /* thread_local long engma_instr_counts[ENGMA_INSTR_MAX_FNS] in libjitruntime,
+       which is loaded with the program so its TLS is static */
+    gcc_jit_type *counts_type = gcc_jit_context_new_array_type(context, 0,
+        types->long_type, ENGMA_INSTR_MAX_FNS);
+    instr_counts_global = gcc_jit_context_new_global(context, 0,
+        GCC_JIT_GLOBAL_IMPORTED, counts_type, "engma_instr_counts");
+    gcc_jit_lvalue_set_tls_model(instr_counts_global, GCC_JIT_TLS_MODEL_INITIAL_EXEC);
+
+    gcc_jit_param *index_param = gcc_jit_context_new_param(context, 0, types->int_type, "index");
+    instr_enter_fn = gcc_jit_context_new_function(context, 0, GCC_JIT_FUNCTION_IMPORTED,
+        types->void_type, "engma_instr_enter", 1, &index_param, 0);
+    index_param = gcc_jit_context_new_param(context, 0, types->int_type, "index");
+    instr_exit_fn = gcc_jit_context_new_function(context, 0, GCC_JIT_FUNCTION_IMPORTED,
+        types->void_type, "engma_instr_exit", 1, &index_param, 0);
+}
+
+/* counts[index] += 1 and, when timing, engma_instr_enter(index) */
+void jit::emit_instr_entry(gcc_jit_block *block, ast_node *fdef_node, gcc_jit_location *loc)
+{
+    instr_fn_index = -1;
+    if (instr_mode < 0 || tier_parent)
+        return;
+    if (v_instr_fn_names.size() == ENGMA_INSTR_MAX_FNS) {
+        std::cerr << "Warning: Only the first " << ENGMA_INSTR_MAX_FNS
+                  << " functions are instrumented" << std::endl;
+        return;
+    }
+
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+    instr_fn_index = v_instr_fn_names.size();
+    try {
+        v_instr_fn_names.push_back(demangle_emc_fn_name(fdef->mangled_name));
+    } catch (std::runtime_error&) {
+        v_instr_fn_names.push_back(fdef->name);
+    }
+
+    gcc_jit_rvalue *idx = gcc_jit_context_new_rvalue_from_int(context,
+        types->int_type, instr_fn_index);
+    gcc_jit_lvalue *counter = gcc_jit_context_new_array_access(context, loc,
+        gcc_jit_lvalue_as_rvalue(instr_counts_global), idx);
+    gcc_jit_block_add_assignment_op(block, loc, counter,
+        GCC_JIT_BINARY_OP_PLUS, gcc_jit_context_one(context, types->long_type));
+
+    if (instr_mode != ENGMA_INSTR_COUNTS)
+        gcc_jit_block_add_eval(block, loc,
+            gcc_jit_context_new_call(context, loc, instr_enter_fn, 1, &idx));
+}
+
+/* Adds engma_instr_exit(index) before a return. The return value is
+   evaluated before it, so that the callees in it are timed as callees.
+   Returns what to return instead of ret. */
+gcc_jit_rvalue* jit::emit_instr_exit(gcc_jit_block *block, gcc_jit_rvalue *ret,
+                                     gcc_jit_location *loc)
+{
+    if (instr_fn_index < 0 || instr_mode == ENGMA_INSTR_COUNTS)
+        return ret;
+
+    if (ret) {
+        gcc_jit_lvalue *tmp = gcc_jit_function_new_local(gcc_jit_block_get_function(block),
+            loc, gcc_jit_rvalue_get_type(ret), new_unique_name("instr_ret").c_str());
+        gcc_jit_block_add_assignment(block, loc, tmp, ret);
+        ret = gcc_jit_lvalue_as_rvalue(tmp);
+    }
+
+    gcc_jit_rvalue *idx = gcc_jit_context_new_rvalue_from_int(context,
+        types->int_type, instr_fn_index);
+    gcc_jit_block_add_eval(block, loc,
+        gcc_jit_context_new_call(context, loc, instr_exit_fn, 1, &idx));
+    return ret;
+}
+
+/* engma_instr_init(mode, n, names) first in main() */
+void jit::emit_instr_init(gcc_jit_block *block)
+{
+    if (instr_mode < 0)
+        return;
+
+    gcc_jit_type *const_char_ptr_type = gcc_jit_context_get_type(context,
+        GCC_JIT_TYPE_CONST_CHAR_PTR);
+    int n = v_instr_fn_names.size();
+    gcc_jit_function *fn = gcc_jit_block_get_function(block);
+    gcc_jit_lvalue *names = gcc_jit_function_new_local(fn, 0,
+        gcc_jit_context_new_array_type(context, 0, const_char_ptr_type, n ? n : 1),
+        "instr_names");
+    for (int i = 0; i < n; i++)
+        gcc_jit_block_add_assignment(block, 0,
+            gcc_jit_context_new_array_access(context, 0, gcc_jit_lvalue_as_rvalue(names),
+                gcc_jit_context_new_rvalue_from_int(context, types->int_type, i)),
+            gcc_jit_context_new_string_literal(context, v_instr_fn_names[i].c_str()));
+
+    gcc_jit_param *params[] = {
+        gcc_jit_context_new_param(context, 0, types->int_type, "mode"),
+        gcc_jit_context_new_param(context, 0, types->int_type, "n_fns"),
+        gcc_jit_context_new_param(context, 0,
+            gcc_jit_type_get_pointer(const_char_ptr_type), "names")
+    };
+    gcc_jit_function *init_fn = gcc_jit_context_new_function(context, 0,
+        GCC_JIT_FUNCTION_IMPORTED, types->void_type, "engma_instr_init", 3, params, 0);
+
+    gcc_jit_rvalue *args[] = {
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, instr_mode),
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, n),
+        gcc_jit_lvalue_get_address(gcc_jit_context_new_array_access(context, 0,
+            gcc_jit_lvalue_as_rvalue(names),
+            gcc_jit_context_zero(context, types->int_type)), 0)
+    };
+    gcc_jit_block_add_eval(block, 0, gcc_jit_context_new_call(context, 0, init_fn, 3, args));
+}
+
+void jit::init_coverage()
+{
+    cov_counts_global = gcc_jit_context_new_global(context, 0, GCC_JIT_GLOBAL_INTERNAL,
+        gcc_jit_type_get_pointer(types->long_type), "engma_cov_counts");
+    v_cov_files = {compilation_units().get_current_compilation_unit().file_name};
+    cov_file = 0;
+}
+
+/* counts[slot] += 1, where slot is the statement's (file, line) */
+void jit::emit_cov_count(gcc_jit_block *block, ast_node *node)
+{
+    if (!cov_counts_global || tier_parent)
+        return;
+    int line = node->loc.first_line;
+    if (line <= 0)
+        return;
+    auto it = map_cov_slots.emplace(std::make_pair(cov_file, line), map_cov_slots.size()).first;
+
+    gcc_jit_lvalue *counter = gcc_jit_context_new_array_access(context, 0,
+        gcc_jit_lvalue_as_rvalue(cov_counts_global),
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, it->second));
+    gcc_jit_block_add_assignment_op(block, 0, counter,
+        GCC_JIT_BINARY_OP_PLUS, gcc_jit_context_one(context, types->long_type));
+}
+
+/* counts = engma_cov_init(n_files, sources, files, lines, n) first in main() */
+void jit::emit_cov_init(gcc_jit_block *block)
+{
+    if (!cov_counts_global)
+        return;
+
+    gcc_jit_type *const_char_ptr_type = gcc_jit_context_get_type(context,
+        GCC_JIT_TYPE_CONST_CHAR_PTR);
+    gcc_jit_function *fn = gcc_jit_block_get_function(block);
+    auto new_array = [&](gcc_jit_type *type, int n, const char *name) {
+        return gcc_jit_function_new_local(fn, 0,
+            gcc_jit_context_new_array_type(context, 0, type, n ? n : 1), name);
+    };
+    auto set = [&](gcc_jit_lvalue *array, int i, gcc_jit_rvalue *val) {
+        gcc_jit_block_add_assignment(block, 0,
+            gcc_jit_context_new_array_access(context, 0, gcc_jit_lvalue_as_rvalue(array),
+                gcc_jit_context_new_rvalue_from_int(context, types->int_type, i)),
+            val);
+    };
+    auto first = [&](gcc_jit_lvalue *array) {
+        return gcc_jit_lvalue_get_address(gcc_jit_context_new_array_access(context, 0,
+            gcc_jit_lvalue_as_rvalue(array),
+            gcc_jit_context_zero(context, types->int_type)), 0);
+    };
+
+    int n_files = v_cov_files.size();
+    gcc_jit_lvalue *sources = new_array(const_char_ptr_type, n_files, "cov_sources");
+    for (int i = 0; i < n_files; i++)
+        set(sources, i, gcc_jit_context_new_string_literal(context, v_cov_files[i].c_str()));
+
+    int n = map_cov_slots.size();
+    gcc_jit_lvalue *files = new_array(types->int_type, n, "cov_files");
+    gcc_jit_lvalue *lines = new_array(types->int_type, n, "cov_lines");
+    for (auto &kv : map_cov_slots) {
+        set(files, kv.second, gcc_jit_context_new_rvalue_from_int(context,
+            types->int_type, kv.first.first));
+        set(lines, kv.second, gcc_jit_context_new_rvalue_from_int(context,
+            types->int_type, kv.first.second));
+    }
+
+    gcc_jit_type *int_ptr_type = gcc_jit_type_get_pointer(types->int_type);
+    gcc_jit_param *params[] = {
+        gcc_jit_context_new_param(context, 0, types->int_type, "n_files"),
+        gcc_jit_context_new_param(context, 0,
+            gcc_jit_type_get_pointer(const_char_ptr_type), "sources"),
+        gcc_jit_context_new_param(context, 0, int_ptr_type, "files"),
+        gcc_jit_context_new_param(context, 0, int_ptr_type, "lines"),
+        gcc_jit_context_new_param(context, 0, types->int_type, "n")
+    };
+    gcc_jit_function *init_fn = gcc_jit_context_new_function(context, 0,
+        GCC_JIT_FUNCTION_IMPORTED, gcc_jit_type_get_pointer(types->long_type),
+        "engma_cov_init", 5, params, 0);
+
+    gcc_jit_rvalue *args[] = {
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, n_files),
+        first(sources),
+        first(files),
+        first(lines),
+        gcc_jit_context_new_rvalue_from_int(context, types->int_type, n)
+    };
+    gcc_jit_block_add_assignment(block, 0, cov_counts_global,
+        gcc_jit_context_new_call(context, 0, init_fn, 5, args));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/* Function level instrumentation, compiled in with --instrument for -X and
+ * executables, and line coverage with --coverage. Shared by the compiler and
+ * libjitruntime.
+ *
+ * Each Engma function gets an index and its entry increments
+ * engma_instr_counts[index], a thread local array in libjitruntime, without
+ * a call. Unless the mode is counts, the function also calls
+ * engma_instr_enter() and engma_instr_exit(), which time it in cycles on a
+ * per thread shadow stack, so each function gets an inclusive time and an
+ * exclusive time without its callees.
+ *
+ * main() calls engma_instr_init() with the function names, which registers
+ * the output at exit:
+ *
+ *   counts   The call counts, on stderr
+ *   report   The counts and times sorted by exclusive time, on stderr
+ *   trace    Chrome trace JSON, each call an event, in engma-trace-PID.json.
+ *            Open in chrome://tracing or ui.perfetto.dev
+ *
+ * The counts of threads that are still running at exit are lost in the
+ * counts mode.
+ */
+
+#define ENGMA_INSTR_MAX_FNS 4096
+/* Per thread, the rest of the calls are left out of the trace */
+#define ENGMA_INSTR_MAX_EVENTS (1 << 20)
+
+enum engma_instr_mode {
+    ENGMA_INSTR_COUNTS,
+    ENGMA_INSTR_REPORT,
+    ENGMA_INSTR_TRACE
+};
+
+/* --coverage counts the executions of each line with a statement in
+ * counts[slot], where counts is from engma_cov_init() in main() and slot
+ * i is line lines[i] of sources[files[i]]. At exit FILE.em.gcov is written
+ * for the main file and each USING:ed one with statements, in the gcov text
+ * format, where the statements' lines that never ran are marked #####. The
+ * counts are not atomic, like gcov's, so threads can lose some.
+ */
+
+extern "C" {
+extern thread_local long engma_instr_counts[ENGMA_INSTR_MAX_FNS];
+
+void engma_instr_init(int mode, int n_fns, const char **names);
+void engma_instr_enter(int index);
+void engma_instr_exit(int index);
+
+long* engma_cov_init(int n_files, const char **sources, const int *files,
+                     const int *lines, int n);
+}
@@ -0,0 +1,1131 @@
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <dlfcn.h>
+
+#include "emc.hh"
+#include "interp.hh"
+
+/* The bytecode has the semantics of the code jit::walk_tree_*() emits,
+ * i.e. C semantics for the operators with the casts done the same way
+ * (see also ctfe.cc that does the same directly on the AST).
+ *
+ * Each function has a frame of registers. The parameters are the first
+ * registers, then come the locals and temporaries. A call passes its
+ * arguments in consecutive registers of the caller, that become the first
+ * registers of the callee's frame. Integers are stored sign or zero
+ * extended to 64 bits and are wrapped to their width after each operation.
+ */
+
+namespace {
+
+/* Thrown while lowering if the program can't be interpreted. */
+struct interp_unsupported {
+    std::string what;
+};
+
+union slot {
+    int64_t i;  /* LONG, INT, SHORT, SBYTE */
+    uint64_t u; /* ULONG, UINT, USHORT, BYTE */
+    double d;
+    float f;
+    const void *p; /* Strings */
+};
+
+#define BC_OPS(X) \
+    X(MOV) X(LOADK) X(LOADG) X(STOREG) \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_S) X(REM_S) X(DIV_U) X(REM_U) \
+    X(ADD_D) X(SUB_D) X(MUL_D) X(DIV_D) X(FDIV_D) X(REM_D) X(POW_D) \
+    X(ADD_F) X(SUB_F) X(MUL_F) X(DIV_F) X(FDIV_F) X(REM_F) X(POW_F) \
+    X(NEG_I) X(NEG_D) X(NEG_F) X(ABS_I) X(ABS_D) X(ABS_F) \
+    X(SEXT8) X(SEXT16) X(SEXT32) X(ZEXT8) X(ZEXT16) X(ZEXT32) \
+    X(I2D) X(U2D) X(F2D) X(I2F) X(U2F) X(D2F) X(D2I) X(D2U) X(F2I) X(F2U) \
+    X(LT_S) X(LE_S) X(LT_U) X(LE_U) X(EQ_I) X(NE_I) \
+    X(LT_D) X(LE_D) X(EQ_D) X(NE_D) X(LT_F) X(LE_F) X(EQ_F) X(NE_F) \
+    X(LAND) X(LOR) X(LXOR) X(NOT) \
+    X(JMP) X(JZ) X(JNZ) \
+    X(CALL) X(CCALL) X(RET) X(RETV)
+
+enum bc_op : uint16_t {
+#define BC_ENUM(name) OP_##name,
+    BC_OPS(BC_ENUM)
+#undef BC_ENUM
+};
+
+/* a is the destination register, b and c the operands. Jumps have the
+   target in b and c, CALL and CCALL the callee in b and the first argument
+   register in c. */
+struct insn {
+    uint16_t op, a, b, c;
+};
+
+typedef void (*c_thunk)(void *fn, const slot *args, slot *ret);
+
+struct bc_function {
+    std::string name;
+    std::vector<insn> code;
+    std::vector<slot> consts;
+    int n_regs = 0;
+};
+
+struct bc_extern {
+    std::string name;
+    void *fn;
+    c_thunk thunk;
+};
+
+struct bc_program {
+    std::vector<bc_function> functions; /* functions[0] is the top level code */
+    std::vector<bc_extern> externs;
+    int n_globals = 0;
+    std::deque<std::string> strings;
+};
+
+/* Thunks for calling C functions. Arguments and return values narrower
+   than an Int are passed as Int, as the C ABIs do. */
+constexpr int MAX_C_ARGS = 3;
+
+template<class T> T from_slot(const slot &s);
+template<> int32_t from_slot<int32_t>(const slot &s) { return (int32_t)s.i; }
+template<> int64_t from_slot<int64_t>(const slot &s) { return s.i; }
+template<> void* from_slot<void*>(const slot &s) { return (void*)s.p; }
+template<> double from_slot<double>(const slot &s) { return s.d; }
+template<> float from_slot<float>(const slot &s) { return s.f; }
+
+inline void to_slot(slot *s, int32_t v) { s->i = v; }
+inline void to_slot(slot *s, int64_t v) { s->i = v; }
+inline void to_slot(slot *s, void *v) { s->p = v; }
+inline void to_slot(slot *s, double v) { s->d = v; }
+inline void to_slot(slot *s, float v) { s->f = v; }
+
+template<class T> constexpr char kind_char()
+{
+    if constexpr (std::is_void_v<T>) return 'v';
+    else if constexpr (std::is_same_v<T, int32_t>) return 'i';
+    else if constexpr (std::is_same_v<T, int64_t>) return 'l';
+    else if constexpr (std::is_same_v<T, void*>) return 'p';
+    else if constexpr (std::is_same_v<T, double>) return 'd';
+    else return 'f';
+}
+
+template<class R, class... A, size_t... I>
+void call_c(void *fn, const slot *args, slot *ret, std::index_sequence<I...>)
+{
+    auto f = (R (*)(A...))fn;
+    if constexpr (std::is_void_v<R>)
+        f(from_slot<A>(args[I])...);
+    else
+        to_slot(ret, f(from_slot<A>(args[I])...));
+}
+
+template<class R, class... A>
+void c_thunk_fn(void *fn, const slot *args, slot *ret)
+{
+    call_c<R, A...>(fn, args, ret, std::index_sequence_for<A...>{});
+}
+
+template<class R, class... A>
+void add_thunks(std::map<std::string, c_thunk> &map)
+{
+    map[std::string{kind_char<R>(), kind_char<A>()...}] = c_thunk_fn<R, A...>;
+    if constexpr (sizeof...(A) < MAX_C_ARGS) {
+        add_thunks<R, A..., int32_t>(map);
+        add_thunks<R, A..., int64_t>(map);
+        add_thunks<R, A..., void*>(map);
+        add_thunks<R, A..., double>(map);
+        add_thunks<R, A..., float>(map);
+    }
+}
+
+/* Signature, e.g. "vi" for void f(int), to thunk */
+const std::map<std::string, c_thunk>& c_thunks()
+{
+    static const std::map<std::string, c_thunk> map = [] {
+        std::map<std::string, c_thunk> m;
+        add_thunks<void>(m);
+        add_thunks<int32_t>(m);
+        add_thunks<int64_t>(m);
+        add_thunks<void*>(m);
+        add_thunks<double>(m);
+        add_thunks<float>(m);
+        return m;
+    }();
+    return map;
+}
+
+/* How a value of an Engma type is stored in a slot */
+enum class bc_kind { S64, S32, S16, S8, U64, U32, U16, U8, F64, F32, PTR };
+
+bc_kind kind_of(const emc_type &t)
+{
+    if (t.is_pointer() || t.is_string())
+        return bc_kind::PTR;
+    switch (t.type) {
+    case emc_types::LONG:   return bc_kind::S64;
+    case emc_types::INT:    return bc_kind::S32;
+    case emc_types::SHORT:  return bc_kind::S16;
+    case emc_types::SBYTE:  return bc_kind::S8;
+    case emc_types::ULONG:  return bc_kind::U64;
+    case emc_types::UINT:   return bc_kind::U32;
+    case emc_types::USHORT: return bc_kind::U16;
+    case emc_types::BYTE:   return bc_kind::U8;
+    case emc_types::DOUBLE: return bc_kind::F64;
+    case emc_types::FLOAT:  return bc_kind::F32;
+    default:
+        throw interp_unsupported{"values of non primitive types"};
+    }
+}
+
+bool is_signed(bc_kind k)
+{
+    return k == bc_kind::S64 || k == bc_kind::S32 || k == bc_kind::S16 || k == bc_kind::S8;
+}
+
+bool is_unsigned(bc_kind k)
+{
+    return k == bc_kind::U64 || k == bc_kind::U32 || k == bc_kind::U16 || k == bc_kind::U8;
+}
+
+int width_of(bc_kind k)
+{
+    switch (k) {
+    case bc_kind::S8:  case bc_kind::U8:  return 8;
+    case bc_kind::S16: case bc_kind::U16: return 16;
+    case bc_kind::S32: case bc_kind::U32: case bc_kind::F32: return 32;
+    default: return 64;
+    }
+}
+
+/* The op that wraps a 64 bit integer to the width of the kind, if any */
+int wrap_op(bc_kind k)
+{
+    switch (k) {
+    case bc_kind::S32: return OP_SEXT32;
+    case bc_kind::S16: return OP_SEXT16;
+    case bc_kind::S8:  return OP_SEXT8;
+    case bc_kind::U32: return OP_ZEXT32;
+    case bc_kind::U16: return OP_ZEXT16;
+    case bc_kind::U8:  return OP_ZEXT8;
+    default: return -1;
+    }
+}
+
+int64_t wrap_int(bc_kind k, int64_t v)
+{
+    switch (k) {
+    case bc_kind::S32: return (int32_t)v;
+    case bc_kind::S16: return (int16_t)v;
+    case bc_kind::S8:  return (int8_t)v;
+    case bc_kind::U32: return (uint32_t)v;
+    case bc_kind::U16: return (uint16_t)v;
+    case bc_kind::U8:  return (uint8_t)v;
+    default: return v;
+    }
+}
+
+/* Same promotions as jit::promote_rvals_for_compare() */
+bc_kind compare_kind(bc_kind a, bc_kind b)
+{
+    using K = bc_kind;
+
+    if (a == b)
+        return a;
+    else if (a == K::PTR || b == K::PTR)
+        throw interp_unsupported{"pointer compares"};
+    else if (a == K::U64 && is_signed(b) || b == K::U64 && is_signed(a))
+        THROW_BUG("Invalid cast for compare: Ulong and signed type");
+    else if (a == K::F64 || b == K::F64)
+        return K::F64;
+    else if (a == K::F32 || b == K::F32)
+        return K::F32;
+    else if (a == K::S64 || b == K::S64 ||
+             a == K::S32 && b == K::U32 || b == K::S32 && a == K::U32)
+        return K::S64;
+    else if (a == K::S32 || b == K::S32 ||
+             a == K::S16 && b == K::U16 || b == K::S16 && a == K::U16)
+        return K::S32;
+    else if (a == K::S16 || b == K::S16 ||
+             a == K::S8 && b == K::U8 || b == K::S8 && a == K::U8)
+        return K::S16;
+    else if (a == K::S8 || b == K::S8)
+        return K::S8;
+    else if (a == K::U64 || b == K::U64)
+        return K::U64;
+    else if (a == K::U32 || b == K::U32)
+        return K::U32;
+    else if (a == K::U16 || b == K::U16)
+        return K::U16;
+    return K::U8;
+}
+
+struct bc_var {
+    bool is_global;
+    int index;
+    bc_kind kind;
+};
+
+/* Lowers the AST to bytecode */
+class bc_compiler {
+public:
+    bc_compiler(bc_program &prog) : prog(prog)
+    {
+        prog.functions.push_back({"<top level>"});
+        scopes.push_back({});
+    }
+
+    void top_level(ast_node *node)
+    {
+        switch (node->type) {
+        case ast_type::FUNCTION_DEF:
+            function_def(dynamic_cast<ast_node_funcdef*>(node));
+            break;
+        case ast_type::FUNCTION_DECL:
+        case ast_type::TYPE:
+        case ast_type::NAMESPACE:
+            break;
+        case ast_type::USING: {
+            auto t_node = dynamic_cast<ast_node_using*>(node);
+            DEBUG_ASSERT_NOTNULL(t_node->compunit);
+            for (ast_node *cu_node : t_node->compunit->v_nodes)
+                top_level(cu_node);
+            break;
+        }
+        default:
+            stmt(node);
+        }
+    }
+
+    void finish()
+    {
+        emit(OP_RETV, 0, 0, 0);
+    }
+
+private:
+    bc_program &prog;
+    int cur_fn = 0;
+    int next_reg = 0;
+    bc_kind ret_kind = bc_kind::S32;
+    bool ret_void = true;
+    std::vector<std::map<std::string, bc_var>> scopes; /* scopes[0] is the file scope */
+    std::vector<int> scope_marks;
+    std::map<ast_node*, int> map_fdef_to_index;
+    std::map<std::string, int> map_cfn_to_extern;
+
+    bc_function& fn()
+    {
+        return prog.functions[cur_fn];
+    }
+
+    int emit(int op, int a, int b, int c)
+    {
+        fn().code.push_back({(uint16_t)op, (uint16_t)a, (uint16_t)b, (uint16_t)c});
+        return fn().code.size() - 1;
+    }
+
+    int here()
+    {
+        return fn().code.size();
+    }
+
+    void patch(int jump, int target)
+    {
+        fn().code[jump].b = target & 0xFFFF;
+        fn().code[jump].c = target >> 16;
+    }
+
+    int alloc_reg()
+    {
+        if (next_reg == 0xFFFF)
+            throw interp_unsupported{"too many registers"};
+        int r = next_reg++;
+        if (next_reg > fn().n_regs)
+            fn().n_regs = next_reg;
+        return r;
+    }
+
+    int load_const(slot value)
+    {
+        if (fn().consts.size() == 0xFFFF)
+            throw interp_unsupported{"too many constants"};
+        fn().consts.push_back(value);
+        int r = alloc_reg();
+        emit(OP_LOADK, r, fn().consts.size() - 1, 0);
+        return r;
+    }
+
+    void push_scope()
+    {
+        scopes.push_back({});
+        scope_marks.push_back(next_reg);
+    }
+
+    void pop_scope()
+    {
+        scopes.pop_back();
+        next_reg = scope_marks.back();
+        scope_marks.pop_back();
+    }
+
+    const bc_var& find_var(const std::string &name)
+    {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); it++) {
+            auto var = it->find(name);
+            if (var != it->end())
+                return var->second;
+        }
+        THROW_BUG("Could not resolve variable: " + name);
+    }
+
+    /* Returns a register with the value in reg converted like a C cast */
+    int convert(int reg, bc_kind from, bc_kind to)
+    {
+        if (from == to)
+            return reg;
+        if (from == bc_kind::PTR || to == bc_kind::PTR)
+            throw interp_unsupported{"pointer casts"};
+
+        int op = -1;
+        if (to == bc_kind::F64)
+            op = is_signed(from) ? OP_I2D : is_unsigned(from) ? OP_U2D : OP_F2D;
+        else if (to == bc_kind::F32)
+            op = is_signed(from) ? OP_I2F : is_unsigned(from) ? OP_U2F : OP_D2F;
+        else if (from == bc_kind::F64)
+            op = is_signed(to) ? OP_D2I : OP_D2U;
+        else if (from == bc_kind::F32)
+            op = is_signed(to) ? OP_F2I : OP_F2U;
+
+        int dst = reg;
+        if (op >= 0) {
+            dst = alloc_reg();
+            emit(op, dst, reg, 0);
+            reg = dst;
+        } else {
+            /* Integer to integer. Nothing to do if all values fit. */
+            if (is_signed(from) == is_signed(to) && width_of(from) <= width_of(to) ||
+                is_unsigned(from) && is_signed(to) && width_of(from) < width_of(to))
+                return reg;
+        }
+        int wrap = wrap_op(to);
+        if (wrap >= 0) {
+            if (dst == reg && op < 0)
+                dst = alloc_reg();
+            emit(wrap, dst, reg, 0);
+        }
+        return dst;
+    }
+
+    /* Conditions are cast to Int, as in walk_tree_if() */
+    int cond(ast_node *node)
+    {
+        int r = expr(node);
+        return convert(r, kind_of(node->value_type), bc_kind::S32);
+    }
+
+    slot const_slot(const const_value &value, bc_kind k)
+    {
+        slot s;
+        s.i = 0;
+        std::visit([&](auto v) {
+            using V = decltype(v);
+            if constexpr (std::is_same_v<V, std::monostate>)
+                THROW_BUG("Folded node without value");
+            else if (k == bc_kind::F64)
+                s.d = (double)v;
+            else if (k == bc_kind::F32)
+                s.f = (float)v;
+            else if (k == bc_kind::PTR)
+                throw interp_unsupported{"pointer constants"};
+            else
+                s.i = wrap_int(k, (int64_t)v);
+        }, value);
+        return s;
+    }
+
+    int binary(int op_i, int op_u, int op_d, int op_f, ast_node *node,
+               ast_node *first, ast_node *sec)
+    {
+        bc_kind k = kind_of(node->value_type);
+        int a = convert(expr(first), kind_of(first->value_type), k);
+        int b = convert(expr(sec), kind_of(sec->value_type), k);
+
+        int op = is_signed(k) ? op_i : is_unsigned(k) ? op_u :
+                 k == bc_kind::F64 ? op_d : k == bc_kind::F32 ? op_f : -1;
+        if (op < 0)
+            throw interp_unsupported{"operator on this type"};
+
+        int dst = alloc_reg();
+        emit(op, dst, a, b);
+        if (wrap_op(k) >= 0)
+            emit(wrap_op(k), dst, dst, 0);
+        return dst;
+    }
+
+    /* dst = a OP b for the compare ops of the chain */
+    void compare(int dst, ast_type type, int a, bc_kind ka, int b, bc_kind kb)
+    {
+        bc_kind k = compare_kind(ka, kb);
+        a = convert(a, ka, k);
+        b = convert(b, kb, k);
+
+        /* > and >= are < and <= with swapped operands */
+        if (type == ast_type::GRE || type == ast_type::GEQ) {
+            std::swap(a, b);
+            type = type == ast_type::GRE ? ast_type::LES : ast_type::LEQ;
+        }
+
+        int op;
+        if (k == bc_kind::F64)
+            op = type == ast_type::LES ? OP_LT_D : type == ast_type::LEQ ? OP_LE_D :
+                 type == ast_type::EQU ? OP_EQ_D : OP_NE_D;
+        else if (k == bc_kind::F32)
+            op = type == ast_type::LES ? OP_LT_F : type == ast_type::LEQ ? OP_LE_F :
+                 type == ast_type::EQU ? OP_EQ_F : OP_NE_F;
+        else if (is_signed(k))
+            op = type == ast_type::LES ? OP_LT_S : type == ast_type::LEQ ? OP_LE_S :
+                 type == ast_type::EQU ? OP_EQ_I : OP_NE_I;
+        else
+            op = type == ast_type::LES ? OP_LT_U : type == ast_type::LEQ ? OP_LE_U :
+                 type == ast_type::EQU ? OP_EQ_I : OP_NE_I;
+        emit(op, dst, a, b);
+    }
+
+    int call(ast_node_funccall *call_node)
+    {
+        auto arg_list = dynamic_cast<ast_node_arglist*>(call_node->arg_list);
+        DEBUG_ASSERT_NOTNULL(arg_list);
+        int n_args = arg_list->v_ast_args.size();
+
+        std::vector<bc_kind> v_kinds;
+        if (call_node->fdef_node) {
+            auto fdef = dynamic_cast<ast_node_funcdef*>(call_node->fdef_node);
+            auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+            for (auto e : parlist->v_defs)
+                v_kinds.push_back(kind_of(e->value_type));
+        } else {
+            for (auto e : arg_list->v_ast_args)
+                v_kinds.push_back(kind_of(e->value_type));
+        }
+
+        /* The arguments are put in consecutive registers at the top of the frame */
+        int base = next_reg;
+        for (int i = 0; i < n_args; i++)
+            alloc_reg();
+        for (int i = 0; i < n_args; i++) {
+            int mark = next_reg;
+            ast_node *arg = arg_list->v_ast_args[i];
+            int r = convert(expr(arg), kind_of(arg->value_type), v_kinds[i]);
+            emit(OP_MOV, base + i, r, 0);
+            next_reg = mark;
+        }
+        next_reg = base;
+        int dst = alloc_reg();
+
+        if (call_node->fdef_node) {
+            emit(OP_CALL, dst, declare_function(call_node->fdef_node), base);
+            return dst;
+        }
+
+        /* C function */
+        bool ret_void = call_node->value_type.is_void();
+        bc_kind ret_k = ret_void ? bc_kind::S32 : kind_of(call_node->value_type);
+        emit(OP_CCALL, dst, declare_extern(call_node->mangled_name, ret_void, ret_k, v_kinds), base);
+        if (!ret_void && wrap_op(ret_k) >= 0)
+            emit(wrap_op(ret_k), dst, dst, 0);
+        return dst;
+    }
+
+    static char c_kind_char(bc_kind k)
+    {
+        switch (k) {
+        case bc_kind::S64: case bc_kind::U64: return 'l';
+        case bc_kind::F64: return 'd';
+        case bc_kind::F32: return 'f';
+        case bc_kind::PTR: return 'p';
+        default: return 'i';
+        }
+    }
+
+    int declare_extern(const std::string &name, bool ret_void, bc_kind ret_k,
+                       const std::vector<bc_kind> &v_kinds)
+    {
+        auto it = map_cfn_to_extern.find(name);
+        if (it != map_cfn_to_extern.end())
+            return it->second;
+
+        if (v_kinds.size() > MAX_C_ARGS)
+            throw interp_unsupported{"C function " + name + " has too many parameters"};
+        std::string sig{ret_void ? 'v' : c_kind_char(ret_k)};
+        for (auto k : v_kinds)
+            sig += c_kind_char(k);
+        auto thunk = c_thunks().find(sig);
+        DEBUG_ASSERT(thunk != c_thunks().end(), "No thunk for signature " + sig);
+
+        void *fn = dlsym(RTLD_DEFAULT, name.c_str());
+        if (!fn)
+            throw interp_unsupported{"C function " + name + " not found"};
+
+        prog.externs.push_back({name, fn, thunk->second});
+        return map_cfn_to_extern[name] = prog.externs.size() - 1;
+    }
+
+    int declare_function(ast_node *fdef_node)
+    {
+        auto it = map_fdef_to_index.find(fdef_node);
+        if (it != map_fdef_to_index.end())
+            return it->second;
+        if (prog.functions.size() == 0xFFFF)
+            throw interp_unsupported{"too many functions"};
+        auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+        DEBUG_ASSERT_NOTNULL(fdef);
+        prog.functions.push_back({fdef->mangled_name});
+        return map_fdef_to_index[fdef_node] = prog.functions.size() - 1;
+    }
+
+    void function_def(ast_node_funcdef *fdef)
+    {
+        DEBUG_ASSERT_NOTNULL(fdef);
+        if (scopes.size() != 1)
+            throw interp_unsupported{"nested functions"};
+
+        int outer_fn = cur_fn;
+        int outer_next_reg = next_reg;
+        cur_fn = declare_function(fdef);
+        next_reg = 0;
+        ret_void = fdef->return_list->value_type.is_void();
+        if (!ret_void)
+            ret_kind = kind_of(fdef->return_list->value_type);
+
+        push_scope();
+        auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+        DEBUG_ASSERT_NOTNULL(parlist);
+        for (auto e : parlist->v_defs) {
+            auto par = dynamic_cast<ast_node_def*>(e);
+            DEBUG_ASSERT_NOTNULL(par);
+            scopes.back()[par->var_name] = {false, alloc_reg(), kind_of(par->value_type)};
+        }
+        stmt(fdef->code_block);
+        pop_scope();
+        /* Falling off the end of a non void function is UB, just return */
+        emit(OP_RETV, 0, 0, 0);
+
+        cur_fn = outer_fn;
+        next_reg = outer_next_reg;
+    }
+
+    void stmt(ast_node *node)
+    {
+        switch (node->type) {
+        case ast_type::EXPLIST: {
+            auto t_node = dynamic_cast<ast_node_explist*>(node);
+            for (auto e : t_node->v_nodes)
+                stmt(e);
+            return;
+        }
+        case ast_type::DOBLOCK:
+            push_scope();
+            stmt(dynamic_cast<ast_node_doblock*>(node)->first);
+            pop_scope();
+            return;
+        case ast_type::IF: {
+            auto t_node = dynamic_cast<ast_node_if*>(node);
+            auto elseif_t = dynamic_cast<ast_node_elseiflist*>(t_node->elseif_el);
+            std::vector<int> v_to_also;
+
+            int mark = next_reg;
+            int jump_next = emit(OP_JZ, cond(t_node->cond_e), 0, 0);
+            next_reg = mark;
+            scoped_stmt(t_node->if_el);
+            v_to_also.push_back(emit(OP_JMP, 0, 0, 0));
+
+            if (elseif_t) {
+                for (int i = 0; i < elseif_t->v_cond_e.size(); i++) {
+                    patch(jump_next, here());
+                    jump_next = emit(OP_JZ, cond(elseif_t->v_cond_e[i]), 0, 0);
+                    next_reg = mark;
+                    scoped_stmt(elseif_t->v_elseif[i]);
+                    v_to_also.push_back(emit(OP_JMP, 0, 0, 0));
+                }
+            }
+            patch(jump_next, here());
+            if (t_node->else_el)
+                scoped_stmt(t_node->else_el);
+            /* ALSO is done if any of the IFs was */
+            int jump_end = emit(OP_JMP, 0, 0, 0);
+            for (int j : v_to_also)
+                patch(j, here());
+            if (t_node->also_el)
+                scoped_stmt(t_node->also_el);
+            patch(jump_end, here());
+            return;
+        }
+        case ast_type::WHILE: {
+            auto t_node = dynamic_cast<ast_node_while*>(node);
+            int mark = next_reg;
+            int jump_else = emit(OP_JZ, cond(t_node->cond_e), 0, 0);
+            next_reg = mark;
+            int top = here();
+            scoped_stmt(t_node->if_el);
+            int jump_top = emit(OP_JNZ, cond(t_node->cond_e), 0, 0);
+            next_reg = mark;
+            patch(jump_top, top);
+            int jump_end = emit(OP_JMP, 0, 0, 0);
+            /* The ELSE is done if the loop never was */
+            patch(jump_else, here());
+            if (t_node->else_el)
+                scoped_stmt(t_node->else_el);
+            patch(jump_end, here());
+            return;
+        }
+        case ast_type::RETURN: {
+            auto t_node = dynamic_cast<ast_node_return*>(node);
+            if (cur_fn == 0)
+                throw interp_unsupported{"RETURN at the top level"};
+            if (!t_node->first || ret_void) {
+                if (t_node->first)
+                    stmt(t_node->first);
+                emit(OP_RETV, 0, 0, 0);
+                return;
+            }
+            int mark = next_reg;
+            int r = convert(expr(t_node->first), kind_of(t_node->first->value_type), ret_kind);
+            emit(OP_RET, r, 0, 0);
+            next_reg = mark;
+            return;
+        }
+        case ast_type::DEF: {
+            auto t_node = dynamic_cast<ast_node_def*>(node);
+            bc_kind k = kind_of(t_node->value_type);
+            bool is_global = scopes.size() == 1;
+            if (is_global && prog.n_globals == 0xFFFF)
+                throw interp_unsupported{"too many globals"};
+            int index = is_global ? prog.n_globals++ : alloc_reg();
+
+            int mark = next_reg;
+            int r;
+            if (t_node->value_node)
+                r = convert(expr(t_node->value_node), kind_of(t_node->value_node->value_type), k);
+            else {
+                slot zero;
+                zero.i = 0;
+                r = load_const(zero);
+            }
+            if (is_global)
+                emit(OP_STOREG, 0, r, index);
+            else
+                emit(OP_MOV, index, r, 0);
+            next_reg = mark;
+
+            scopes.back()[t_node->var_name] = {is_global, index, k};
+            return;
+        }
+        case ast_type::ASSIGN: {
+            auto t_node = dynamic_cast<ast_node_assign*>(node);
+            auto var_node = dynamic_cast<ast_node_var*>(t_node->first);
+            if (!var_node)
+                throw interp_unsupported{"assignment to something else than a variable"};
+            const bc_var &var = find_var(var_node->name);
+
+            int mark = next_reg;
+            int r = convert(expr(t_node->sec), kind_of(t_node->sec->value_type), var.kind);
+            if (var.is_global)
+                emit(OP_STOREG, 0, r, var.index);
+            else
+                emit(OP_MOV, var.index, r, 0);
+            next_reg = mark;
+            return;
+        }
+        case ast_type::FUNCTION_DEF:
+            function_def(dynamic_cast<ast_node_funcdef*>(node));
+            return;
+        case ast_type::FUNCTION_DECL:
+        case ast_type::TYPE:
+            throw interp_unsupported{"declarations in blocks"};
+        default: {
+            int mark = next_reg;
+            if (node->type == ast_type::FUNCTION_CALL)
+                call(dynamic_cast<ast_node_funccall*>(node)); /* Can be void */
+            else
+                expr(node);
+            next_reg = mark;
+            return;
+        }
+        }
+    }
+
+    void scoped_stmt(ast_node *node)
+    {
+        push_scope();
+        stmt(node);
+        pop_scope();
+    }
+
+    /* Returns a register with the value of the expression. Might be the
+       register of a local, so it must not be written to. */
+    int expr(ast_node *node)
+    {
+        switch (node->type) {
+        case ast_type::INT_LITERAL: {
+            slot s;
+            s.i = dynamic_cast<ast_node_int_literal*>(node)->i;
+            return load_const(s);
+        }
+        case ast_type::DOUBLE_LITERAL: {
+            slot s;
+            s.d = dynamic_cast<ast_node_double_literal*>(node)->d;
+            return load_const(s);
+        }
+        case ast_type::STRING_LITERAL: {
+            prog.strings.push_back(dynamic_cast<ast_node_string_literal*>(node)->s);
+            slot s;
+            s.p = prog.strings.back().c_str();
+            return load_const(s);
+        }
+        default:
+            break;
+        }
+
+        /* Use the value of already folded nodes */
+        if (node->value_type.is_const_expr && has_value(node->value))
+            return load_const(const_slot(node->value, kind_of(node->value_type)));
+
+        switch (node->type) {
+        case ast_type::VAR: {
+            const bc_var &var = find_var(dynamic_cast<ast_node_var*>(node)->full_name);
+            if (!var.is_global)
+                return var.index;
+            int r = alloc_reg();
+            emit(OP_LOADG, r, var.index, 0);
+            return r;
+        }
+        case ast_type::ADD: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(OP_ADD_I, OP_ADD_I, OP_ADD_D, OP_ADD_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::SUB: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(OP_SUB_I, OP_SUB_I, OP_SUB_D, OP_SUB_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::MUL: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(OP_MUL_I, OP_MUL_I, OP_MUL_D, OP_MUL_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::RDIV: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(-1, -1, OP_DIV_D, OP_DIV_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::INTDIV: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(OP_DIV_S, OP_DIV_U, OP_FDIV_D, OP_FDIV_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::REM: {
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(OP_REM_S, OP_REM_U, OP_REM_D, OP_REM_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::POW: {
+            /* Only floating point x^y is implemented in the jit */
+            auto t_node = dynamic_cast<ast_node_bin_op*>(node);
+            return binary(-1, -1, OP_POW_D, OP_POW_F, node, t_node->first, t_node->sec);
+        }
+        case ast_type::UMINUS:
+        case ast_type::ABS: {
+            ast_node *first = node->type == ast_type::UMINUS ?
+                dynamic_cast<ast_node_uminus*>(node)->first :
+                dynamic_cast<ast_node_abs*>(node)->first;
+            bc_kind k = kind_of(node->value_type);
+            int a = convert(expr(first), kind_of(first->value_type), k);
+            bool neg = node->type == ast_type::UMINUS;
+            int op = is_signed(k) ? (neg ? OP_NEG_I : OP_ABS_I) :
+                     is_unsigned(k) ? (neg ? OP_NEG_I : OP_MOV) :
+                     k == bc_kind::F64 ? (neg ? OP_NEG_D : OP_ABS_D) :
+                     k == bc_kind::F32 ? (neg ? OP_NEG_F : OP_ABS_F) : -1;
+            if (op < 0)
+                throw interp_unsupported{"operator on this type"};
+            int dst = alloc_reg();
+            emit(op, dst, a, 0);
+            if (wrap_op(k) >= 0)
+                emit(wrap_op(k), dst, dst, 0);
+            return dst;
+        }
+        case ast_type::ANDCHAIN: {
+            auto t_node = dynamic_cast<ast_node_andchain*>(node);
+            DEBUG_ASSERT(t_node->v_children.size(), "No children in andchain");
+            /* All operands are evaluated once, like in walk_tree_andchain() */
+            std::vector<int> v_regs;
+            std::vector<bc_kind> v_kinds;
+            ast_node *first = t_node->v_children.front()->first.get();
+            v_regs.push_back(expr(first));
+            v_kinds.push_back(kind_of(first->value_type));
+            for (auto e : t_node->v_children) {
+                v_regs.push_back(expr(e->sec.get()));
+                v_kinds.push_back(kind_of(e->sec->value_type));
+            }
+            int dst = alloc_reg();
+            for (int i = 0; i < t_node->v_children.size(); i++) {
+                int r = i ? alloc_reg() : dst;
+                compare(r, t_node->v_children[i]->type, v_regs[i], v_kinds[i],
+                        v_regs[i + 1], v_kinds[i + 1]);
+                if (i)
+                    emit(OP_LAND, dst, dst, r);
+            }
+            return dst;
+        }
+        case ast_type::AND:
+        case ast_type::OR:
+        case ast_type::XOR:
+        case ast_type::NAND:
+        case ast_type::NOR:
+        case ast_type::XNOR: {
+            ast_node *first = nullptr, *sec = nullptr;
+            if (auto t = dynamic_cast<ast_node_and*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_or*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_xor*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_nand*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_nor*>(node)) first = t->first, sec = t->sec;
+            else if (auto t = dynamic_cast<ast_node_xnor*>(node)) first = t->first, sec = t->sec;
+            DEBUG_ASSERT_NOTNULL(first);
+            /* Both operands are always evaluated */
+            int a = cond(first);
+            int b = cond(sec);
+            int dst = alloc_reg();
+            switch (node->type) {
+            case ast_type::AND:
+            case ast_type::NAND:
+                emit(OP_LAND, dst, a, b);
+                break;
+            case ast_type::OR:
+            case ast_type::NOR:
+                emit(OP_LOR, dst, a, b);
+                break;
+            default:
+                emit(OP_LXOR, dst, a, b);
+            }
+            if (node->type == ast_type::NAND || node->type == ast_type::NOR ||
+                node->type == ast_type::XNOR)
+                emit(OP_NOT, dst, dst, 0);
+            return dst;
+        }
+        case ast_type::NOT: {
+            int a = cond(dynamic_cast<ast_node_not*>(node)->first);
+            int dst = alloc_reg();
+            emit(OP_NOT, dst, a, 0);
+            return dst;
+        }
+        case ast_type::FUNCTION_CALL: {
+            if (node->value_type.is_void())
+                throw interp_unsupported{"value of a void call"};
+            return call(dynamic_cast<ast_node_funccall*>(node));
+        }
+        default:
+            throw interp_unsupported{"this kind of expression"};
+        }
+    }
+};
+
+[[noreturn]] void interp_error(const char *msg)
+{
+    THROW_USER_ERROR(msg);
+}
+
+void bc_run(const bc_program &prog)
+{
+    struct call_frame {
+        const insn *ret_pc;
+        const insn *code;
+        slot *base;
+        const slot *consts;
+        uint16_t dst;
+    };
+
+    static void *labels[] = {
+#define BC_LABEL(name) &&L_##name,
+        BC_OPS(BC_LABEL)
+#undef BC_LABEL
+    };
+
+    std::vector<slot> stack(1 << 20);
+    std::vector<call_frame> frames;
+    frames.reserve(256);
+    slot *stack_end = stack.data() + stack.size();
+    std::vector<slot> globals(prog.n_globals);
+    slot *G = globals.data();
+
+    const bc_function *top = &prog.functions[0];
+    if (top->n_regs > stack.size())
+        interp_error("Stack overflow");
+    slot *R = stack.data();
+    const slot *K = top->consts.data();
+    const insn *code = top->code.data();
+    const insn *pc = code;
+
+#define DISPATCH() goto *labels[pc->op]
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define A R[pc->a]
+#define B R[pc->b]
+#define C R[pc->c]
+#define TARGET (pc->b | (uint32_t)pc->c << 16)
+
+    DISPATCH();
+
+L_MOV:    A = B; NEXT();
+L_LOADK:  A = K[pc->b]; NEXT();
+L_LOADG:  A = G[pc->b]; NEXT();
+L_STOREG: G[pc->c] = B; NEXT();
+
+    /* Done unsigned to wrap instead of UB */
+L_ADD_I:  A.u = B.u + C.u; NEXT();
+L_SUB_I:  A.u = B.u - C.u; NEXT();
+L_MUL_I:  A.u = B.u * C.u; NEXT();
+L_DIV_S:
+    if (C.i == 0) interp_error("Integer division by zero");
+    A.i = C.i == -1 ? (int64_t)(0 - B.u) : B.i / C.i; NEXT();
+L_REM_S:
+    if (C.i == 0) interp_error("Integer division by zero");
+    A.i = C.i == -1 ? 0 : B.i % C.i; NEXT();
+L_DIV_U:
+    if (C.u == 0) interp_error("Integer division by zero");
+    A.u = B.u / C.u; NEXT();
+L_REM_U:
+    if (C.u == 0) interp_error("Integer division by zero");
+    A.u = B.u % C.u; NEXT();
+
+L_ADD_D:  A.d = B.d + C.d; NEXT();
+L_SUB_D:  A.d = B.d - C.d; NEXT();
+L_MUL_D:  A.d = B.d * C.d; NEXT();
+L_DIV_D:  A.d = B.d / C.d; NEXT();
+L_FDIV_D: A.d = floor(B.d / C.d); NEXT();
+L_REM_D:  A.d = fmod(B.d, C.d); NEXT();
+L_POW_D:  A.d = pow(B.d, C.d); NEXT();
+L_ADD_F:  A.f = B.f + C.f; NEXT();
+L_SUB_F:  A.f = B.f - C.f; NEXT();
+L_MUL_F:  A.f = B.f * C.f; NEXT();
+L_DIV_F:  A.f = B.f / C.f; NEXT();
+L_FDIV_F: A.f = floorf(B.f / C.f); NEXT();
+L_REM_F:  A.f = fmodf(B.f, C.f); NEXT();
+L_POW_F:  A.f = powf(B.f, C.f); NEXT();
+
+L_NEG_I:  A.u = 0 - B.u; NEXT();
+L_NEG_D:  A.d = -B.d; NEXT();
+L_NEG_F:  A.f = -B.f; NEXT();
+L_ABS_I:  A.u = B.i < 0 ? 0 - B.u : B.u; NEXT();
+L_ABS_D:  A.d = fabs(B.d); NEXT();
+L_ABS_F:  A.f = fabsf(B.f); NEXT();
+
+L_SEXT8:  A.i = (int8_t)B.i; NEXT();
+L_SEXT16: A.i = (int16_t)B.i; NEXT();
+L_SEXT32: A.i = (int32_t)B.i; NEXT();
+L_ZEXT8:  A.u = (uint8_t)B.u; NEXT();
+L_ZEXT16: A.u = (uint16_t)B.u; NEXT();
+L_ZEXT32: A.u = (uint32_t)B.u; NEXT();
+
+L_I2D:    A.d = (double)B.i; NEXT();
+L_U2D:    A.d = (double)B.u; NEXT();
+L_F2D:    A.d = B.f; NEXT();
+L_I2F:    A.f = (float)B.i; NEXT();
+L_U2F:    A.f = (float)B.u; NEXT();
+L_D2F:    A.f = (float)B.d; NEXT();
+L_D2I:    A.i = (int64_t)B.d; NEXT();
+L_D2U:    A.u = (uint64_t)B.d; NEXT();
+L_F2I:    A.i = (int64_t)B.f; NEXT();
+L_F2U:    A.u = (uint64_t)B.f; NEXT();
+
+L_LT_S:   A.i = B.i < C.i; NEXT();
+L_LE_S:   A.i = B.i <= C.i; NEXT();
+L_LT_U:   A.i = B.u < C.u; NEXT();
+L_LE_U:   A.i = B.u <= C.u; NEXT();
+L_EQ_I:   A.i = B.u == C.u; NEXT();
+L_NE_I:   A.i = B.u != C.u; NEXT();
+L_LT_D:   A.i = B.d < C.d; NEXT();
+L_LE_D:   A.i = B.d <= C.d; NEXT();
+L_EQ_D:   A.i = B.d == C.d; NEXT();
+L_NE_D:   A.i = B.d != C.d; NEXT();
+L_LT_F:   A.i = B.f < C.f; NEXT();
+L_LE_F:   A.i = B.f <= C.f; NEXT();
+L_EQ_F:   A.i = B.f == C.f; NEXT();
+L_NE_F:   A.i = B.f != C.f; NEXT();
+
+L_LAND:   A.i = B.i && C.i; NEXT();
+L_LOR:    A.i = B.i || C.i; NEXT();
+L_LXOR:   A.i = !B.i != !C.i; NEXT();
+L_NOT:    A.i = !B.i; NEXT();
+
+L_JMP:
+    pc = code + TARGET; DISPATCH();
+L_JZ:
+    if (A.i == 0) { pc = code + TARGET; DISPATCH(); }
+    NEXT();
+L_JNZ:
+    if (A.i != 0) { pc = code + TARGET; DISPATCH(); }
+    NEXT();
+
+L_CALL: {
+    const bc_function &callee = prog.functions[pc->b];
+    slot *base = R + pc->c;
+    if (base + callee.n_regs > stack_end)
+        interp_error("Stack overflow");
+    frames.push_back({pc + 1, code, R, K, pc->a});
+    R = base;
+    K = callee.consts.data();
+    pc = code = callee.code.data();
+    DISPATCH();
+}
+L_CCALL: {
+    const bc_extern &ext = prog.externs[pc->b];
+    slot ret;
+    ext.thunk(ext.fn, R + pc->c, &ret);
+    A = ret;
+    NEXT();
+}
+L_RET:
+L_RETV: {
+    slot ret = A;
+    if (frames.empty())
+        return;
+    const call_frame &frame = frames.back();
+    if (pc->op == OP_RET)
+        frame.base[frame.dst] = ret;
+    pc = frame.ret_pc;
+    code = frame.code;
+    R = frame.base;
+    K = frame.consts;
+    frames.pop_back();
+    DISPATCH();
+}
+
+#undef DISPATCH
+#undef NEXT
+#undef A
+#undef B
+#undef C
+#undef TARGET
+}
+
+} /* namespace */
+
+bool interp_run(std::vector<ast_node*> &v_nodes)
+{
+    if (opts().nonengma_files.size()) {
+        std::cerr << "--interp: C files need the jit" << std::endl;
+        return false;
+    }
+
+    bc_program prog;
+    try {
+        bc_compiler compiler(prog);
+        for (ast_node *node : v_nodes)
+            compiler.top_level(node);
+        compiler.finish();
+    } catch (interp_unsupported &e) {
+        std::cerr << "--interp: Not supported: " << e.what << ", using the jit" << std::endl;
+        return false;
+    }
+
+    bc_run(prog);
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/* Bytecode interpreter, used with -X --interp.
+ *
+ * The resolved AST, the same nodes jit::walk_tree() compiles, is lowered to
+ * a register bytecode that is run by a threaded dispatch loop. That way a
+ * short script does not have to wait for libgccjit to run the assembler and
+ * the linker. C functions, e.g. the ones in Std.Io, are looked up with
+ * dlsym() and called through thunks generated for each signature.
+ *
+ * Programs that use something the interpreter does not support (structs,
+ * pointers other than strings, C files on the command line etc.) are run
+ * with the jit instead.
+ */
+
+#include <vector>
+
+class ast_node;
+
+/* Runs the top level nodes of a compilation unit. Returns false, without
+   having run anything, if the program has to be run with the jit. */
+bool interp_run(std::vector<ast_node*> &v_nodes);
@@ -1,6 +1,26 @@
 /* C-linkage functions that are supposed to be call from within the JITed context. */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "instrument.hh"
+#include "target_clones.hh"
 
 extern "C" void printnl_int(int i)
 {
@@ -11,3 +31,312 @@ extern "C" void printnl_double(double d)
 {
     std::cout << d << std::endl;
 }
+
+/* For --target-clones, see target_clones.hh */
+extern "C" int engma_select_target(int n, const char **targets)
+{
+    int best = n, best_rank = -1;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    for (int i = 0; i < n; i++) {
+        int rank = 0;
+        /* __builtin_cpu_supports() only takes literals */
+#define X(name) \
+        if (!strcmp(targets[i], name) && __builtin_cpu_supports(name) && rank > best_rank) { \
+            best = i; \
+            best_rank = rank; \
+        } \
+        rank++;
+        ENGMA_FOR_EACH_CLONE_TARGET(X)
+#undef X
+    }
+#endif
+    return best;
+}
+
+/* Runtime for --instrument, see instrument.hh */
+
+namespace {
+
+uint64_t instr_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct instr_frame {
+    int index;
+    uint64_t start;
+    uint64_t children; /* Cycles in callees */
+};
+
+struct instr_event {
+    int index;
+    uint64_t start;
+    uint64_t cycles;
+};
+
+/* Only touched by its own thread until the report at exit */
+struct instr_thread {
+    long tid;
+    std::vector<long> counts;
+    std::vector<uint64_t> inclusive;
+    std::vector<uint64_t> exclusive;
+    std::vector<instr_frame> stack;
+    std::vector<instr_event> events;
+    bool events_dropped = false;
+};
+
+std::mutex instr_mutex;
+std::vector<instr_thread*> instr_threads;
+int instr_mode;
+std::vector<std::string> instr_names;
+uint64_t instr_start_cycles;
+std::chrono::steady_clock::time_point instr_start_time;
+
+/* The counts are in engma_instr_counts while the thread runs */
+void instr_fold_counts(instr_thread *t)
+{
+    t->counts.assign(engma_instr_counts, engma_instr_counts + instr_names.size());
+}
+
+struct instr_thread_guard {
+    instr_thread *t = nullptr;
+    ~instr_thread_guard()
+    {
+        if (t)
+            instr_fold_counts(t);
+    }
+};
+thread_local instr_thread_guard instr_this_thread;
+
+instr_thread* instr_get_thread()
+{
+    instr_thread *t = instr_this_thread.t;
+    if (t)
+        return t;
+
+    t = new instr_thread;
+    t->tid = syscall(SYS_gettid);
+    t->inclusive.resize(instr_names.size());
+    t->exclusive.resize(instr_names.size());
+    {
+        std::lock_guard<std::mutex> lock{instr_mutex};
+        instr_threads.push_back(t);
+    }
+    return instr_this_thread.t = t;
+}
+
+void instr_print_report(double cycles_per_ms)
+{
+    size_t n = instr_names.size();
+    std::vector<long> counts(n);
+    std::vector<uint64_t> inclusive(n), exclusive(n);
+    for (instr_thread *t : instr_threads)
+        for (size_t i = 0; i < n; i++) {
+            /* Not folded if the thread still runs */
+            if (t->counts.size() == n)
+                counts[i] += t->counts[i];
+            inclusive[i] += t->inclusive[i];
+            exclusive[i] += t->exclusive[i];
+        }
+
+    std::vector<size_t> v_order;
+    for (size_t i = 0; i < n; i++)
+        if (counts[i])
+            v_order.push_back(i);
+    std::stable_sort(v_order.begin(), v_order.end(), [&](size_t a, size_t b) {
+        return instr_mode == ENGMA_INSTR_COUNTS ? counts[a] > counts[b] : exclusive[a] > exclusive[b];
+    });
+
+    if (instr_mode == ENGMA_INSTR_COUNTS) {
+        std::cerr << std::setw(14) << "calls" << "  function\n";
+        for (size_t i : v_order)
+            std::cerr << std::setw(14) << counts[i] << "  " << instr_names[i] << "\n";
+        return;
+    }
+
+    std::cerr << std::setw(14) << "calls"
+              << std::setw(14) << "excl ms"
+              << std::setw(14) << "incl ms"
+              << std::setw(18) << "excl cycles" << "  function\n";
+    std::cerr << std::fixed << std::setprecision(3);
+    for (size_t i : v_order)
+        std::cerr << std::setw(14) << counts[i]
+                  << std::setw(14) << exclusive[i] / cycles_per_ms
+                  << std::setw(14) << inclusive[i] / cycles_per_ms
+                  << std::setw(18) << exclusive[i] << "  " << instr_names[i] << "\n";
+    std::cerr << std::defaultfloat;
+}
+
+void instr_write_trace(double cycles_per_ms)
+{
+    std::string path = "engma-trace-" + std::to_string(getpid()) + ".json";
+    std::ofstream f{path};
+    if (!f) {
+        std::cerr << "Could not write " << path << std::endl;
+        return;
+    }
+
+    f << std::fixed << std::setprecision(3);
+    f << "{\"traceEvents\": [";
+    bool first = true;
+    bool dropped = false;
+    for (instr_thread *t : instr_threads) {
+        dropped |= t->events_dropped;
+        for (const instr_event &e : t->events) {
+            std::string name;
+            for (char c : instr_names[e.index])
+                name += c == '"' || c == '\\' ? std::string{'\\', c} : std::string{c};
+            f << (first ? "\n" : ",\n")
+              << "{\"name\": \"" << name << "\", \"ph\": \"X\""
+              << ", \"ts\": " << (e.start - instr_start_cycles) / cycles_per_ms * 1000
+              << ", \"dur\": " << e.cycles / cycles_per_ms * 1000
+              << ", \"pid\": " << getpid() << ", \"tid\": " << t->tid << "}";
+            first = false;
+        }
+    }
+    f << "\n]}\n";
+
+    std::cerr << "Wrote the trace to " << path << std::endl;
+    if (dropped)
+        std::cerr << "Only the first " << ENGMA_INSTR_MAX_EVENTS << " calls per thread are in the trace" << std::endl;
+}
+
+void instr_at_exit()
+{
+    /* Cycles to time, measured over the run */
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - instr_start_time).count();
+    double cycles_per_ms = ms > 0 ? (instr_cycles() - instr_start_cycles) / ms : 1;
+
+    instr_fold_counts(instr_get_thread());
+
+    std::lock_guard<std::mutex> lock{instr_mutex};
+    if (instr_mode == ENGMA_INSTR_TRACE)
+        instr_write_trace(cycles_per_ms);
+    else
+        instr_print_report(cycles_per_ms);
+}
+
+/* --coverage */
+std::vector<std::string> cov_sources;
+std::vector<int> cov_files;
+std::vector<int> cov_lines;
+std::vector<long> cov_counts;
+
+/* FILE.em.gcov in the current directory, like gcov */
+void cov_write_gcov(int file)
+{
+    const std::string &source = cov_sources[file];
+    std::string name = source.substr(source.find_last_of('/') + 1);
+    std::string path = name + ".gcov";
+    std::ifstream src{source};
+    std::ofstream f{path};
+    if (!src || !f) {
+        std::cerr << "Could not write " << path << std::endl;
+        return;
+    }
+
+    /* The slot of each counted line in the file */
+    std::map<int, int> line_slots;
+    for (size_t i = 0; i < cov_lines.size(); i++)
+        if (cov_files[i] == file)
+            line_slots[cov_lines[i]] = i;
+
+    auto row = [&](const std::string &count, int line, const std::string &text) {
+        f << std::setw(9) << count << ":" << std::setw(5) << line << ":" << text << "\n";
+    };
+    row("-", 0, "Source:" + source);
+    row("-", 0, "Runs:1");
+
+    int n_executed = 0;
+    std::string text;
+    for (int line = 1; std::getline(src, text); line++) {
+        if (text.size() && text.back() == '\r')
+            text.pop_back();
+        auto it = line_slots.find(line);
+        if (it == line_slots.end())
+            row("-", line, text);
+        else if (!cov_counts[it->second])
+            row("#####", line, text);
+        else {
+            row(std::to_string(cov_counts[it->second]), line, text);
+            n_executed++;
+        }
+    }
+
+    std::cerr << "File '" << source << "'\n"
+              << "Lines executed:" << std::fixed << std::setprecision(2)
+              << (line_slots.size() ? 100.0 * n_executed / line_slots.size() : 0)
+              << "% of " << line_slots.size() << "\n"
+              << "Creating '" << path << "'" << std::endl;
+}
+
+/* The main file and the USING:ed ones with statements, like Std.Io has none */
+void cov_at_exit()
+{
+    for (size_t file = 0; file < cov_sources.size(); file++)
+        if (!file || std::count(cov_files.begin(), cov_files.end(), file))
+            cov_write_gcov(file);
+}
+
+}
+
+extern "C" {
+
+thread_local long engma_instr_counts[ENGMA_INSTR_MAX_FNS];
+
+void engma_instr_init(int mode, int n_fns, const char **names)
+{
+    instr_mode = mode;
+    instr_names.assign(names, names + n_fns);
+    instr_start_cycles = instr_cycles();
+    instr_start_time = std::chrono::steady_clock::now();
+    atexit(instr_at_exit);
+}
+
+long* engma_cov_init(int n_files, const char **sources, const int *files,
+                     const int *lines, int n)
+{
+    cov_sources.assign(sources, sources + n_files);
+    cov_files.assign(files, files + n);
+    cov_lines.assign(lines, lines + n);
+    cov_counts.assign(n ? n : 1, 0);
+    atexit(cov_at_exit);
+    return cov_counts.data();
+}
+
+void engma_instr_enter(int index)
+{
+    instr_get_thread()->stack.push_back({index, instr_cycles(), 0});
+}
+
+void engma_instr_exit(int index)
+{
+    uint64_t now = instr_cycles();
+    instr_thread *t = instr_this_thread.t;
+    if (!t || t->stack.empty() || t->stack.back().index != index)
+        return;
+
+    instr_frame frame = t->stack.back();
+    t->stack.pop_back();
+    uint64_t cycles = now - frame.start;
+    t->inclusive[index] += cycles;
+    t->exclusive[index] += cycles - frame.children;
+    if (t->stack.size())
+        t->stack.back().children += cycles;
+
+    if (instr_mode == ENGMA_INSTR_TRACE) {
+        if (t->events.size() < ENGMA_INSTR_MAX_EVENTS)
+            t->events.push_back({index, frame.start, cycles});
+        else
+            t->events_dropped = true;
+    }
+}
+
+}
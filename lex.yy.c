@@ -362,8 +362,8 @@ static void yynoreturn yy_fatal_error ( const char* msg , yyscan_t yyscanner );
 	yyg->yy_hold_char = *yy_cp; \
 	*yy_cp = '\0'; \
 	yyg->yy_c_buf_p = yy_cp;
-#define YY_NUM_RULES 65
-#define YY_END_OF_BUFFER 66
+#define YY_NUM_RULES 68
+#define YY_END_OF_BUFFER 69
 /* This struct is not used in this scanner,
    but its presence is necessary. */
 struct yy_trans_info
@@ -371,30 +371,34 @@ struct yy_trans_info
 	flex_int32_t yy_verify;
 	flex_int32_t yy_nxt;
 	};
-static const flex_int16_t yy_accept[200] =
+static const flex_int16_t yy_accept[232] =
     {   0,
-        0,    0,    0,    0,   66,   64,   61,   63,   64,   64,
-       64,    8,    6,   15,   16,    3,    1,   10,    2,   11,
-        4,   51,   51,   12,   18,    5,   19,    7,   48,   48,
-       48,   48,   48,   48,   48,   48,   48,   48,   48,   48,
-       48,   48,   64,   17,   47,   47,   13,    9,   14,   57,
-       59,   58,   60,   63,   24,    0,   53,    0,    0,    8,
-        0,    0,    6,    0,    0,    3,    0,    0,    1,    0,
-        0,   10,    0,    0,    2,    0,    0,   11,    0,   50,
-        0,    4,    0,   54,   25,   49,   51,    0,   18,   18,
-        0,   21,    0,    5,    0,   23,   19,   19,    0,   22,
-
-        0,    7,    0,   48,    0,    0,   27,    0,    0,    0,
-       26,    0,    0,    0,   37,    0,    0,    0,    0,    0,
-        0,    0,   62,   47,    0,   57,   56,   55,    0,   24,
-        0,    0,    0,   25,    0,   49,    0,   52,    0,   21,
-        0,   20,    0,   23,    0,    0,   22,    0,    0,   36,
-        0,   28,    0,    0,    0,    0,   41,   42,    0,    0,
-        0,    0,    0,    0,   38,   46,    0,   50,    0,   49,
-        0,   20,    0,   32,   29,   31,    0,    0,   40,    0,
-        0,   34,    0,    0,   39,    0,    0,    0,    0,   44,
-       30,   45,    0,   33,   35,    0,    0,   43,    0
-
+        0,    0,    0,    0,   69,   67,   64,   66,   67,   67,
+       67,    8,    6,   15,   16,    3,    1,   10,    2,   11,
+        4,   54,   54,   12,   18,    5,   19,    7,   51,   51,
+       51,   51,   51,   51,   51,   51,   51,   51,   51,   51,
+       51,   51,   51,   67,   17,   50,   50,   13,    9,   14,
+       60,   62,   61,   63,   66,   24,    0,   56,    0,    0,
+        8,    0,    0,    6,    0,    0,    3,    0,    0,    1,
+        0,    0,   10,    0,    0,    2,    0,    0,   11,    0,
+       53,    0,    4,    0,   57,   25,   52,   54,    0,   18,
+       18,    0,   21,    0,    5,    0,   23,   19,   19,    0,
+
+       22,    0,    7,    0,   51,    0,    0,    0,   27,    0,
+        0,    0,   26,    0,    0,    0,   37,    0,    0,    0,
+        0,    0,    0,    0,   65,   50,    0,   59,   58,    0,
+       24,    0,    0,    8,    6,    3,    1,   10,    2,   11,
+        0,    4,    0,   25,    0,   52,    0,   55,   18,    0,
+       21,    0,   20,    5,    0,   23,    0,   19,    0,   22,
+        0,    7,    0,    0,   36,    0,    0,   28,    0,    0,
+        0,    0,   41,   42,    0,    0,    0,    0,    0,    0,
+        0,   38,   49,   24,    0,   53,   25,    0,   52,   21,
+        0,   20,    0,   23,   22,    0,   32,    0,   29,   31,
+
+        0,    0,   40,    0,    0,    0,   34,    0,    0,   39,
+       20,   48,   46,    0,    0,    0,    0,    0,   44,   30,
+       45,    0,    0,   33,   35,    0,    0,    0,   47,   43,
+        0
     } ;
 
 static const YY_CHAR yy_ec[256] =
@@ -431,162 +435,194 @@ static const YY_CHAR yy_ec[256] =
 
 static const YY_CHAR yy_meta[58] =
     {   0,
-        1,    1,    2,    1,    1,    1,    1,    1,    1,    1,
-        2,    1,    1,    3,    1,    2,    4,    4,    1,    1,
-        1,    1,    1,    1,    5,    5,    5,    5,    5,    5,
-        1,    1,    1,    1,    6,    1,    6,    1,    1,    1,
-        1,    1,    1,    1,    1,    1,    1,    1,    3,    4,
-        4,    4,    3,    3,    1,    1,    1
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
+        1,    1,    1,    1,    1,    1,    1
     } ;
 
-static const flex_int16_t yy_base[206] =
+static const flex_int16_t yy_base[232] =
     {   0,
-        0,    0,   55,   56,  335,  336,  336,  336,  331,  311,
-       54,   59,   66,  336,  336,   71,   74,   77,   80,   85,
-       88,   78,   90,  336,  107,  111,  114,  117,   63,   87,
-      294,   90,  288,   76,  101,  290,  300,  286,  281,  285,
-      293,   27,  321,  336,    0,  304,  336,  336,  336,    0,
-      336,  306,  310,  336,  138,   88,  336,  317,  141,  336,
-      316,  144,  336,  315,  147,  336,  314,  150,  336,  313,
-      153,  336,  312,  156,  336,  311,  159,  336,  310,  147,
-      164,  336,  309,  336,  167,  155,  113,    0,  175,  336,
-      308,  178,  183,  336,  307,  186,  189,  336,  306,  192,
-
-      200,  336,  305,    0,  266,  278,  336,  264,  276,  266,
-      336,  263,   49,  158,  336,  259,  260,  260,  265,  264,
-      258,  255,  336,    0,  275,    0,  336,  336,  206,  336,
-      290,  199,  216,  336,  289,  197,  210,    0,  227,  336,
-      288,  230,  233,  336,  287,  236,  336,  286,  250,  336,
-      258,  336,  259,  247,  255,  255,  336,  336,  239,  238,
-      251,  242,  243,  237,  336,  336,  120,  157,  188,  224,
-      241,  336,  273,  336,  336,  336,  229,  223,  336,  208,
-      220,  336,  215,  196,  336,  181,  182,  175,  155,  336,
-      336,  336,  158,  336,  336,  107,   68,  336,  336,  249,
-
-      255,  259,  263,  267,  270
+        1,    0,   58,    0,    0,  116,    0,    0,  114,   96,
+      118,  174,  177,    0,    0,  180,  183,  186,  189,  192,
+      195,  185,  159,    0,  212,  215,  218,  221,  214,  170,
+      163,  170,  192,  169,  205,  208,  186,  207,  196,  196,
+      202,  212,  210,  242,    0,  236,  233,    0,    0,    0,
+      258,    0,  239,  245,    0,  255,    0,    0,  290,    0,
+        0,  257,    0,    0,  259,    0,    0,  267,    0,    0,
+      268,    0,    0,  269,    0,    0,  270,  258,    0,  274,
+      331,  267,    0,  276,    0,  278,  333,    0,  338,  262,
+        0,  290,  350,  335,    0,  355,  367,  337,    0,  358,
+
+      372,    0,    0,  369,    0,  345,  349,  342,    0,  339,
+      353,  345,    0,  345,  355,  353,    0,  355,  347,  355,
+      365,  366,  362,  361,    0,    0,  383,    0,    0,    0,
+        0,  400,    0,    0,    0,    0,    0,    0,    0,    0,
+      392,    0,    0,    0,  402,    0,  399,    0,    0,  384,
+        0,  405,  416,    0,    0,    0,  409,    0,    0,    0,
+      411,    0,  384,  383,    0,  381,  394,    0,  397,  387,
+      397,  399,    0,    0,  386,  386,  387,  402,  395,  398,
+      394,    0,    0,    0,  418,    0,    0,  420,    0,    0,
+        0,    0,  436,    0,    0,  403,    0,  399,    0,    0,
+
+      402,  402,    0,  404,  405,  419,    0,  416,  419,    0,
+        0,    0,    0,  407,  411,  418,  415,  411,    0,    0,
+        0,  429,  428,    0,    0,  429,  415,  429,    0,    0,
+      459
     } ;
 
-static const flex_int16_t yy_def[206] =
+static const flex_int16_t yy_def[232] =
     {   0,
-      199,    1,  200,  200,  199,  199,  199,  199,  199,  199,
-      201,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  202,  202,
-       30,   30,   30,   30,   30,   30,   30,   30,   30,   30,
-       30,   30,  199,  199,  203,  203,  199,  199,  199,  204,
-      199,  199,  199,  199,  199,  201,  199,  201,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  205,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-
-      199,  199,  199,   30,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  203,  199,  204,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  205,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,    0,  199,
-
-      199,  199,  199,  199,  199
+      231,    1,    1,    3,  231,  231,    6,    6,    6,    6,
+        1,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,   22,    6,    6,    6,    6,    6,    6,   29,
+       30,   30,   29,   30,   30,   30,   30,   30,   30,   30,
+       30,   30,   30,    6,    6,    6,   46,    6,    6,    6,
+        3,    6,    6,    6,    6,    6,   11,    6,    6,   12,
+        6,    6,   13,    6,    6,   16,    6,    6,   17,    6,
+        6,   18,    6,    6,   19,    6,    6,   20,    6,    6,
+        6,   21,    6,    6,    6,    6,    6,   23,    6,   25,
+        6,    6,    6,   26,    6,    6,    6,   27,    6,    6,
+
+        6,   28,    6,    6,   30,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,   46,    6,    6,    6,   56,
+        6,    6,   11,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,   86,    6,    6,   87,    6,   89,    6,   93,
+        6,    6,    6,    6,   97,    6,    6,    6,  101,    6,
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,  185,    6,    6,  188,    6,
+      153,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        6,    6,    6,    6,    6,    6,    6,    6,    6,    6,
+        0
     } ;
 
-static const flex_int16_t yy_nxt[394] =
+static const flex_int16_t yy_nxt[517] =
     {   0,
-        6,    7,    8,    9,   10,   11,   12,   13,   14,   15,
-       16,   17,   18,   19,   20,   21,   22,   23,    6,   24,
-       25,   26,   27,   28,   29,   30,   30,   31,   32,   33,
-       30,   30,   34,   30,   30,   30,   35,   36,   30,   37,
-       38,   39,   40,   41,   42,   30,   43,   44,    6,   45,
-       46,   45,   45,   45,   47,   48,   49,   51,   51,   57,
-       59,   60,   61,  121,  122,   52,   52,   62,   63,   64,
-       53,   53,   65,   66,   67,   68,   69,   70,   71,   72,
-       73,   74,   75,   76,  155,  156,   77,   78,   79,   81,
-       82,   83,   86,   57,   87,   87,  198,  105,   84,  106,
-
-       58,   80,   80,   85,   86,  111,   87,   87,   89,   90,
-       91,  112,   93,   94,   95,   97,   98,   99,  101,  102,
-      103,  199,   88,  199,  108,  113,  109,   86,   92,   87,
-       87,   88,   96,  197,   58,  100,  168,  168,  114,  129,
-      130,  131,   59,   60,   61,   62,   63,   64,   65,   66,
-       67,   68,   69,   70,   71,   72,   73,   74,   75,   76,
-       77,   78,   79,   80,   80,   81,   82,   83,  133,  134,
-      135,  136,  136,  168,  168,  132,   89,   90,   91,  139,
-      140,  141,  196,  137,   93,   94,   95,  143,  144,  145,
-       97,   98,   99,  146,  147,  148,  195,  157,  132,  158,
-
-      142,  101,  102,  103,  170,  170,  137,  129,  130,  131,
-      167,  194,  167,  136,  136,  168,  168,  133,  134,  135,
-      193,  169,  192,  169,  191,  137,  170,  170,  139,  140,
-      141,  171,  172,  173,  143,  144,  145,  146,  147,  148,
-      170,  170,  171,  172,  173,  190,  189,  188,  137,   50,
-       50,   50,   50,   50,   50,   56,   56,   56,   56,   56,
-       56,  104,  104,  187,  104,  124,  124,  126,  186,  126,
-      126,  126,  126,  138,  138,  172,  185,  184,  183,  182,
-      181,  180,  179,  178,  177,  176,  175,  174,  147,  144,
-      140,  134,  130,  166,  165,  164,  163,  162,  161,  160,
-
-      159,  154,  153,  152,  151,  150,  149,  102,   98,   94,
-       90,   82,   78,   75,   72,   69,   66,   63,   60,  199,
-      128,  127,  125,  123,  120,  119,  118,  117,  116,  115,
-      110,  107,   55,   54,  199,    5,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199
-
+        5,    6,    7,    8,    9,   10,   11,   12,   13,   14,
+       15,   16,   17,   18,   19,   20,   21,   22,   23,    6,
+       24,   25,   26,   27,   28,   29,   30,   31,   32,   33,
+       34,   30,   30,   35,   30,   30,   30,   36,   37,   30,
+       38,   39,   40,   41,   42,   43,   30,   44,   45,    6,
+       46,   47,   46,   46,   46,   48,   49,   50,   51,   51,
+       52,   51,   51,   51,   51,   51,   51,   51,   53,   51,
+       51,   51,   51,   54,   51,   51,   51,   51,   51,   51,
+       51,   51,   51,   51,   51,   51,   51,   51,   51,   51,
+       51,   51,   51,   51,   51,   51,   51,   51,   51,   51,
+
+       51,   51,   51,   51,   51,   51,   51,   51,   51,   51,
+       51,   51,   51,   51,   51,    5,   55,   56,   57,   57,
+       57,   57,   57,   58,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   59,   57,   57,   57,   57,   57,
+       57,   57,   57,   57,   57,   60,   61,   62,   63,   64,
+       65,   66,   67,   68,   69,   70,   71,   72,   73,   74,
+       75,   76,   77,   78,   79,   80,   82,   83,   84,   87,
+
+      108,   88,   88,  231,  231,   85,  231,  109,   81,   81,
+       86,  112,  231,   90,   91,   92,   94,   95,   96,   98,
+       99,  100,  102,  103,  104,  117,  110,  105,  111,   89,
+      105,  105,  115,   93,  113,  118,   97,  119,   89,  101,
+      114,  120,  121,  122,  125,  116,  123,  124,  106,  126,
+      107,  127,  126,  126,  128,  129,  130,  131,  132,  134,
+      231,  135,  105,  105,  105,  105,  105,  105,  231,  136,
+      137,  138,  139,  231,  231,  231,  140,  231,  142,  143,
+      144,  145,  231,  231,  126,  126,  126,  126,  126,  126,
+      133,  133,  149,  133,  133,  133,  133,  133,  133,  133,
+
+      133,  133,  133,  133,  133,  133,  133,  133,  133,  133,
+      133,  133,  133,  133,  133,  133,  133,  133,  133,  133,
+      133,  133,  133,  133,  133,  133,  133,  133,  133,  133,
+      133,  133,  133,  133,  133,  133,  133,  133,  133,  133,
+      133,  133,  133,  133,  133,  133,  133,   81,   81,  146,
+      146,  150,  151,  152,  148,  148,  231,  154,  231,  141,
+      158,  147,  148,  148,  148,  148,  148,  148,  155,  156,
+      157,  162,  153,  159,  160,  161,  165,  163,  166,  167,
+      168,  169,  141,  170,  147,  164,  177,  148,  148,  148,
+      171,  172,  173,  178,  174,  175,  176,  179,  180,  181,
+
+      182,  183,  184,  185,  187,  185,  231,  190,  186,  186,
+      188,  194,  188,  195,  196,  189,  189,  191,  192,  193,
+      197,  198,  199,  200,  201,  202,  203,  204,  205,  206,
+      207,  208,  209,  210,  186,  186,  189,  189,  211,  212,
+      213,  214,  215,  216,  217,  218,  219,  220,  221,  222,
+      223,  224,  225,  226,  227,  228,  229,  230,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231
     } ;
 
-static const flex_int16_t yy_chk[394] =
+static const flex_int16_t yy_chk[517] =
     {   0,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
         1,    1,    1,    1,    1,    1,    1,    1,    1,    1,
-        1,    1,    1,    1,    1,    1,    1,    3,    4,   11,
-       12,   12,   12,   42,   42,    3,    4,   13,   13,   13,
-        3,    4,   16,   16,   16,   17,   17,   17,   18,   18,
-       18,   19,   19,   19,  113,  113,   20,   20,   20,   21,
-       21,   21,   22,   56,   22,   22,  197,   29,   21,   29,
-
-       11,   20,   20,   21,   23,   34,   23,   23,   25,   25,
-       25,   34,   26,   26,   26,   27,   27,   27,   28,   28,
-       28,   30,   22,   30,   32,   35,   32,   87,   25,   87,
-       87,   22,   26,  196,   56,   27,  167,  167,   35,   55,
-       55,   55,   59,   59,   59,   62,   62,   62,   65,   65,
-       65,   68,   68,   68,   71,   71,   71,   74,   74,   74,
-       77,   77,   77,   80,   80,   81,   81,   81,   85,   85,
-       85,   86,   86,  168,  168,   80,   89,   89,   89,   92,
-       92,   92,  193,   86,   93,   93,   93,   96,   96,   96,
-       97,   97,   97,  100,  100,  100,  189,  114,   80,  114,
-
-       92,  101,  101,  101,  169,  169,   86,  129,  129,  129,
-      132,  188,  132,  136,  136,  132,  132,  133,  133,  133,
-      187,  137,  186,  137,  184,  136,  137,  137,  139,  139,
-      139,  142,  142,  142,  143,  143,  143,  146,  146,  146,
-      170,  170,  171,  171,  171,  183,  181,  180,  136,  200,
-      200,  200,  200,  200,  200,  201,  201,  201,  201,  201,
-      201,  202,  202,  178,  202,  203,  203,  204,  177,  204,
-      204,  204,  204,  205,  205,  173,  164,  163,  162,  161,
-      160,  159,  156,  155,  154,  153,  151,  149,  148,  145,
-      141,  135,  131,  125,  122,  121,  120,  119,  118,  117,
-
-      116,  112,  110,  109,  108,  106,  105,  103,   99,   95,
-       91,   83,   79,   76,   73,   70,   67,   64,   61,   58,
-       53,   52,   46,   43,   41,   40,   39,   38,   37,   36,
-       33,   31,   10,    9,    5,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199,  199,  199,  199,  199,  199,  199,  199,
-      199,  199,  199
-
+        1,    1,    1,    1,    1,    1,    1,    1,    3,    3,
+        3,    3,    3,    3,    3,    3,    3,    3,    3,    3,
+        3,    3,    3,    3,    3,    3,    3,    3,    3,    3,
+        3,    3,    3,    3,    3,    3,    3,    3,    3,    3,
+        3,    3,    3,    3,    3,    3,    3,    3,    3,    3,
+
+        3,    3,    3,    3,    3,    3,    3,    3,    3,    3,
+        3,    3,    3,    3,    3,    6,    9,   10,   11,   11,
+       11,   11,   11,   11,   11,   11,   11,   11,   11,   11,
+       11,   11,   11,   11,   11,   11,   11,   11,   11,   11,
+       11,   11,   11,   11,   11,   11,   11,   11,   11,   11,
+       11,   11,   11,   11,   11,   11,   11,   11,   11,   11,
+       11,   11,   11,   11,   11,   11,   11,   11,   11,   11,
+       11,   11,   11,   11,   11,   12,   12,   12,   13,   13,
+       13,   16,   16,   16,   17,   17,   17,   18,   18,   18,
+       19,   19,   19,   20,   20,   20,   21,   21,   21,   22,
+
+       31,   22,   22,   23,   30,   21,   30,   32,   20,   20,
+       21,   34,   23,   25,   25,   25,   26,   26,   26,   27,
+       27,   27,   28,   28,   28,   37,   33,   29,   33,   22,
+       29,   29,   36,   25,   35,   38,   26,   39,   22,   27,
+       35,   40,   41,   42,   44,   36,   43,   43,   29,   46,
+       29,   47,   46,   46,   53,   54,   56,   56,   56,   62,
+       51,   65,   29,   29,   29,   29,   29,   29,   51,   68,
+       71,   74,   77,   51,   78,   78,   80,   82,   84,   86,
+       86,   86,   82,   90,   46,   46,   46,   46,   46,   46,
+       59,   59,   92,   59,   59,   59,   59,   59,   59,   59,
+
+       59,   59,   59,   59,   59,   59,   59,   59,   59,   59,
+       59,   59,   59,   59,   59,   59,   59,   59,   59,   59,
+       59,   59,   59,   59,   59,   59,   59,   59,   59,   59,
+       59,   59,   59,   59,   59,   59,   59,   59,   59,   59,
+       59,   59,   59,   59,   59,   59,   59,   81,   81,   87,
+       87,   93,   93,   93,   89,   89,   94,   96,   98,   81,
+      100,   87,   89,   89,   89,   89,   89,   89,   97,   97,
+       97,  104,   93,  101,  101,  101,  107,  106,  108,  110,
+      111,  112,   81,  114,   87,  106,  119,   89,   89,   89,
+      115,  115,  116,  120,  116,  118,  118,  121,  122,  123,
+
+      124,  127,  132,  141,  145,  141,  150,  152,  141,  141,
+      147,  157,  147,  161,  163,  147,  147,  153,  153,  153,
+      164,  166,  167,  169,  170,  171,  172,  175,  176,  177,
+      178,  179,  180,  181,  185,  185,  188,  188,  193,  196,
+      198,  201,  202,  204,  205,  206,  208,  209,  214,  215,
+      216,  217,  218,  222,  223,  226,  227,  228,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+
+      231,  231,  231,  231,  231,  231,  231,  231,  231,  231,
+      231,  231,  231,  231,  231,  231
     } ;
 
 /* The intent behind this definition is that it'll catch
@@ -608,7 +644,7 @@ void yyerror(const char *s);
 
 #define YY_USER_ACTION update_loc(yylloc_param, yytext);
 
-int n_nested_comments = 0;
+thread_local int n_nested_comments = 0;
 
 /*typedef struct YYLTYPE
 {
@@ -618,11 +654,11 @@ int n_nested_comments = 0;
   int last_column;
 } YYLTYPE;*/
 
-#line 622 "lex.yy.c"
+#line 658 "lex.yy.c"
 #line 28 "emc_lexer.l"
     /* float exponent */
 
-#line 626 "lex.yy.c"
+#line 662 "lex.yy.c"
 
 #define INITIAL 0
 #define IN_COMMENT 1
@@ -912,7 +948,7 @@ YY_DECL
 
     /* Single character operators */
 
-#line 916 "lex.yy.c"
+#line 952 "lex.yy.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -939,13 +975,13 @@ yy_match:
 			while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 				{
 				yy_current_state = (int) yy_def[yy_current_state];
-				if ( yy_current_state >= 200 )
+				if ( yy_current_state >= 232 )
 					yy_c = yy_meta[yy_c];
 				}
 			yy_current_state = yy_nxt[yy_base[yy_current_state] + yy_c];
 			++yy_cp;
 			}
-		while ( yy_base[yy_current_state] != 336 );
+		while ( yy_base[yy_current_state] != 459 );
 
 yy_find_action:
 		yy_act = yy_accept[yy_current_state];
@@ -1167,26 +1203,41 @@ return IMPORT;
 	YY_BREAK
 case 46:
 YY_RULE_SETUP
+#line 86 "emc_lexer.l"
+return CONST;
+	YY_BREAK
+case 47:
+YY_RULE_SETUP
 #line 87 "emc_lexer.l"
+return RESTRICT;
+	YY_BREAK
+case 48:
+YY_RULE_SETUP
+#line 88 "emc_lexer.l"
+return ALIGN;
+	YY_BREAK
+case 49:
+YY_RULE_SETUP
+#line 90 "emc_lexer.l"
 return CLINKAGE;
 	YY_BREAK
 /* Symbol names */
-case 47:
+case 50:
 YY_RULE_SETUP
-#line 90 "emc_lexer.l"
+#line 93 "emc_lexer.l"
 { yylval->s = new std::string{yytext}; return NAME; }
 	YY_BREAK
 /* Types */
-case 48:
+case 51:
 YY_RULE_SETUP
-#line 93 "emc_lexer.l"
+#line 96 "emc_lexer.l"
 { yylval->s = new std::string{yytext}; return TYPENAME; }
 	YY_BREAK
-case 49:
-#line 96 "emc_lexer.l"
-case 50:
+case 52:
+#line 99 "emc_lexer.l"
+case 53:
 YY_RULE_SETUP
-#line 96 "emc_lexer.l"
+#line 99 "emc_lexer.l"
 { 
 							yylval->node = new ast_node_double_literal{std::string{yytext}};
 							return NUMBER; 
@@ -1194,96 +1245,96 @@ YY_RULE_SETUP
 	YY_BREAK
 /* TODO: Borde göra egen parsning för att tex. tillåta 1'000'000 och 09 som inte 
 	 * oktal ... */
-case 51:
-#line 104 "emc_lexer.l"
-case 52:
+case 54:
+#line 107 "emc_lexer.l"
+case 55:
 YY_RULE_SETUP
-#line 104 "emc_lexer.l"
+#line 107 "emc_lexer.l"
 { 
 							yylval->node = new ast_node_int_literal{std::string{yytext}};
 							return NUMBER; 
 						}
 	YY_BREAK
-case 53:
-/* rule 53 can match eol */
+case 56:
+/* rule 56 can match eol */
 YY_RULE_SETUP
-#line 110 "emc_lexer.l"
+#line 113 "emc_lexer.l"
 { 
 							yylval->s = new std::string{yytext + 1, strlen(yytext) - 2}; 
 							deescape_string(*yylval->s);
 							return ESC_STRING; 
 						}
 	YY_BREAK
-case 54:
+case 57:
 YY_RULE_SETUP
-#line 116 "emc_lexer.l"
+#line 119 "emc_lexer.l"
 {n_nested_comments++; BEGIN(IN_COMMENT);}
 	YY_BREAK
-case 55:
+case 58:
 YY_RULE_SETUP
-#line 117 "emc_lexer.l"
+#line 120 "emc_lexer.l"
 {n_nested_comments++;}
 	YY_BREAK
-case 56:
+case 59:
 YY_RULE_SETUP
-#line 118 "emc_lexer.l"
+#line 121 "emc_lexer.l"
 {n_nested_comments--; if (n_nested_comments == 0) BEGIN(INITIAL);}
 	YY_BREAK
-case 57:
+case 60:
 YY_RULE_SETUP
-#line 119 "emc_lexer.l"
+#line 122 "emc_lexer.l"
 // eat comment in chunks
 	YY_BREAK
-case 58:
+case 61:
 YY_RULE_SETUP
-#line 120 "emc_lexer.l"
+#line 123 "emc_lexer.l"
 // eat the lone star
 	YY_BREAK
-case 59:
-/* rule 59 can match eol */
+case 62:
+/* rule 62 can match eol */
 YY_RULE_SETUP
-#line 121 "emc_lexer.l"
+#line 124 "emc_lexer.l"
 
 	YY_BREAK
-case 60:
+case 63:
 YY_RULE_SETUP
-#line 122 "emc_lexer.l"
+#line 125 "emc_lexer.l"
 
 	YY_BREAK
-case 61:
+case 64:
 YY_RULE_SETUP
-#line 125 "emc_lexer.l"
+#line 128 "emc_lexer.l"
 /* ignore white space */
 	YY_BREAK
-case 62:
-/* rule 62 can match eol */
+case 65:
+/* rule 65 can match eol */
 YY_RULE_SETUP
-#line 126 "emc_lexer.l"
+#line 129 "emc_lexer.l"
 /* ignore line continuation */
 	YY_BREAK
 /*^{WS}*\n*/           /* ignore empty new lines */
-case 63:
-/* rule 63 can match eol */
+case 66:
+/* rule 66 can match eol */
 YY_RULE_SETUP
-#line 128 "emc_lexer.l"
+#line 131 "emc_lexer.l"
 { return EOL; }
 	YY_BREAK
 case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(IN_COMMENT):
-#line 130 "emc_lexer.l"
+#line 133 "emc_lexer.l"
 { return ENDOFFILE; }
 	YY_BREAK
-case 64:
+case 67:
 YY_RULE_SETUP
-#line 131 "emc_lexer.l"
+#line 134 "emc_lexer.l"
 { fprintf(stderr, "Mystery character %c %i\n", *yytext, (int)*yytext); }
 	YY_BREAK
-case 65:
+case 68:
 YY_RULE_SETUP
-#line 133 "emc_lexer.l"
+#line 136 "emc_lexer.l"
 YY_FATAL_ERROR( "flex scanner jammed" );
 	YY_BREAK
-#line 1287 "lex.yy.c"
+#line 1338 "lex.yy.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -1580,7 +1631,7 @@ static int yy_get_next_buffer (yyscan_t yyscanner)
 		while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 			{
 			yy_current_state = (int) yy_def[yy_current_state];
-			if ( yy_current_state >= 200 )
+			if ( yy_current_state >= 232 )
 				yy_c = yy_meta[yy_c];
 			}
 		yy_current_state = yy_nxt[yy_base[yy_current_state] + yy_c];
@@ -1609,11 +1660,11 @@ static int yy_get_next_buffer (yyscan_t yyscanner)
 	while ( yy_chk[yy_base[yy_current_state] + yy_c] != yy_current_state )
 		{
 		yy_current_state = (int) yy_def[yy_current_state];
-		if ( yy_current_state >= 200 )
+		if ( yy_current_state >= 232 )
 			yy_c = yy_meta[yy_c];
 		}
 	yy_current_state = yy_nxt[yy_base[yy_current_state] + yy_c];
-	yy_is_jam = (yy_current_state == 199);
+	yy_is_jam = (yy_current_state == 231);
 
 	(void)yyg;
 	return yy_is_jam ? 0 : yy_current_state;
@@ -2474,11 +2525,11 @@ void yyfree (void * ptr , yyscan_t yyscanner)
 
 #define YYTABLES_NAME "yytables"
 
-#line 133 "emc_lexer.l"
+#line 136 "emc_lexer.l"
 
 
-int curr_line = 1;
-int curr_col = 1;
+thread_local int curr_line = 1;
+thread_local int curr_col = 1;
 
 static void update_loc(struct YYLTYPE * yylloc_param, char *yytext_arg) {
 	if (yylloc_param->first_line == 0) {
@@ -0,0 +1,475 @@
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+
+/* Bison and flex requires this include order. */
+#include "emc.hh"
+typedef void *yyscan_t;
+#include "emc.tab.h"
+#include "lexer.h"
+/* End of stupid include order. */
+
+#include "compile.hh"
+#include "ast_passes.hh"
+#include "libengma.hh"
+
+namespace engma {
+
+struct engine::impl {
+    /* The options and the scopes used while compiling */
+    engma_session session;
+    /* One per compile. The code is used until the engine is destroyed. */
+    std::vector<std::unique_ptr<jit>> v_jits;
+
+    void compile(yyscan_t scanner, const std::string &name);
+};
+
+static emc_type to_emc_type(const value_type &t)
+{
+    static const emc_types kinds[] = {
+        emc_types::NONE, emc_types::BOOL, emc_types::BYTE, emc_types::SBYTE,
+        emc_types::SHORT, emc_types::USHORT, emc_types::INT, emc_types::UINT,
+        emc_types::LONG, emc_types::ULONG, emc_types::FLOAT, emc_types::DOUBLE
+    };
+    emc_type ret{kinds[(int)t.kind]};
+    ret.n_pointer_indirections = t.n_pointer_indirections;
+    ret.ptr_const_mask = t.ptr_const_mask;
+    return ret;
+}
+
+/* "Foo.Bar.baz" => "Foo.Bar", "baz" */
+static void split_name(const std::string &full_name, std::string &nspace, std::string &name)
+{
+    auto dot = full_name.rfind('.');
+    if (dot == std::string::npos) {
+        nspace = "";
+        name = full_name;
+    } else {
+        nspace = full_name.substr(0, dot);
+        name = full_name.substr(dot + 1);
+    }
+}
+
+/* The AST is not needed after a compile, so it is freed like main() in
+   engma.cc does after each file. */
+static void clear_compiler_state()
+{
+    compilation_units().clear();
+    builtin_typestack().clear();
+    builtin_objstack().clear();
+}
+
+void engine::impl::compile(yyscan_t scanner, const std::string &name)
+{
+    engma_session_scope session_scope{&session};
+    init_builtin_types();
+    compilation_units().get_current_compilation_unit().file_name = name;
+
+    auto j = std::make_unique<jit>();
+    try {
+        bool parsed_eol;
+        do {
+            if (yyparse(scanner))
+                throw std::runtime_error("Could not parse " + name);
+
+            auto &cu = compilation_units().get_current_compilation_unit();
+            if (cu.ast_root) {
+                cu.ast_root->resolve();
+                cu.v_nodes.push_back(cu.ast_root);
+                cu.ast_root = nullptr;
+            }
+            parsed_eol = cu.parsed_eol;
+        } while (!parsed_eol);
+
+        auto &cu = compilation_units().get_current_compilation_unit();
+        run_ast_passes(cu.v_nodes);
+
+        j->init_as_root_context();
+        for (auto e : cu.v_nodes)
+            j->add_ast_node(e);
+        j->postprocess();
+        j->compile();
+    } catch (...) {
+        clear_compiler_state();
+        throw;
+    }
+    clear_compiler_state();
+
+    /* Initialize the globals and run the top level statements */
+    auto root_fn = (int (*)(int, char**))j->get_function("root_fn");
+    if (!root_fn)
+        THROW_BUG("NULL root function after JIT compilation");
+    char arg[] = "";
+    char *argv[] = {arg};
+    root_fn(1, argv);
+
+    v_jits.push_back(std::move(j));
+}
+
+engine::engine(const engine_options &options)
+    : p(new impl)
+{
+    engma_options &o = p->session.opts;
+    o.run_type = engma_run_type::EXECUTE;
+    o.include_dirs = options.include_dirs;
+    o.optimization_level = "-O" + std::to_string(options.optimization_level);
+    if (options.debug_info)
+        o.debug_flag = "-g";
+    o.batch_wrappers = options.batch_wrappers;
+}
+
+engine::~engine()
+{
+}
+
+void engine::compile_string(const std::string &source, const std::string &name)
+{
+    yyscan_t scanner;
+    yylex_init(&scanner);
+    yy_scan_string(source.c_str(), scanner);
+    try {
+        p->compile(scanner, name);
+    } catch (...) {
+        yylex_destroy(scanner);
+        throw;
+    }
+    yylex_destroy(scanner);
+}
+
+void engine::compile_file(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        throw std::runtime_error("Could not open file: " + path);
+
+    yyscan_t scanner;
+    yylex_init(&scanner);
+    yyset_in(f, scanner);
+    try {
+        p->compile(scanner, path);
+    } catch (...) {
+        yylex_destroy(scanner);
+        fclose(f);
+        throw;
+    }
+    yylex_destroy(scanner);
+    fclose(f);
+}
+
+void* engine::function_address(const std::string &full_name, const value_type &return_type,
+                               const std::vector<value_type> &v_param_types)
+{
+    std::string nspace, name;
+    split_name(full_name, nspace, name);
+
+    std::vector<emc_type> v_emc_param_types;
+    for (auto &e : v_param_types)
+        v_emc_param_types.push_back(to_emc_type(e));
+    std::string mangled_name = mangle_emc_fn_name(to_emc_type(return_type), nspace,
+                                                  name, v_emc_param_types);
+
+    /* The latest compile first */
+    for (auto it = p->v_jits.rbegin(); it != p->v_jits.rend(); it++)
+        if (void *code = (*it)->get_function(mangled_name))
+            return code;
+    return nullptr;
+}
+
+void* engine::global_address(const std::string &full_name)
+{
+    std::string nspace, name;
+    split_name(full_name, nspace, name);
+    std::string mangled_name = mangle_emc_var_name(name, nspace);
+
+    for (auto it = p->v_jits.rbegin(); it != p->v_jits.rend(); it++)
+        if (void *addr = (*it)->get_var(mangled_name))
+            return addr;
+    return nullptr;
+}
+
+/* Whitespace is dropped next to brackets, commas and operators, unless it
+   separates two characters that could be read as one token, e.g. "a * (b+c)"
+   => "a*(b+c)" and "a < = b" is kept. '-' is not dropped around since names
+   can contain '-'. Newlines are dropped too, so an expression can't end its
+   function. */
+static std::string normalize_expression(const std::string &source)
+{
+    auto is_separator = [](char c) { return strchr("()+*/%@^<>=&|,", c) != nullptr; };
+    auto fuses = [](char a, char b) {
+        return b == '=' && strchr("<>=!", a) || a == '/' && b == '/' || a == '=' && b == '>';
+    };
+    std::string ans;
+    bool pending_space = false;
+    for (size_t i = 0; i < source.size(); i++) {
+        char c = source[i];
+        if (isspace((unsigned char)c)) {
+            pending_space = ans.size();
+            continue;
+        }
+        if (pending_space) {
+            char prev = ans.back();
+            if (!(is_separator(prev) || is_separator(c)) || fuses(prev, c))
+                ans += ' ';
+        }
+        pending_space = false;
+
+        if (c == '"') {
+            /* Copy string literals as is */
+            size_t end = i + 1;
+            while (end < source.size() && source[end] != '"')
+                end += source[end] == '\\' ? 2 : 1;
+            ans += source.substr(i, end - i + 1);
+            i = end;
+        } else
+            ans += c;
+    }
+    return ans;
+}
+
+static std::string engma_type_name(const value_type &t)
+{
+    static const char *names[] = {
+        nullptr, nullptr, "Byte", "Sbyte", "Short", "Ushort", "Int", "Uint",
+        "Long", "Ulong", "Float", "Double"
+    };
+    if (!names[(int)t.kind])
+        throw std::runtime_error("An expression can't be of type void or bool");
+    std::string pointers;
+    for (int i = t.n_pointer_indirections - 1; i >= 0; i--)
+        pointers += t.ptr_const_mask & 1u << i ? "&CONST " : "&";
+    return pointers + names[(int)t.kind];
+}
+
+struct expression_cache::impl {
+    expression_cache_options options;
+    mutable std::mutex mutex;
+    expression_cache_stats stats;
+
+    struct entry {
+        std::string key;
+        void *code = nullptr;
+        std::shared_ptr<void> unit;     /* The engine that compiled the code */
+        std::string error;              /* Set if the expression did not compile */
+        size_t source_bytes = 0;
+    };
+    /* Most recently used first */
+    std::list<entry> lru;
+    std::unordered_map<std::string, std::list<entry>::iterator> map_key_to_entry;
+    size_t source_bytes = 0;
+
+    struct pending {
+        std::string key;
+        input_type input;
+        std::string expression;         /* Normalized */
+        value_type result_type;
+    };
+    std::vector<pending> v_pending;
+
+    /* The result of a compile, made without the mutex held */
+    struct compiled {
+        std::vector<entry> v_entries;   /* The first, the one asked for, last */
+        long compiles = 0;
+        long expressions = 0;
+        double compile_seconds = 0;
+    };
+
+    void compile_batch(std::unique_lock<std::mutex> &lock);
+    void compile(std::vector<pending> &v, compiled &out);
+    void insert(entry e);
+};
+
+static std::string expression_key(const input_type &input, const std::string &expression,
+                                  const value_type &result_type)
+{
+    return input.name + '\n' + normalize_expression(input.definition) + '\n' +
+        engma_type_name(result_type) + '\n' + expression;
+}
+
+void expression_cache::impl::insert(entry e)
+{
+    /* Another thread compiled the same expression meanwhile; keep its code */
+    if (map_key_to_entry.count(e.key))
+        return;
+    source_bytes += e.source_bytes;
+    lru.push_front(std::move(e));
+    map_key_to_entry[lru.front().key] = lru.begin();
+
+    /* The code is freed when the last expression of its compile is evicted
+       and no compiled_expression refers to it */
+    while (lru.size() > 1 &&
+           (lru.size() > options.max_entries || source_bytes > options.max_source_bytes)) {
+        source_bytes -= lru.back().source_bytes;
+        map_key_to_entry.erase(lru.back().key);
+        lru.pop_back();
+        stats.evictions++;
+    }
+}
+
+/* Compiles the expressions in one engine. If that fails they are compiled
+   one by one so a bad expression doesn't fail the others. Only reads the
+   options, so it runs without the mutex. */
+void expression_cache::impl::compile(std::vector<pending> &v, compiled &out)
+{
+    std::map<std::string, std::string> map_input_definitions;
+    std::vector<std::string> v_fn_names;
+    std::string source;
+    for (auto &e : v) {
+        if (map_input_definitions.emplace(e.input.name, e.input.definition).second)
+            source += e.input.definition + "\n";
+        v_fn_names.push_back("engma_expr_" + std::to_string(v_fn_names.size()));
+        source += "FUNC " + engma_type_name(e.result_type) + " r = " + v_fn_names.back() +
+            "(&" + e.input.name + " in) DO\n"
+            "    RETURN " + e.expression + "\n"
+            "END\n";
+    }
+
+    auto unit = std::make_shared<engine>(options.engine);
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        unit->compile_string(source, "expressions");
+    } catch (std::runtime_error &err) {
+        error = err.what();
+    }
+    out.compile_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    out.compiles++;
+
+    if (error.size() && v.size() > 1) {
+        for (auto it = v.rbegin(); it != v.rend(); it++) {
+            std::vector<pending> v_one{*it};
+            compile(v_one, out);
+        }
+        return;
+    }
+    if (error.empty())
+        out.expressions += v.size();
+
+    /* Last to first so that the first, the one asked for, is the most recently used */
+    jit *j = error.empty() ? unit->p->v_jits.back().get() : nullptr;
+    for (size_t i = v.size(); i-- > 0;) {
+        entry e;
+        e.key = v[i].key;
+        e.source_bytes = v[i].key.size();
+        if (j) {
+            emc_type input_t{emc_types::STRUCT};
+            input_t.mangled_name = mangle_emc_type_name(v[i].input.name);
+            input_t.n_pointer_indirections = 1;
+            e.code = j->get_function(mangle_emc_fn_name(to_emc_type(v[i].result_type), "",
+                                                        v_fn_names[i], {input_t}));
+            if (!e.code)
+                THROW_BUG("Compiled expression not found: " + v_fn_names[i]);
+            e.unit = unit;
+        } else
+            e.error = error;
+        out.v_entries.push_back(std::move(e));
+    }
+}
+
+/* Expressions with different definitions of the same input type wait for
+   the next compile. lock holds the mutex, which is released while gcc
+   compiles so that hits and other misses don't wait for it. */
+void expression_cache::impl::compile_batch(std::unique_lock<std::mutex> &lock)
+{
+    std::map<std::string, std::string> map_input_definitions;
+    std::vector<pending> v_now, v_later;
+    for (auto &e : v_pending) {
+        auto it = map_input_definitions.emplace(e.input.name, e.input.definition).first;
+        if (it->second == e.input.definition)
+            v_now.push_back(std::move(e));
+        else
+            v_later.push_back(std::move(e));
+    }
+    v_pending = std::move(v_later);
+
+    compiled out;
+    lock.unlock();
+    compile(v_now, out);
+    lock.lock();
+
+    stats.compiles += out.compiles;
+    stats.expressions += out.expressions;
+    stats.compile_seconds += out.compile_seconds;
+    for (auto &e : out.v_entries)
+        insert(std::move(e));
+}
+
+expression_cache::expression_cache(const expression_cache_options &options)
+    : p(new impl)
+{
+    p->options = options;
+}
+
+expression_cache::~expression_cache()
+{
+}
+
+std::pair<void*, std::shared_ptr<void>> expression_cache::lookup_expression(
+    const input_type &input, const std::string &expression, const value_type &result_type)
+{
+    std::string normalized = normalize_expression(expression);
+    std::string key = expression_key(input, normalized, result_type);
+
+    std::unique_lock<std::mutex> lock(p->mutex);
+    auto it = p->map_key_to_entry.find(key);
+    if (it == p->map_key_to_entry.end()) {
+        p->stats.misses++;
+        /* First, so its input definition is used if several differ */
+        for (auto pend = p->v_pending.begin(); pend != p->v_pending.end(); pend++)
+            if (pend->key == key) {
+                p->v_pending.erase(pend);
+                break;
+            }
+        p->v_pending.insert(p->v_pending.begin(), {key, input, normalized, result_type});
+        p->compile_batch(lock);
+        it = p->map_key_to_entry.find(key);
+        if (it == p->map_key_to_entry.end())
+            THROW_BUG("Expression not in the cache after its compile");
+    } else
+        p->stats.hits++;
+
+    p->lru.splice(p->lru.begin(), p->lru, it->second);
+    auto &e = *it->second;
+    if (e.error.size())
+        throw std::runtime_error(e.error);
+    return {e.code, e.unit};
+}
+
+void expression_cache::prefetch_expression(const input_type &input, const std::string &expression,
+                                           const value_type &result_type)
+{
+    std::string normalized = normalize_expression(expression);
+    std::string key = expression_key(input, normalized, result_type);
+
+    std::lock_guard<std::mutex> lock(p->mutex);
+    if (p->map_key_to_entry.count(key))
+        return;
+    for (auto &e : p->v_pending)
+        if (e.key == key)
+            return;
+    p->v_pending.push_back({key, input, normalized, result_type});
+}
+
+void expression_cache::compile_pending()
+{
+    std::unique_lock<std::mutex> lock(p->mutex);
+    while (p->v_pending.size())
+        p->compile_batch(lock);
+}
+
+expression_cache_stats expression_cache::stats() const
+{
+    std::lock_guard<std::mutex> lock(p->mutex);
+    return p->stats;
+}
+
+}
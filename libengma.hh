@@ -0,0 +1,242 @@
+#pragma once
+
+/* libengma, compiles Engma code in the host process and looks up the
+ * compiled functions and globals by their Engma names.
+ *
+ *     engma::engine e;
+ *     e.compile_string("FUNC Int r = add(Int a, Int b) DO\n"
+ *                      "    RETURN a + b\n"
+ *                      "END\n");
+ *     auto add = e.function<int(int, int)>("add");
+ *     int three = add(1, 2);
+ *
+ * Link with -lengma -lgccjit -ljitruntime -pthread -ldl.
+ *
+ * Each engine has its own compiler state, so engines can compile on
+ * different threads at the same time. An engine must not be used by two
+ * threads at once, but the compiled code can be called from any thread.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace engma {
+
+/* The Engma types that can be passed between the host and Engma code */
+enum class value_kind {
+    VOID,
+    BOOL,
+    BYTE,
+    SBYTE,
+    SHORT,
+    USHORT,
+    INT,
+    UINT,
+    LONG,
+    ULONG,
+    FLOAT,
+    DOUBLE
+};
+
+struct value_type {
+    value_kind kind;
+    int n_pointer_indirections = 0;
+    /* Bit i is set if the target of pointer indirection i is const, where 0
+       is the innermost pointer. E.g. const double* const* => 0b11. */
+    unsigned ptr_const_mask = 0;
+};
+
+/* value_type_of<T>::get() is the Engma type of the C++ type T */
+template<class T> struct value_type_of;
+
+#define ENGMA_VALUE_TYPE_OF(T, KIND)\
+template<> struct value_type_of<T> {\
+    static value_type get() { return {value_kind::KIND}; }\
+};
+ENGMA_VALUE_TYPE_OF(void, VOID)
+ENGMA_VALUE_TYPE_OF(bool, BOOL)
+ENGMA_VALUE_TYPE_OF(unsigned char, BYTE)
+ENGMA_VALUE_TYPE_OF(signed char, SBYTE)
+ENGMA_VALUE_TYPE_OF(short, SHORT)
+ENGMA_VALUE_TYPE_OF(unsigned short, USHORT)
+ENGMA_VALUE_TYPE_OF(int, INT)
+ENGMA_VALUE_TYPE_OF(unsigned int, UINT)
+ENGMA_VALUE_TYPE_OF(long, LONG)
+ENGMA_VALUE_TYPE_OF(unsigned long, ULONG)
+ENGMA_VALUE_TYPE_OF(float, FLOAT)
+ENGMA_VALUE_TYPE_OF(double, DOUBLE)
+#undef ENGMA_VALUE_TYPE_OF
+
+/* A const value is passed like any other; only a const pointer target is
+   part of the Engma type, see below */
+template<class T> struct value_type_of<const T> : value_type_of<T> {};
+
+template<class T> struct value_type_of<T*> {
+    static value_type get()
+    {
+        value_type t = value_type_of<T>::get();
+        if (std::is_const<T>::value)
+            t.ptr_const_mask |= 1u << t.n_pointer_indirections;
+        t.n_pointer_indirections++;
+        return t;
+    }
+};
+
+struct engine_options {
+    /* Where USING looks for modules, e.g. the folder with Std/ */
+    std::vector<std::string> include_dirs;
+    int optimization_level = 0;
+    bool debug_info = false;
+    /* Also compile name_batch(const T1*, ..., R *out, size_t n) for each
+       function of primitives, see --batch-wrappers */
+    bool batch_wrappers = false;
+};
+
+class engine {
+public:
+    engine(const engine_options &options = {});
+    ~engine();
+    engine(const engine&) = delete;
+    engine& operator=(const engine&) = delete;
+
+    /* Compiles the code and runs its top level statements, i.e. initializes
+       its globals. A user main() is not called. Throws std::runtime_error if
+       the code can't be compiled. name is used in error messages and debug
+       info. The code of earlier compiles is kept. */
+    void compile_string(const std::string &source, const std::string &name = "<string>");
+    void compile_file(const std::string &path);
+
+    /* E.g. function<double(double, int)>("Foo.bar"). Returns nullptr if no
+       function with that name and signature has been compiled. */
+    template<class F>
+    F* function(const std::string &name);
+
+    /* Returns nullptr if no global with that name has been compiled. The
+       type is not checked. */
+    template<class T>
+    T* global(const std::string &name)
+    {
+        return static_cast<T*>(global_address(name));
+    }
+
+    void* function_address(const std::string &name, const value_type &return_type,
+                           const std::vector<value_type> &v_param_types);
+    void* global_address(const std::string &name);
+
+private:
+    friend class expression_cache;
+    struct impl;
+    std::unique_ptr<impl> p;
+};
+
+template<class F> struct signature_of;
+
+template<class R, class... A> struct signature_of<R(A...)> {
+    static value_type return_type() { return value_type_of<R>::get(); }
+    static std::vector<value_type> param_types() { return {value_type_of<A>::get()...}; }
+};
+
+template<class F>
+F* engine::function(const std::string &name)
+{
+    return reinterpret_cast<F*>(function_address(name,
+        signature_of<F>::return_type(), signature_of<F>::param_types()));
+}
+
+/* The struct type an expression is evaluated against, e.g.
+ *
+ *     {"Order", "TYPE Order = STRUCT\n    Int qty\n    Double price\nEND\n"}
+ *
+ * The struct must have the same layout as the host's C struct. */
+struct input_type {
+    std::string name;
+    std::string definition;
+};
+
+/* A compiled expression. Keeps its code alive after it is evicted from the
+   cache. */
+template<class R>
+class compiled_expression {
+public:
+    compiled_expression() {}
+    compiled_expression(R (*fn)(const void*), std::shared_ptr<void> code)
+        : fn(fn), code(std::move(code)) {}
+
+    R operator()(const void *input) const { return fn(input); }
+    explicit operator bool() const { return fn != nullptr; }
+
+private:
+    R (*fn)(const void*) = nullptr;
+    std::shared_ptr<void> code;
+};
+
+struct expression_cache_options {
+    engine_options engine;
+    /* The least recently used expressions are evicted beyond these */
+    std::size_t max_entries = 4096;
+    std::size_t max_source_bytes = 1 << 20;
+};
+
+struct expression_cache_stats {
+    long hits = 0;
+    long misses = 0;
+    long compiles = 0;      /* Compiles, each of one or more expressions */
+    long expressions = 0;   /* Expressions compiled */
+    long evictions = 0;
+    double compile_seconds = 0;
+};
+
+/* Compiled Engma expressions, keyed by the input type, the result type and
+ * the source with its whitespace normalized. The input is "in", a pointer to
+ * the input struct:
+ *
+ *     engma::expression_cache cache;
+ *     auto total = cache.get<double>(order_type, "@in.qty * (@in.price)");
+ *     double d = total(&order);
+ *
+ * A miss compiles the expression together with the prefetched ones in one
+ * context. A hit does not touch the compiler. The cache can be used from
+ * several threads; it is not locked while gcc compiles, and if two threads
+ * compile the same expression the first result is kept. Throws std::runtime_error if an expression can't be
+ * compiled; failed expressions are cached too. */
+class expression_cache {
+public:
+    expression_cache(const expression_cache_options &options = {});
+    ~expression_cache();
+    expression_cache(const expression_cache&) = delete;
+    expression_cache& operator=(const expression_cache&) = delete;
+
+    template<class R>
+    compiled_expression<R> get(const input_type &input, const std::string &expression)
+    {
+        auto lookup = lookup_expression(input, expression, value_type_of<R>::get());
+        return {reinterpret_cast<R (*)(const void*)>(lookup.first), std::move(lookup.second)};
+    }
+
+    /* Queues the expression to be compiled with the next miss */
+    template<class R>
+    void prefetch(const input_type &input, const std::string &expression)
+    {
+        prefetch_expression(input, expression, value_type_of<R>::get());
+    }
+
+    /* Compiles the queued expressions now */
+    void compile_pending();
+
+    expression_cache_stats stats() const;
+
+    std::pair<void*, std::shared_ptr<void>> lookup_expression(const input_type &input,
+        const std::string &expression, const value_type &result_type);
+    void prefetch_expression(const input_type &input, const std::string &expression,
+                             const value_type &result_type);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> p;
+};
+
+}
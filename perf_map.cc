@@ -0,0 +1,173 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <stdexcept>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "emc.hh"
+#include "perf_map.hh"
+
+namespace {
+
+/* The jitdump format is described in tools/perf/Documentation/jitdump-specification.txt */
+struct jitdump_header {
+    uint32_t magic = 0x4A695444;
+    uint32_t version = 1;
+    uint32_t total_size = sizeof(jitdump_header);
+    uint32_t elf_mach;
+    uint32_t pad1 = 0;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags = 0;
+};
+
+struct jitdump_record_header {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+enum {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_DEBUG_INFO = 2,
+};
+
+/* One perf map and jitdump per process */
+std::mutex perf_map_mutex;
+FILE *perf_map_file = nullptr;
+FILE *jitdump_file = nullptr;
+uint64_t jitdump_code_index = 0;
+
+uint64_t perf_timestamp()
+{
+    /* perf record -k 1 */
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint32_t elf_machine()
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__i386__)
+    return EM_386;
+#else
+    return EM_NONE;
+#endif
+}
+
+void open_jitdump()
+{
+    std::string path = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+    int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0)
+        THROW_USER_ERROR("Could not open " + path);
+
+    /* perf finds the dump by this executable mmap of it */
+    void *marker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (marker == MAP_FAILED) {
+        close(fd);
+        THROW_USER_ERROR("Could not mmap " + path);
+    }
+
+    jitdump_file = fdopen(fd, "wb");
+    jitdump_header header;
+    header.elf_mach = elf_machine();
+    header.pid = getpid();
+    header.timestamp = perf_timestamp();
+    fwrite(&header, sizeof header, 1, jitdump_file);
+}
+
+void write_jitdump(const perf_map_fn &fn, const std::string &name, void *code, uint64_t size)
+{
+    uint64_t addr = (uint64_t)(uintptr_t)code;
+
+    /* The debug info goes before the code it is for */
+    {
+        jitdump_record_header header{JIT_CODE_DEBUG_INFO, 0, perf_timestamp()};
+        uint64_t nr_entry = 1;
+        uint32_t line = fn.line, discrim = 0;
+        header.total_size = sizeof header + 2 * sizeof(uint64_t) + sizeof addr +
+            2 * sizeof(uint32_t) + fn.file_name.size() + 1;
+        fwrite(&header, sizeof header, 1, jitdump_file);
+        fwrite(&addr, sizeof addr, 1, jitdump_file);
+        fwrite(&nr_entry, sizeof nr_entry, 1, jitdump_file);
+        fwrite(&addr, sizeof addr, 1, jitdump_file);
+        fwrite(&line, sizeof line, 1, jitdump_file);
+        fwrite(&discrim, sizeof discrim, 1, jitdump_file);
+        fwrite(fn.file_name.c_str(), fn.file_name.size() + 1, 1, jitdump_file);
+    }
+
+    jitdump_record_header header{JIT_CODE_LOAD, 0, perf_timestamp()};
+    uint32_t pid = getpid(), tid = syscall(SYS_gettid);
+    uint64_t index = jitdump_code_index++;
+    header.total_size = sizeof header + 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) +
+        name.size() + 1 + size;
+    fwrite(&header, sizeof header, 1, jitdump_file);
+    fwrite(&pid, sizeof pid, 1, jitdump_file);
+    fwrite(&tid, sizeof tid, 1, jitdump_file);
+    fwrite(&addr, sizeof addr, 1, jitdump_file); /* vma */
+    fwrite(&addr, sizeof addr, 1, jitdump_file); /* code_addr */
+    fwrite(&size, sizeof size, 1, jitdump_file);
+    fwrite(&index, sizeof index, 1, jitdump_file);
+    fwrite(name.c_str(), name.size() + 1, 1, jitdump_file);
+    fwrite(code, size, 1, jitdump_file);
+}
+
+}
+
+void perf_map_add(gcc_jit_result *result, const std::vector<perf_map_fn> &v_fns)
+{
+    if (opts().perf_map.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock{perf_map_mutex};
+
+    if (!perf_map_file) {
+        std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        perf_map_file = fopen(path.c_str(), "w");
+        if (!perf_map_file)
+            THROW_USER_ERROR("Could not open " + path);
+    }
+    if (opts().perf_map == "jitdump" && !jitdump_file)
+        open_jitdump();
+
+    for (const perf_map_fn &fn : v_fns) {
+        void *code = gcc_jit_result_get_code(result, fn.mangled_name.c_str());
+        if (!code)
+            continue;
+
+        /* The size is in the symbol table of the loaded .so */
+        Dl_info info;
+        ElfW(Sym) *sym = nullptr;
+        if (!dladdr1(code, &info, (void**)&sym, RTLD_DL_SYMENT) || !sym || !sym->st_size)
+            continue;
+
+        std::string name;
+        try {
+            name = demangle_emc_fn_name(fn.mangled_name);
+        } catch (std::runtime_error&) {
+            name = fn.mangled_name;
+        }
+
+        fprintf(perf_map_file, "%lx %lx %s\n", (unsigned long)code, (unsigned long)sym->st_size, name.c_str());
+        if (jitdump_file)
+            write_jitdump(fn, name, code, sym->st_size);
+    }
+
+    fflush(perf_map_file);
+    if (jitdump_file)
+        fflush(jitdump_file);
+}
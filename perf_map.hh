@@ -0,0 +1,33 @@
+#pragma once
+
+/* Symbols for perf of the code run with -X, enabled with --perf-map.
+ *
+ * perf can't see the names of the jitted functions since the .so libgccjit
+ * loads them from is deleted. With --perf-map each compiled result's Engma
+ * functions are appended to /tmp/perf-PID.map, which perf report and perf top
+ * read by themselves, with demangled names like Foo.add(&Long, Int).
+ *
+ * --perf-map=jitdump also writes /tmp/jit-PID.dump, with the code and the
+ * source line of each function, for
+ *
+ *     perf record -k 1 engmac -X --perf-map=jitdump foo.em
+ *     perf inject --jit -i perf.data -o perf.jit.data
+ *     perf report -i perf.jit.data
+ *
+ * libgccjit doesn't give the addresses of the lines in a function, so the
+ * line table has just the line of the FUNC.
+ */
+
+#include <string>
+#include <vector>
+
+#include <libgccjit.h>
+
+struct perf_map_fn {
+    std::string mangled_name;
+    std::string file_name;
+    int line;
+};
+
+/* Adds the functions in v_fns that are in result. Thread safe. */
+void perf_map_add(gcc_jit_result *result, const std::vector<perf_map_fn> &v_fns);
@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "emc.hh"
+#include "profiler.hh"
+
+/* Samples go to the profiler of the thread that started it */
+static sampling_profiler *active_profiler = nullptr;
+static thread_local bool profiled_thread = false;
+
+/* Most samples; the rest are dropped */
+#define MAX_SAMPLES (1 << 16)
+
+sampling_profiler::sampling_profiler(void *code, int hz)
+    : hz(hz)
+{
+    Dl_info info;
+    if (!dladdr(code, &info))
+        THROW_BUG("dladdr() failed on the jitted code");
+    so_path = info.dli_fname ? info.dli_fname : "";
+    code_begin = (uintptr_t)info.dli_fbase;
+
+    /* The end of the .so's last segment */
+    dl_iterate_phdr([](dl_phdr_info *phdr_info, size_t, void *data) {
+        auto self = (sampling_profiler*)data;
+        if (phdr_info->dlpi_addr != self->code_begin)
+            return 0;
+        for (int i = 0; i < phdr_info->dlpi_phnum; i++) {
+            const ElfW(Phdr) &phdr = phdr_info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD)
+                self->code_end = std::max<uintptr_t>(self->code_end,
+                    phdr_info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+        }
+        return 1;
+    }, this);
+    if (!code_end)
+        THROW_BUG("Could not find the jitted code's segments");
+
+    v_samples.resize(MAX_SAMPLES);
+}
+
+sampling_profiler::~sampling_profiler()
+{
+    stop();
+
+    /* The .so was kept for addr2line, remove libgccjit's temporary directory */
+    std::filesystem::path dir = std::filesystem::path{so_path}.parent_path();
+    if (dir.filename().string().rfind("libgccjit-", 0) == 0) {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+}
+
+void sampling_profiler::start()
+{
+    DEBUG_ASSERT(!active_profiler, "Only one sampling_profiler at a time");
+
+    /* The frame pointers are only followed within the stack */
+    pthread_attr_t attr;
+    if (!pthread_getattr_np(pthread_self(), &attr)) {
+        void *addr;
+        size_t size;
+        pthread_attr_getstack(&attr, &addr, &size);
+        stack_lo = (uintptr_t)addr;
+        stack_hi = stack_lo + size;
+        pthread_attr_destroy(&attr);
+    }
+
+    active_profiler = this;
+    profiled_thread = true;
+    running = true;
+
+    struct sigaction sa = {};
+    sa.sa_sigaction = (void (*)(int, siginfo_t*, void*))on_sigprof;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, nullptr);
+
+    /* tv_usec must be below a second, so 1 Hz is tv_sec = 1 */
+    long interval_usec = 1000000 / hz;
+    itimerval timer = {};
+    timer.it_interval.tv_sec = interval_usec / 1000000;
+    timer.it_interval.tv_usec = interval_usec % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr)) {
+        int err = errno;
+        stop();
+        THROW_USER_ERROR(std::string{"--profile: setitimer() failed: "} + strerror(err));
+    }
+}
+
+void sampling_profiler::stop()
+{
+    if (!running)
+        return;
+    itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_IGN);
+    profiled_thread = false;
+    active_profiler = nullptr;
+    running = false;
+}
+
+/* Async signal safe: no allocations or locks */
+void sampling_profiler::on_sigprof(int, void*, void *ucontext)
+{
+    sampling_profiler *self = active_profiler;
+    if (!self || !profiled_thread)
+        return;
+
+    auto uc = (ucontext_t*)ucontext;
+#if defined(__x86_64__)
+    uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+    uintptr_t fp = uc->uc_mcontext.gregs[REG_RBP];
+    uintptr_t sp = uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+    uintptr_t pc = uc->uc_mcontext.pc;
+    uintptr_t fp = uc->uc_mcontext.regs[29];
+#else
+    uintptr_t pc = 0, fp = 0;
+#endif
+
+    long i = self->n_samples.fetch_add(1, std::memory_order_relaxed);
+    if (i >= MAX_SAMPLES) {
+        self->n_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    sample &s = self->v_samples[i];
+    s.n_frames = 0;
+    s.frames[s.n_frames++] = pc;
+    if (!self->in_code(pc))
+        return;
+
+#if defined(__x86_64__)
+    /* GCC leaves leaf functions without a frame even with
+       -fno-omit-frame-pointer, and a function in its prologue has none
+       yet. Then the return address is on the top of the stack, and the
+       frame pointer is the caller's. It is recognized by the call
+       instruction before it. */
+    if (sp % sizeof(uintptr_t) == 0 && sp >= self->stack_lo && sp + sizeof(uintptr_t) <= self->stack_hi) {
+        uintptr_t ret = *(uintptr_t*)sp;
+        bool framed = fp >= self->stack_lo && fp + 2 * sizeof(uintptr_t) <= self->stack_hi &&
+            ((uintptr_t*)fp)[1] == ret;
+        if (!framed && self->in_code(ret) && self->in_code(ret - 5) && *(uint8_t*)(ret - 5) == 0xe8)
+            s.frames[s.n_frames++] = ret;
+    }
+#endif
+
+    /* The frame pointer points at the caller's frame pointer, followed
+       by the return address */
+    while (s.n_frames < max_depth && fp % sizeof(uintptr_t) == 0 &&
+           fp >= self->stack_lo && fp + 2 * sizeof(uintptr_t) <= self->stack_hi) {
+        uintptr_t ret = ((uintptr_t*)fp)[1];
+        if (!self->in_code(ret))
+            break;
+        s.frames[s.n_frames++] = ret;
+        uintptr_t next_fp = ((uintptr_t*)fp)[0];
+        if (next_fp <= fp)
+            break;
+        fp = next_fp;
+    }
+}
+
+namespace {
+
+struct location {
+    std::string function;
+    std::string line; /* file:line */
+};
+
+std::string function_name(uintptr_t pc)
+{
+    Dl_info info;
+    if (!dladdr((void*)pc, &info) || !info.dli_sname)
+        return "??";
+    try {
+        return demangle_emc_fn_name(info.dli_sname);
+    } catch (std::runtime_error&) {
+        return info.dli_sname;
+    }
+}
+
+/* file:line of each address, by addr2line on the .so */
+std::map<uintptr_t, std::string> addr2line(const std::string &so_path, uintptr_t base,
+                                           const std::set<uintptr_t> &addrs)
+{
+    std::map<uintptr_t, std::string> ans;
+    std::string addr_file = "/tmp/engma-profile-" + std::to_string(getpid()) + ".addrs";
+    {
+        std::ofstream f{addr_file};
+        for (uintptr_t a : addrs)
+            f << std::hex << "0x" << a - base << "\n";
+    }
+
+    std::string cmd = "addr2line -e '" + so_path + "' < " + addr_file + " 2>/dev/null";
+    FILE *p = so_path.size() ? popen(cmd.c_str(), "r") : nullptr;
+    if (p) {
+        char buf[4096];
+        auto it = addrs.begin();
+        while (it != addrs.end() && fgets(buf, sizeof buf, p)) {
+            std::string line{buf};
+            if (line.size() && line.back() == '\n')
+                line.pop_back();
+            /* Drop " (discriminator N)" */
+            line = line.substr(0, line.find(" ("));
+            ans[*it++] = line;
+        }
+        pclose(p);
+    }
+    std::remove(addr_file.c_str());
+    return ans;
+}
+
+}
+
+void sampling_profiler::print_report(std::ostream &os)
+{
+    long n = std::min<long>(n_samples.load(), MAX_SAMPLES);
+
+    /* The return addresses are looked up at the call instruction */
+    std::set<uintptr_t> addrs;
+    for (long i = 0; i < n; i++) {
+        const sample &s = v_samples[i];
+        for (int j = 0; j < s.n_frames && in_code(s.frames[j]); j++)
+            addrs.insert(j ? s.frames[j] - 1 : s.frames[j]);
+    }
+    auto map_addr_to_line = addr2line(so_path, code_begin, addrs);
+
+    std::map<uintptr_t, location> map_addr_to_location;
+    for (uintptr_t a : addrs) {
+        std::string line = map_addr_to_line.count(a) ? map_addr_to_line[a] : "";
+        if (line.empty() || line.rfind("??", 0) == 0)
+            line = "?";
+        map_addr_to_location[a] = {function_name(a), line};
+    }
+
+    long n_native = 0;
+    std::map<std::pair<std::string, std::string>, long> map_line_to_count;
+    std::map<std::string, long> map_fn_to_self, map_fn_to_total;
+    std::map<std::string, long> map_stack_to_count;
+    for (long i = 0; i < n; i++) {
+        const sample &s = v_samples[i];
+        if (!in_code(s.frames[0])) {
+            n_native++;
+            map_stack_to_count["[native]"]++;
+            continue;
+        }
+        const location &leaf = map_addr_to_location[s.frames[0]];
+        map_line_to_count[{leaf.line, leaf.function}]++;
+        map_fn_to_self[leaf.function]++;
+
+        std::set<std::string> fns_in_stack;
+        std::string stack;
+        for (int j = s.n_frames - 1; j >= 0; j--) {
+            const location &loc = map_addr_to_location[j ? s.frames[j] - 1 : s.frames[j]];
+            fns_in_stack.insert(loc.function);
+            stack += (stack.size() ? ";" : "") + loc.function;
+        }
+        for (auto &fn : fns_in_stack)
+            map_fn_to_total[fn]++;
+        map_stack_to_count[stack]++;
+    }
+
+    auto percent = [&](long count) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(1) << std::setw(6) << 100.0 * count / (n ? n : 1) << "%";
+        return ss.str();
+    };
+
+    os << "Profile: " << n << " samples at " << hz << " Hz, " << n_native << " in native code";
+    if (n_dropped)
+        os << ", " << n_dropped << " dropped";
+    os << "\n\n";
+
+    std::vector<std::pair<long, std::pair<std::string, std::string>>> v_lines;
+    for (auto &e : map_line_to_count)
+        v_lines.push_back({e.second, e.first});
+    std::stable_sort(v_lines.begin(), v_lines.end(), [](auto &a, auto &b) { return a.first > b.first; });
+    os << std::setw(7) << "self" << std::setw(10) << "samples" << "  line\n";
+    for (auto &e : v_lines)
+        os << percent(e.first) << std::setw(10) << e.first << "  "
+           << e.second.first << "  " << e.second.second << "\n";
+
+    std::vector<std::pair<long, std::string>> v_fns;
+    for (auto &e : map_fn_to_total)
+        v_fns.push_back({e.second, e.first});
+    std::stable_sort(v_fns.begin(), v_fns.end(), [](auto &a, auto &b) { return a.first > b.first; });
+    os << "\n" << std::setw(7) << "self" << std::setw(8) << "total" << "  function\n";
+    for (auto &e : v_fns)
+        os << percent(map_fn_to_self[e.second]) << percent(e.first) << "  " << e.second << "\n";
+
+    std::string folded_path = "engma-profile-" + std::to_string(getpid()) + ".folded";
+    std::ofstream f{folded_path};
+    for (auto &e : map_stack_to_count)
+        f << e.first << " " << e.second << "\n";
+    os << "\nWrote the collapsed stacks to " << folded_path << "\n";
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/* Sampling profiler for -X --profile[=HZ], see jit::execute().
+ *
+ * SIGPROF from setitimer(ITIMER_PROF) samples the thread running the Engma
+ * code, by default 1000 times per CPU second. The handler stores the PC and
+ * the return addresses in the jitted code, found by following the frame
+ * pointers, which --profile keeps with -fno-omit-frame-pointer. Samples in
+ * other code, e.g. libc or libjitruntime, are counted as native.
+ *
+ * After the run the addresses are mapped to the Engma functions with dladdr()
+ * and to file:line with addr2line on the .so libgccjit made, which --profile
+ * keeps together with -g. A flat profile is printed to stderr and the
+ * collapsed stacks, for flamegraph.pl, are written to engma-profile-PID.folded.
+ *
+ * Only the code in the root result is profiled, so --profile can't be
+ * combined with --tiered or --lazy.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class sampling_profiler {
+public:
+    /* code is any function in the gcc_jit_result to profile */
+    sampling_profiler(void *code, int hz);
+    ~sampling_profiler();
+    sampling_profiler(const sampling_profiler&) = delete;
+    sampling_profiler& operator=(const sampling_profiler&) = delete;
+
+    void start();
+    void stop();
+    void print_report(std::ostream &os);
+
+private:
+    static const int max_depth = 32;
+    struct sample {
+        int n_frames;
+        uintptr_t frames[max_depth]; /* The PC first */
+    };
+
+    static void on_sigprof(int sig, void *info, void *ucontext);
+    bool in_code(uintptr_t pc) const { return pc >= code_begin && pc < code_end; }
+
+    int hz;
+    uintptr_t code_begin = 0, code_end = 0;
+    std::string so_path;
+    uintptr_t stack_lo = 0, stack_hi = 0;
+    std::vector<sample> v_samples;
+    std::atomic<long> n_samples{0};
+    std::atomic<long> n_dropped{0};
+    bool running = false;
+};
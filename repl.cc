@@ -0,0 +1,232 @@
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+/* Bison and flex requires this include order. */
+#include "emc.hh"
+typedef void *yyscan_t;
+#include "emc.tab.h"
+#include "lexer.h"
+/* End of stupid include order. */
+
+#include "compile.hh"
+#include "tiered.hh"
+#include "repl.hh"
+
+/* REPL
+ *
+ * The types and structs are put in a parent context that lives as long as
+ * the REPL. Each statement is compiled in a child context of it and run
+ * right away. The globals can't be put in the parent since libgccjit
+ * compiles the parent into each child, which would give every statement
+ * its own copy. Instead a global lives in the result of the statement that
+ * defined it and later statements use it, and call the functions defined
+ * earlier, by address like the tier up contexts of tiered.cc do.
+ *
+ * The globals, functions and C function declarations of the statements
+ * are kept in maps by name in the tier_state, and a statement only adds
+ * the ones it uses to its context. A statement that fails is rolled back
+ * from the scopes so that later statements can't refer to what it defined.
+ */
+
+void jit::init_as_repl_root()
+{
+    types_context = gcc_jit_context_acquire ();
+    if (!types_context)
+        THROW_BUG("Could not acquire jit context");
+    types = new default_types(types_context);
+
+    tiering = new tier_state;
+    tiering->session = current_session;
+    tiering->types_context = types_context;
+    tiering->types = types;
+    tiering->structs = &map_structtypename_to_gccstructobj;
+}
+
+/* Adds the globals and functions node defines, that are in res, to the
+   maps of the REPL */
+static void add_repl_symbols(tier_state *state, ast_node *node, gcc_jit_result *res)
+{
+    switch (node->type) {
+    case ast_type::DEF: {
+        auto def = dynamic_cast<ast_node_def*>(node);
+        DEBUG_ASSERT_NOTNULL(def);
+        state->map_repl_globals[def->var_name] = node;
+        if (void *p = gcc_jit_result_get_global(res, def->mangled_name.c_str()))
+            state->map_repl_global_addrs[def->mangled_name] = p;
+        break;
+    }
+    case ast_type::FUNCTION_DEF: {
+        auto fdef = dynamic_cast<ast_node_funcdef*>(node);
+        DEBUG_ASSERT_NOTNULL(fdef);
+        if (void *p = gcc_jit_result_get_code(res, fdef->mangled_name.c_str()))
+            state->map_repl_code[fdef->mangled_name] = p;
+        break;
+    }
+    case ast_type::FUNCTION_DECL: {
+        auto fdec = dynamic_cast<ast_node_funcdec*>(node);
+        DEBUG_ASSERT_NOTNULL(fdec);
+        state->map_repl_fn_decls[fdec->mangled_name] = node;
+        break;
+    }
+    case ast_type::USING: {
+        auto using_node = dynamic_cast<ast_node_using*>(node);
+        DEBUG_ASSERT_NOTNULL(using_node);
+        DEBUG_ASSERT_NOTNULL(using_node->compunit);
+        for (ast_node *cu_node : using_node->compunit->v_nodes)
+            add_repl_symbols(state, cu_node, res);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void jit::run_repl_statement(ast_node *node)
+{
+    DEBUG_ASSERT_NOTNULL(tiering);
+    gcc_jit_result *res = nullptr;
+    {
+        jit j;
+        j.init_as_tier_context(tiering);
+        j.repl = true;
+
+        j.root_func = gcc_jit_context_new_function(j.context, 0,
+            GCC_JIT_FUNCTION_EXPORTED, j.types->void_type, "engma_repl_statement",
+            0, 0, 0);
+        j.root_block = gcc_jit_function_new_block(j.root_func, "root_block");
+        j.add_ast_node(node);
+        gcc_jit_block_end_with_void_return(j.root_block, 0);
+
+        gcc_jit_context_add_driver_option(j.context, "-fPIC");
+        gcc_jit_context_add_driver_option(j.context, "-ljitruntime");
+        if (opts().debug_flag.size())
+            gcc_jit_context_add_command_line_option(j.context, opts().debug_flag.c_str());
+        gcc_jit_context_add_command_line_option(j.context, opts().optimization_level.c_str());
+        add_target_options(j.context);
+
+        res = gcc_jit_context_compile(j.context);
+        if (!res) {
+            const char *err = gcc_jit_context_get_last_error(j.context);
+            THROW_BUG("Compilation of statement failed: " + std::string{err ? err : ""});
+        }
+        perf_map_add(res, j.v_perf_fns);
+        /* Structs defined by the statement, they are in the shared types_context */
+        map_structtypename_to_gccstructobj = j.map_structtypename_to_gccstructobj;
+    }
+
+    /* The result is kept since later statements use its globals and functions */
+    tiering->v_results.push_back(res);
+    add_repl_symbols(tiering, node, res);
+
+    auto statement = (void (*)())gcc_jit_result_get_code(res, "engma_repl_statement");
+    if (!statement)
+        THROW_BUG("NULL statement function after JIT compilation");
+    statement();
+}
+
+gcc_jit_lvalue* jit::repl_global(const std::string &name)
+{
+    auto it = tier_parent->map_repl_globals.find(name);
+    if (it == tier_parent->map_repl_globals.end())
+        return nullptr;
+    auto def = dynamic_cast<ast_node_def*>(it->second);
+    DEBUG_ASSERT_NOTNULL(def);
+
+    gcc_jit_lvalue *lval = tier_global(emc_type_to_jit_type(def->value_type),
+        def->mangled_name, ast_node_to_gccloc(def));
+    v_of_map_of_varname_to_lval.front()[name] = lval;
+    return lval;
+}
+
+bool jit::repl_declare_fn(const std::string &mangled_name)
+{
+    auto it = tier_parent->map_repl_fn_decls.find(mangled_name);
+    if (it == tier_parent->map_repl_fn_decls.end())
+        return false;
+    gcc_jit_rvalue *rval = nullptr;
+    walk_tree(it->second, 0, 0, &rval, 0);
+    return true;
+}
+
+gcc_jit_rvalue* jit::repl_call(ast_node *fdef_node,
+                               std::vector<gcc_jit_rvalue*> &v_args,
+                               gcc_jit_location *loc)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+    const tier_signature &sig = get_tier_signature(fdef_node);
+
+    void *code = tier_lookup(tier_parent, fdef->mangled_name, false);
+    if (!code)
+        THROW_BUG("Function " + fdef->mangled_name + " not in the compiled code");
+
+    gcc_jit_rvalue *fn_ptr = gcc_jit_context_new_rvalue_from_ptr(context, sig.fn_ptr_type, code);
+    return gcc_jit_context_new_call_through_ptr(context, loc, fn_ptr,
+        v_args.size(), v_args.data());
+}
+
+int repl_run(FILE *in)
+{
+    bool interactive = isatty(fileno(in));
+    int status = 0;
+
+    yyscan_t scanner;
+    yylex_init(&scanner);
+    yyset_in(in, scanner);
+
+    compilation_units().get_current_compilation_unit().file_name = "<stdin>";
+
+    jit jit;
+    jit.init_as_repl_root();
+
+    do {
+        if (interactive)
+            std::cout << "> " << std::flush;
+
+        int err = yyparse(scanner);
+        auto &cu = compilation_units().get_current_compilation_unit();
+        if (err) {
+            std::cerr << "error" << std::endl;
+            if (!interactive) {
+                status = 1;
+                break;
+            }
+            continue;
+        }
+
+        ast_node *node = cu.ast_root;
+        cu.ast_root = nullptr;
+        if (!node)
+            continue;
+        /* The types of a statement that failed might still be in the
+           scopes and point into it, so it is kept until the end. */
+        cu.v_nodes.push_back(node);
+
+        auto &objstack = compilation_units().get_current_objstack();
+        size_t n_scopes = objstack.vec_scope.size();
+        size_t n_objs = objstack.get_global_scope().vec_objs.size();
+        try {
+            node->resolve();
+            jit.run_repl_statement(node);
+        } catch (std::exception &e) {
+            /* What the statement defined is not in any compiled code */
+            while (objstack.vec_scope.size() > n_scopes)
+                objstack.pop_scope();
+            auto &scope = objstack.get_global_scope();
+            while (scope.vec_objs.size() > n_objs) {
+                delete scope.vec_objs.back();
+                scope.pop_object();
+            }
+            /* The error has been printed by the code that threw */
+            if (!interactive) {
+                status = 1;
+                break;
+            }
+        }
+        fflush(stdout);
+    } while (!compilation_units().get_current_compilation_unit().parsed_eol);
+
+    yylex_destroy(scanner);
+    return status;
+}
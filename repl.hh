@@ -0,0 +1,13 @@
+#pragma once
+
+/* Read-eval-print loop, used with -X and no .em files.
+ *
+ * Each statement is compiled and run as soon as it has been parsed, so the
+ * globals, functions and types of earlier statements can be used by the
+ * later ones. See repl.cc.
+ */
+
+#include <cstdio>
+
+/* Reads statements from in until end of file. Returns the exit status. */
+int repl_run(FILE *in);
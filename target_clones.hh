@@ -0,0 +1,13 @@
+#pragma once
+
+/* The targets of --target-clones, from the least to the most capable.
+ * engma_select_target() in libjitruntime picks the most capable of targets
+ * that the CPU supports, or returns n for the default clone. The x86-64-vN
+ * levels are compiled with arch=x86-64-vN, the rest as ISA extensions.
+ * Each ISA ranks above the ones it implies and the order otherwise follows
+ * GCC's target_clones priorities, e.g. avx2 above fma and bmi2. */
+#define ENGMA_FOR_EACH_CLONE_TARGET(X) \
+    X("sse4.2") X("x86-64-v2") X("avx") X("fma") X("bmi2") X("avx2") \
+    X("x86-64-v3") X("avx512f") X("avx512bw") X("avx512vl") X("x86-64-v4")
+
+extern "C" int engma_select_target(int n, const char **targets);
@@ -0,0 +1,9 @@
+NAMESPACE Cov.Lib
+
+/* Used by coverage-using.em */
+FUNC Int r = pick(Int n) DO
+    IF n > 0 DO
+        RETURN n
+    END
+    RETURN 0 - n
+END
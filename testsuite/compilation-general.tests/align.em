@@ -0,0 +1,37 @@
+USING IMPORT Std.Io
+
+/* Each counter on its own 64 byte cache line, so threads that update
+   their own counters don't share lines */
+TYPE Counter = STRUCT ALIGN(64)
+    Long n
+END
+
+TYPE Vec = STRUCT
+    Int len
+    ALIGN(32) Double x
+    Double y
+END
+
+ALIGN(64) Counter global_counter
+ALIGN(32) Double global_d = 1.5
+
+FUNC Double r = sum(Vec v) DO
+    ALIGN(16) Double local = v.x + v.y
+    RETURN local
+END
+
+global_counter.n = 3
+IF global_counter.n != 3 DO
+    print("FAIL")
+END
+
+Vec v = {2, 1.5, 2.5}
+v.y = v.y + global_d
+IF sum(v) != 5.5 DO
+    print("FAIL")
+END
+IF v.len != 2 DO
+    print("FAIL")
+END
+
+print("DONE")
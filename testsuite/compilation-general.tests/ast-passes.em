@@ -0,0 +1,79 @@
+USING IMPORT Std.Io
+
+/* The AST passes inline, propagate constants, eliminate common
+   subexpressions and remove dead code in function bodies and top
+   level DO blocks. */
+
+FUNC Int r = sq(Int x) DO
+    RETURN x * x
+END
+
+FUNC Double r = mean(Double a, Double b) DO
+    RETURN (a + b) / 2.
+END
+
+FUNC Int r = f(Int a, Int b) DO
+    Int k = 3
+    Int m = k * 2
+    Int unused = a + 1
+    Int t = (a + b) * (a + b) + (a + b) * k
+    IF m > 10 DO
+        RETURN -1
+    END
+    WHILE k < 0 DO
+        t = t + 1
+    END
+    t = t + sq(a) + sq(b + 1)
+    RETURN t
+    t = 7
+END
+
+FUNC Int r = g(Int a) DO
+    Int p = a
+    Int z = 0
+    z = z + 1
+    RETURN p + z + (a*a - 1) + (a*a - 1)
+END
+
+FUNC Int r = h(Int a) DO
+    Int n = 0
+    Int i = 0
+    WHILE i < a DO
+        n = n + (i + 1) * (i + 1) - (i + 1)
+        i = i + 1
+    END
+    RETURN n
+END
+
+Int two = 2
+Int three = 3
+Double x = 1.5
+
+IF f(two, three) != 60 DO
+    print("FAIL")
+END
+IF g(three) != 20 DO
+    print("FAIL")
+END
+IF h(three) != 8 DO
+    print("FAIL")
+END
+IF mean(x, 2.5) != 2. DO
+    print("FAIL")
+END
+IF sq(sq(two)) != 16 DO
+    print("FAIL")
+END
+
+DO
+    Int k = 4
+    Int unused_top = two + 1
+    IF k * k != 16 DO
+        print("FAIL")
+    END
+    IF sq(k) + sq(two) != 20 DO
+        print("FAIL")
+    END
+END
+
+print("DONE")
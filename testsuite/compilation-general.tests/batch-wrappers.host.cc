@@ -0,0 +1,62 @@
+/* Host program for batch-wrappers.exp. Calls the array-mapping companions
+   of scalar functions. */
+#include <cstddef>
+#include <cstdio>
+
+#include "libengma.hh"
+
+static const char *source =
+    "FUNC Double r = score(Double x, Int w) DO\n"
+    "    RETURN x * w + 1.\n"
+    "END\n"
+    /* Gets the C named clamp_batch */
+    "FUNC Int r = c::clamp(Int x) DO\n"
+    "    IF x > 10 DO\n"
+    "        RETURN 10\n"
+    "    END\n"
+    "    RETURN x\n"
+    "END\n"
+    "FUNC Int r = first(&Int p) DO\n"
+    "    RETURN @p\n"
+    "END\n";
+
+int main()
+{
+    engma::engine_options options;
+    options.include_dirs.push_back("../");
+    options.optimization_level = 3;
+    options.batch_wrappers = true;
+    engma::engine e(options);
+    e.compile_string(source);
+
+    const int n = 1000;
+    static double x[n], scores[n];
+    static int w[n];
+    for (int i = 0; i < n; i++) {
+        x[i] = i * 0.5;
+        w[i] = i % 7;
+    }
+
+    auto score_batch = e.function<void(const double*, const int*, double*, unsigned long)>("score_batch");
+    if (!score_batch) {
+        printf("FAIL no score_batch\n");
+        return 1;
+    }
+    score_batch(x, w, scores, n);
+    auto score = e.function<double(double, int)>("score");
+    for (int i = 0; i < n; i++)
+        if (scores[i] != score(x[i], w[i]) || scores[i] != x[i] * w[i] + 1.) {
+            printf("FAIL score %d\n", i);
+            break;
+        }
+
+    /* No companion for functions with pointer parameters */
+    if (e.function<void(int* const*, int*, unsigned long)>("first_batch"))
+        printf("FAIL first_batch\n");
+
+    /* n = 0 touches nothing */
+    score_batch(x, w, nullptr, 0);
+
+    printf("DONE\n");
+    return 0;
+}
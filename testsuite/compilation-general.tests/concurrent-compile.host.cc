@@ -0,0 +1,83 @@
+/* Host program for concurrent-compile.exp. Compiles Engma code on many threads
+   at once, each thread with its own engine, and checks that the results don't mix. */
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libengma.hh"
+
+static const int n_threads = 16;
+static const int n_rounds = 8;
+
+static std::atomic<int> n_failed{0};
+
+static std::string source(int k)
+{
+    std::string ks = std::to_string(k);
+    return
+        "Int base = " + ks + "\n"
+        "TYPE Pair_" + ks + " = STRUCT\n"
+        "    Int a\n"
+        "    Int b\n"
+        "END\n"
+        "FUNC Int r = fib(Int n) DO\n"
+        "    Int a = 0\n"
+        "    Int b = 1\n"
+        "    WHILE n > 0 DO\n"
+        "        Int t = a + b\n"
+        "        a = b\n"
+        "        b = t\n"
+        "        n = n - 1\n"
+        "    END\n"
+        "    RETURN a\n"
+        "END\n"
+        "FUNC Int r = f(Int x) DO\n"
+        "    Pair_" + ks + " p\n"
+        "    p.a = x\n"
+        "    p.b = base\n"
+        "    Int a = p.a\n"
+        "    Int b = p.b\n"
+        "    RETURN a * b + fib(10)\n"
+        "END\n";
+}
+
+static void worker(int id)
+{
+    engma::engine_options options;
+    options.include_dirs.push_back("../");
+    engma::engine e(options);
+
+    for (int round = 0; round < n_rounds; round++) {
+        int k = id * n_rounds + round + 1;
+        try {
+            e.compile_string(source(k), "unit" + std::to_string(k));
+        } catch (std::runtime_error &err) {
+            printf("FAIL compile %d: %s\n", k, err.what());
+            n_failed++;
+            return;
+        }
+        auto f = e.function<int(int)>("f");
+        int *base = e.global<int>("base");
+        if (!f || !base || *base != k || f(3) != 3 * k + 55) {
+            printf("FAIL thread %d round %d\n", id, round);
+            n_failed++;
+            return;
+        }
+    }
+}
+
+int main()
+{
+    std::vector<std::thread> v_threads;
+    for (int i = 0; i < n_threads; i++)
+        v_threads.emplace_back(worker, i);
+    for (auto &t : v_threads)
+        t.join();
+
+    if (n_failed == 0)
+        printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+USING IMPORT Std.Io
+
+/* Comparisons, logical operators and abs of constant expressions are folded,
+   and branches with constant conditions are dropped. */
+
+FUNC Int r = debug_level() DO
+    RETURN 1
+END
+
+Int a = 1 < 2
+Int b = 3 <= 2
+Int c = 1 < 2 < 3 < 3
+Int d = 1. == 1
+Int e = 1 AND 0 OR NOT 0
+Int f = |-3| + |2 - 4|
+Int g = (2 <=> 3) + (3 <=> 3) + (4 <=> 3)
+
+IF a != 1 OR b != 0 OR c != 0 OR d != 1 OR e != 1 OR f != 5 OR g != 0 DO
+    print("FAIL")
+END
+
+IF debug_level() > 2 DO
+    print("FAIL")
+ELSE IF debug_level() > 0 DO
+    print("LEVEL-ONE")
+ELSE DO
+    print("FAIL")
+ALSO DO
+    print("ALSO-WORKS")
+END
+
+FUNC Int r = flags(Int x) DO
+    IF 0 DO
+        RETURN 1
+    ELSE IF x == 2 DO
+        RETURN 2
+    ELSE IF 1 DO
+        x = x + 10
+    ELSE DO
+        RETURN 3
+    ALSO DO
+        x = x + 100
+    END
+    RETURN x
+END
+
+Int one = 1
+Int two = 2
+IF flags(2) != 2 OR flags(1) != 111 OR flags(two) != 2 OR flags(one) != 111 DO
+    print("FAIL")
+END
+
+Int i = 0
+WHILE 0 DO
+    print("FAIL")
+ELSE DO
+    i = 1
+END
+IF i != 1 DO
+    print("FAIL")
+END
+
+FUNC Int r = loop() DO
+    Int n = 0
+    WHILE 1 DO
+        n = n + 1
+        IF n == 5 DO
+            RETURN n
+        END
+    ELSE DO
+        RETURN -1
+    END
+    RETURN 0
+END
+
+Int five = 5
+IF loop() != five DO
+    print("FAIL")
+END
+
+print("DONE")
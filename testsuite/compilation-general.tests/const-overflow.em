@@ -0,0 +1,23 @@
+USING IMPORT Std.Io
+
+/* Signed overflow is undefined behaviour in the generated code, so these
+   are not folded to a wrapped value, or trap in the compiler. They never
+   run. */
+
+Int run = 0
+IF run != 0 DO
+    Int a = 2147483647 + 1
+    Int b = -2147483647 - 2
+    Int c = 65536 * 65536
+    Int d = (-2147483647 - 1) // -1
+    Int m = (-2147483647 - 1) % -1
+    print(a)
+END
+
+/* No overflow is still folded */
+Int e = 2147483646 + 1
+IF e != 2147483647 DO
+    print("FAIL")
+END
+
+print("DONE")
@@ -0,0 +1,45 @@
+USING IMPORT Std.Io
+
+/* The restrict pointers let GCC assume that out doesn't alias a or b */
+FUNC Double r = axpy(&RESTRICT Double out, &CONST RESTRICT Double a, &CONST RESTRICT Double b) DO
+    @out = @a * 2.0 + @b
+    RETURN @out
+END
+
+FUNC Long r = get(&CONST Long p) DO
+    RETURN @p
+END
+
+/* A pointer to a const pointer; only the Long can be written through it */
+FUNC set(&CONST &Long pp, Long v) DO
+    @@pp = v
+END
+
+Double x = 1.5
+Double y = 2.0
+Double z = 0.0
+IF axpy(&z, &x, &y) != 5.0 DO
+    print("FAIL")
+END
+IF z != 5.0 DO
+    print("FAIL")
+END
+
+/* A pointer to non-const converts to a pointer to const */
+Long l = 3
+&Long pl = &l
+&CONST Long cpl = pl
+IF get(cpl) != 3 DO
+    print("FAIL")
+END
+IF get(pl) != 3 DO
+    print("FAIL")
+END
+
+Long seven = 7
+set(&pl, seven)
+IF l != 7 DO
+    print("FAIL")
+END
+
+print("DONE")
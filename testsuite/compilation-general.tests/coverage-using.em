@@ -0,0 +1,10 @@
+USING IMPORT Std.Io
+USING IMPORT Cov.Lib
+
+/* The statements in Cov.Lib are counted in Lib.em.gcov */
+
+IF pick(3) != 3 DO
+    print("FAIL")
+END
+
+print("DONE")
@@ -0,0 +1,21 @@
+USING IMPORT Std.Io
+
+/* -X --coverage writes the line counts to coverage.em.gcov */
+
+FUNC Int r = add_odd(Int n) DO
+    Int s = 0
+    Int i = 0
+    WHILE i < n DO
+        IF i % 2 == 1 DO
+            s = s + i
+        END
+        i = i + 1
+    END
+    RETURN s
+END
+
+IF add_odd(10) != 25 DO
+    print("FAIL")
+END
+
+print("DONE")
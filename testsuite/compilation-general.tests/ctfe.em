@@ -0,0 +1,123 @@
+USING IMPORT Std.Io
+
+/* Calls to side effect free functions with constant arguments are
+   evaluated at compile time. */
+
+FUNC Int r = fib(Int n) DO
+    Int a = 0
+    Int b = 1
+    WHILE n > 0 DO
+        Int t = a + b
+        a = b
+        b = t
+        n = n - 1
+    END
+    RETURN a
+END
+
+FUNC Int r = sq(Int x) DO
+    IF x < 0 DO
+        RETURN -x * x
+    ELSE IF x == 0 DO
+        RETURN 0
+    ELSE DO
+        RETURN x * x
+    END
+END
+
+FUNC Int r = fibsq(Int x) DO
+    RETURN sq(fib(x))
+END
+
+FUNC Double d = half(Double x) DO
+    RETURN x / 2
+END
+
+Int g = 3
+/* Reads a global so can't be evaluated at compile time */
+FUNC Int r = add_g(Int x) DO
+    RETURN x + g
+END
+
+/* Too many steps, so evaluated at runtime */
+FUNC Long r = sum_to(Int n) DO
+    Long s = 0
+    WHILE n > 0 DO
+        s = s + n
+        n = n - 1
+    END
+    RETURN s
+END
+
+/* Recursive. count(100) is 101 calls deep, so with the default
+   --ctfe-max-depth it is evaluated at runtime. */
+FUNC Int r = count(Int n) DO
+    IF n == 0 DO
+        RETURN 0
+    END
+    RETURN 1 + count(n - 1)
+END
+
+FUNC Int r = fact(Int n) DO
+    IF n <= 1 DO
+        RETURN 1
+    END
+    RETURN n * fact(n - 1)
+END
+
+/* Overflows, so evaluated at runtime */
+FUNC Int r = twice(Int x) DO
+    RETURN x * 2
+END
+
+DO
+    Int a = fib(20)
+    Int b = fib(10) + 1
+    Int s = sq(-4)
+    Int fs = fibsq(10)
+    Double d = half(3.)
+    Int i = add_g(1)
+    Long l = sum_to(200000)
+    Long l_expected = 200001
+    l_expected = l_expected * 100000
+    Int f = fact(10)
+    Int c = count(100)
+    Int t = twice(2000000000)
+
+    IF a != 6765 DO
+        print("FAIL")
+    END
+    IF b != 56 DO
+        print("FAIL")
+    END
+    IF s != -16 DO
+        print("FAIL")
+    END
+    IF fs != 3025 DO
+        print("FAIL")
+    END
+    IF fib(5) != 5 DO
+        print("FAIL")
+    END
+    IF d != 1.5 DO
+        print("FAIL")
+    END
+    IF i != 4 DO
+        print("FAIL")
+    END
+    g = 4
+    IF add_g(1) != 5 DO
+        print("FAIL")
+    END
+    IF l != l_expected DO
+        print("FAIL")
+    END
+    IF f != 3628800 DO
+        print("FAIL")
+    END
+    IF c != 100 DO
+        print("FAIL")
+    END
+END
+
+print("DONE")
@@ -0,0 +1,99 @@
+/* Host program for expression-cache.exp. Evaluates Engma expressions against
+   a struct through the expression cache. */
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libengma.hh"
+
+struct Order {
+    int qty;
+    double price;
+};
+
+static const engma::input_type order_type = {
+    "Order",
+    "TYPE Order = STRUCT\n"
+    "    Int qty\n"
+    "    Double price\n"
+    "END\n"
+};
+
+int main()
+{
+    engma::expression_cache_options options;
+    options.engine.include_dirs.push_back("../");
+    options.max_entries = 4;
+    engma::expression_cache cache(options);
+
+    Order order = {3, 2.5};
+
+    /* Three expressions in one compile */
+    cache.prefetch<int>(order_type, "@in.qty + 1");
+    cache.prefetch<int>(order_type, "@in.qty > 2 AND @in.price < 10.");
+    auto total = cache.get<double>(order_type, "@in.qty * (@in.price)");
+    if (!total || total(&order) != 7.5)
+        printf("FAIL total\n");
+    auto s = cache.stats();
+    if (s.misses != 1 || s.hits != 0 || s.compiles != 1 || s.expressions != 3)
+        printf("FAIL batch\n");
+
+    /* Same source up to whitespace */
+    auto plus_one = cache.get<int>(order_type, "  @in.qty+1 ");
+    auto cheap = cache.get<int>(order_type, "@in.qty > 2 AND @in.price < 10.");
+    if (plus_one(&order) != 4 || !cheap(&order))
+        printf("FAIL prefetched\n");
+    s = cache.stats();
+    if (s.hits != 2 || s.compiles != 1)
+        printf("FAIL hits\n");
+
+    /* Another result type is another entry */
+    auto total_int = cache.get<long>(order_type, "@in.qty * 2");
+    if (total_int(&order) != 6 || cache.stats().misses != 2)
+        printf("FAIL result type\n");
+
+    /* A bad expression does not fail the ones compiled with it */
+    cache.prefetch<int>(order_type, "@in.qty - 1");
+    bool threw = false;
+    try {
+        cache.get<int>(order_type, "@in.no_such_field");
+    } catch (std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw || cache.get<int>(order_type, "@in.qty - 1")(&order) != 2)
+        printf("FAIL bad expression\n");
+
+    /* Evicted expressions are recompiled, but handles to them still work */
+    if (cache.stats().evictions == 0)
+        printf("FAIL evictions\n");
+    long compiles = cache.stats().compiles;
+    auto total_again = cache.get<double>(order_type, "@in.qty * (@in.price)");
+    if (cache.stats().compiles != compiles + 1 || total_again(&order) != 7.5)
+        printf("FAIL evicted\n");
+    order.qty = 4;
+    if (total(&order) != 10.)
+        printf("FAIL handle\n");
+
+    /* Misses on several threads compile at the same time. The first result
+       of an expression is kept and all threads get code that works. */
+    std::vector<std::thread> v_threads;
+    std::atomic<int> n_bad{0};
+    for (int i = 0; i < 4; i++)
+        v_threads.emplace_back([&cache, &n_bad, i] {
+            Order o = {i, 1.5};
+            auto shared = cache.get<double>(order_type, "@in.price * 4.");
+            auto own = cache.get<int>(order_type, "@in.qty + " + std::to_string(10 * i));
+            if (shared(&o) != 6. || own(&o) != 11 * i)
+                n_bad++;
+        });
+    for (auto &t : v_threads)
+        t.join();
+    if (n_bad)
+        printf("FAIL threads\n");
+
+    printf("DONE\n");
+    return 0;
+}
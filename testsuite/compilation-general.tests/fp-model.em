@@ -0,0 +1,22 @@
+USING IMPORT Std.Io
+
+/* A reduction that --fp-model=fast may reassociate. The terms are exact
+   so the sum is the same in any order. */
+
+FUNC Double r = sum(Long n) DO
+    Double s = 0
+    Long i = 0
+    WHILE i < n DO
+        Double x = i
+        s = s + x * 0.5
+        i = i + 1
+    END
+    RETURN s
+END
+
+Long n = 1000
+IF sum(n) != 249750 DO
+    print("FAIL")
+END
+
+print("DONE")
@@ -0,0 +1,98 @@
+USING IMPORT Std.Io
+
+/* Run with --interp. The results must be the same as with the jit. */
+
+FUNC Long r = add(Long a, Long b) DO
+    RETURN a + b
+END
+
+FUNC Long r = fib(Int n) DO
+    Long a = 0
+    Long b = 1
+    WHILE n > 0 DO
+        Long t = add(a, b)
+        a = b
+        b = t
+        n = n - 1
+    END
+    RETURN a
+END
+
+FUNC Double r = avg3(Double a, Double b, Double c) DO
+    RETURN (a + b + c) / 3.
+END
+
+FUNC Int r = classify(Int i) DO
+    Int r = 0
+    IF i < 0 DO
+        r = -1
+    ELSE IF i == 0 DO
+        r = 0
+    ELSE DO
+        r = 1
+    ALSO DO
+        r = r * 10
+    END
+    RETURN r
+END
+
+Int n = 0
+Int calls = 0
+
+FUNC count() DO
+    calls = calls + 1
+END
+
+IF fib(20) != 6765 DO
+    print("FAIL")
+END
+IF avg3(1., 2., 6.) != 3. DO
+    print("FAIL")
+END
+IF classify(-5) != -10 OR classify(0) != 0 OR classify(7) != 1 DO
+    print("FAIL")
+END
+
+/* Narrow and unsigned types wrap */
+Byte b = 250
+b = b + 10
+IF b != 4 DO
+    print("FAIL")
+END
+Ushort us = 0
+us = us - 1
+IF us != 65535 DO
+    print("FAIL")
+END
+Sbyte sb = 127
+sb = sb + 1
+IF sb != -128 DO
+    print("FAIL")
+END
+
+/* Loops and globals */
+WHILE n < 100 DO
+    count()
+    n = n + 1
+END
+IF calls != 100 DO
+    print("FAIL")
+END
+Int m = 5
+WHILE m < 0 DO
+    print("FAIL")
+ELSE DO
+    m = 6
+END
+IF m != 6 DO
+    print("FAIL")
+END
+IF NOT (1 < 2 < 3) OR 3 < 2 < 1 DO
+    print("FAIL")
+END
+
+/* Calls to C functions */
+print(fib(10))
+print(" ")
+println(2.5)
+print("DONE")
@@ -0,0 +1,57 @@
+USING IMPORT Std.Io
+
+/* With --lazy each function is compiled the first time it is called.
+   The functions that are never called must not matter and the ones that
+   are must behave as if everything was compiled up front. */
+
+TYPE Point = STRUCT
+    Int x
+    Int y
+END
+
+Point origin = {3, 4}
+Int calls = 0
+
+FUNC Int r = add(Int a, Int b) DO
+    calls = calls + 1
+    RETURN a + b
+END
+
+FUNC Int r = manhattan(Point p) DO
+    RETURN add(p.x, p.y)
+END
+
+FUNC move(&Point p, Int dx) DO
+    @p.x = add(@p.x, dx)
+END
+
+FUNC Double r = never_called(Double x) DO
+    print("FAIL")
+    RETURN x
+END
+
+FUNC Int r = also_never_called() DO
+    never_called(1.)
+    RETURN 1
+END
+
+IF manhattan(origin) != 7 DO
+    print("FAIL")
+END
+
+Int i = 0
+WHILE i < 10 DO
+    move(&origin, 1)
+    i = i + 1
+END
+IF origin.x != 13 DO
+    print("FAIL")
+END
+IF manhattan(origin) != 17 DO
+    print("FAIL")
+END
+IF calls != 12 DO
+    print("FAIL")
+END
+
+print("DONE")
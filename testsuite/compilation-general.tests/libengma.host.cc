@@ -0,0 +1,72 @@
+/* Host program for libengma.exp. Compiles Engma code in-process and calls it. */
+#include <cstdio>
+#include <stdexcept>
+
+#include "libengma.hh"
+
+static const char *source =
+    "Int counter = 40\n"
+    "FUNC Int r = add(Int a, Int b) DO\n"
+    "    counter = counter + 1\n"
+    "    RETURN a + b\n"
+    "END\n"
+    "FUNC Double r = scale(Double x, &Double factor) DO\n"
+    "    RETURN x * @factor\n"
+    "END\n"
+    "FUNC Double r = first(&CONST Double p) DO\n"
+    "    RETURN @p\n"
+    "END\n";
+
+int main()
+{
+    engma::engine_options options;
+    options.include_dirs.push_back("../");
+    engma::engine e(options);
+
+    e.compile_string(source);
+
+    auto add = e.function<int(int, int)>("add");
+    auto scale = e.function<double(double, double*)>("scale");
+    int *counter = e.global<int>("counter");
+    if (!add || !scale || !counter) {
+        printf("FAIL lookup\n");
+        return 1;
+    }
+    if (*counter != 40)
+        printf("FAIL counter init\n");
+    if (add(1, 2) != 3 || *counter != 41)
+        printf("FAIL add\n");
+    double factor = 2.5;
+    if (scale(2., &factor) != 5.)
+        printf("FAIL scale\n");
+
+    /* A pointer to const is part of the signature */
+    auto first = e.function<double(const double*)>("first");
+    if (!first || first(&factor) != 2.5)
+        printf("FAIL const pointer\n");
+    if (e.function<double(double*)>("first"))
+        printf("FAIL const pointer signature\n");
+
+    /* Wrong signature or name */
+    if (e.function<long(long, long)>("add") || e.function<int(int, int)>("sub"))
+        printf("FAIL wrong signature\n");
+
+    /* A later compile in the same engine sees nothing of the first, but the
+       first's code is kept */
+    e.compile_string("FUNC Int r = sub(Int a, Int b) DO\n    RETURN a - b\nEND\n", "second");
+    auto sub = e.function<int(int, int)>("sub");
+    if (!sub || sub(5, 3) != 2 || add(2, 2) != 4)
+        printf("FAIL second compile\n");
+
+    bool threw = false;
+    try {
+        e.compile_string("Int x = undefined_thing\n", "bad");
+    } catch (std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw)
+        printf("FAIL no error\n");
+
+    printf("DONE\n");
+    return 0;
+}
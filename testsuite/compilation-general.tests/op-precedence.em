@@ -1,6 +1,11 @@
 
 USING IMPORT Std.Io
 
+TYPE Pair = STRUCT
+    Long a
+    Long b
+END
+
 FUNC test1() DO
     println(2 + 2 * 3) /* 8 */
     println(2 - 2 * 3) /* -4 */
@@ -24,4 +29,16 @@ FUNC test1() DO
     println(4 % 3 - 1)/* 0 */
 END
 
+FUNC test2() DO
+    Pair p
+    p.a = 2
+    p.b = 3
+    &Pair pp = &p
+    println(p.a * p.b) /* 6 */
+    println(p.b - p.a * p.b) /* -3 */
+    println(p.a * p.b // p.a) /* 3 */
+    println(@pp.a * @pp.b + 1) /* 7 */
+END
+
 test1()
+test2()
@@ -0,0 +1,26 @@
+USING IMPORT Std.Io
+
+/* Busy enough for -X --profile to take samples in spin() */
+
+FUNC Long r = spin(Long n) DO
+    Long s = 0
+    Long i = 0
+    WHILE i < n DO
+        s = s + i % 7
+        i = i + 1
+    END
+    RETURN s
+END
+
+Long n = 10000000
+Long total = 0
+Int k = 0
+WHILE k < 20 DO
+    total = total + spin(n)
+    k = k + 1
+END
+IF total != 599999880 DO
+    print("FAIL")
+END
+
+print("DONE")
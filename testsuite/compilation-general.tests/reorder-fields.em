@@ -0,0 +1,42 @@
+USING IMPORT Std.Io
+
+/* 32 bytes in the declaration order and 24 with --reorder-fields */
+TYPE Rec = STRUCT
+    Byte tag
+    Double a
+    Byte flags
+    Double b
+END
+
+/* Laid out as declared, like the same struct in C */
+TYPE Crec = STRUCT c::
+    Byte tag
+    Double a
+END
+
+FUNC Double r = total(Rec rec) DO
+    RETURN rec.a + rec.b
+END
+
+/* The list literal is in the declaration order */
+Rec rec = {1, 1.5, 2, 2.5}
+IF rec.tag != 1 DO
+    print("FAIL")
+END
+IF rec.flags != 2 DO
+    print("FAIL")
+END
+rec.b = rec.b + 1.0
+IF total(rec) != 5.0 DO
+    print("FAIL")
+END
+
+Crec crec = {3, 0.5}
+IF crec.tag != 3 DO
+    print("FAIL")
+END
+IF crec.a != 0.5 DO
+    print("FAIL")
+END
+
+print("DONE")
@@ -0,0 +1,42 @@
+USING IMPORT Std.Io
+
+/* Piped to engmac -X, which runs each statement before the next one is
+   read. Globals, functions and types of earlier statements must be usable
+   by the later ones. */
+
+TYPE Pair = STRUCT
+    Int a
+    Int b
+END
+
+Int n = 40
+Pair p = {1, 2}
+
+FUNC Int r = twice(Int x) DO
+    RETURN x * 2
+END
+
+FUNC Int r = pair_sum(Pair q) DO
+    RETURN q.a + q.b
+END
+
+n = n + 1
+p.b = twice(p.b)
+
+IF n != 41 DO
+    print("FAIL")
+END
+IF pair_sum(p) != 5 DO
+    print("FAIL")
+END
+
+Int i = 0
+WHILE i < 3 DO
+    n = twice(n)
+    i = i + 1
+END
+IF n != 328 DO
+    print("FAIL")
+END
+
+print("DONE")
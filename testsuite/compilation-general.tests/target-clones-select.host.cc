@@ -0,0 +1,47 @@
+/* Host program for target-clones-select.exp. Checks which clone
+   engma_select_target() picks for the CPU it runs on, whatever order the
+   targets are given in. */
+#include <cstdio>
+
+#include "target_clones.hh"
+
+static void check(const char *what, int n, const char **targets, int expected)
+{
+    int picked = engma_select_target(n, targets);
+    if (picked != expected)
+        printf("FAIL %s: picked %d, expected %d\n", what, picked, expected);
+}
+
+int main()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool avx = __builtin_cpu_supports("avx");
+    bool fma = __builtin_cpu_supports("fma");
+    bool bmi2 = __builtin_cpu_supports("bmi2");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool v3 = __builtin_cpu_supports("x86-64-v3");
+    bool avx512f = __builtin_cpu_supports("avx512f");
+    bool avx512vl = __builtin_cpu_supports("avx512vl");
+    bool v4 = __builtin_cpu_supports("x86-64-v4");
+
+    /* avx2 outranks fma and bmi2, which outrank avx */
+    const char *t1[] = {"avx2", "fma", "bmi2", "avx"};
+    check("avx2", 4, t1, avx2 ? 0 : bmi2 ? 2 : fma ? 1 : avx ? 3 : 4);
+    const char *t2[] = {"fma", "bmi2", "avx2"};
+    check("avx2 last", 3, t2, avx2 ? 2 : bmi2 ? 1 : fma ? 0 : 3);
+
+    /* Each level outranks the extensions it implies */
+    const char *t3[] = {"avx512f", "x86-64-v3", "avx2"};
+    check("x86-64-v3", 3, t3, avx512f ? 0 : v3 ? 1 : avx2 ? 2 : 3);
+    const char *t4[] = {"x86-64-v4", "avx512vl", "avx512f"};
+    check("x86-64-v4", 3, t4, v4 ? 0 : avx512vl ? 1 : avx512f ? 2 : 3);
+#endif
+
+    /* Unknown targets are never picked */
+    const char *t5[] = {"no-such-isa"};
+    check("default", 1, t5, 1);
+
+    printf("DONE\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+USING IMPORT Std.Io
+
+/* With --tiered --tier-threshold=10 the functions below get hot and are
+   recompiled while the program runs. The results must not change when
+   the calls start to go to the recompiled code. */
+
+Int calls = 0
+
+FUNC Int r = add(Int a, Int b) DO
+    calls = calls + 1
+    RETURN a + b
+END
+
+FUNC Int r = sum_to(Int n) DO
+    Int s = 0
+    Int i = 1
+    WHILE i <= n DO
+        IF i > 0 DO
+            s = add(s, i)
+        END
+        i = i + 1
+    END
+    RETURN s
+END
+
+FUNC Double r = half(Double x) DO
+    RETURN x / 2.
+END
+
+Int k = 0
+Int total = 0
+WHILE k < 100 DO
+    total = total + sum_to(k)
+    k = k + 1
+END
+IF total != 166650 DO
+    print("FAIL")
+END
+IF calls != 4950 DO
+    print("FAIL")
+END
+
+Double d = 1024.
+Int j = 0
+WHILE j < 10 DO
+    d = half(d)
+    j = j + 1
+END
+IF d != 1. DO
+    print("FAIL")
+END
+
+print("DONE")
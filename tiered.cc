@@ -0,0 +1,514 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "compile.hh"
+#include "tiered.hh"
+#include "common.hh"
+
+/* Tiered compilation
+ *
+ * With -X --tiered the code is first compiled at the optimization level
+ * given by -O (tier 0). All calls to Engma functions go through a table of
+ * function pointers and each function gets a counter that is increased on
+ * each call and each iteration of a loop in it. When a counter reaches
+ * --tier-threshold the function is queued to a worker thread that compiles
+ * it in a new context at --tier-level and puts the new code in the table.
+ *
+ * The recompiled functions use the globals of the tier 0 code and call
+ * other functions through the same table. A function that is running keeps
+ * running the tier 0 code, it is the next call that gets the new code.
+ *
+ * Lazy compilation with -X --lazy uses the same table. The root context
+ * only gets a stub for each Engma function. On the first call the stub
+ * compiles the function, on the calling thread, in a child context of a
+ * context with the types and structs, and puts the code in the table. The
+ * stub then calls the new code, as do all later calls through the table.
+ * Callers of the stub itself, like main(), the batch wrappers and the host
+ * program, get the code from the table too once the function is compiled.
+ */
+
+/* Called by the jitted code with the state as a constant argument */
+static void tier_hot(tier_state *state, int index)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->v_queue.push_back(index);
+    }
+    state->cv.notify_one();
+}
+
+void jit::init_tiering()
+{
+    tiering = new tier_state;
+    tiering->session = current_session;
+
+    gcc_jit_type *param_types[] = {types->void_ptr_type, types->int_type};
+    gcc_jit_type *hook_type = gcc_jit_context_new_function_ptr_type(context, 0,
+        types->void_type, 2, param_types, 0);
+
+    tier_table_global = gcc_jit_context_new_global(context, 0,
+        GCC_JIT_GLOBAL_EXPORTED, gcc_jit_type_get_pointer(types->void_ptr_type),
+        "engma_tier_table");
+    tier_counters_global = gcc_jit_context_new_global(context, 0,
+        GCC_JIT_GLOBAL_EXPORTED, gcc_jit_type_get_pointer(types->long_type),
+        "engma_tier_counters");
+    tier_hook_global = gcc_jit_context_new_global(context, 0,
+        GCC_JIT_GLOBAL_EXPORTED, hook_type, "engma_tier_hook");
+
+    if (lazy) {
+        tiering->types_context = types_context;
+        tiering->types = types;
+        tiering->structs = &map_structtypename_to_gccstructobj;
+
+        gcc_jit_type *lazy_hook_type = gcc_jit_context_new_function_ptr_type(context, 0,
+            types->void_ptr_type, 2, param_types, 0);
+        lazy_hook_global = gcc_jit_context_new_global(context, 0,
+            GCC_JIT_GLOBAL_EXPORTED, lazy_hook_type, "engma_lazy_hook");
+    }
+}
+
+void jit::start_tiering()
+{
+    if (!tiering)
+        return;
+    DEBUG_ASSERT_NOTNULL(result);
+    tiering->result = result;
+
+    tiering->v_table.resize(tiering->v_fn_names.size());
+    tiering->v_counters.assign(tiering->v_fn_names.size(), 0);
+    for (int i = 0; i < tiering->v_fn_names.size(); i++) {
+        void *code = gcc_jit_result_get_code(result, tiering->v_fn_names[i].c_str());
+        if (!code)
+            THROW_BUG("NULL function " + tiering->v_fn_names[i] + " after JIT compilation");
+        tiering->v_table[i] = code;
+    }
+
+    auto table = (void***)gcc_jit_result_get_global(result, "engma_tier_table");
+    auto counters = (long**)gcc_jit_result_get_global(result, "engma_tier_counters");
+    auto hook = (void (**)(tier_state*, int))gcc_jit_result_get_global(result, "engma_tier_hook");
+    if (!table || !counters || !hook)
+        THROW_BUG("Tier globals missing after JIT compilation");
+    *table = tiering->v_table.data();
+    *counters = tiering->v_counters.data();
+    *hook = tier_hot;
+
+    if (lazy) {
+        /* The table points at the stubs until the functions are compiled */
+        auto lazy_hook = (void* (**)(tier_state*, int))gcc_jit_result_get_global(result, "engma_lazy_hook");
+        if (!lazy_hook)
+            THROW_BUG("Lazy hook missing after JIT compilation");
+        *lazy_hook = lazy_compile;
+        tiering->v_stubs = tiering->v_table;
+        return;
+    }
+
+    tiering->stop = false;
+    tiering->worker = std::thread(tier_worker, tiering);
+}
+
+void jit::stop_tiering()
+{
+    if (!tiering || !tiering->worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(tiering->mutex);
+        tiering->stop = true;
+    }
+    tiering->cv.notify_one();
+    tiering->worker.join();
+
+    if (opts().tier_stats)
+        std::cerr << "Tiered: " << tiering->n_recompiled << " functions recompiled" << std::endl;
+}
+
+void jit::end_tiering()
+{
+    if (!tiering)
+        return;
+    stop_tiering();
+    for (auto e : tiering->v_results)
+        gcc_jit_result_release(e);
+    delete tiering;
+    tiering = nullptr;
+}
+
+void jit::init_as_tier_context(tier_state *parent)
+{
+    tier_parent = parent;
+
+    if (parent->types_context) {
+        /* Lazy compilation or the REPL. The types and structs are shared. */
+        context = gcc_jit_context_new_child_context(parent->types_context);
+        types_context = parent->types_context;
+        types = parent->types;
+        map_structtypename_to_gccstructobj = *parent->structs;
+        shared_types = true;
+    } else {
+        context = gcc_jit_context_acquire ();
+        types = new default_types(context);
+    }
+    if (!context)
+        THROW_BUG("Could not acquire jit context");
+
+    setup_default_root_environment();
+}
+
+void jit::tier_record_node(ast_node *node)
+{
+    tiering->v_nodes.push_back(node);
+}
+
+void jit::tier_worker(tier_state *state)
+{
+    engma_session_scope session_scope{state->session};
+    std::set<int> done;
+
+    while (true) {
+        std::vector<int> v_batch;
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cv.wait(lock, [state]{ return state->stop || state->v_queue.size(); });
+            /* The queue is drained before stopping, so that what got hot
+               is compiled however short the run was */
+            if (state->stop && state->v_queue.empty())
+                return;
+            v_batch.swap(state->v_queue);
+        }
+
+        /* Everything that got hot since the last wake up is compiled together */
+        std::set<std::string> hot_fns;
+        for (int idx : v_batch)
+            if (done.insert(idx).second)
+                hot_fns.insert(state->v_fn_names[idx]);
+        if (hot_fns.empty())
+            continue;
+
+        try {
+            state->n_recompiled += compile_tier_fns(state, hot_fns, opts().tier_optimization_level);
+        } catch (std::exception &e) {
+            /* The tier 0 code is kept */
+            std::cerr << "Tiered compilation failed: " << e.what() << std::endl;
+        }
+    }
+}
+
+/* Returns the number of functions put in the table */
+int jit::compile_tier_fns(tier_state *state, const std::set<std::string> &fns,
+                          const std::string &optimization_level)
+{
+    jit j;
+    j.init_as_tier_context(state);
+    for (ast_node *node : state->v_nodes)
+        j.add_tier_node(node, fns);
+
+    gcc_jit_context_add_driver_option(j.context, "-fPIC");
+    if (opts().debug_flag.size())
+        gcc_jit_context_add_command_line_option(j.context, opts().debug_flag.c_str());
+    gcc_jit_context_add_command_line_option(j.context, optimization_level.c_str());
+    add_target_options(j.context);
+
+    gcc_jit_result *res = gcc_jit_context_compile(j.context);
+    if (!res) {
+        const char *err = gcc_jit_context_get_last_error(j.context);
+        THROW_BUG("Compilation of " + *fns.begin() + " failed: " + std::string{err ? err : ""});
+    }
+
+    /* The result has to outlive the jit object since the code is used
+       until the tier 0 code is released. */
+    state->v_results.push_back(res);
+    perf_map_add(res, j.v_perf_fns);
+    int n = 0;
+    for (const std::string &name : fns) {
+        void *code = gcc_jit_result_get_code(res, name.c_str());
+        if (!code)
+            continue;
+        int idx = state->map_fnname_to_index[name];
+        __atomic_store_n(&state->v_table[idx], code, __ATOMIC_RELEASE);
+        n++;
+    }
+    return n;
+}
+
+void* jit::lazy_compile(tier_state *state, int index)
+{
+    engma_session_scope session_scope{state->session};
+
+    /* Another stub might have been called before the table was updated */
+    if (state->v_table[index] != state->v_stubs[index])
+        return state->v_table[index];
+
+    const std::string &name = state->v_fn_names[index];
+    try {
+        compile_tier_fns(state, {name}, opts().optimization_level);
+    } catch (std::exception &e) {
+        /* Can't throw through the jitted code */
+        std::cerr << "Lazy compilation failed: " << e.what() << std::endl;
+        exit(1);
+    }
+    if (state->v_table[index] == state->v_stubs[index]) {
+        std::cerr << "Lazy compilation failed: no code for " << name << std::endl;
+        exit(1);
+    }
+    return state->v_table[index];
+}
+
+void jit::emit_lazy_stub(ast_node *fdef_node)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+    const tier_signature &sig = get_tier_signature(fdef_node);
+    gcc_jit_type *return_type = emc_type_to_jit_type(fdef->return_list->value_type);
+    gcc_jit_location *loc = ast_node_to_gccloc(fdef_node);
+
+    /* The stub has the name and signature of the function so it can be
+       called like it, e.g. from main(). */
+    std::vector<gcc_jit_param*> v_params;
+    for (int i = 0; i < sig.v_param_types.size(); i++)
+        v_params.push_back(gcc_jit_context_new_param(context, 0,
+            sig.v_param_types[i], ("p" + std::to_string(i)).c_str()));
+
+    gcc_jit_function *fn = gcc_jit_context_new_function(context, loc,
+        GCC_JIT_FUNCTION_EXPORTED, return_type, fdef->mangled_name.c_str(),
+        v_params.size(), v_params.size() ? v_params.data() : 0, 0);
+    gcc_jit_block *start_block = gcc_jit_function_new_block(fn, new_unique_name("lazy_stub").c_str());
+    gcc_jit_block *compile_block = gcc_jit_function_new_block(fn, new_unique_name("lazy_compile").c_str());
+    gcc_jit_block *block = gcc_jit_function_new_block(fn, new_unique_name("lazy_call").c_str());
+
+    /* void *code = engma_tier_table[idx];
+       if (code == stub)
+           code = hook(idx);
+       return ((fn_ptr_type)code)(p0, p1, ...) */
+    gcc_jit_rvalue *idx = gcc_jit_context_new_rvalue_from_int(context,
+        types->int_type, tier_index(fdef->mangled_name));
+    gcc_jit_lvalue *code = gcc_jit_function_new_local(fn, loc, types->void_ptr_type, "code");
+    gcc_jit_block_add_assignment(start_block, loc, code,
+        gcc_jit_lvalue_as_rvalue(gcc_jit_context_new_array_access(context, loc,
+            gcc_jit_lvalue_as_rvalue(tier_table_global), idx)));
+    gcc_jit_rvalue *stub = gcc_jit_context_new_cast(context, loc,
+        gcc_jit_function_get_address(fn, loc), types->void_ptr_type);
+    gcc_jit_block_end_with_conditional(start_block, loc,
+        gcc_jit_context_new_comparison(context, loc, GCC_JIT_COMPARISON_EQ,
+            gcc_jit_lvalue_as_rvalue(code), stub),
+        compile_block, block);
+
+    gcc_jit_rvalue *hook_args[] = {
+        gcc_jit_context_new_rvalue_from_ptr(context, types->void_ptr_type, tiering), idx};
+    gcc_jit_block_add_assignment(compile_block, loc, code,
+        gcc_jit_context_new_call_through_ptr(context, loc,
+            gcc_jit_lvalue_as_rvalue(lazy_hook_global), 2, hook_args));
+    gcc_jit_block_end_with_jump(compile_block, loc, block);
+
+    gcc_jit_rvalue *fn_ptr = gcc_jit_context_new_cast(context, loc,
+        gcc_jit_lvalue_as_rvalue(code), sig.fn_ptr_type);
+
+    std::vector<gcc_jit_rvalue*> v_args;
+    for (auto e : v_params)
+        v_args.push_back(gcc_jit_param_as_rvalue(e));
+    gcc_jit_rvalue *call = gcc_jit_context_new_call_through_ptr(context, loc, fn_ptr,
+        v_args.size(), v_args.data());
+
+    if (return_type == types->void_type) {
+        gcc_jit_block_add_eval(block, loc, call);
+        gcc_jit_block_end_with_void_return(block, loc);
+    } else
+        gcc_jit_block_end_with_return(block, loc, call);
+
+    map_fnname_to_gccfnobj[fdef->mangled_name] = fn;
+}
+
+void jit::add_tier_node(ast_node *node, const std::set<std::string> &hot_fns)
+{
+    gcc_jit_rvalue *rval = nullptr;
+    gcc_jit_block *block = nullptr;
+    gcc_jit_function *func = nullptr;
+
+    switch (node->type) {
+    case ast_type::FUNCTION_DEF: {
+        auto fdef = dynamic_cast<ast_node_funcdef*>(node);
+        DEBUG_ASSERT_NOTNULL(fdef);
+        if (hot_fns.count(fdef->mangled_name))
+            walk_tree(node, 0, 0, &rval, 0);
+        break;
+    }
+    case ast_type::DEF: {
+        /* The globals are the ones in the tier 0 code */
+        auto def = dynamic_cast<ast_node_def*>(node);
+        DEBUG_ASSERT_NOTNULL(def);
+        push_lval(def->var_name, tier_global(emc_type_to_jit_type(def->value_type),
+            def->mangled_name, ast_node_to_gccloc(node)));
+        break;
+    }
+    case ast_type::FUNCTION_DECL:
+        walk_tree(node, 0, 0, &rval, 0);
+        break;
+    case ast_type::TYPE:
+        if (!shared_types) /* Else the structs are in the parent context */
+            walk_tree(node, &block, &func, &rval, 0);
+        break;
+    case ast_type::USING: {
+        auto using_node = dynamic_cast<ast_node_using*>(node);
+        DEBUG_ASSERT_NOTNULL(using_node);
+        DEBUG_ASSERT_NOTNULL(using_node->compunit);
+        for (ast_node *cu_node : using_node->compunit->v_nodes)
+            add_tier_node(cu_node, hot_fns);
+        break;
+    }
+    default: /* Top level expressions only run in tier 0 */
+        break;
+    }
+}
+
+int jit::tier_index(const std::string &mangled_name)
+{
+    tier_state *state = tiering ? tiering : tier_parent;
+    DEBUG_ASSERT_NOTNULL(state);
+
+    auto it = state->map_fnname_to_index.find(mangled_name);
+    if (it != state->map_fnname_to_index.end())
+        return it->second;
+    if (!tiering)
+        THROW_BUG("Function " + mangled_name + " not in the tier table");
+
+    int idx = state->v_fn_names.size();
+    state->v_fn_names.push_back(mangled_name);
+    state->map_fnname_to_index[mangled_name] = idx;
+    return idx;
+}
+
+const jit::tier_signature& jit::get_tier_signature(ast_node *fdef_node)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+
+    auto it = map_fnname_to_tier_signature.find(fdef->mangled_name);
+    if (it != map_fnname_to_tier_signature.end())
+        return it->second;
+
+    auto parlist = dynamic_cast<ast_node_vardef_list*>(fdef->parlist);
+    DEBUG_ASSERT_NOTNULL(parlist);
+
+    tier_signature sig;
+    for (auto e : parlist->v_defs)
+        sig.v_param_types.push_back(emc_type_to_jit_type(e->value_type));
+    gcc_jit_type *return_type = emc_type_to_jit_type(fdef->return_list->value_type);
+    sig.fn_ptr_type = gcc_jit_context_new_function_ptr_type(context, 0, return_type,
+        sig.v_param_types.size(), sig.v_param_types.data(), 0);
+
+    return map_fnname_to_tier_signature[fdef->mangled_name] = sig;
+}
+
+void jit::emit_tier_counter(gcc_jit_block **current_block, gcc_jit_location *loc)
+{
+    if (!tiering || tier_fn_index < 0)
+        return;
+    DEBUG_ASSERT_NOTNULL(current_block);
+    DEBUG_ASSERT_NOTNULL(*current_block);
+
+    gcc_jit_function *fn = gcc_jit_block_get_function(*current_block);
+    gcc_jit_rvalue *idx = gcc_jit_context_new_rvalue_from_int(context,
+        types->int_type, tier_fn_index);
+
+    /* counters[idx] += 1 */
+    gcc_jit_lvalue *counter = gcc_jit_context_new_array_access(context, loc,
+        gcc_jit_lvalue_as_rvalue(tier_counters_global), idx);
+    gcc_jit_block_add_assignment_op(*current_block, loc, counter,
+        GCC_JIT_BINARY_OP_PLUS, gcc_jit_context_one(context, types->long_type));
+
+    /* if (counters[idx] == threshold) hook(idx) */
+    gcc_jit_rvalue *is_hot = gcc_jit_context_new_comparison(context, loc,
+        GCC_JIT_COMPARISON_EQ, gcc_jit_lvalue_as_rvalue(counter),
+        gcc_jit_context_new_rvalue_from_long(context, types->long_type, opts().tier_threshold));
+
+    gcc_jit_block *hot_block = gcc_jit_function_new_block(fn, new_unique_name("tier_hot").c_str());
+    gcc_jit_block *cont_block = gcc_jit_function_new_block(fn, new_unique_name("tier_cont").c_str());
+    gcc_jit_block_end_with_conditional(*current_block, loc, is_hot, hot_block, cont_block);
+
+    gcc_jit_rvalue *args[] = {
+        gcc_jit_context_new_rvalue_from_ptr(context, types->void_ptr_type, tiering), idx};
+    gcc_jit_block_add_eval(hot_block, loc, gcc_jit_context_new_call_through_ptr(context, loc,
+        gcc_jit_lvalue_as_rvalue(tier_hook_global), 2, args));
+    gcc_jit_block_end_with_jump(hot_block, loc, cont_block);
+
+    *current_block = cont_block;
+}
+
+gcc_jit_rvalue* jit::tier_call(ast_node *fdef_node,
+                               std::vector<gcc_jit_rvalue*> &v_args,
+                               gcc_jit_location *loc)
+{
+    auto fdef = dynamic_cast<ast_node_funcdef*>(fdef_node);
+    DEBUG_ASSERT_NOTNULL(fdef);
+    const tier_signature &sig = get_tier_signature(fdef_node);
+
+    gcc_jit_rvalue *table = nullptr;
+    if (tiering)
+        table = gcc_jit_lvalue_as_rvalue(tier_table_global);
+    else
+        table = gcc_jit_context_new_rvalue_from_ptr(context,
+            gcc_jit_type_get_pointer(types->void_ptr_type), tier_parent->v_table.data());
+
+    gcc_jit_rvalue *idx = gcc_jit_context_new_rvalue_from_int(context,
+        types->int_type, tier_index(fdef->mangled_name));
+    gcc_jit_rvalue *fn_ptr = gcc_jit_context_new_cast(context, loc,
+        gcc_jit_lvalue_as_rvalue(gcc_jit_context_new_array_access(context, loc, table, idx)),
+        sig.fn_ptr_type);
+
+    return gcc_jit_context_new_call_through_ptr(context, loc, fn_ptr,
+        v_args.size(), v_args.data());
+}
+
+gcc_jit_rvalue* jit::tier_call_imported(gcc_jit_function *func,
+                                        const std::string &mangled_name,
+                                        std::vector<gcc_jit_rvalue*> &v_args,
+                                        gcc_jit_location *loc)
+{
+    /* C functions that were compiled into the tier 0 code are not visible
+       to the recompiled code, so they are called by their tier 0 address. */
+    void *code = tier_lookup(tier_parent, mangled_name, false);
+    if (!code)
+        return gcc_jit_context_new_call(context, loc, func, v_args.size(), v_args.data());
+
+    gcc_jit_rvalue *fn_ptr = gcc_jit_context_new_rvalue_from_ptr(context,
+        gcc_jit_rvalue_get_type(gcc_jit_function_get_address(func, loc)), code);
+    return gcc_jit_context_new_call_through_ptr(context, loc, fn_ptr,
+        v_args.size(), v_args.data());
+}
+
+gcc_jit_lvalue* jit::tier_global(gcc_jit_type *type,
+                                 const std::string &mangled_name,
+                                 gcc_jit_location *loc)
+{
+    void *addr = tier_lookup(tier_parent, mangled_name, true);
+    if (!addr)
+        THROW_BUG("Global " + mangled_name + " not in the compiled code");
+    return gcc_jit_rvalue_dereference(
+        gcc_jit_context_new_rvalue_from_ptr(context, gcc_jit_type_get_pointer(type), addr),
+        loc);
+}
+
+void* jit::tier_lookup(tier_state *state, const std::string &name, bool global)
+{
+    /* The REPL has no tier 0 code, the symbols of its statements are indexed */
+    if (!state->result) {
+        auto &map = global ? state->map_repl_global_addrs : state->map_repl_code;
+        auto it = map.find(name);
+        return it != map.end() ? it->second : nullptr;
+    }
+
+    auto get = [&](gcc_jit_result *res) {
+        return global ? gcc_jit_result_get_global(res, name.c_str()) :
+                        gcc_jit_result_get_code(res, name.c_str());
+    };
+
+    /* The tier 0 code first, then the later results in order */
+    if (state->result)
+        if (void *p = get(state->result))
+            return p;
+    for (gcc_jit_result *res : state->v_results)
+        if (void *p = get(res))
+            return p;
+    return nullptr;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "compile.hh"
+
+/* State shared by the contexts of tiered compilation, lazy compilation and
+   the REPL. See tiered.cc and repl.cc. */
+struct tier_state {
+    gcc_jit_result *result = nullptr; /* Tier 0 code. Not owned. Null in the REPL */
+    std::vector<ast_node*> v_nodes;   /* Top level nodes of tier 0. Not owned. */
+
+    std::map<std::string, int> map_fnname_to_index;
+    std::vector<std::string> v_fn_names;
+    std::vector<void*> v_table;
+    std::vector<long> v_counters;
+    std::vector<gcc_jit_result*> v_results; /* Results of the recompiles and REPL statements */
+    engma_session *session = nullptr;        /* The compilation is done in this session */
+
+    /* Lazy compilation and the REPL. Not owned. */
+    gcc_jit_context *types_context = nullptr;
+    default_types *types = nullptr;
+    std::map<std::string, struct_wrapper> *structs = nullptr;
+    std::vector<void*> v_stubs;
+
+    /* The REPL. What the earlier statements defined, by name, so that a
+       statement only adds the globals and C functions it uses to its
+       context. Not owned. */
+    std::map<std::string, ast_node*> map_repl_globals;  /* DEFs by variable name */
+    std::map<std::string, ast_node*> map_repl_fn_decls; /* FUNCTION_DECLs by mangled name */
+    std::map<std::string, void*> map_repl_code;         /* By mangled name */
+    std::map<std::string, void*> map_repl_global_addrs; /* By mangled name */
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> v_queue;
+    bool stop = false;
+    int n_recompiled = 0;   /* Functions the worker put in the table, for --tier-stats */
+};
@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/resource.h>
+
+#include "time_report.hh"
+#include "emc_assert.hh"
+
+thread_local time_report *current_time_report = nullptr;
+std::atomic<long> n_allocations{0};
+
+long peak_rss_kb()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+    return usage.ru_maxrss; /* In kB on Linux */
+}
+
+time_report::time_report()
+    : gcc_timer(gcc_jit_timer_new()), start(clock::now())
+{
+}
+
+time_report::~time_report()
+{
+    gcc_jit_timer_release(gcc_timer);
+}
+
+int time_report::phase_index(const char *phase_name)
+{
+    for (int i = 0; i < v_phases.size(); i++)
+        if (v_phases[i].name == phase_name)
+            return i;
+    v_phases.push_back({phase_name});
+    return v_phases.size() - 1;
+}
+
+/* Charges the running phase for the time and allocations since it was
+   last resumed */
+void time_report::pause_top(clock::time_point now)
+{
+    if (v_stack.empty())
+        return;
+    running &top = v_stack.back();
+    phase &p = v_phases[top.index];
+    p.self_seconds += std::chrono::duration<double>(now - top.resumed).count();
+    p.n_allocations += n_allocations.load(std::memory_order_relaxed) - top.n_allocations_resumed;
+}
+
+void time_report::push(const char *phase_name, bool sample_memory)
+{
+    auto now = clock::now();
+    pause_top(now);
+
+    int index = phase_index(phase_name);
+    bool outermost = true;
+    for (auto &e : v_stack)
+        if (e.index == index)
+            outermost = false;
+    v_stack.push_back({index, sample_memory, outermost, now, now,
+                       n_allocations.load(std::memory_order_relaxed)});
+}
+
+void time_report::pop()
+{
+    DEBUG_ASSERT(v_stack.size(), "time_report::pop() without a phase");
+    auto now = clock::now();
+    pause_top(now);
+
+    running &top = v_stack.back();
+    phase &p = v_phases[top.index];
+    p.n_calls++;
+    if (top.outermost)
+        p.total_seconds += std::chrono::duration<double>(now - top.start).count();
+    if (top.sample_memory)
+        p.peak_rss_kb = peak_rss_kb();
+    v_stack.pop_back();
+
+    /* Resume the phase this one was in */
+    if (v_stack.size()) {
+        v_stack.back().resumed = now;
+        v_stack.back().n_allocations_resumed = n_allocations.load(std::memory_order_relaxed);
+    }
+}
+
+/* gcc_jit_timer_print() only writes to a FILE */
+std::string time_report::gcc_report()
+{
+    char *buf = nullptr;
+    size_t size = 0;
+    FILE *f = open_memstream(&buf, &size);
+    if (!f)
+        return "";
+    gcc_jit_timer_print(gcc_timer, f);
+    fclose(f);
+    std::string ans{buf, size};
+    free(buf);
+    return ans;
+}
+
+void time_report::print_table(std::ostream &os)
+{
+    double total = std::chrono::duration<double>(clock::now() - start).count();
+    double accounted = 0;
+
+    os << std::left << std::setw(12) << "phase"
+       << std::right << std::setw(8) << "calls"
+       << std::setw(12) << "self ms"
+       << std::setw(12) << "total ms"
+       << std::setw(12) << "allocs"
+       << std::setw(14) << "peak RSS kB" << "\n";
+    for (auto &p : v_phases) {
+        os << std::left << std::setw(12) << p.name
+           << std::right << std::setw(8) << p.n_calls
+           << std::fixed << std::setprecision(3)
+           << std::setw(12) << p.self_seconds * 1000
+           << std::setw(12) << p.total_seconds * 1000
+           << std::setw(12) << p.n_allocations
+           << std::setw(14) << p.peak_rss_kb << "\n";
+        accounted += p.self_seconds;
+    }
+    os << std::left << std::setw(12) << "other"
+       << std::right << std::setw(8) << ""
+       << std::setw(12) << (total - accounted) * 1000 << "\n";
+    os << std::left << std::setw(12) << "total"
+       << std::right << std::setw(8) << ""
+       << std::setw(12) << total * 1000
+       << std::setw(12) << ""
+       << std::setw(12) << n_allocations.load()
+       << std::setw(14) << peak_rss_kb() << "\n";
+    os << std::defaultfloat;
+
+    os << "\nGCC:\n" << gcc_report();
+}
+
+static std::string json_string(const std::string &s)
+{
+    std::ostringstream ss;
+    ss << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\')
+            ss << '\\' << c;
+        else if (c == '\n')
+            ss << "\\n";
+        else if (c < 0x20)
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c
+               << std::dec << std::setfill(' ');
+        else
+            ss << c;
+    }
+    ss << '"';
+    return ss.str();
+}
+
+void time_report::print_json(std::ostream &os)
+{
+    double total = std::chrono::duration<double>(clock::now() - start).count();
+
+    os << "{\"phases\": [";
+    for (int i = 0; i < v_phases.size(); i++) {
+        auto &p = v_phases[i];
+        os << (i ? ", " : "")
+           << "{\"name\": " << json_string(p.name)
+           << ", \"calls\": " << p.n_calls
+           << ", \"self_seconds\": " << p.self_seconds
+           << ", \"total_seconds\": " << p.total_seconds
+           << ", \"allocations\": " << p.n_allocations
+           << ", \"peak_rss_kb\": " << p.peak_rss_kb << "}";
+    }
+    os << "], \"total_seconds\": " << total
+       << ", \"allocations\": " << n_allocations.load()
+       << ", \"peak_rss_kb\": " << peak_rss_kb()
+       << ", \"gcc\": " << json_string(gcc_report()) << "}\n";
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+/* Where the compiler spends its time and memory, printed to stderr with
+ * --time-report or --time-report=json.
+ *
+ *     {
+ *         phase_timer timer{"resolve"};
+ *         node->resolve();
+ *     }
+ *
+ * Phases nest. Each phase gets its own time ("self") and its time including
+ * the phases in it ("total"), so "import" is the total of everything a USING
+ * does while "parse" and "resolve" also get their part of it. The allocation
+ * counts are self counts too. The peak RSS is sampled when a phase ends,
+ * except for "lex" which is too fine grained, so its memory shows in "parse".
+ *
+ * GCC times its own passes in gcc_timer, see jit::compile().
+ *
+ * The timers do nothing unless a time_report is installed for the thread
+ * in current_time_report.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <libgccjit.h>
+
+class time_report {
+public:
+    time_report();
+    ~time_report();
+    time_report(const time_report&) = delete;
+    time_report& operator=(const time_report&) = delete;
+
+    void push(const char *phase_name, bool sample_memory);
+    void pop();
+
+    void print_table(std::ostream &os);
+    void print_json(std::ostream &os);
+
+    gcc_jit_timer *gcc_timer = nullptr;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct phase {
+        std::string name;
+        long n_calls = 0;
+        double self_seconds = 0;
+        double total_seconds = 0;
+        long n_allocations = 0;
+        long peak_rss_kb = 0;
+    };
+    struct running {
+        int index;
+        bool sample_memory;
+        bool outermost;             /* Not nested in a phase of the same name */
+        clock::time_point start;
+        clock::time_point resumed;
+        long n_allocations_resumed;
+    };
+
+    std::vector<phase> v_phases;    /* In the order they first ran */
+    std::vector<running> v_stack;
+    clock::time_point start;
+
+    int phase_index(const char *phase_name);
+    void pause_top(clock::time_point now);
+    std::string gcc_report();
+};
+
+extern thread_local time_report *current_time_report;
+
+/* Counted by engmac's operator new */
+extern std::atomic<long> n_allocations;
+
+long peak_rss_kb();
+
+class phase_timer {
+public:
+    phase_timer(const char *phase_name, bool sample_memory = true)
+        : report(current_time_report)
+    {
+        if (report)
+            report->push(phase_name, sample_memory);
+    }
+    ~phase_timer()
+    {
+        if (report)
+            report->pop();
+    }
+    phase_timer(const phase_timer&) = delete;
+    phase_timer& operator=(const phase_timer&) = delete;
+
+private:
+    time_report *report;
+};